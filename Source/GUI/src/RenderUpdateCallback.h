@@ -5,8 +5,7 @@
 
 #include <Raytracer/Core/Renderer.h>
 #include <Raytracer/Core/Film.h>
-#include <Raytracer/Core/SpectrumRoutines.h>
-#include <Raytracer/Core/Color.h>
+#include <Raytracer/Core/ToneMapper.h>
 
 #include "RenderCanvas.h"
 
@@ -14,7 +13,7 @@ class RenderUpdateCallback: public DisplayUpdateCallback
   {
   public:
 
-    RenderUpdateCallback(RenderCanvas *ip_canvas): mp_canvas(ip_canvas)
+    RenderUpdateCallback(RenderCanvas *ip_canvas): mp_canvas(ip_canvas), m_tone_mapper(500.0, 256.0)
       {
       }
 
@@ -25,33 +24,18 @@ class RenderUpdateCallback: public DisplayUpdateCallback
 
       std::vector<unsigned char> data(width*height * 4);
 
-      for(int y=0;y<(int)height;++y)
-        for(int x=0;x<(int)width;++x)
-          {
-          Spectrum_d sp;
-          p_film->GetPixel(Point2D_i(x,y),sp);
-          sp *= 500;//250;
-
-          RGBColor_d color = global_sRGB_D65_ColorSystem.XYZ_To_RGB(SpectrumRoutines::SpectrumToXYZ(sp),true);
-          color.Clamp(0.0,256.0);
-          color[0]/=256.0;color[1]/=256.0;color[2]/=256.0;
-          color = global_sRGB_D65_ColorSystem.GammaEncode(color);
-          int r = std::min(255,(int)(color[0]*256.0));
-          int g = std::min(255,(int)(color[1]*256.0));
-          int b = std::min(255,(int)(color[2]*256.0));
-
-          unsigned int pixel_index = (unsigned int) ((y*width+x)*4);
-          data[pixel_index+0] = unsigned char(b);
-          data[pixel_index+1] = unsigned char(g);
-          data[pixel_index+2] = unsigned char(r);
-          data[pixel_index+3] = unsigned char (~0);
-          }
+      // The spectrum buffer is kept between the updates to avoid reallocating it.
+      p_film->GetPixels(Point2D_i(0,0), Point2D_i((int)width,(int)height), m_values);
+      m_tone_mapper.ToneMap(m_values, width, height, ToneMapper::PIXEL_FORMAT_BGRA, false, &data[0], width*4);
 
       mp_canvas->setImageData(width, height, std::move(data));
       }
 
   private:
     RenderCanvas *mp_canvas;
+
+    ToneMapper m_tone_mapper;
+    std::vector<float> m_values;
   };
 
 #endif // RENDER_UPDATE_CALLBACK_H
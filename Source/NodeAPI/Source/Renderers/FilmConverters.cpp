@@ -15,9 +15,7 @@
 #include "FilmConverters.h"
 
 #include <Math/Geometry.h>
-#include <Raytracer/Core/Spectrum.h>
-#include <Raytracer/Core/Color.h>
-#include <Raytracer/Core/SpectrumRoutines.h>
+#include <Raytracer/Core/ToneMapper.h>
 
 #include <FreeImage.h>
 
@@ -32,39 +30,16 @@ namespace NodeAPI
       const Film *p_film = ip_film.get();
       int height = (int)p_film->GetYResolution(), width = (int)p_film->GetXResolution();
 
-      double inv_256 = 1.0 / 256.0;
       FIBITMAP *dib = FreeImage_Allocate(width, height, 32, FI_RGBA_RED_MASK, FI_RGBA_GREEN_MASK, FI_RGBA_BLUE_MASK);
       if (dib)
         {
-        // Calculate the number of bytes per pixel (3 for 24-bit or 4 for 32-bit)
-        int bytespp = FreeImage_GetLine(dib) / FreeImage_GetWidth(dib);
-        for (int y = 0; y < height; y++)
-          {
-          BYTE *bits = FreeImage_GetScanLine(dib, y);
-          for (int x = 0; x < width; x++)
-            {
-            Spectrum_d sp;
-            p_film->GetPixel(Point2D_i(x, height - y - 1), sp);
-            sp *= 500;//250;
+        std::vector<float> values;
+        p_film->GetPixels(Point2D_i(0, 0), Point2D_i(width, height), values);
 
-            RGBColor_d color = global_sRGB_D65_ColorSystem.XYZ_To_RGB(SpectrumRoutines::SpectrumToXYZ(sp), true);
-            color.Clamp(0.0, 256.0);
-
-            color[0] *= inv_256; color[1] *= inv_256; color[2] *= inv_256;
-            color = global_sRGB_D65_ColorSystem.GammaEncode(color);
-            int r = std::min(255, (int)(color[0] * 256.0));
-            int g = std::min(255, (int)(color[1] * 256.0));
-            int b = std::min(255, (int)(color[2] * 256.0));
-
-            // Set pixel color to green with a transparency of 128
-            bits[FI_RGBA_RED] = BYTE(r);
-            bits[FI_RGBA_GREEN] = BYTE(g);
-            bits[FI_RGBA_BLUE] = BYTE(b);
-            bits[FI_RGBA_ALPHA] = 255;
-            // jump to next pixel
-            bits += bytespp;
-            }
-          }
+        // FreeImage stores the scanlines bottom-up so the rows are flipped. The order of the color components depends on the platform's endianness.
+        ToneMapper::PixelFormat format = FI_RGBA_RED == 0 ? ToneMapper::PIXEL_FORMAT_RGBA : ToneMapper::PIXEL_FORMAT_BGRA;
+        ToneMapper tone_mapper(500.0, 256.0);
+        tone_mapper.ToneMap(values, width, height, format, true, FreeImage_GetBits(dib), FreeImage_GetPitch(dib));
 
         // open a memory stream
         FIMEMORY *hmem = FreeImage_OpenMemory();
@@ -0,0 +1,165 @@
+/*
+* Copyright (C) 2014 by Volodymyr Kachurovskyi <Volodymyr.Kachurovskyi@gmail.com>
+*
+* This file is part of Skwarka.
+*
+* Skwarka is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+*
+* Skwarka is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License along with Skwarka.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "BenchmarkRunner.h"
+#include <tbb/tick_count.h>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <iomanip>
+
+BenchmarkRunner::BenchmarkRunner(size_t i_warmup_repetitions, size_t i_repetitions, const std::string &i_filter):
+m_warmup_repetitions(i_warmup_repetitions), m_repetitions(std::max(i_repetitions, (size_t)1)), m_filter(i_filter)
+  {
+  ASSERT(i_repetitions > 0);
+  }
+
+void BenchmarkRunner::Add(const std::string &i_name, const std::string &i_unit, Workload i_workload, Setup i_setup, Setup i_teardown)
+  {
+  ASSERT(i_workload);
+
+  Entry entry;
+  entry.m_name = i_name;
+  entry.m_unit = i_unit;
+  entry.m_workload = i_workload;
+  entry.m_setup = i_setup;
+  entry.m_teardown = i_teardown;
+  m_entries.push_back(entry);
+  }
+
+void BenchmarkRunner::Run(std::ostream &io_progress)
+  {
+  m_results.clear();
+
+  for(size_t i=0;i<m_entries.size();++i)
+    {
+    const Entry &entry = m_entries[i];
+    if (m_filter.empty()==false && entry.m_name.find(m_filter)==std::string::npos)
+      continue;
+
+    if (entry.m_setup)
+      entry.m_setup();
+
+    for(size_t j=0;j<m_warmup_repetitions;++j)
+      entry.m_workload();
+
+    BenchmarkResult result;
+    result.m_name = entry.m_name;
+    result.m_unit = entry.m_unit;
+    result.m_items_per_repetition = 0;
+    for(size_t j=0;j<m_repetitions;++j)
+      {
+      tbb::tick_count start = tbb::tick_count::now();
+      size_t items = entry.m_workload();
+      double seconds = (tbb::tick_count::now()-start).seconds();
+
+      result.m_items_per_repetition = items;
+      result.m_throughputs.push_back(seconds > 0.0 ? items/seconds : 0.0);
+      }
+
+    if (entry.m_teardown)
+      entry.m_teardown();
+
+    _ComputeStatistics(result);
+    m_results.push_back(result);
+
+    io_progress << std::left << std::setw(48) << result.m_name << std::right << std::setw(16) << std::fixed << std::setprecision(1) << result.m_median
+      << " " << result.m_unit << "  (min " << result.m_min << ", max " << result.m_max << ", stddev " << result.m_stddev << ")" << std::endl;
+    }
+  }
+
+const std::vector<BenchmarkResult> &BenchmarkRunner::GetResults() const
+  {
+  return m_results;
+  }
+
+void BenchmarkRunner::_ComputeStatistics(BenchmarkResult &io_result)
+  {
+  ASSERT(io_result.m_throughputs.empty()==false);
+
+  std::vector<double> sorted(io_result.m_throughputs);
+  std::sort(sorted.begin(), sorted.end());
+
+  size_t n = sorted.size();
+  io_result.m_median = (n&1) ? sorted[n/2] : 0.5*(sorted[n/2-1]+sorted[n/2]);
+  io_result.m_min = sorted.front();
+  io_result.m_max = sorted.back();
+
+  double sum = 0.0, sum_sqr = 0.0;
+  for(size_t i=0;i<n;++i)
+    {
+    sum += sorted[i];
+    sum_sqr += sorted[i]*sorted[i];
+    }
+
+  io_result.m_mean = sum/n;
+  io_result.m_stddev = n>1 ? sqrt(std::max(0.0, (sum_sqr-sum*io_result.m_mean)/(n-1))) : 0.0;
+  }
+
+std::string BenchmarkRunner::_EscapeJSON(const std::string &i_string)
+  {
+  std::string ret;
+  for(size_t i=0;i<i_string.size();++i)
+    {
+    char c = i_string[i];
+    if (c=='"' || c=='\\')
+      {
+      ret += '\\';
+      ret += c;
+      }
+    else if ((unsigned char)c < 0x20)
+      {
+      char buffer[8];
+      sprintf(buffer, "\\u%04x", (unsigned int)c);
+      ret += buffer;
+      }
+    else
+      ret += c;
+    }
+
+  return ret;
+  }
+
+void BenchmarkRunner::WriteJSON(std::ostream &io_stream, const std::vector<std::pair<std::string,std::string>> &i_context) const
+  {
+  io_stream << std::setprecision(17);
+
+  io_stream << "{\n  \"context\": {";
+  for(size_t i=0;i<i_context.size();++i)
+    io_stream << (i>0 ? "," : "") << "\n    \"" << _EscapeJSON(i_context[i].first) << "\": \"" << _EscapeJSON(i_context[i].second) << "\"";
+  io_stream << "\n  },\n";
+
+  io_stream << "  \"warmup_repetitions\": " << m_warmup_repetitions << ",\n";
+  io_stream << "  \"repetitions\": " << m_repetitions << ",\n";
+
+  io_stream << "  \"benchmarks\": [";
+  for(size_t i=0;i<m_results.size();++i)
+    {
+    const BenchmarkResult &result = m_results[i];
+    io_stream << (i>0 ? "," : "") << "\n    {\n";
+    io_stream << "      \"name\": \"" << _EscapeJSON(result.m_name) << "\",\n";
+    io_stream << "      \"unit\": \"" << _EscapeJSON(result.m_unit) << "\",\n";
+    io_stream << "      \"items_per_repetition\": " << result.m_items_per_repetition << ",\n";
+    io_stream << "      \"median\": " << result.m_median << ",\n";
+    io_stream << "      \"mean\": " << result.m_mean << ",\n";
+    io_stream << "      \"min\": " << result.m_min << ",\n";
+    io_stream << "      \"max\": " << result.m_max << ",\n";
+    io_stream << "      \"stddev\": " << result.m_stddev << ",\n";
+    io_stream << "      \"throughputs\": [";
+    for(size_t j=0;j<result.m_throughputs.size();++j)
+      io_stream << (j>0 ? ", " : "") << result.m_throughputs[j];
+    io_stream << "]\n    }";
+    }
+  io_stream << "\n  ]\n}\n";
+  }
@@ -0,0 +1,125 @@
+/*
+* Copyright (C) 2014 by Volodymyr Kachurovskyi <Volodymyr.Kachurovskyi@gmail.com>
+*
+* This file is part of Skwarka.
+*
+* Skwarka is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+*
+* Skwarka is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License along with Skwarka.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef BENCHMARK_RUNNER_H
+#define BENCHMARK_RUNNER_H
+
+#include <Common/Common.h>
+#include <functional>
+#include <string>
+#include <vector>
+#include <ostream>
+
+/**
+* Holds the measured statistics of a single benchmark.
+* The throughput values are measured in processed items (rays, photons, lookups etc.) per second.
+*/
+struct BenchmarkResult
+  {
+  // Unique name of the benchmark, e.g. "accelerator.intersect.triangle_soup".
+  std::string m_name;
+
+  // Name of the items the throughput is measured in, e.g. "rays/s".
+  std::string m_unit;
+
+  // Number of items processed by a single repetition.
+  size_t m_items_per_repetition;
+
+  // Throughput of each timed repetition (items per second) in the order the repetitions were run.
+  std::vector<double> m_throughputs;
+
+  double m_median, m_mean, m_min, m_max, m_stddev;
+  };
+
+/**
+* Runs the registered benchmarks and reports their throughput.
+* Each benchmark is a callable object that performs one repetition of the measured workload and returns the number of processed items.
+* The runner executes a number of untimed warm-up repetitions first and then a number of timed repetitions.
+* The median of the timed repetitions is the reported value since it is stable with respect to occasional outliers caused by the OS scheduler.
+*/
+class BenchmarkRunner
+  {
+  public:
+    /**
+    * Workload of a single repetition. Returns the number of items processed.
+    */
+    typedef std::function<size_t()> Workload;
+
+    /**
+    * Workload setup that is called once before the repetitions of the benchmark. May be empty.
+    * The setup is not timed and can be used to allocate data which is too large to be kept alive for all the benchmarks at once.
+    */
+    typedef std::function<void()> Setup;
+
+  public:
+    /**
+    * Creates BenchmarkRunner instance.
+    * @param i_warmup_repetitions Number of untimed repetitions run before the timed ones.
+    * @param i_repetitions Number of timed repetitions. Should be greater than zero.
+    * @param i_filter Only benchmarks whose names contain this string are run. All benchmarks are run if the string is empty.
+    */
+    BenchmarkRunner(size_t i_warmup_repetitions, size_t i_repetitions, const std::string &i_filter);
+
+    /**
+    * Registers a benchmark.
+    * @param i_name Unique benchmark name.
+    * @param i_unit Throughput unit, e.g. "rays/s".
+    * @param i_workload Workload of a single repetition.
+    * @param i_setup Optional setup called once before the repetitions and a matching teardown (i_teardown) called after.
+    */
+    void Add(const std::string &i_name, const std::string &i_unit, Workload i_workload, Setup i_setup = Setup(), Setup i_teardown = Setup());
+
+    /**
+    * Runs all registered benchmarks matching the filter in the order they were registered.
+    * A one-line summary for each benchmark is written to the specified stream as soon as it completes.
+    */
+    void Run(std::ostream &io_progress);
+
+    /**
+    * Returns the results of the benchmarks that have been run.
+    */
+    const std::vector<BenchmarkResult> &GetResults() const;
+
+    /**
+    * Writes the results to the specified stream in JSON format.
+    * @param io_stream Output stream.
+    * @param i_context Key-value pairs that are written to the "context" object of the JSON document (e.g. build configuration, threads number).
+    */
+    void WriteJSON(std::ostream &io_stream, const std::vector<std::pair<std::string,std::string>> &i_context) const;
+
+  private:
+    // Not implemented, not a value type.
+    BenchmarkRunner(const BenchmarkRunner&);
+    BenchmarkRunner &operator=(const BenchmarkRunner&);
+
+    struct Entry
+      {
+      std::string m_name, m_unit;
+      Workload m_workload;
+      Setup m_setup, m_teardown;
+      };
+
+    static void _ComputeStatistics(BenchmarkResult &io_result);
+
+    static std::string _EscapeJSON(const std::string &i_string);
+
+  private:
+    size_t m_warmup_repetitions, m_repetitions;
+    std::string m_filter;
+
+    std::vector<Entry> m_entries;
+    std::vector<BenchmarkResult> m_results;
+  };
+
+#endif // BENCHMARK_RUNNER_H
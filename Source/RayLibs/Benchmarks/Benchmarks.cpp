@@ -0,0 +1,468 @@
+/*
+* Copyright (C) 2014 by Volodymyr Kachurovskyi <Volodymyr.Kachurovskyi@gmail.com>
+*
+* This file is part of Skwarka.
+*
+* Skwarka is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+*
+* Skwarka is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License along with Skwarka.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/**
+* Headless throughput benchmarks for the ray tracing core.
+* The benchmarks run on canonical procedural scenes (see ProceduralScenes namespace) and do not depend on any external data files,
+* so the results of different builds are directly comparable.
+*
+* Usage: Benchmarks [--repetitions N] [--warmup N] [--threads N] [--filter SUBSTRING] [--json FILE] [--quick]
+*/
+
+#include "BenchmarkRunner.h"
+#include "ProceduralScenes.h"
+#include <Common/Common.h>
+#include <Common/MemoryPool.h>
+#include <Math/Geometry.h>
+#include <Math/RandomGenerator.h>
+#include <Raytracer/Core/CoreCommon.h>
+#include <Raytracer/Core/TriangleAccelerator.h>
+#include <Raytracer/Core/KDTree.h>
+#include <Raytracer/Core/MIPMap.h>
+#include <Raytracer/Core/SpectrumCoef.h>
+#include <Raytracer/Cameras/PerspectiveCamera.h>
+#include <Raytracer/Films/ImageFilm.h>
+#include <Raytracer/FilmFilters/BoxFilter.h>
+#include <Raytracer/Samplers/StratifiedSampler.h>
+#include <Raytracer/Samplers/LDSampler.h>
+#include <Raytracer/Samplers/RandomSampler.h>
+#include <Raytracer/LTEIntegrators/DirectLightingLTEIntegrator.h>
+#include <Raytracer/LTEIntegrators/PhotonLTEIntegrator.h>
+#include <Raytracer/Renderers/SamplerBasedRenderer.h>
+#include <tbb/tbb.h>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <cstdlib>
+
+namespace
+  {
+
+  /**
+  * Command line options of the benchmarks executable.
+  */
+  struct Options
+    {
+    size_t m_repetitions, m_warmup_repetitions;
+
+    // Number of worker threads. Zero means that TBB chooses the number automatically.
+    size_t m_threads;
+
+    std::string m_filter, m_json_filename;
+
+    // Reduces the workloads sizes. Intended for smoke-testing the executable, the results are not comparable with the full-sized runs.
+    bool m_quick;
+    };
+
+  bool _ParseOptions(int i_argc, char *i_argv[], Options &o_options)
+    {
+    o_options.m_repetitions = 5;
+    o_options.m_warmup_repetitions = 1;
+    o_options.m_threads = 0;
+    o_options.m_quick = false;
+
+    for(int i=1;i<i_argc;++i)
+      {
+      std::string arg(i_argv[i]);
+      bool has_value = i+1<i_argc;
+
+      if (arg=="--repetitions" && has_value)
+        o_options.m_repetitions = std::max(atoi(i_argv[++i]), 1);
+      else if (arg=="--warmup" && has_value)
+        o_options.m_warmup_repetitions = std::max(atoi(i_argv[++i]), 0);
+      else if (arg=="--threads" && has_value)
+        o_options.m_threads = std::max(atoi(i_argv[++i]), 0);
+      else if (arg=="--filter" && has_value)
+        o_options.m_filter = i_argv[++i];
+      else if (arg=="--json" && has_value)
+        o_options.m_json_filename = i_argv[++i];
+      else if (arg=="--quick")
+        o_options.m_quick = true;
+      else
+        return false;
+      }
+
+    return true;
+    }
+
+  void _PrintUsage()
+    {
+    std::cout << "Usage: Benchmarks [options]" << std::endl;
+    std::cout << "  --repetitions N     number of timed repetitions of each benchmark (default 5)" << std::endl;
+    std::cout << "  --warmup N          number of untimed warm-up repetitions (default 1)" << std::endl;
+    std::cout << "  --threads N         number of worker threads (default: number of hardware threads)" << std::endl;
+    std::cout << "  --filter SUBSTRING  run only the benchmarks whose names contain the substring" << std::endl;
+    std::cout << "  --json FILE         write the results to the file in JSON format" << std::endl;
+    std::cout << "  --quick             use reduced workloads (for smoke-testing only)" << std::endl;
+    }
+
+  std::string _ToString(size_t i_value)
+    {
+    std::ostringstream stream;
+    stream << i_value;
+    return stream.str();
+    }
+
+  /**
+  * Holds the data shared by the benchmarks of one procedural scene.
+  * The data is created lazily by the setup callbacks so that only the scenes required by the filtered benchmarks are built.
+  */
+  struct SceneData
+    {
+    std::vector<intrusive_ptr<const Primitive>> m_primitives;
+    intrusive_ptr<const Scene> mp_scene;
+    std::vector<Ray> m_rays;
+    };
+
+  /**
+  * Registers build, intersection and occlusion benchmarks for the specified build mode of the accelerator.
+  * The primitives are released after the occlusion benchmark if i_release_primitives is true.
+  */
+  void _AddAcceleratorBuildModeBenchmarks(BenchmarkRunner &io_runner, const std::string &i_name_suffix, shared_ptr<SceneData> ip_data,
+    BenchmarkRunner::Setup i_create_primitives, TriangleAccelerator::BuildMode i_build_mode, size_t i_rays_num, bool i_release_primitives)
+    {
+    BenchmarkRunner::Setup create_scene = [=]
+      {
+      i_create_primitives();
+      if (ip_data->mp_scene == NULL)
+        {
+        ip_data->mp_scene = ProceduralScenes::CreateScene(ip_data->m_primitives, i_build_mode);
+        ip_data->m_rays = ProceduralScenes::GenerateRays(ip_data->mp_scene->GetWorldBounds(), i_rays_num, 1);
+        }
+      };
+
+    io_runner.Add("accelerator.build." + i_name_suffix, "builds/s", [=]
+      {
+      TriangleAccelerator accelerator(ip_data->m_primitives, i_build_mode);
+      return (size_t)1;
+      }, i_create_primitives);
+
+    io_runner.Add("accelerator.intersect." + i_name_suffix, "rays/s", [=]
+      {
+      const Scene *p_scene = ip_data->mp_scene.get();
+      const std::vector<Ray> &rays = ip_data->m_rays;
+      tbb::parallel_for(tbb::blocked_range<size_t>(0, rays.size()), [&](const tbb::blocked_range<size_t> &i_range)
+        {
+        Intersection intersection;
+        for(size_t i=i_range.begin();i!=i_range.end();++i)
+          p_scene->Intersect(RayDifferential(rays[i]), intersection);
+        });
+      return rays.size();
+      }, create_scene);
+
+    io_runner.Add("accelerator.occlusion." + i_name_suffix, "rays/s", [=]
+      {
+      const Scene *p_scene = ip_data->mp_scene.get();
+      const std::vector<Ray> &rays = ip_data->m_rays;
+      tbb::parallel_for(tbb::blocked_range<size_t>(0, rays.size()), [&](const tbb::blocked_range<size_t> &i_range)
+        {
+        for(size_t i=i_range.begin();i!=i_range.end();++i)
+          p_scene->IntersectTest(rays[i]);
+        });
+      return rays.size();
+      }, create_scene, [=]
+      {
+      // The scene is not needed by the rest of the benchmarks, the primitives are still needed by the benchmarks of the next build mode.
+      ip_data->mp_scene.reset();
+      std::vector<Ray>().swap(ip_data->m_rays);
+      if (i_release_primitives)
+        ip_data->m_primitives.clear();
+      });
+    }
+
+  /**
+  * Registers build, intersection and occlusion benchmarks for the scene created by the specified callback.
+  * The benchmarks are registered for each build mode of the accelerator so that the build times and the traversal speeds can be compared side by side.
+  */
+  void _AddAcceleratorBenchmarks(BenchmarkRunner &io_runner, const std::string &i_scene_name,
+    std::function<std::vector<intrusive_ptr<const Primitive>>()> i_create_primitives, size_t i_rays_num)
+    {
+    shared_ptr<SceneData> p_data(new SceneData);
+
+    BenchmarkRunner::Setup create_primitives = [=]
+      {
+      if (p_data->m_primitives.empty())
+        p_data->m_primitives = i_create_primitives();
+      };
+
+    const TriangleAccelerator::BuildMode build_modes[] = {
+      TriangleAccelerator::BUILD_MODE_SAH, TriangleAccelerator::BUILD_MODE_MORTON, TriangleAccelerator::BUILD_MODE_MORTON_OPTIMIZED};
+    const std::string build_mode_prefixes[] = {"", "morton.", "morton_optimized."};
+    const size_t build_modes_num = sizeof(build_modes)/sizeof(build_modes[0]);
+
+    for(size_t mode_index=0;mode_index<build_modes_num;++mode_index)
+      _AddAcceleratorBuildModeBenchmarks(io_runner, build_mode_prefixes[mode_index] + i_scene_name, p_data, create_primitives, build_modes[mode_index], i_rays_num,
+        mode_index+1 == build_modes_num);
+    }
+
+  void _AddKDTreeBenchmarks(BenchmarkRunner &io_runner, size_t i_points_num, size_t i_lookups_num)
+    {
+    const size_t LOOKUP_POINTS = 64;
+    shared_ptr<std::vector<Point3D_f>> p_points(new std::vector<Point3D_f>);
+
+    BenchmarkRunner::Setup create_points = [=]
+      {
+      RandomGenerator<double> rng(2);
+      p_points->resize(i_points_num);
+      for(size_t i=0;i<i_points_num;++i)
+        (*p_points)[i] = Point3D_f((float)rng(1.0), (float)rng(1.0), (float)rng(1.0));
+      };
+
+    io_runner.Add("kdtree.build", "builds/s", [=]
+      {
+      KDTree<Point3D_f> tree(*p_points);
+      return (size_t)1;
+      }, create_points);
+
+    shared_ptr<shared_ptr<KDTree<Point3D_f>>> pp_tree(new shared_ptr<KDTree<Point3D_f>>);
+    io_runner.Add("kdtree.lookup", "lookups/s", [=]
+      {
+      const KDTree<Point3D_f> &tree = **pp_tree;
+      tbb::parallel_for(tbb::blocked_range<size_t>(0, i_lookups_num), [&](const tbb::blocked_range<size_t> &i_range)
+        {
+        std::vector<KDTree<Point3D_f>::NearestPoint> nearest_points(LOOKUP_POINTS);
+        RandomGenerator<double> rng(i_range.begin());
+        for(size_t i=i_range.begin();i!=i_range.end();++i)
+          tree.GetNearestPoints(Point3D_d(rng(1.0),rng(1.0),rng(1.0)), LOOKUP_POINTS, &nearest_points[0]);
+        });
+      return i_lookups_num;
+      }, [=]
+      {
+      create_points();
+      pp_tree->reset(new KDTree<Point3D_f>(*p_points));
+      }, [=]
+      {
+      pp_tree->reset();
+      std::vector<Point3D_f>().swap(*p_points);
+      });
+    }
+
+  void _AddMIPMapBenchmarks(BenchmarkRunner &io_runner, size_t i_resolution, size_t i_lookups_num)
+    {
+    shared_ptr<std::vector<std::vector<SpectrumCoef_f>>> p_image(new std::vector<std::vector<SpectrumCoef_f>>);
+    shared_ptr<intrusive_ptr<const MIPMap<SpectrumCoef_f>>> pp_mip_map(new intrusive_ptr<const MIPMap<SpectrumCoef_f>>);
+
+    BenchmarkRunner::Setup create_image = [=]
+      {
+      // Procedural checkerboard with a smooth gradient so that the filtered values differ on all levels.
+      p_image->assign(i_resolution, std::vector<SpectrumCoef_f>(i_resolution));
+      for(size_t y=0;y<i_resolution;++y)
+        for(size_t x=0;x<i_resolution;++x)
+          {
+          float checker = ((x/8+y/8)&1) ? 1.f : 0.2f;
+          (*p_image)[y][x] = SpectrumCoef_f(checker, checker*x/i_resolution, checker*y/i_resolution);
+          }
+      };
+
+    BenchmarkRunner::Setup create_mip_map = [=]
+      {
+      create_image();
+      pp_mip_map->reset(new MIPMap<SpectrumCoef_f>(*p_image, true, 8.0));
+      };
+
+    BenchmarkRunner::Setup release = [=]
+      {
+      pp_mip_map->reset();
+      std::vector<std::vector<SpectrumCoef_f>>().swap(*p_image);
+      };
+
+    io_runner.Add("mipmap.build", "builds/s", [=]
+      {
+      MIPMap<SpectrumCoef_f> mip_map(*p_image, true, 8.0);
+      return (size_t)1;
+      }, create_image, release);
+
+    io_runner.Add("mipmap.lookup.trilinear", "lookups/s", [=]
+      {
+      const MIPMap<SpectrumCoef_f> &mip_map = **pp_mip_map;
+      tbb::parallel_for(tbb::blocked_range<size_t>(0, i_lookups_num), [&](const tbb::blocked_range<size_t> &i_range)
+        {
+        RandomGenerator<double> rng(i_range.begin());
+        for(size_t i=i_range.begin();i!=i_range.end();++i)
+          mip_map.Evaluate(Point2D_d(rng(1.0),rng(1.0)), rng(0.05));
+        });
+      return i_lookups_num;
+      }, create_mip_map, release);
+
+    io_runner.Add("mipmap.lookup.ewa", "lookups/s", [=]
+      {
+      const MIPMap<SpectrumCoef_f> &mip_map = **pp_mip_map;
+      tbb::parallel_for(tbb::blocked_range<size_t>(0, i_lookups_num), [&](const tbb::blocked_range<size_t> &i_range)
+        {
+        RandomGenerator<double> rng(i_range.begin());
+        for(size_t i=i_range.begin();i!=i_range.end();++i)
+          {
+          // Anisotropic footprints with the major axis up to 8 times longer than the minor one.
+          double minor = rng(0.0005, 0.005), major = minor*rng(1.0, 8.0), angle = rng(2.0*M_PI);
+          Vector2D_d dxy_1(major*cos(angle), major*sin(angle)), dxy_2(-minor*sin(angle), minor*cos(angle));
+          mip_map.Evaluate(Point2D_d(rng(1.0),rng(1.0)), dxy_1, dxy_2);
+          }
+        });
+      return i_lookups_num;
+      }, create_mip_map, release);
+    }
+
+  /**
+  * Registers a benchmark that generates all samples of the specified sampler. The benchmark runs in a single thread.
+  */
+  void _AddSamplerBenchmark(BenchmarkRunner &io_runner, const std::string &i_name, intrusive_ptr<Sampler> ip_sampler)
+    {
+    const size_t PIXELS_PER_CHUNK = 16;
+
+    io_runner.Add("sampler." + i_name, "samples/s", [=]
+      {
+      ip_sampler->Reset();
+
+      // Request the sequences typical for a direct lighting integrator with a single light source.
+      ip_sampler->ClearSamplesSequences();
+      ip_sampler->AddSamplesSequence1D(4);
+      ip_sampler->AddSamplesSequence2D(4);
+      ip_sampler->AddSamplesSequence2D(4);
+
+      RandomGenerator<double> rng(3);
+      intrusive_ptr<Sample> p_sample = ip_sampler->CreateSample();
+      size_t samples_num = 0;
+      while(intrusive_ptr<SubSampler> p_sub_sampler = ip_sampler->GetNextSubSampler(PIXELS_PER_CHUNK, &rng))
+        while(p_sub_sampler->GetNextSample(p_sample.get()))
+          ++samples_num;
+
+      return samples_num;
+      });
+    }
+
+  void _AddPhotonsBenchmark(BenchmarkRunner &io_runner, size_t i_detail, size_t i_photons_num)
+    {
+    shared_ptr<intrusive_ptr<const Scene>> pp_scene(new intrusive_ptr<const Scene>);
+
+    io_runner.Add("photons.shoot.shapes", "photons/s", [=]
+      {
+      PhotonLTEIntegratorParams params;
+      params.m_direct_light_samples_num = 1;
+      params.m_gather_samples_num = 16;
+      params.m_caustic_lookup_photons_num = 100;
+      params.m_max_caustic_lookup_dist = 0.01;
+      params.m_media_step_size = 0.01;
+      params.m_max_specular_depth = 6;
+
+      intrusive_ptr<PhotonLTEIntegrator> p_integrator( new PhotonLTEIntegrator(*pp_scene, params) );
+      p_integrator->ShootPhotons(i_photons_num);
+      return i_photons_num;
+      }, [=]
+      {
+      *pp_scene = ProceduralScenes::CreateScene(ProceduralScenes::CreateShapes(i_detail));
+      }, [=]
+      {
+      pp_scene->reset();
+      });
+    }
+
+  void _AddRenderBenchmark(BenchmarkRunner &io_runner, size_t i_detail, size_t i_x_resolution, size_t i_y_resolution, size_t i_samples_per_pixel_sqrt)
+    {
+    shared_ptr<intrusive_ptr<const Scene>> pp_scene(new intrusive_ptr<const Scene>);
+
+    io_runner.Add("render.direct_lighting.shapes", "samples/s", [=]
+      {
+      DirectLightingLTEIntegratorParams params;
+      params.m_direct_light_samples_num = 1;
+      params.m_max_specular_depth = 6;
+      params.m_media_step_size = 0.01;
+
+      intrusive_ptr<LTEIntegrator> p_integrator( new DirectLightingLTEIntegrator(*pp_scene, params) );
+      intrusive_ptr<Sampler> p_sampler( new StratifiedSampler(Point2D_i(0,0), Point2D_i((int)i_x_resolution,(int)i_y_resolution),
+        i_samples_per_pixel_sqrt, i_samples_per_pixel_sqrt) );
+
+      intrusive_ptr<Film> p_film( new ImageFilm(i_x_resolution, i_y_resolution, new BoxFilter(0.5,0.5)) );
+      Transform camera2world = MakeLookAt(Point3D_d(0.0,-8.0,3.0), Vector3D_d(0.0,1.0,-0.3), Vector3D_d(0,0,1)).Inverted();
+      intrusive_ptr<const Camera> p_camera( new PerspectiveCamera(camera2world, p_film, 0.0, 1.0, 1.0) );
+
+      intrusive_ptr<SamplerBasedRenderer> p_renderer( new SamplerBasedRenderer(p_integrator, p_sampler) );
+      p_renderer->Render(p_camera);
+      return p_sampler->GetTotalSamplesNum();
+      }, [=]
+      {
+      *pp_scene = ProceduralScenes::CreateScene(ProceduralScenes::CreateShapes(i_detail));
+      }, [=]
+      {
+      pp_scene->reset();
+      });
+    }
+
+  }
+
+int main(int i_argc, char *i_argv[])
+  {
+  Options options;
+  if (_ParseOptions(i_argc, i_argv, options) == false)
+    {
+    _PrintUsage();
+    return 1;
+    }
+
+  tbb::task_scheduler_init scheduler_init(options.m_threads > 0 ? (int)options.m_threads : tbb::task_scheduler_init::automatic);
+
+  // Workload sizes are chosen so that a single repetition of each benchmark takes roughly from 0.1 to 1 second on a modern 4-core CPU.
+  const size_t shapes_detail = options.m_quick ? 4 : 7;
+  const size_t grid_size = options.m_quick ? 3 : 8, grid_detail = options.m_quick ? 3 : 5;
+  const size_t soup_triangles = options.m_quick ? 10000 : 500000;
+  const size_t rays_num = options.m_quick ? 10000 : 1000000;
+  const size_t kdtree_points = options.m_quick ? 10000 : 500000, kdtree_lookups = options.m_quick ? 10000 : 200000;
+  const size_t mipmap_resolution = options.m_quick ? 256 : 2048, mipmap_lookups = options.m_quick ? 10000 : 1000000;
+  const size_t sampler_resolution = options.m_quick ? 64 : 512;
+  const size_t photons_num = options.m_quick ? 10000 : 500000;
+  const size_t render_x_resolution = options.m_quick ? 64 : 320, render_y_resolution = options.m_quick ? 48 : 240;
+
+  BenchmarkRunner runner(options.m_warmup_repetitions, options.m_repetitions, options.m_filter);
+
+  _AddAcceleratorBenchmarks(runner, "shapes", [=]{ return ProceduralScenes::CreateShapes(shapes_detail); }, rays_num);
+  _AddAcceleratorBenchmarks(runner, "instanced_grid", [=]{ return ProceduralScenes::CreateInstancedGrid(grid_size, grid_detail); }, rays_num);
+  _AddAcceleratorBenchmarks(runner, "triangle_soup", [=]{ return ProceduralScenes::CreateTriangleSoup(soup_triangles, 1); }, rays_num);
+
+  _AddKDTreeBenchmarks(runner, kdtree_points, kdtree_lookups);
+  _AddMIPMapBenchmarks(runner, mipmap_resolution, mipmap_lookups);
+
+  Point2D_i sampler_end((int)sampler_resolution, (int)sampler_resolution);
+  _AddSamplerBenchmark(runner, "stratified", new StratifiedSampler(Point2D_i(0,0), sampler_end, 4, 4));
+  _AddSamplerBenchmark(runner, "ld", new LDSampler(Point2D_i(0,0), sampler_end, 16));
+  _AddSamplerBenchmark(runner, "random", new RandomSampler(Point2D_i(0,0), sampler_end, 16));
+
+  _AddPhotonsBenchmark(runner, shapes_detail, photons_num);
+  _AddRenderBenchmark(runner, shapes_detail, render_x_resolution, render_y_resolution, 2);
+
+  runner.Run(std::cout);
+
+  if (options.m_json_filename.empty() == false)
+    {
+    std::vector<std::pair<std::string,std::string>> context;
+    context.push_back(std::make_pair("threads", _ToString(options.m_threads > 0 ? options.m_threads : (size_t)tbb::task_scheduler_init::default_num_threads())));
+    context.push_back(std::make_pair("quick", options.m_quick ? "true" : "false"));
+#ifdef NDEBUG
+    context.push_back(std::make_pair("configuration", "release"));
+#else
+    context.push_back(std::make_pair("configuration", "debug"));
+#endif
+
+    std::ofstream stream(options.m_json_filename.c_str());
+    if (stream.good() == false)
+      {
+      std::cerr << "Can not open " << options.m_json_filename << " for writing." << std::endl;
+      return 2;
+      }
+
+    runner.WriteJSON(stream, context);
+    }
+
+  return 0;
+  }
@@ -0,0 +1,173 @@
+/*
+* Copyright (C) 2014 by Volodymyr Kachurovskyi <Volodymyr.Kachurovskyi@gmail.com>
+*
+* This file is part of Skwarka.
+*
+* Skwarka is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+*
+* Skwarka is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License along with Skwarka.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "ProceduralScenes.h"
+#include <Math/Transform.h>
+#include <Math/RandomGenerator.h>
+#include <Math/SamplingRoutines.h>
+#include <Raytracer/Core/TriangleMesh.h>
+#include <Raytracer/Materials/MatteMaterial.h>
+#include <Raytracer/Textures/ConstantTexture.h>
+#include <Raytracer/LightSources/PointLight.h>
+#include <Shapes/Sphere.h>
+#include <Shapes/Cylinder.h>
+#include <Shapes/Disk.h>
+
+namespace
+  {
+
+  intrusive_ptr<const Material> _CreateMatteMaterial(const SpectrumCoef_d &i_reflectance)
+    {
+    intrusive_ptr<const Texture<SpectrumCoef_d>> p_reflectance( new ConstantTexture<SpectrumCoef_d>(i_reflectance) );
+    intrusive_ptr<const Texture<double>> p_sigma( new ConstantTexture<double>(0.0) );
+    return intrusive_ptr<const Material>( new MatteMaterial(p_reflectance, p_sigma) );
+    }
+
+  intrusive_ptr<const Primitive> _CreatePrimitive(intrusive_ptr<const TriangleMesh> ip_mesh, const Transform &i_mesh_to_world, const SpectrumCoef_d &i_reflectance)
+    {
+    return intrusive_ptr<const Primitive>( new Primitive(ip_mesh, i_mesh_to_world, _CreateMatteMaterial(i_reflectance), NULL) );
+    }
+
+  }
+
+namespace ProceduralScenes
+  {
+
+  std::vector<intrusive_ptr<const Primitive>> CreateShapes(size_t i_detail)
+    {
+    size_t subdivisions = (size_t)1 << (i_detail+5);
+    std::vector<intrusive_ptr<const Primitive>> primitives;
+
+    Sphere sphere;
+    sphere.SetSubdivisions(i_detail);
+    sphere.SetTransformation(MakeTranslation(Vector3D_d(-1.5,0.0,1.0)));
+    primitives.push_back(_CreatePrimitive(sphere.BuildMesh(), Transform(), SpectrumCoef_d(0.7,0.6,0.5)));
+
+    Cylinder cylinder;
+    cylinder.SetSubdivisions(subdivisions);
+    cylinder.SetTransformation(MakeTranslation(Vector3D_d(1.5,0.0,0.0)) * MakeScale(1.0,1.0,2.0));
+    primitives.push_back(_CreatePrimitive(cylinder.BuildMesh(), Transform(), SpectrumCoef_d(0.5,0.6,0.7)));
+
+    Disk cap;
+    cap.SetSubdivisions(subdivisions);
+    cap.SetInnerRadius(0.5);
+    cap.SetTransformation(MakeTranslation(Vector3D_d(1.5,0.0,2.0)));
+    primitives.push_back(_CreatePrimitive(cap.BuildMesh(), Transform(), SpectrumCoef_d(0.6,0.6,0.6)));
+
+    Disk ground;
+    ground.SetSubdivisions(subdivisions);
+    ground.SetTransformation(MakeScale(10.0));
+    primitives.push_back(_CreatePrimitive(ground.BuildMesh(), Transform(), SpectrumCoef_d(0.8,0.8,0.8)));
+
+    return primitives;
+    }
+
+  std::vector<intrusive_ptr<const Primitive>> CreateInstancedGrid(size_t i_grid_size, size_t i_detail)
+    {
+    Sphere sphere;
+    sphere.SetSubdivisions(i_detail);
+    intrusive_ptr<const TriangleMesh> p_mesh = sphere.BuildMesh();
+    intrusive_ptr<const Material> p_material = _CreateMatteMaterial(SpectrumCoef_d(0.7,0.7,0.7));
+
+    std::vector<intrusive_ptr<const Primitive>> primitives;
+    for(size_t x=0;x<i_grid_size;++x)
+      for(size_t y=0;y<i_grid_size;++y)
+        for(size_t z=0;z<i_grid_size;++z)
+          {
+          // Slightly rotate each instance so that the instances' bounding boxes are not all axis-aligned copies of each other.
+          Transform mesh_to_world = MakeTranslation(Vector3D_d(3.0*x,3.0*y,3.0*z)) * MakeRotationZ(0.1*(x+y+z));
+          primitives.push_back(intrusive_ptr<const Primitive>( new Primitive(p_mesh, mesh_to_world, p_material, NULL) ));
+          }
+
+    return primitives;
+    }
+
+  std::vector<intrusive_ptr<const Primitive>> CreateTriangleSoup(size_t i_triangles_num, size_t i_seed)
+    {
+    RandomGenerator<double> rng(i_seed);
+
+    std::vector<Point3D_f> vertices;
+    std::vector<MeshTriangle> triangles;
+    vertices.reserve(3*i_triangles_num);
+    triangles.reserve(i_triangles_num);
+
+    // The triangle size is chosen so that the total area of the triangles is roughly constant regardless of their number.
+    double triangle_size = 4.0 / sqrt((double)std::max(i_triangles_num, (size_t)1));
+    for(size_t i=0;i<i_triangles_num;++i)
+      {
+      Point3D_d center(rng(-1.0,1.0), rng(-1.0,1.0), rng(-1.0,1.0));
+      for(size_t j=0;j<3;++j)
+        {
+        Vector3D_d offset = SamplingRoutines::UniformSphereSampling(Point2D_d(rng(1.0),rng(1.0)));
+        vertices.push_back(Convert<float>(center + offset*triangle_size));
+        }
+
+      triangles.push_back(MeshTriangle(3*i, 3*i+1, 3*i+2));
+      }
+
+    intrusive_ptr<const TriangleMesh> p_mesh( new TriangleMesh(vertices, triangles, false) );
+    return std::vector<intrusive_ptr<const Primitive>>(1, _CreatePrimitive(p_mesh, Transform(), SpectrumCoef_d(0.7,0.7,0.7)));
+    }
+
+  intrusive_ptr<const Scene> CreateScene(const std::vector<intrusive_ptr<const Primitive>> &i_primitives, TriangleAccelerator::BuildMode i_build_mode)
+    {
+    BBox3D_d bbox;
+    for(size_t i=0;i<i_primitives.size();++i)
+      {
+      BBox3D_d mesh_bbox = Convert<double>(i_primitives[i]->GetTriangleMesh_RawPtr()->GetBounds());
+      Transform mesh_to_world = i_primitives[i]->GetMeshToWorldTransform();
+      for(unsigned char corner=0;corner<8;++corner)
+        bbox.Unite(mesh_to_world(Point3D_d(
+          (corner&1) ? mesh_bbox.m_max[0] : mesh_bbox.m_min[0],
+          (corner&2) ? mesh_bbox.m_max[1] : mesh_bbox.m_min[1],
+          (corner&4) ? mesh_bbox.m_max[2] : mesh_bbox.m_min[2])));
+      }
+
+    Vector3D_d extent = Vector3D_d(bbox.m_max-bbox.m_min);
+    Point3D_d light_position = Point3D_d(0.5*(bbox.m_min[0]+bbox.m_max[0]), 0.5*(bbox.m_min[1]+bbox.m_max[1]), bbox.m_max[2] + 0.5*extent[2] + 1.0);
+
+    LightSources lights;
+    lights.m_delta_light_sources.push_back(intrusive_ptr<DeltaLightSource>( new PointLight(light_position, Spectrum_d(1000.0)) ));
+
+    return intrusive_ptr<const Scene>( new Scene(i_primitives, NULL, lights, i_build_mode) );
+    }
+
+  std::vector<Ray> GenerateRays(const BBox3D_d &i_bbox, size_t i_rays_num, size_t i_seed)
+    {
+    RandomGenerator<double> rng(i_seed);
+
+    Point3D_d center = (i_bbox.m_min+i_bbox.m_max)/2.0;
+    double radius = 0.5*Vector3D_d(i_bbox.m_max-i_bbox.m_min).Length() + 1.0;
+
+    std::vector<Ray> rays;
+    rays.reserve(i_rays_num);
+    for(size_t i=0;i<i_rays_num;++i)
+      {
+      Point3D_d origin = center + radius*SamplingRoutines::UniformSphereSampling(Point2D_d(rng(1.0),rng(1.0)));
+      Point3D_d target(rng(i_bbox.m_min[0],i_bbox.m_max[0]), rng(i_bbox.m_min[1],i_bbox.m_max[1]), rng(i_bbox.m_min[2],i_bbox.m_max[2]));
+      rays.push_back(Ray(origin, Vector3D_d(target-origin).Normalized()));
+      }
+
+    return rays;
+    }
+
+  size_t GetNumberOfTriangles(const std::vector<intrusive_ptr<const Primitive>> &i_primitives)
+    {
+    size_t triangles_num = 0;
+    for(size_t i=0;i<i_primitives.size();++i)
+      triangles_num += i_primitives[i]->GetTriangleMesh_RawPtr()->GetNumberOfTriangles();
+    return triangles_num;
+    }
+
+  };
@@ -0,0 +1,75 @@
+/*
+* Copyright (C) 2014 by Volodymyr Kachurovskyi <Volodymyr.Kachurovskyi@gmail.com>
+*
+* This file is part of Skwarka.
+*
+* Skwarka is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+*
+* Skwarka is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License along with Skwarka.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef PROCEDURAL_SCENES_H
+#define PROCEDURAL_SCENES_H
+
+#include <Common/Common.h>
+#include <Math/Geometry.h>
+#include <Raytracer/Core/Primitive.h>
+#include <Raytracer/Core/Scene.h>
+#include <vector>
+
+/**
+* Canonical procedurally generated scenes used by the benchmarks.
+* All scenes are deterministic, i.e. the same parameters always produce exactly the same geometry, so the results of different runs can be compared.
+* All primitives use a lambertian material and all scenes are lit by a single point light placed above the geometry.
+*/
+namespace ProceduralScenes
+  {
+  /**
+  * Creates a set of the analytic shapes (a sphere, a cylinder and a disk) standing on a large ground disk.
+  * @param i_detail Tessellation level. The sphere is subdivided i_detail times (4^(i_detail+1) triangles), cylinder and disks have 2^(i_detail+5) subdivisions.
+  */
+  std::vector<intrusive_ptr<const Primitive>> CreateShapes(size_t i_detail);
+
+  /**
+  * Creates a regular 3D grid of sphere instances. All the instances share the same TriangleMesh and only differ in their mesh-to-world transformations.
+  * @param i_grid_size Number of instances along each of the three axes.
+  * @param i_detail Number of the instanced sphere subdivisions (4^(i_detail+1) triangles).
+  */
+  std::vector<intrusive_ptr<const Primitive>> CreateInstancedGrid(size_t i_grid_size, size_t i_detail);
+
+  /**
+  * Creates a single mesh of randomly placed and randomly oriented small triangles inside the [-1;1]^3 cube.
+  * The triangles are not connected to each other.
+  * @param i_triangles_num Number of triangles.
+  * @param i_seed Random generator seed.
+  */
+  std::vector<intrusive_ptr<const Primitive>> CreateTriangleSoup(size_t i_triangles_num, size_t i_seed);
+
+  /**
+  * Creates Scene for the specified primitives lit by a point light placed above the primitives' bounding box.
+  * @param i_primitives Primitives of the scene.
+  * @param i_build_mode Build mode of the scene's acceleration structure.
+  */
+  intrusive_ptr<const Scene> CreateScene(const std::vector<intrusive_ptr<const Primitive>> &i_primitives,
+    TriangleAccelerator::BuildMode i_build_mode = TriangleAccelerator::BUILD_MODE_SAH);
+
+  /**
+  * Generates rays that start outside of the specified bounding box and are aimed at random points inside of it.
+  * @param i_bbox Bounding box to aim the rays at.
+  * @param i_rays_num Number of rays.
+  * @param i_seed Random generator seed.
+  * @return Generated rays with normalized directions.
+  */
+  std::vector<Ray> GenerateRays(const BBox3D_d &i_bbox, size_t i_rays_num, size_t i_seed);
+
+  /**
+  * Returns total number of triangles in the specified primitives.
+  */
+  size_t GetNumberOfTriangles(const std::vector<intrusive_ptr<const Primitive>> &i_primitives);
+  };
+
+#endif // PROCEDURAL_SCENES_H
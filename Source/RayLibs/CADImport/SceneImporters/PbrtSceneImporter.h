@@ -31,7 +31,15 @@ class PbrtSceneImporter: public SceneImporter
   {
   public:
 
-    PbrtSceneImporter(std::string i_filename, intrusive_ptr<Log> ip_log = NULL);
+    /**
+    * Creates PbrtSceneImporter for the specified file.
+    * If the texture cache is not NULL, the image textures of the scene read their data on demand from the MIP-map files written next to the images,
+    * or keep it in the cache if such a file can not be written (see TextureFactory).
+    * If i_compact_textures is true, the image textures built in memory keep the texels in a reduced precision format (see TextureFactory).
+    * If i_write_mip_map_files is true, the MIP-map levels built for the image textures are written to the files next to the images and are read from them on the next imports (see TextureFactory).
+    */
+    PbrtSceneImporter(std::string i_filename, intrusive_ptr<Log> ip_log = NULL, intrusive_ptr<TextureCache> ip_texture_cache = NULL, bool i_compact_textures = false,
+      bool i_write_mip_map_files = false);
 
     virtual intrusive_ptr<const Scene> GetScene() const;
     virtual std::vector<intrusive_ptr<const Camera>> GetCameras() const;
@@ -122,13 +122,17 @@ namespace PbrtImport
 
         std::string texmap = i_params.FindOneFilename("mapname", "");
 
+        // The precomputed sampling data can be cached on disk or computed lazily instead of being computed in full for each render.
+        std::string cache_directory = i_params.FindOneFilename("cachedirectory", "");
+        bool lazy_precomputation = i_params.FindOneBool("lazyprecomputation", false);
+
         if (texmap.empty()==false)
           {
           intrusive_ptr<const ImageSource<Spectrum_f>> p_image_source =
             PbrtImport::Utils::CreateImageSourceFromFile<Spectrum_f>(texmap, false, 1.0, mp_log);
 
           if (p_image_source && p_image_source->GetHeight() > 0)
-            return new ImageEnvironmentalLight(i_world_bounds, i_light_to_world, p_image_source, sc);
+            return new ImageEnvironmentalLight(i_world_bounds, i_light_to_world, p_image_source, sc, cache_directory, lazy_precomputation);
           }
 
         std::vector<std::vector<Spectrum_f>> values(1, std::vector<Spectrum_f>(1, Convert<float>(L)));
@@ -30,6 +30,7 @@
 #include <boost/algorithm/string.hpp>
 #include "../PbrtUtils.h"
 #include <fstream>
+#include <stdexcept>
 
 namespace PbrtImport
   {
@@ -249,7 +250,42 @@ namespace PbrtImport
           return NULL;
           }
 
-        std::ifstream data_file(filename.c_str(), std::ios::in | std::ios::binary);
+        intrusive_ptr<const MERLMeasuredData> p_merl_measured_data = _LoadMERLMeasuredData(filename);
+        if (p_merl_measured_data == NULL)
+          return NULL;
+
+        intrusive_ptr<const Material> p_ret(new MERLMeasuredMaterial(p_merl_measured_data));
+        _AddBumpMap(p_ret, bumpMap);
+        return p_ret;
+        }
+
+      // Loads the preprocessed MERL data from the cache file next to the data file if it exists, otherwise preprocesses the data file and writes the cache file.
+      // The cache file is only used if the size and modification time of the data file stored in it match the data file, an outdated cache file is written again.
+      intrusive_ptr<const MERLMeasuredData> _LoadMERLMeasuredData(const std::string &i_filename) const
+        {
+        std::string cache_filename = i_filename + ".cache";
+
+        // If the data file itself is missing the cache file is still used, there is nothing to compare it to.
+        unsigned long long source_size = 0, source_modification_time = 0;
+        bool source_exists = PbrtImport::Utils::GetFileStamp(i_filename, source_size, source_modification_time);
+
+        if (std::ifstream(cache_filename.c_str(), std::ios::in | std::ios::binary).good())
+          {
+          try
+            {
+            intrusive_ptr<const MERLMeasuredData> p_cached_data( new MERLMeasuredData(cache_filename) );
+            if (source_exists == false || (p_cached_data->GetSourceSize() == source_size && p_cached_data->GetSourceModificationTime() == source_modification_time))
+              return p_cached_data;
+
+            PbrtImport::Utils::LogInfo(mp_log, "MERL cache file is outdated and will be written again: " + cache_filename);
+            }
+          catch(const std::runtime_error &e)
+            {
+            PbrtImport::Utils::LogWarning(mp_log, std::string("Could not load MERL cache file, the data file will be used instead. ") + e.what());
+            }
+          }
+
+        std::ifstream data_file(i_filename.c_str(), std::ios::in | std::ios::binary);
         if (data_file.eof() || data_file.fail())
           {
           PbrtImport::Utils::LogError(mp_log, "MERL data file does not exist or empty.");
@@ -257,9 +293,16 @@ namespace PbrtImport
           }
 
         intrusive_ptr<MERLMeasuredData> p_merl_measured_data( new MERLMeasuredData(data_file) );
-        intrusive_ptr<const Material> p_ret(new MERLMeasuredMaterial(p_merl_measured_data));
-        _AddBumpMap(p_ret, bumpMap);
-        return p_ret;
+        try
+          {
+          p_merl_measured_data->SaveCache(cache_filename, source_size, source_modification_time);
+          }
+        catch(const std::runtime_error &e)
+          {
+          PbrtImport::Utils::LogWarning(mp_log, e.what());
+          }
+
+        return p_merl_measured_data;
         }
 
     private:
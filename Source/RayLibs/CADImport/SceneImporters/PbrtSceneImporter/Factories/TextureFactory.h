@@ -29,10 +29,15 @@
 #include <Raytracer/Textures/WrinkledTexture.h>
 #include <Raytracer/Core/SpectrumRoutines.h>
 #include <Raytracer/Core/MIPMap.h>
+#include <Raytracer/Core/TextureCache.h>
+#include <Raytracer/Core/MIPMapStorage.h>
 #include "../PbrtUtils.h"
+#include <boost/algorithm/string.hpp>
 #include <string>
 #include <map>
 #include <algorithm>
+#include <fstream>
+#include <stdexcept>
 
 namespace PbrtImport
   {
@@ -40,7 +45,17 @@ namespace PbrtImport
   class TextureFactory
     {
     public:
-      TextureFactory(intrusive_ptr<Log> ip_log): mp_log(ip_log) {}
+      /**
+      * Creates TextureFactory instance.
+      * If the texture cache is not NULL, the MIP-map files are always written (see below) so that the image textures read their MIP-map levels from the mapped files on demand.
+      * Only if a file can not be written, the image is kept in memory and the other MIP-map levels are loaded on demand and kept in the cache.
+      * Otherwise, the MIP-map levels are built in memory.
+      * If i_compact_textures is true, the MIP-map levels built in memory are kept as half floats for the high dynamic range images (EXR, HDR, PFM) and as 8-bit values for all other images.
+      * If i_write_mip_map_files is true, the MIP-map levels built for an image without a prebuilt MIP-map file are written to such file next to the image (see _CreateMIPMap()),
+      * so that the next loads of the image read the levels from the file instead of building them.
+      */
+      TextureFactory(intrusive_ptr<Log> ip_log, intrusive_ptr<TextureCache> ip_texture_cache = NULL, bool i_compact_textures = false, bool i_write_mip_map_files = false):
+        mp_log(ip_log), mp_texture_cache(ip_texture_cache), m_compact_textures(i_compact_textures), m_write_mip_map_files(i_write_mip_map_files) {}
 
       intrusive_ptr<const Texture<double>> CreateFloatTexture(const std::string &i_name, const Transform &i_tex_to_world, const PbrtImport::TextureParams &i_params) const
         {
@@ -107,6 +122,84 @@ namespace PbrtImport
         }
 
     private:
+      /**
+      * Creates MIP-map for the specified image file. Returns NULL if the image can not be loaded.
+      * If there is a prebuilt MIP-map file next to the image (named "<image>.<type>.mip", or "<image>.<scale>.<type>.mip" if the image values are scaled)
+      * the MIP-map levels are read directly from the mapped file.
+      * The file is only used if the size and modification time of the image stored in it match the image file, an outdated file is rebuilt from the image.
+      * If there is no such file, it is written after the levels are built only if the factory is created with the option to write the MIP-map files or with the texture cache.
+      */
+      template<typename T>
+      intrusive_ptr<const MIPMap<T>> _CreateMIPMap(const std::string &i_filename, const std::string &i_type_name, float i_scale, bool i_repeat, float i_max_anisotropy) const
+        {
+        std::string mip_map_filename = i_filename + "." + (i_scale != 1.f ? std::to_string(i_scale) + "." : std::string()) + i_type_name + ".mip";
+
+        // If the image itself is missing the stamp stays zero and the prebuilt file is still used, there is nothing to compare it to.
+        unsigned long long source_size = 0, source_modification_time = 0;
+        PbrtImport::Utils::GetFileStamp(i_filename, source_size, source_modification_time);
+
+        // The existing files are always kept up to date while the new ones are only written on request.
+        // With the texture cache the files are always written, reading the levels from the mapped file is the only way to not keep the whole image in memory.
+        bool write_mip_map_file = m_write_mip_map_files || mp_texture_cache != NULL;
+        if (std::ifstream(mip_map_filename.c_str(), std::ios::in | std::ios::binary).good())
+          {
+          try
+            {
+            intrusive_ptr<const MIPMap<T>> p_mip_map = MIPMap<T>::LoadFile(mip_map_filename, i_repeat, i_max_anisotropy, source_size, source_modification_time);
+            if (p_mip_map)
+              return p_mip_map;
+
+            PbrtImport::Utils::LogInfo(mp_log, "Prebuilt MIP-map file is outdated and will be rebuilt: " + mip_map_filename);
+            write_mip_map_file = true;
+            }
+          catch(const std::exception &e)
+            {
+            PbrtImport::Utils::LogWarning(mp_log, std::string("Cannot use prebuilt MIP-map file: ") + e.what());
+            }
+          }
+
+        intrusive_ptr<const ImageSource<T>> p_image_source =
+          PbrtImport::Utils::CreateImageSourceFromFile<T>(i_filename, true, i_scale, mp_log);
+
+        if (p_image_source==NULL)
+          return NULL;
+
+        // The written file keeps the levels in full precision and the MIP-map reads them from the mapped file, so neither the storage format nor the texture cache apply.
+        if (write_mip_map_file)
+          try
+            {
+            return MIPMap<T>::BuildFile(p_image_source, mip_map_filename, i_repeat, i_max_anisotropy, source_size, source_modification_time);
+            }
+          catch(const std::runtime_error &e)
+            {
+            PbrtImport::Utils::LogWarning(mp_log, e.what());
+            }
+
+        if (mp_texture_cache)
+          {
+          PbrtImport::Utils::LogWarning(mp_log, "Image is kept in memory since its MIP-map file can not be written: " + i_filename);
+          return new MIPMap<T>(p_image_source, i_repeat, i_max_anisotropy, mp_texture_cache);
+          }
+        else
+          return new MIPMap<T>(p_image_source, i_repeat, i_max_anisotropy, _GetStorageFormat(i_filename));
+        }
+
+      /**
+      * Returns the storage format of the MIP-map levels for the specified image file.
+      */
+      MIPMapStorageFormat _GetStorageFormat(const std::string &i_filename) const
+        {
+        if (m_compact_textures == false)
+          return MIP_MAP_STORAGE_FULL;
+
+        size_t dot_position = i_filename.find_last_of('.');
+        std::string extension = dot_position != std::string::npos ? boost::algorithm::to_lower_copy(i_filename.substr(dot_position)) : std::string();
+        if (extension == ".exr" || extension == ".hdr" || extension == ".pfm")
+          return MIP_MAP_STORAGE_HALF;
+        else
+          return MIP_MAP_STORAGE_SRGB8;
+        }
+
       /////////////////////////////////////////// Float Textures ////////////////////////////////////////////////
 
       intrusive_ptr<const Texture<double>> _CreateConstantFloatTexture(const Transform &i_tex_to_world, const TextureParams &tp) const
@@ -160,16 +253,13 @@ namespace PbrtImport
           // PBRT scales image values prior to applying the gamma correction so we need to account for that.
           scale = pow(scale, gamma);
 
-          intrusive_ptr<const ImageSource<float>> p_image_source =
-            PbrtImport::Utils::CreateImageSourceFromFile<float>(filename, true, scale, mp_log);
-
-          if (p_image_source==NULL)
+          p_mip_map = _CreateMIPMap<float>(filename, "float", scale, repeat, maxAniso);
+          if (p_mip_map==NULL)
             {
             PbrtImport::Utils::LogError(mp_log, "Cannot create float image texture.");
             return NULL;
             }
 
-          p_mip_map.reset(new MIPMap<float>(p_image_source, repeat, maxAniso));
           m_float_mip_map_cache[cache_key] = p_mip_map;
           }
 
@@ -289,16 +379,13 @@ namespace PbrtImport
           // PBRT scales image values prior to applying the gamma correction so we need to account for that.
           scale = pow(scale, gamma);
 
-          intrusive_ptr<const ImageSource<SpectrumCoef_f>> p_image_source =
-            PbrtImport::Utils::CreateImageSourceFromFile<SpectrumCoef_f>(filename, true, scale, mp_log);
-
-          if (p_image_source==NULL)
+          p_mip_map = _CreateMIPMap<SpectrumCoef_f>(filename, "spectrum", scale, repeat, maxAniso);
+          if (p_mip_map==NULL)
             {
             PbrtImport::Utils::LogError(mp_log, "Cannot create spectrum image texture.");
             return NULL;
             }
 
-          p_mip_map.reset(new MIPMap<SpectrumCoef_f>(p_image_source, repeat, maxAniso));
           m_spectrum_mip_map_cache[cache_key] = p_mip_map;
           }
 
@@ -368,6 +455,8 @@ namespace PbrtImport
 
     private:
       intrusive_ptr<Log> mp_log;
+      intrusive_ptr<TextureCache> mp_texture_cache;
+      bool m_compact_textures, m_write_mip_map_files;
 
       mutable std::map<std::string, intrusive_ptr<const MIPMap<SpectrumCoef_f>>> m_spectrum_mip_map_cache;
       mutable std::map<std::string, intrusive_ptr<const MIPMap<float>>> m_float_mip_map_cache;
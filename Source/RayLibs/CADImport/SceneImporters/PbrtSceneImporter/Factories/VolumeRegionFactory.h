@@ -20,6 +20,7 @@
 #include <Raytracer/VolumeRegions/GridDensityVolumeRegion.h>
 #include <Raytracer/VolumeRegions/HomogeneousVolumeRegion.h>
 #include <Raytracer/PhaseFunctions/HGPhaseFunction.h>
+#include <Raytracer/PhaseFunctions/TabulatedPhaseFunction.h>
 #include "../PbrtUtils.h"
 
 namespace PbrtImport
@@ -55,8 +56,7 @@ namespace PbrtImport
         Point3D_d p0 = i_params.FindOnePoint("p0", Point3D_d(0,0,0));
         Point3D_d p1 = i_params.FindOnePoint("p1", Point3D_d(1,1,1));
 
-        intrusive_ptr<PhaseFunction> p_phase_function(new HGPhaseFunction(g));
-        return new HomogeneousVolumeRegion(BBox3D_d(i_volume_to_world(p0),i_volume_to_world(p1)), Le, sigma_a, sigma_s, p_phase_function);
+        return new HomogeneousVolumeRegion(BBox3D_d(i_volume_to_world(p0),i_volume_to_world(p1)), Le, sigma_a, sigma_s, _CreatePhaseFunction(g));
         }
 
       intrusive_ptr<const VolumeRegion> _CreateGridVolumeRegion( const Transform &i_volume_to_world, const ParamSet &i_params) const
@@ -69,6 +69,24 @@ namespace PbrtImport
         Point3D_d p0 = i_params.FindOnePoint("p0", Point3D_d(0,0,0));
         Point3D_d p1 = i_params.FindOnePoint("p1", Point3D_d(1,1,1));
 
+        // The densities can be loaded from the binary volume file instead of being listed in the scene file.
+        std::string density_file = i_params.FindOneFilename("densityfile", "");
+        if (density_file.empty() == false)
+          {
+          intrusive_ptr<const DensityGrid> p_densities;
+          try
+            {
+            p_densities.reset(new DensityGrid(density_file));
+            }
+          catch(const std::exception &e)
+            {
+            PbrtImport::Utils::LogError(mp_log, e.what());
+            return NULL;
+            }
+
+          return new GridDensityVolumeRegion(BBox3D_d(i_volume_to_world(p0),i_volume_to_world(p1)), Le, sigma_a, sigma_s, _CreatePhaseFunction(g), p_densities);
+          }
+
         size_t nitems;
         const float *data = i_params.FindFloat("density", &nitems);
         if (!data)
@@ -95,8 +113,17 @@ namespace PbrtImport
             for(int x=0;x<nx;++x)
               densities[x][y][z] = data[ind++];
 
-        intrusive_ptr<PhaseFunction> p_phase_function(new HGPhaseFunction(g));
-        return new GridDensityVolumeRegion(BBox3D_d(i_volume_to_world(p0),i_volume_to_world(p1)), Le, sigma_a, sigma_s, p_phase_function, densities);
+        return new GridDensityVolumeRegion(BBox3D_d(i_volume_to_world(p0),i_volume_to_world(p1)), Le, sigma_a, sigma_s, _CreatePhaseFunction(g), densities);
+        }
+
+      /**
+      * Creates Henyey-Greenstein phase function with the specified asymmetry parameter.
+      * The phase function is tabulated so that the media integration samples the scattering directions proportionally to it rather than uniformly.
+      */
+      intrusive_ptr<const PhaseFunction> _CreatePhaseFunction(float i_g) const
+        {
+        intrusive_ptr<const PhaseFunction> p_phase_function(new HGPhaseFunction(i_g));
+        return new TabulatedPhaseFunction(p_phase_function);
         }
 
       intrusive_ptr<const VolumeRegion> _CreateExponentialVolumeRegion( const Transform &i_volume_to_world, const ParamSet &i_params) const
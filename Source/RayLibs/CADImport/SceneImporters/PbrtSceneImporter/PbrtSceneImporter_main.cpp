@@ -21,8 +21,9 @@
 #include <boost/algorithm/string.hpp>
 #include <boost/iostreams/device/mapped_file.hpp>
 
-PbrtSceneImporter::PbrtSceneImporter(std::string i_filename, intrusive_ptr<Log> ip_log):
-m_filename(i_filename), mp_log(ip_log), m_texture_factory(ip_log)
+PbrtSceneImporter::PbrtSceneImporter(std::string i_filename, intrusive_ptr<Log> ip_log, intrusive_ptr<TextureCache> ip_texture_cache, bool i_compact_textures,
+                                     bool i_write_mip_map_files):
+m_filename(i_filename), mp_log(ip_log), m_texture_factory(ip_log, ip_texture_cache, i_compact_textures, i_write_mip_map_files)
   {
   m_currentApiState = STATE_UNINITIALIZED;
 
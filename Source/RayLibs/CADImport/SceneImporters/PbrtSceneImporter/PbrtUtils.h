@@ -20,6 +20,8 @@
 #include <ctype.h>
 #include <cstdlib>
 #include <string>
+#include <sys/types.h>
+#include <sys/stat.h>
 #include <boost/algorithm/string.hpp>
 #include <Raytracer/Core/ImageSource.h>
 #include <Raytracer/ImageSources/RGBImageSource.h>
@@ -110,6 +112,28 @@ namespace PbrtImport
       return (i_filename[0] == '\\' || i_filename[0] == '/' || i_filename.find(':') != std::string::npos);
       }
 
+    /**
+    * Gets the size (in bytes) and the modification time of the specified file.
+    * The values are used to detect the cache files that are outdated with respect to the source file they were built from.
+    * Returns false if the file does not exist.
+    */
+    inline bool GetFileStamp(const std::string &i_filename, unsigned long long &o_size, unsigned long long &o_modification_time)
+      {
+#if defined(_WIN32)
+      struct _stat64 file_stat;
+      if (_stat64(i_filename.c_str(), &file_stat) != 0)
+        return false;
+#else
+      struct stat file_stat;
+      if (stat(i_filename.c_str(), &file_stat) != 0)
+        return false;
+#endif
+
+      o_size = (unsigned long long)file_stat.st_size;
+      o_modification_time = (unsigned long long)file_stat.st_mtime;
+      return true;
+      }
+
     template<typename T>
     intrusive_ptr<const ImageSource<T>> CreateImageSourceFromFile(const std::string &i_filename, bool i_E_whitepoint, double i_scale, intrusive_ptr<Log> ip_log)
       {
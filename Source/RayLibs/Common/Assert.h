@@ -15,12 +15,18 @@
 #ifndef ASSERT_H
 #define ASSERT_H
 
+#ifdef _MSC_VER
 #include <crtdbg.h>
+#else
+#include <cassert>
+#endif // _MSC_VER
 
 #ifdef NDEBUG
 #define ASSERT(expr) ((void)0)
-#else
+#elif defined(_MSC_VER)
 #define ASSERT(expr) _ASSERTE(expr)
+#else
+#define ASSERT(expr) assert(expr)
 #endif // NDEBUG
 
 #endif // ASSERT_H
\ No newline at end of file
@@ -40,8 +40,22 @@ class ReferenceCounted
     */
     size_t DecRef() const;
 
+#ifndef NDEBUG
+    /**
+    * Returns total number of reference counter increments and decrements performed so far for all ReferenceCounted instances.
+    * Used to verify that per-ray code (intersection, BSDF and texture evaluation, lights sampling) borrows raw pointers instead of copying intrusive pointers.
+    * Only available in debug builds.
+    */
+    static size_t GetReferenceOperationsCount();
+#endif
+
     virtual ~ReferenceCounted();
 
+  private:
+#ifndef NDEBUG
+    static tbb::atomic<size_t> &_ReferenceOperationsCounter();
+#endif
+
   private:
     mutable tbb::atomic<size_t> m_references;
     //mutable size_t m_references;
@@ -67,15 +81,35 @@ inline ReferenceCounted::~ReferenceCounted()
 
 inline size_t ReferenceCounted::IncRef() const
   {
+#ifndef NDEBUG
+  ++_ReferenceOperationsCounter();
+#endif
   return ++m_references;
   }
 
 inline size_t ReferenceCounted::DecRef() const
   {
   ASSERT(m_references>0);
+#ifndef NDEBUG
+  ++_ReferenceOperationsCounter();
+#endif
   return --m_references;
   }
 
+#ifndef NDEBUG
+inline size_t ReferenceCounted::GetReferenceOperationsCount()
+  {
+  return _ReferenceOperationsCounter();
+  }
+
+inline tbb::atomic<size_t> &ReferenceCounted::_ReferenceOperationsCounter()
+  {
+  // Zero-initialized since it has static storage duration.
+  static tbb::atomic<size_t> counter;
+  return counter;
+  }
+#endif
+
 /**
 * This function is called by boost library when a new intrusive_ptr instance is created.
 */
@@ -20,6 +20,7 @@
 */
 
 #include <float.h>
+#include <cmath>
 #include <limits>
 
 /**
@@ -59,13 +60,21 @@ bool IsNaN(T i_value)
 template<>
 inline bool IsNaN<float>(float i_value)
   {
+#ifdef _MSC_VER
   return _isnan(i_value) != 0;
+#else
+  return std::isnan(i_value);
+#endif
   }
 
 template<>
 inline bool IsNaN<double>(double i_value)
   {
+#ifdef _MSC_VER
   return _isnan(i_value) != 0;
+#else
+  return std::isnan(i_value);
+#endif
   }
 
 template<typename T>
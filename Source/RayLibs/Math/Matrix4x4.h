@@ -16,6 +16,7 @@
 #define MATRIX_4X4_H
 
 #include <Common/Common.h>
+#include <cmath>
 #include <cstring>
 
 /**
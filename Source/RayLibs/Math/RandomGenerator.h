@@ -16,7 +16,7 @@
 #define RANDOM_GENERATOR_H
 
 #include <limits>
-#include <boost\random\mersenne_twister.hpp>
+#include <boost/random/mersenne_twister.hpp>
 
 /**
 * Random generator class template.
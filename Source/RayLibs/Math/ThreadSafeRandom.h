@@ -15,11 +15,13 @@
 #ifndef THREAD_SAFE_RANDOM_H
 #define THREAD_SAFE_RANDOM_H
 
-#include <Common\Common.h>
+#include <Common/Common.h>
 #include <limits>
-#include <boost\random\mersenne_twister.hpp>
-#include <tbb\enumerable_thread_specific.h>
-#include <tbb\cache_aligned_allocator.h>
+#include <thread>
+#include <functional>
+#include <boost/random/mersenne_twister.hpp>
+#include <tbb/enumerable_thread_specific.h>
+#include <tbb/cache_aligned_allocator.h>
 
 /**
 * Thread-safe random generator class template.
@@ -146,7 +148,7 @@ unsigned int ThreadSafeRandomGenerator<UnderlyingRandomGenerator>::GenerateUIntR
 
   // Decorrelate random generators for different threads by seeding the thread ID.
   if (exists==false && m_decorrelate_thread_generators)
-    thread_local_generator.seed(GetCurrentThreadId());
+    thread_local_generator.seed( (unsigned int)std::hash<std::thread::id>()(std::this_thread::get_id()) );
 
   return thread_local_generator();
   }
@@ -18,9 +18,40 @@
 #include <Raytracer/Core/Color.h>
 #include <Raytracer/Core/SpectrumRoutines.h>
 #include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <tbb/tbb.h>
+
+namespace
+  {
+  const char MERL_CACHE_FILE_MAGIC[8] = {'S','K','W','M','E','R','L','C'};
+  const unsigned int MERL_CACHE_FILE_VERSION = 2;
+
+  /*
+  * Header of the cache file. It is followed by the BRDF data and the segmentations.
+  * The sizes of the stored types are written to detect the files written with a different sampling resolution or on an incompatible platform.
+  * The size and the modification time of the MERL data file are written to detect the files that are outdated with respect to the data file.
+  */
+  struct MERLCacheHeader
+    {
+    char m_magic[8];
+    unsigned int m_version;
+    unsigned int m_brdf_value_size;
+    unsigned int m_segmentation_size;
+    unsigned int m_segmentations_num;
+    unsigned long long m_brdf_values_num;
+    unsigned long long m_source_size;
+    unsigned long long m_source_modification_time;
+    };
+  }
 
 /////////////////////////////////// MERLMeasuredData::Segmentation2D //////////////////////////////////////
 
+MERLMeasuredData::Segmentation2D::Segmentation2D()
+  {
+  }
+
 MERLMeasuredData::Segmentation2D::Segmentation2D(const std::vector<std::vector<float>> &i_values)
 {
   size_t size_x = SEGMENTATION_EXITANT_PHI_RES, size_y = SEGMENTATION_EXITANT_THETA_RES;
@@ -39,12 +70,10 @@ MERLMeasuredData::Segmentation2D::Segmentation2D(const std::vector<std::vector<f
   std::vector<size_t> reduction_Y = _Reduce(sum_Y, size_y);
 
   // Normalize X grid line coordinates.
-  m_grid_X.assign(size_x, 0.f);
   for(size_t i=0;i<size_x;++i)
     m_grid_X[i] = reduction_X[i] / (float)m;
 
   // Normalize Y grid line coordinates.
-  m_grid_Y.assign(size_y, 0.f);
   for(size_t i=0;i<size_y;++i)
     m_grid_Y[i] = reduction_Y[i] / (float)n;
 
@@ -66,17 +95,16 @@ MERLMeasuredData::Segmentation2D::Segmentation2D(const std::vector<std::vector<f
       }
 
   // Build CDF for rows.
-  m_CDF_rows.assign(size_y, 0.f);
   for(size_t i=0;i<size_y;++i)
     {
-    if (i>0) m_CDF_rows[i]=m_CDF_rows[i-1];
+    m_CDF_rows[i] = i>0 ? m_CDF_rows[i-1] : 0.f;
     m_CDF_rows[i] += m_CDF_cols[i][size_x-1];
     }
 
   // Normalize CDF values.
   for(size_t i=0;i<size_y;++i)
     {
-    m_CDF_rows[i] /= m_CDF_rows.back();
+    m_CDF_rows[i] /= m_CDF_rows[size_y-1];
 
     double inv = 1.0/m_CDF_cols[i][size_x-1];
     for(size_t j=0;j<size_x;++j)
@@ -118,7 +146,7 @@ std::vector<size_t> MERLMeasuredData::Segmentation2D::_Reduce(std::vector<float>
 void MERLMeasuredData::Segmentation2D::Sample(const Point2D_d &i_sample, Point2D_d &o_residual_sample, Point2D_d &o_box_min, Point2D_d &o_box_max, double &o_pdf) const
   {
   double row_pdf, col_pdf;
-  size_t row_index = MathRoutines::BinarySearchCDF(m_CDF_rows.begin(), m_CDF_rows.end(), i_sample[1], &row_pdf) - m_CDF_rows.begin();
+  size_t row_index = MathRoutines::BinarySearchCDF(m_CDF_rows, m_CDF_rows+SEGMENTATION_EXITANT_THETA_RES, i_sample[1], &row_pdf) - m_CDF_rows;
   
   const float *p_CDF_cols = m_CDF_cols[row_index];
   size_t col_index = MathRoutines::BinarySearchCDF(p_CDF_cols, p_CDF_cols+SEGMENTATION_EXITANT_PHI_RES, i_sample[0], &col_pdf) - p_CDF_cols;
@@ -139,8 +167,8 @@ void MERLMeasuredData::Segmentation2D::PDF(const Point2D_d &i_point, Point2D_d &
   ASSERT(i_point[0]>=0.0 && i_point[0]<1.0);
   ASSERT(i_point[1]>=0.0 && i_point[1]<1.0);
 
-  size_t col_index = std::upper_bound(m_grid_X.begin(), m_grid_X.end(), i_point[0]) - m_grid_X.begin();
-  size_t row_index = std::upper_bound(m_grid_Y.begin(), m_grid_Y.end(), i_point[1]) - m_grid_Y.begin();
+  size_t col_index = std::upper_bound(m_grid_X, m_grid_X+SEGMENTATION_EXITANT_PHI_RES, i_point[0]) - m_grid_X;
+  size_t row_index = std::upper_bound(m_grid_Y, m_grid_Y+SEGMENTATION_EXITANT_THETA_RES, i_point[1]) - m_grid_Y;
   ASSERT(row_index>0 && col_index>0);
   --col_index; --row_index;
 
@@ -157,7 +185,7 @@ void MERLMeasuredData::Segmentation2D::PDF(const Point2D_d &i_point, Point2D_d &
 
 ////////////////////////////////////////// MERLMeasuredData ///////////////////////////////////////////////
 
-MERLMeasuredData::MERLMeasuredData(std::istream &i_stream)
+MERLMeasuredData::MERLMeasuredData(std::istream &i_stream): mp_brdf_data(NULL), mp_segmentations(NULL), m_source_size(0), m_source_modification_time(0)
   {
   int dims[3];
   i_stream.read(reinterpret_cast<char*>(&dims[0]), sizeof(int));
@@ -217,9 +245,87 @@ MERLMeasuredData::MERLMeasuredData(std::istream &i_stream)
   delete[] p_tmp;
   delete[] p_regular_halfangle_data;
 
+  mp_brdf_data = &m_brdf_data[0];
   _InitializeSegmentations();
   }
 
+MERLMeasuredData::MERLMeasuredData(const std::string &i_cache_filename): mp_brdf_data(NULL), mp_segmentations(NULL), m_source_size(0), m_source_modification_time(0)
+  {
+  if (std::ifstream(i_cache_filename.c_str(), std::ios::binary).good() == false)
+    throw std::runtime_error("Could not open MERL cache file: " + i_cache_filename);
+
+  try
+    {
+    m_cache_file.open(i_cache_filename);
+    }
+  catch(const std::ios_base::failure &)
+    {
+    throw std::runtime_error("Could not map MERL cache file: " + i_cache_filename);
+    }
+
+  const size_t n = BRDF_SAMPLING_RES_THETA_H*BRDF_SAMPLING_RES_THETA_D*BRDF_SAMPLING_RES_PHI_D;
+  const size_t brdf_data_size = n*sizeof(SpectrumCoef_h), segmentations_size = SEGMENTATION_INCIDENT_THETA_RES*sizeof(Segmentation2D);
+  if (m_cache_file.size() < sizeof(MERLCacheHeader))
+    throw std::runtime_error("Not a MERL cache file: " + i_cache_filename);
+
+  MERLCacheHeader header;
+  memcpy(&header, m_cache_file.data(), sizeof(MERLCacheHeader));
+  if (memcmp(header.m_magic, MERL_CACHE_FILE_MAGIC, sizeof(MERL_CACHE_FILE_MAGIC)) != 0)
+    throw std::runtime_error("Not a MERL cache file: " + i_cache_filename);
+
+  if (header.m_version != MERL_CACHE_FILE_VERSION || header.m_brdf_value_size != sizeof(SpectrumCoef_h) || header.m_segmentation_size != sizeof(Segmentation2D) ||
+    header.m_segmentations_num != SEGMENTATION_INCIDENT_THETA_RES || header.m_brdf_values_num != n)
+    throw std::runtime_error("Incompatible MERL cache file: " + i_cache_filename);
+
+  if (m_cache_file.size() != sizeof(MERLCacheHeader) + brdf_data_size + segmentations_size)
+    throw std::runtime_error("Unexpected size of MERL cache file: " + i_cache_filename);
+
+  // The header and the BRDF data sizes are multiples of 4 bytes so both arrays are properly aligned in the mapped memory.
+  mp_brdf_data = reinterpret_cast<const SpectrumCoef_h*>(m_cache_file.data() + sizeof(MERLCacheHeader));
+  mp_segmentations = reinterpret_cast<const Segmentation2D*>(m_cache_file.data() + sizeof(MERLCacheHeader) + brdf_data_size);
+
+  m_source_size = header.m_source_size;
+  m_source_modification_time = header.m_source_modification_time;
+  }
+
+void MERLMeasuredData::SaveCache(const std::string &i_filename, unsigned long long i_source_size, unsigned long long i_source_modification_time) const
+  {
+  if (mp_brdf_data == NULL)
+    throw std::runtime_error("No MERL data to write to cache file: " + i_filename);
+
+  std::ofstream stream(i_filename.c_str(), std::ios::binary);
+  if (stream.good() == false)
+    throw std::runtime_error("Could not create MERL cache file: " + i_filename);
+
+  MERLCacheHeader header;
+  memset(&header, 0, sizeof(MERLCacheHeader));
+  memcpy(header.m_magic, MERL_CACHE_FILE_MAGIC, sizeof(MERL_CACHE_FILE_MAGIC));
+  header.m_version = MERL_CACHE_FILE_VERSION;
+  header.m_brdf_value_size = sizeof(SpectrumCoef_h);
+  header.m_segmentation_size = sizeof(Segmentation2D);
+  header.m_segmentations_num = SEGMENTATION_INCIDENT_THETA_RES;
+  header.m_brdf_values_num = BRDF_SAMPLING_RES_THETA_H*BRDF_SAMPLING_RES_THETA_D*BRDF_SAMPLING_RES_PHI_D;
+  header.m_source_size = i_source_size;
+  header.m_source_modification_time = i_source_modification_time;
+
+  stream.write(reinterpret_cast<const char*>(&header), sizeof(MERLCacheHeader));
+  stream.write(reinterpret_cast<const char*>(mp_brdf_data), header.m_brdf_values_num*sizeof(SpectrumCoef_h));
+  stream.write(reinterpret_cast<const char*>(mp_segmentations), header.m_segmentations_num*sizeof(Segmentation2D));
+
+  if (stream.good() == false)
+    throw std::runtime_error("Could not write MERL cache file: " + i_filename);
+  }
+
+unsigned long long MERLMeasuredData::GetSourceSize() const
+  {
+  return m_source_size;
+  }
+
+unsigned long long MERLMeasuredData::GetSourceModificationTime() const
+  {
+  return m_source_modification_time;
+  }
+
 void MERLMeasuredData::_InitializeSegmentations()
   {
   // Originally we sample the BRDF values at a higher frequency and then reduce it back to the needed resolution.
@@ -228,33 +334,40 @@ void MERLMeasuredData::_InitializeSegmentations()
   const size_t exitant_phi_res = SEGMENTATION_MULTIPLIER*SEGMENTATION_EXITANT_PHI_RES;
   double phi_coef = M_PI / (exitant_phi_res), theta_coef = M_PI_2 / (exitant_theta_res);
 
-  std::vector<std::vector<float>> values(exitant_theta_res, std::vector<float>(exitant_phi_res));
-  for(size_t i=0;i<SEGMENTATION_INCIDENT_THETA_RES;++i)
+  // The layers are independent from each other so they are built in parallel.
+  m_segmentations.resize(SEGMENTATION_INCIDENT_THETA_RES);
+  tbb::parallel_for(tbb::blocked_range<size_t>(0, m_segmentations.size()), [&](const tbb::blocked_range<size_t> &i_range)
     {
-    double incident_theta = (i+0.5)*M_PI_2/SEGMENTATION_INCIDENT_THETA_RES;
-    Vector3D_d incident = MathRoutines::SphericalDirection<double>(0.0, incident_theta);
-
-    for(size_t i1=0;i1<exitant_theta_res;++i1)
+    std::vector<std::vector<float>> values(exitant_theta_res, std::vector<float>(exitant_phi_res));
+    for(size_t i=i_range.begin();i!=i_range.end();++i)
       {
-      double exitant_theta = (i1+0.5)*theta_coef;
-      double cos_exitant_theta = cos(exitant_theta);
-      double cos_theta1 = cos(i1*theta_coef), cos_theta2 = cos((i1+1)*theta_coef);
-      double d_cos_theta = cos_theta1 - cos_theta2;
+      double incident_theta = (i+0.5)*M_PI_2/SEGMENTATION_INCIDENT_THETA_RES;
+      Vector3D_d incident = MathRoutines::SphericalDirection<double>(0.0, incident_theta);
 
-      for(size_t j1=0;j1<exitant_phi_res;++j1)
+      for(size_t i1=0;i1<exitant_theta_res;++i1)
         {
-        double luminance = SpectrumRoutines::Luminance(GetBRDF(incident, MathRoutines::SphericalDirection<double>((j1+0.5)*phi_coef, exitant_theta)));
-        values[i1][j1] = (float)(phi_coef*d_cos_theta*cos_exitant_theta*luminance);
+        double exitant_theta = (i1+0.5)*theta_coef;
+        double cos_exitant_theta = cos(exitant_theta);
+        double cos_theta1 = cos(i1*theta_coef), cos_theta2 = cos((i1+1)*theta_coef);
+        double d_cos_theta = cos_theta1 - cos_theta2;
+
+        for(size_t j1=0;j1<exitant_phi_res;++j1)
+          {
+          double luminance = SpectrumRoutines::Luminance(GetBRDF(incident, MathRoutines::SphericalDirection<double>((j1+0.5)*phi_coef, exitant_theta)));
+          values[i1][j1] = (float)(phi_coef*d_cos_theta*cos_exitant_theta*luminance);
+          }
         }
+
+      m_segmentations[i] = Segmentation2D(values);
       }
+    });
 
-    m_segmentations.push_back( Segmentation2D(values) );
-    }
+  mp_segmentations = &m_segmentations[0];
   }
 
 SpectrumCoef_d MERLMeasuredData::GetBRDF(const Vector3D_d &i_incident, const Vector3D_d &i_exitant) const
   {
-  if (m_brdf_data.empty())
+  if (mp_brdf_data == NULL)
     return SpectrumCoef_d();
 
   Vector3D_d half_angle = i_incident+i_exitant;
@@ -287,15 +400,15 @@ SpectrumCoef_d MERLMeasuredData::GetBRDF(const Vector3D_d &i_incident, const Vec
     {
     // Interpolate by the theta angle of half vector.
     double t = half_vector_theta_deg_scaled-(size_t)half_vector_theta_deg_scaled;
-    return Convert<double>(m_brdf_data[index])*(1.0-t) + Convert<double>(m_brdf_data[index+BRDF_SAMPLING_RES_THETA_D*BRDF_SAMPLING_RES_PHI_D])*t;
+    return Convert<double>(mp_brdf_data[index])*(1.0-t) + Convert<double>(mp_brdf_data[index+BRDF_SAMPLING_RES_THETA_D*BRDF_SAMPLING_RES_PHI_D])*t;
     }
   else
-    return Convert<double>( m_brdf_data[index] );
+    return Convert<double>( mp_brdf_data[index] );
   }
 
 SpectrumCoef_d MERLMeasuredData::Sample(const Vector3D_d &i_incident, Vector3D_d &o_exitant, const Point2D_d &i_sample, double &o_pdf) const
   {
-  if (m_brdf_data.empty())
+  if (mp_brdf_data == NULL)
     {
     o_pdf=0.0;
     return SpectrumCoef_d();
@@ -315,7 +428,7 @@ SpectrumCoef_d MERLMeasuredData::Sample(const Vector3D_d &i_incident, Vector3D_d
 
   double pdf;
   Point2D_d residual_sample, box_min, box_max;
-  m_segmentations[incident_theta_index].Sample(sample, residual_sample, box_min, box_max, pdf);
+  mp_segmentations[incident_theta_index].Sample(sample, residual_sample, box_min, box_max, pdf);
   
   double d_phi = (box_max[0]-box_min[0]) * M_PI;
   double cos_theta1 = cos(box_min[1]*M_PI_2), cos_theta2 = cos(box_max[1]*M_PI_2);
@@ -337,7 +450,7 @@ SpectrumCoef_d MERLMeasuredData::Sample(const Vector3D_d &i_incident, Vector3D_d
 
 double MERLMeasuredData::PDF(const Vector3D_d &i_incident, const Vector3D_d &i_exitant) const
   {
-  if (m_brdf_data.empty())
+  if (mp_brdf_data == NULL)
     return 0.0;
 
   size_t incident_theta_index = std::min((size_t)(MathRoutines::SphericalTheta(i_incident)*2.0*INV_PI * SEGMENTATION_INCIDENT_THETA_RES), SEGMENTATION_INCIDENT_THETA_RES-1);
@@ -352,7 +465,7 @@ double MERLMeasuredData::PDF(const Vector3D_d &i_incident, const Vector3D_d &i_e
 
   double pdf;
   Point2D_d box_min, box_max;
-  m_segmentations[incident_theta_index].PDF(point, box_min, box_max, pdf);
+  mp_segmentations[incident_theta_index].PDF(point, box_min, box_max, pdf);
 
   double d_phi = (box_max[0]-box_min[0]) * M_PI;
   double cos_theta1 = cos(box_min[1]*M_PI_2), cos_theta2 = cos(box_max[1]*M_PI_2);
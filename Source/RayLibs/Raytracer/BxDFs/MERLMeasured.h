@@ -19,7 +19,9 @@
 #include <Raytracer/Core/BxDF.h>
 #include <vector>
 #include <istream>
+#include <string>
 #include <Math/HalfFloat.h>
+#include <boost/iostreams/device/mapped_file.hpp>
 
 /**
 * The class stores measured reflectivity data and provides methods to evaluate and sample the data and compute the sampling PDF.
@@ -35,6 +37,9 @@
 * The regions of theta and phi angles which correspond to rows and columns of the table define a grid which subdivides the sampling domain.
 * This grid is not regular, it is computed in a specific way to decrease the variance of the sampling.
 * Basically, the regions where the BRDF function takes high values are covered more densely by the grid and vice versa.
+*
+* Converting the MERL data and building the PDF layers takes a considerable time, so the preprocessed data can be written to a binary cache file with SaveCache() method.
+* When loaded from the cache file the data is memory-mapped and used as is, without any conversion.
 * @sa MERLMeasured
 */
 class MERLMeasuredData: public ReferenceCounted
@@ -46,6 +51,36 @@ class MERLMeasuredData: public ReferenceCounted
     */
     MERLMeasuredData(std::istream &i_stream);
 
+    /**
+    * Loads MERLMeasuredData from the cache file written by SaveCache() method.
+    * The file is memory-mapped and stays open for the lifetime of the instance.
+    * Throws std::runtime_error if the file can not be read or is not a valid cache file (e.g. it was written with a different sampling resolution).
+    */
+    MERLMeasuredData(const std::string &i_cache_filename);
+
+    /**
+    * Writes the preprocessed BRDF data and the sampling PDF data to the binary cache file.
+    * The cache file is not portable between platforms with different endianness.
+    * Throws std::runtime_error if the file can not be written.
+    * @param i_filename Name of the cache file.
+    * @param i_source_size Size (in bytes) of the MERL data file the data was read from, 0 if unknown. Stored in the file, see GetSourceSize().
+    * @param i_source_modification_time Modification time of the MERL data file, 0 if unknown. Stored in the file, see GetSourceModificationTime().
+    */
+    void SaveCache(const std::string &i_filename, unsigned long long i_source_size = 0, unsigned long long i_source_modification_time = 0) const;
+
+    /**
+    * Returns size (in bytes) of the MERL data file stored in the cache file the data was loaded from.
+    * Returns 0 if the data was not loaded from a cache file or the size was not specified when the file was written.
+    * The value can be used to detect the cache files that are outdated with respect to the data file.
+    */
+    unsigned long long GetSourceSize() const;
+
+    /**
+    * Returns modification time of the MERL data file stored in the cache file the data was loaded from.
+    * Returns 0 if the data was not loaded from a cache file or the time was not specified when the file was written.
+    */
+    unsigned long long GetSourceModificationTime() const;
+
     /**
     * Returns BRDF value for the specified incident and exitant directions.
     */
@@ -86,9 +121,17 @@ class MERLMeasuredData: public ReferenceCounted
     // Change it wisely, bigger values require more processing time and do not necessarily yield a better result.
     const static size_t SEGMENTATION_MULTIPLIER = 8;
 
+    // The two vectors below are empty if the data is loaded from the cache file.
     std::vector<SpectrumCoef_h> m_brdf_data;
-
     std::vector<Segmentation2D> m_segmentations;
+
+    // Point either to the vectors above or to the memory-mapped cache file.
+    const SpectrumCoef_h *mp_brdf_data;
+    const Segmentation2D *mp_segmentations;
+
+    boost::iostreams::mapped_file_source m_cache_file;
+
+    unsigned long long m_source_size, m_source_modification_time;
   };
 
 /**
@@ -150,10 +193,16 @@ class MERLMeasured: public BxDF
 * The PDF function is defined by a 2D array, each row of which represents CDF function for the corresponding theta angle.
 * Rows and columns of the table correspond to the regions of theta and phi angles of the domain respectively and together define a grid on the domain.
 * The grid is not regular, the position of the grid lines are positioned in a specific way to reduce the sampling variance.
+* The class only holds fixed-size arrays so that it can be written to and read from the cache file as is.
 */
 class MERLMeasuredData::Segmentation2D
   {
   public:
+    /**
+    * Creates uninitialized Segmentation2D.
+    */
+    Segmentation2D();
+
     /**
     * Initializes Segmentation2D with the specified 2D array of luminance values.
     * The input array will be reduced to the necessary size by merging some adjacent rows and columns (see _Reduce() method).
@@ -193,10 +242,10 @@ class MERLMeasuredData::Segmentation2D
 
   private:
     // Define grid of the domain subdivision.
-    std::vector<float> m_grid_X, m_grid_Y;
+    float m_grid_X[SEGMENTATION_EXITANT_PHI_RES], m_grid_Y[SEGMENTATION_EXITANT_THETA_RES];
 
     // CDF function for sampling the rows (theta values).
-    std::vector<float> m_CDF_rows;
+    float m_CDF_rows[SEGMENTATION_EXITANT_THETA_RES];
 
     // Array of CDF functions for sampling the columns (phi values).
     float m_CDF_cols[SEGMENTATION_EXITANT_THETA_RES][SEGMENTATION_EXITANT_PHI_RES];
@@ -31,9 +31,13 @@ Camera(i_camera2world, ip_film), m_lens_radius(i_lens_radius), m_focal_distance(
 
   m_x_tan=tan(m_x_view_angle/2.0);
   m_y_tan=m_x_tan*((double)m_film_y_resolution)/m_film_x_resolution;
+
+  Transform camera2world = GetCamera2WorldTransform();
+  m_pixel_dx = camera2world(Vector3D_d(2.0*m_x_tan/m_film_x_resolution, 0.0, 0.0));
+  m_pixel_dy = camera2world(Vector3D_d(0.0, 2.0*m_y_tan/m_film_y_resolution, 0.0));
   }
 
-double PerspectiveCamera::GenerateRay(const Point2D_d &i_image_point, const Point2D_d &i_lens_uv, Ray &o_ray) const
+void PerspectiveCamera::_GenerateUnnormalizedRay(const Point2D_d &i_image_point, const Point2D_d &i_lens_uv, Ray &o_ray) const
   {
   ASSERT(i_lens_uv[0]>=0.0 && i_lens_uv[0]<1.0 && i_lens_uv[1]>=0.0 && i_lens_uv[1]<1.0);
 
@@ -59,11 +63,34 @@ double PerspectiveCamera::GenerateRay(const Point2D_d &i_image_point, const Poin
     }
 
   _TransformRay(o_ray, o_ray);
+  }
+
+double PerspectiveCamera::GenerateRay(const Point2D_d &i_image_point, const Point2D_d &i_lens_uv, Ray &o_ray) const
+  {
+  _GenerateUnnormalizedRay(i_image_point, i_lens_uv, o_ray);
   o_ray.m_direction.Normalize();
 
   return 1.0;
   }
 
+double PerspectiveCamera::GenerateRayDifferential(const Point2D_d &i_image_point, const Point2D_d &i_lens_uv, double i_dx, double i_dy, RayDifferential &o_ray) const
+  {
+  _GenerateUnnormalizedRay(i_image_point, i_lens_uv, o_ray.m_base_ray);
+
+  // The lens only changes the ray origin which is the same for all three rays, while the points on the plane of focus
+  // move by the pixel offsets scaled by the focal distance.
+  double scale = m_lens_radius > 0.0 ? m_focal_distance : 1.0;
+  const Vector3D_d &direction = o_ray.m_base_ray.m_direction;
+
+  o_ray.m_origin_dx = o_ray.m_origin_dy = o_ray.m_base_ray.m_origin;
+  o_ray.m_direction_dx = (direction + m_pixel_dx*(i_dx*scale)).Normalized();
+  o_ray.m_direction_dy = (direction + m_pixel_dy*(i_dy*scale)).Normalized();
+  o_ray.m_base_ray.m_direction.Normalize();
+  o_ray.m_has_differentials = true;
+
+  return 1.0;
+  }
+
 double PerspectiveCamera::GetLensRadius() const
   {
   return m_lens_radius;
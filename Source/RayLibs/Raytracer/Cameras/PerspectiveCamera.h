@@ -47,12 +47,32 @@ class PerspectiveCamera: public Camera
     */
     double GenerateRay(const Point2D_d &i_image_point, const Point2D_d &i_lens_uv, Ray &o_ray) const;
 
+    /**
+    * Generates ray with differentials based on the image point and lens UV coordinates.
+    * The differentials are computed analytically using the precomputed world space offsets of the camera ray direction per image pixel.
+    * @param i_image_point An image point.
+    * @param i_lens_uv Lens UV coordinates in [0;1]x[0;1].
+    * @param i_dx Offset along X image axis the X differential ray corresponds to.
+    * @param i_dy Offset along Y image axis the Y differential ray corresponds to.
+    * @param[out] o_ray Resulting ray in the world space. The direction components of the base and the differential rays are normalized.
+    * @return The weight of the ray. It corresponds to the value the ray brings to the resulting image.
+    */
+    double GenerateRayDifferential(const Point2D_d &i_image_point, const Point2D_d &i_lens_uv, double i_dx, double i_dy, RayDifferential &o_ray) const;
+
     double GetLensRadius() const;
 
     double GetFocalDistance() const;
 
     double GetXViewAngle() const;
 
+  private:
+    /**
+    * Generates ray in the world space with the direction component not normalized.
+    * The direction is scaled so that the offsets of the direction per image pixel are equal to m_pixel_dx and m_pixel_dy
+    * (multiplied by the focal distance if the lens radius is not zero).
+    */
+    void _GenerateUnnormalizedRay(const Point2D_d &i_image_point, const Point2D_d &i_lens_uv, Ray &o_ray) const;
+
   private:
     double m_lens_radius;
     double m_focal_distance;
@@ -61,6 +81,9 @@ class PerspectiveCamera: public Camera
     double m_x_tan, m_y_tan;
 
     size_t m_film_x_resolution, m_film_y_resolution;
+
+    // World space offsets of the not normalized camera ray direction corresponding to one pixel offset along X and Y image axes.
+    Vector3D_d m_pixel_dx, m_pixel_dy;
   };
 
 #endif // PERSPECTIVE_CAMERA_H
\ No newline at end of file
@@ -13,6 +13,7 @@
 */
 
 #include "Camera.h"
+#include <Math/Constants.h>
 
 Camera::Camera(const Transform &i_camera2world, intrusive_ptr<Film> ip_film):
 m_camera2world(i_camera2world), mp_film(ip_film)
@@ -30,6 +31,24 @@ intrusive_ptr<Film> Camera::GetFilm() const
   return mp_film;
   }
 
+double Camera::GenerateRayDifferential(const Point2D_d &i_image_point, const Point2D_d &i_lens_uv, double i_dx, double i_dy, RayDifferential &o_ray) const
+  {
+  // Compute ray differentials by computing camera rays for adjacent image points.
+  Ray r_dx, r_dy;
+  double weight = GenerateRay(i_image_point, i_lens_uv, o_ray.m_base_ray);
+  double weight_dx = GenerateRay(i_image_point+Point2D_d(i_dx, 0.0), i_lens_uv, r_dx);
+  double weight_dy = GenerateRay(i_image_point+Point2D_d(0.0, i_dy), i_lens_uv, r_dy);
+
+  o_ray.m_has_differentials = weight_dx > DBL_EPS && weight_dy > DBL_EPS;
+
+  o_ray.m_origin_dx=r_dx.m_origin;
+  o_ray.m_origin_dy=r_dy.m_origin;
+  o_ray.m_direction_dx=r_dx.m_direction;
+  o_ray.m_direction_dy=r_dy.m_direction;
+
+  return weight;
+  }
+
 void Camera::_TransformRay(const Ray &i_ray, Ray &o_ray) const
   {
   m_camera2world(i_ray,o_ray);
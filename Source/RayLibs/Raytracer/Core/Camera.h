@@ -21,7 +21,7 @@
 
 /**
 * An abstract class for camera placed in the scene.
-* This is the abstract class, derived classes must implement GenerateRay() method.
+* This is the abstract class, derived classes must implement GenerateRay() method and may override GenerateRayDifferential() method.
 * The camera holds an instance of Film class.
 * @sa Film
 */
@@ -38,6 +38,20 @@ class Camera: public ReferenceCounted
     */
     virtual double GenerateRay(const Point2D_d &i_image_point, const Point2D_d &i_lens_uv, Ray &o_ray) const = 0;
 
+    /**
+    * Generates ray with differentials based on the image point and lens UV coordinates.
+    * The differential rays correspond to the image points shifted by the specified offsets along X and Y image axes and the same lens UV coordinates.
+    * The default implementation calls GenerateRay() three times. Derived classes should override the method if the differentials can be computed analytically.
+    * @param i_image_point An image point.
+    * @param i_lens_uv Lens UV coordinates in [0;1]x[0;1].
+    * @param i_dx Offset along X image axis the X differential ray corresponds to.
+    * @param i_dy Offset along Y image axis the Y differential ray corresponds to.
+    * @param[out] o_ray Resulting ray in the world space. The direction components of the base and the differential rays are normalized.
+    * The m_has_differentials field is set to true only if both differential rays have non-zero weights.
+    * @return The weight of the base ray. It corresponds to the value the ray brings to the resulting image.
+    */
+    virtual double GenerateRayDifferential(const Point2D_d &i_image_point, const Point2D_d &i_lens_uv, double i_dx, double i_dy, RayDifferential &o_ray) const;
+
     /**
     * Returns the transformation object that defines the transformation between the camera space and world space.
     */
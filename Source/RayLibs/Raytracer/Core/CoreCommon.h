@@ -19,6 +19,8 @@
 #include <Common/MemoryPool.h>
 #include <Math/RandomGenerator.h>
 
+struct OccluderHint;
+
 /**
 * This structure encapsulates objects that are passed through the pipeline of the raytracer and which are specific to each thread.
 */
@@ -27,6 +29,9 @@ struct ThreadSpecifics
   MemoryPool *mp_pool;
 
   RandomGenerator<double> *mp_random_generator;
+
+  // Last occluder found by the shadow rays of the thread (see Scene::IntersectTest()). Can be NULL.
+  OccluderHint *mp_occluder_hint;
   };
 
 #endif // CORE_COMMON_H
\ No newline at end of file
@@ -18,7 +18,6 @@
 #include <Math/Geometry.h>
 #include "DifferentialGeometry.h"
 #include "Intersection.h"
-#include <windows.h>
 #include <algorithm>
 
 /**
@@ -53,12 +52,6 @@ namespace CoreUtils
   */
   double GetNextMinT(const Intersection &i_intersection, const Vector3D_d &i_direction);
 
-  /**
-  * Sets priority for the current thread.
-  * @param i_priority Value that defines thread priority. Should be one of THREAD_PRIORITY_xxx constants defined in windows.h
-  * @return Previous priority of the current thread.
-  */
-  int SetCurrentThreadPriority(int i_priority);
   };
 
 /////////////////////////////////////////// IMPLEMENTATION ////////////////////////////////////////////////
@@ -139,7 +132,7 @@ namespace CoreUtils
   inline double GetNextMinT(const Intersection &i_intersection, const Vector3D_d &i_direction)
     {
     ASSERT(i_direction.IsNormalized());
-    Transform world_to_mesh = i_intersection.mp_primitive->GetMeshToWorldTransform().Inverted();
+    const Transform &world_to_mesh = i_intersection.mp_primitive->GetWorldToMeshTransform();
 
     double divisor = world_to_mesh(i_direction)*i_intersection.m_cross;
     if (divisor == 0.0)
@@ -147,14 +140,6 @@ namespace CoreUtils
     else
       return std::max(0.0,(i_intersection.m_dot * (1.0/divisor)) + (1e-14));
     }
-
-  inline int SetCurrentThreadPriority(int i_priority)
-    {
-    const HANDLE h_thread = ::GetCurrentThread();
-    const int prev_priority = ::GetThreadPriority(h_thread);
-    ::SetThreadPriority(h_thread, i_priority);
-    return prev_priority;
-    }
   }
 
 #endif // CORE_UTILS_H
\ No newline at end of file
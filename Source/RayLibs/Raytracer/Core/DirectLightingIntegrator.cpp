@@ -16,10 +16,12 @@
 #include <Raytracer/LightsSamplingStrategies/IrradianceLightsSamplingStrategy.h>
 #include <Math/SamplingRoutines.h>
 #include "CoreUtils.h"
+#include "SpectrumRoutines.h"
 
 DirectLightingIntegrator::DirectLightingIntegrator(intrusive_ptr<const Scene> ip_scene, size_t i_lights_samples_num, size_t i_bsdf_samples_num, double i_media_step_size,
-                                                   intrusive_ptr<const LightsSamplingStrategy> ip_lights_sampling_strategy):
-mp_scene(ip_scene), m_lights_samples_num(i_lights_samples_num), m_bsdf_samples_num(i_bsdf_samples_num), m_media_step_size(i_media_step_size), m_samples_requested(false)
+                                                   intrusive_ptr<const LightsSamplingStrategy> ip_lights_sampling_strategy, size_t i_delta_lights_samples_num):
+mp_scene(ip_scene), m_lights_samples_num(i_lights_samples_num), m_bsdf_samples_num(i_bsdf_samples_num), m_delta_lights_samples_num(i_delta_lights_samples_num),
+m_media_step_size(i_media_step_size), m_samples_requested(false)
   {
   ASSERT(ip_scene);
   ASSERT(i_media_step_size > 0.0);
@@ -48,6 +50,9 @@ void DirectLightingIntegrator::RequestSamples(intrusive_ptr<Sampler> ip_sampler)
   m_bsdf_1D_samples_id = ip_sampler->AddSamplesSequence1D(m_bsdf_samples_num, &m_bsdf_samples_num);
   m_bsdf_2D_samples_id = ip_sampler->AddSamplesSequence2D(m_bsdf_samples_num, &m_bsdf_samples_num);
 
+  if (m_delta_lights_samples_num > 0)
+    m_delta_light_1D_samples_id = ip_sampler->AddSamplesSequence1D(m_delta_lights_samples_num, &m_delta_lights_samples_num);
+
   m_samples_requested = true;
   }
 
@@ -78,41 +83,37 @@ Spectrum_d DirectLightingIntegrator::ComputeDirectLighting(const Intersection &i
   size_t infinity_light_sources_num = light_sources.m_infinite_light_sources.size();
   size_t area_light_sources_num = light_sources.m_area_light_sources.size();
 
-  // Compute direct lighting from delta lights.
-  for(size_t i=0;i<delta_light_sources_num;++i)
-    {
-    Ray lighting_ray;
-    Spectrum_d light = light_sources.m_delta_light_sources[i]->Lighting(i_intersection.m_dg.m_point, lighting_ray);
-    if (light.IsBlack()==false)
-      {
-      SpectrumCoef_d reflectance = ip_bsdf->Evaluate(lighting_ray.m_direction, i_view_direction);
-
-      lighting_ray.m_min_t = CoreUtils::GetNextMinT(i_intersection, lighting_ray.m_direction);
-      if (reflectance.IsBlack()==false && mp_scene->IntersectTest(lighting_ray) == false)
-        {
-        SpectrumCoef_d transmittance = _MediaTransmittance(lighting_ray, i_ts);
-        radiance.AddWeighted(reflectance*light*transmittance, fabs(lighting_ray.m_direction*shading_normal));
-        }
-      }
-    }
-
-  double *lights_CDF = static_cast<double*>(p_pool->Alloc( (infinity_light_sources_num + area_light_sources_num)*sizeof(double) ));
-
+  // Determine the (hemi)sphere to be sampled.
+  LightsSelection selection;
+  selection.m_point = i_intersection.m_dg.m_point;
+  selection.m_entire_sphere = false;
   if (reflection_components_num==0)
-    {
     // The BSDF has only transmission components, so need to sample only lights in the opposite hemisphere.
-    Vector3D_d normal = (i_view_direction*shading_normal <= 0.0) ? shading_normal : shading_normal*(-1.0);
-    mp_lights_sampling_strategy->GetLightsCDF(i_intersection.m_dg.m_point, normal, lights_CDF);
-    }
+    selection.m_normal = (i_view_direction*shading_normal <= 0.0) ? shading_normal : shading_normal*(-1.0);
   else if (transmission_components_num==0)
-    {
     // The BSDF has only reflection components, so need to sample only lights in the same hemisphere.
-    Vector3D_d normal = (i_view_direction*shading_normal >= 0.0) ? shading_normal : shading_normal*(-1.0);
-    mp_lights_sampling_strategy->GetLightsCDF(i_intersection.m_dg.m_point, normal, lights_CDF);
-    }
+    selection.m_normal = (i_view_direction*shading_normal >= 0.0) ? shading_normal : shading_normal*(-1.0);
   else
     // The BSDF has reflection and transmission components, so need to sample lights in both hemispheres.
-    mp_lights_sampling_strategy->GetLightsCDF(i_intersection.m_dg.m_point, lights_CDF);
+    selection.m_entire_sphere = true;
+
+  // The CDF takes time linear in the number of lights to build, so it is only built if the strategy can not sample the lights directly.
+  selection.mp_lights_CDF = NULL;
+  if (mp_lights_sampling_strategy->SamplesLightsDirectly()==false)
+    {
+    double *lights_CDF = static_cast<double*>(p_pool->Alloc( (infinity_light_sources_num + area_light_sources_num)*sizeof(double) ));
+    if (selection.m_entire_sphere)
+      mp_lights_sampling_strategy->GetLightsCDF(selection.m_point, lights_CDF);
+    else
+      mp_lights_sampling_strategy->GetLightsCDF(selection.m_point, selection.m_normal, lights_CDF);
+    selection.mp_lights_CDF = lights_CDF;
+    }
+
+  // Compute direct lighting from delta lights. If there are more delta lights than the samples, the lights are sampled.
+  bool sample_delta_lights = m_delta_lights_samples_num > 0 && delta_light_sources_num > m_delta_lights_samples_num;
+  if (sample_delta_lights==false)
+    for(size_t i=0;i<delta_light_sources_num;++i)
+      radiance += _DeltaLightLighting(i_intersection, i_view_direction, ip_bsdf, i, i_ts);
 
   if (ip_sample)
     {
@@ -127,8 +128,15 @@ Spectrum_d DirectLightingIntegrator::ComputeDirectLighting(const Intersection &i
     ASSERT(std::distance(samples.m_bsdf_1D_samples.m_begin, samples.m_bsdf_1D_samples.m_end) == m_bsdf_samples_num);
     ASSERT(std::distance(samples.m_bsdf_2D_samples.m_begin, samples.m_bsdf_2D_samples.m_end) == m_bsdf_samples_num);
 
-    radiance += _SampleLights(i_intersection, i_view_direction, ip_bsdf, samples, lights_CDF, i_ts);
-    radiance += _SampleBSDF(i_intersection, i_view_direction, ip_bsdf, samples, lights_CDF, i_ts);
+    if (sample_delta_lights)
+      {
+      samples.m_delta_light_1D_samples = ip_sample->GetSamplesSequence1D(m_delta_light_1D_samples_id);
+      ASSERT(std::distance(samples.m_delta_light_1D_samples.m_begin, samples.m_delta_light_1D_samples.m_end) == m_delta_lights_samples_num);
+      radiance += _SampleDeltaLights(i_intersection, i_view_direction, ip_bsdf, samples, selection, i_ts);
+      }
+
+    radiance += _SampleLights(i_intersection, i_view_direction, ip_bsdf, samples, selection, i_ts);
+    radiance += _SampleBSDF(i_intersection, i_view_direction, ip_bsdf, samples, selection, i_ts);
     }
   else
     {
@@ -148,15 +156,85 @@ Spectrum_d DirectLightingIntegrator::ComputeDirectLighting(const Intersection &i
     SamplingRoutines::LatinHypercubeSampling2D(samples.m_light_2D_samples.m_begin, m_lights_samples_num, true, p_rng);
     SamplingRoutines::LatinHypercubeSampling2D(samples.m_bsdf_2D_samples.m_begin,  m_bsdf_samples_num,   true, p_rng);
 
-    radiance += _SampleLights(i_intersection, i_view_direction, ip_bsdf, samples, lights_CDF, i_ts);
-    radiance += _SampleBSDF(i_intersection, i_view_direction, ip_bsdf, samples, lights_CDF, i_ts);
+    if (sample_delta_lights)
+      {
+      double *delta_samples_1D = (double *)p_pool->Alloc( m_delta_lights_samples_num * sizeof(double) );
+      samples.m_delta_light_1D_samples=SamplesSequence1D(delta_samples_1D, delta_samples_1D+m_delta_lights_samples_num);
+      SamplingRoutines::StratifiedSampling1D(samples.m_delta_light_1D_samples.m_begin, m_delta_lights_samples_num, true, p_rng);
+      radiance += _SampleDeltaLights(i_intersection, i_view_direction, ip_bsdf, samples, selection, i_ts);
+      }
+
+    radiance += _SampleLights(i_intersection, i_view_direction, ip_bsdf, samples, selection, i_ts);
+    radiance += _SampleBSDF(i_intersection, i_view_direction, ip_bsdf, samples, selection, i_ts);
     }
 
   return radiance;
   }
 
+Spectrum_d DirectLightingIntegrator::_DeltaLightLighting(const Intersection &i_intersection, const Vector3D_d &i_view_direction,
+                                                        const BSDF *ip_bsdf, size_t i_light_index, ThreadSpecifics i_ts) const
+  {
+  Ray lighting_ray;
+  Spectrum_d light = mp_scene->GetLightSources().m_delta_light_sources[i_light_index]->Lighting(i_intersection.m_dg.m_point, lighting_ray);
+  if (light.IsBlack())
+    return Spectrum_d();
+
+  SpectrumCoef_d reflectance = ip_bsdf->Evaluate(lighting_ray.m_direction, i_view_direction);
+
+  lighting_ray.m_min_t = CoreUtils::GetNextMinT(i_intersection, lighting_ray.m_direction);
+  if (reflectance.IsBlack() || mp_scene->IntersectTest(lighting_ray, i_ts.mp_occluder_hint))
+    return Spectrum_d();
+
+  SpectrumCoef_d transmittance = _MediaTransmittance(lighting_ray, i_ts);
+  return (reflectance*light*transmittance) * fabs(lighting_ray.m_direction*ip_bsdf->GetShadingNormal());
+  }
+
+Spectrum_d DirectLightingIntegrator::_SampleDeltaLights(const Intersection &i_intersection, const Vector3D_d &i_view_direction,
+                                                        const BSDF *ip_bsdf, const DirectLightingSamples &i_samples, const LightsSelection &i_selection, ThreadSpecifics i_ts) const
+  {
+  ASSERT(i_ts.mp_pool);
+  const LightSources &light_sources = mp_scene->GetLightSources();
+  size_t delta_light_sources_num = light_sources.m_delta_light_sources.size();
+  if (m_delta_lights_samples_num==0 || delta_light_sources_num==0)
+    return Spectrum_d();
+
+  // Evaluating the lighting without the shadow rays is cheap so the CDF is built from the exact unoccluded lighting.
+  double *delta_lights_CDF = static_cast<double*>(i_ts.mp_pool->Alloc( delta_light_sources_num*sizeof(double) ));
+  for(size_t i=0;i<delta_light_sources_num;++i)
+    {
+    Ray lighting_ray;
+    double weight = SpectrumRoutines::Luminance(light_sources.m_delta_light_sources[i]->Lighting(i_selection.m_point, lighting_ray));
+    if (i_selection.m_entire_sphere==false)
+      weight *= std::max(0.0, lighting_ray.m_direction*i_selection.m_normal);
+
+    delta_lights_CDF[i] = (i>0 ? delta_lights_CDF[i-1] : 0.0) + weight;
+    }
+
+  // No delta light can contribute to the lighting.
+  if (delta_lights_CDF[delta_light_sources_num-1] <= 0.0)
+    return Spectrum_d();
+
+  double inv_total = 1.0/delta_lights_CDF[delta_light_sources_num-1];
+  for(size_t i=0;i<delta_light_sources_num;++i)
+    delta_lights_CDF[i] *= inv_total;
+
+  Spectrum_d radiance;
+  SamplesSequence1D::Iterator light_iterator = i_samples.m_delta_light_1D_samples.m_begin;
+  for(size_t i=0;i<m_delta_lights_samples_num;++i)
+    {
+    double light_pdf;
+    size_t sampled_index = MathRoutines::BinarySearchCDF(delta_lights_CDF, delta_lights_CDF+delta_light_sources_num, *light_iterator, &light_pdf) - delta_lights_CDF;
+    ASSERT(sampled_index<delta_light_sources_num && light_pdf>0.0);
+
+    radiance.AddWeighted(_DeltaLightLighting(i_intersection, i_view_direction, ip_bsdf, sampled_index, i_ts), 1.0/light_pdf);
+    ++light_iterator;
+    }
+
+  return radiance / (double)m_delta_lights_samples_num;
+  }
+
 Spectrum_d DirectLightingIntegrator::_SampleLights(const Intersection &i_intersection, const Vector3D_d &i_view_direction,
-                                                   const BSDF *ip_bsdf, const DirectLightingSamples &i_samples, double *ip_lights_CDF, ThreadSpecifics i_ts) const
+                                                   const BSDF *ip_bsdf, const DirectLightingSamples &i_samples, const LightsSelection &i_selection, ThreadSpecifics i_ts) const
   {
   Spectrum_d radiance;
 
@@ -168,20 +246,7 @@ Spectrum_d DirectLightingIntegrator::_SampleLights(const Intersection &i_interse
     return Spectrum_d();
 
   Vector3D_d shading_normal = ip_bsdf->GetShadingNormal();
-  double inv_infinity_lights_probability = infinity_light_sources_num>0 ? 1.0/ip_lights_CDF[infinity_light_sources_num-1] : 0.0;
-
-  // Determine the (hemi)sphere to be sampled.
-  Vector3D_d normal;
-  bool sample_entire_sphere = false;
-  if (ip_bsdf->GetComponentsNum( BxDFType(BSDF_DIFFUSE | BSDF_GLOSSY | BSDF_REFLECTION) )==0)
-    // The BSDF has only transmission components, so need to sample only lights in the opposite hemisphere.
-    normal = (i_view_direction*shading_normal <= 0.0) ? shading_normal : shading_normal*(-1.0);
-  else if (ip_bsdf->GetComponentsNum( BxDFType(BSDF_DIFFUSE | BSDF_GLOSSY | BSDF_TRANSMISSION) )==0)
-    // The BSDF has only reflection components, so need to sample only lights in the same hemisphere.
-    normal = (i_view_direction*shading_normal >= 0.0) ? shading_normal : shading_normal*(-1.0);
-  else
-    // The BSDF has reflection and transmission components, so need to sample lights in both hemispheres.
-    sample_entire_sphere = true;
+  double inv_infinity_lights_probability = infinity_light_sources_num>0 ? 1.0/_GetInfinityLightsProbability(i_selection) : 0.0;
 
   Ray lighting_ray;
   SamplesSequence1D::Iterator component_iterator = i_samples.m_light_1D_samples.m_begin;
@@ -191,9 +256,8 @@ Spectrum_d DirectLightingIntegrator::_SampleLights(const Intersection &i_interse
     double component_sample = *component_iterator;
     Point2D_d position_sample = *position_iterator;
 
-    // Binary search for the sampled light source.
-    double light_component_pdf;
-    size_t sampled_index = MathRoutines::BinarySearchCDF(ip_lights_CDF, ip_lights_CDF+light_sources_num, component_sample, &light_component_pdf) - ip_lights_CDF;
+    double light_component_pdf, triangle_sample;
+    size_t sampled_index = _SelectLight(i_selection, component_sample, light_component_pdf, triangle_sample);
     ASSERT(sampled_index<light_sources_num);
 
     if (sampled_index<infinity_light_sources_num)
@@ -201,8 +265,8 @@ Spectrum_d DirectLightingIntegrator::_SampleLights(const Intersection &i_interse
       // If infinity light is sampled.
       double light_pdf=0.0;
       Vector3D_d sampled_direction;
-      Spectrum_d light = sample_entire_sphere ? light_sources.m_infinite_light_sources[sampled_index]->SampleLighting(position_sample, sampled_direction, light_pdf) :
-        light_sources.m_infinite_light_sources[sampled_index]->SampleLighting(normal, position_sample, sampled_direction, light_pdf);
+      Spectrum_d light = i_selection.m_entire_sphere ? light_sources.m_infinite_light_sources[sampled_index]->SampleLighting(position_sample, sampled_direction, light_pdf) :
+        light_sources.m_infinite_light_sources[sampled_index]->SampleLighting(i_selection.m_normal, position_sample, sampled_direction, light_pdf);
       lighting_ray = Ray(i_intersection.m_dg.m_point, sampled_direction);
 
       if (light_pdf>0.0 && light.IsBlack()==false)
@@ -210,7 +274,7 @@ Spectrum_d DirectLightingIntegrator::_SampleLights(const Intersection &i_interse
         light *= ip_bsdf->Evaluate(i_view_direction, lighting_ray.m_direction);
         lighting_ray.m_min_t = CoreUtils::GetNextMinT(i_intersection, lighting_ray.m_direction);
 
-        if (light.IsBlack() == false && mp_scene->IntersectTest(lighting_ray) == false)
+        if (light.IsBlack() == false && mp_scene->IntersectTest(lighting_ray, i_ts.mp_occluder_hint) == false)
           {
           double bsdf_pdf = ip_bsdf->PDF(i_view_direction, lighting_ray.m_direction);
 
@@ -226,7 +290,6 @@ Spectrum_d DirectLightingIntegrator::_SampleLights(const Intersection &i_interse
       {
       // If area light is sampled.
       double light_pdf=0.0;
-      double triangle_sample = (sampled_index==0 ? component_sample : component_sample-ip_lights_CDF[sampled_index-1]) / light_component_pdf;
       Spectrum_d light = light_sources.m_area_light_sources[sampled_index-infinity_light_sources_num]->SampleLighting(i_intersection.m_dg.m_point, triangle_sample,
         position_sample, lighting_ray, light_pdf);
 
@@ -236,7 +299,7 @@ Spectrum_d DirectLightingIntegrator::_SampleLights(const Intersection &i_interse
         lighting_ray.m_min_t = CoreUtils::GetNextMinT(i_intersection, lighting_ray.m_direction);
         lighting_ray.m_max_t -= (1e-4); // To avoid intersection with the area light.
 
-        if (light.IsBlack() == false && mp_scene->IntersectTest(lighting_ray) == false)
+        if (light.IsBlack() == false && mp_scene->IntersectTest(lighting_ray, i_ts.mp_occluder_hint) == false)
           {
           double bsdf_pdf = ip_bsdf->PDF(i_view_direction, lighting_ray.m_direction);
 
@@ -262,7 +325,7 @@ Spectrum_d DirectLightingIntegrator::_SampleLights(const Intersection &i_interse
   }
 
 Spectrum_d DirectLightingIntegrator::_SampleBSDF(const Intersection &i_intersection, const Vector3D_d &i_view_direction,
-                                                   const BSDF *ip_bsdf, const DirectLightingSamples &i_samples, double *ip_lights_CDF, ThreadSpecifics i_ts) const
+                                                   const BSDF *ip_bsdf, const DirectLightingSamples &i_samples, const LightsSelection &i_selection, ThreadSpecifics i_ts) const
   {
   ASSERT(i_ts.mp_pool && i_ts.mp_random_generator);
   RandomGenerator<double> *p_rng = i_ts.mp_random_generator;
@@ -277,21 +340,8 @@ Spectrum_d DirectLightingIntegrator::_SampleBSDF(const Intersection &i_intersect
     return Spectrum_d();
 
   Vector3D_d shading_normal = ip_bsdf->GetShadingNormal();
-  double infinity_lights_probability = infinity_light_sources_num>0 ? ip_lights_CDF[infinity_light_sources_num-1] : 0.0;
-  double inv_infinity_lights_probability = infinity_light_sources_num>0 ? 1.0/ip_lights_CDF[infinity_light_sources_num-1] : 0.0;
-
-  // Determine the (hemi)sphere to be sampled.
-  Vector3D_d normal;
-  bool sample_entire_sphere = false;
-  if (ip_bsdf->GetComponentsNum( BxDFType(BSDF_DIFFUSE | BSDF_GLOSSY | BSDF_REFLECTION) )==0)
-    // The BSDF has only transmission components, so need to sample only lights in the opposite hemisphere.
-    normal = (i_view_direction*shading_normal <= 0.0) ? shading_normal : shading_normal*(-1.0);
-  else if (ip_bsdf->GetComponentsNum( BxDFType(BSDF_DIFFUSE | BSDF_GLOSSY | BSDF_TRANSMISSION) )==0)
-    // The BSDF has only reflection components, so need to sample only lights in the same hemisphere.
-    normal = (i_view_direction*shading_normal >= 0.0) ? shading_normal : shading_normal*(-1.0);
-  else
-    // The BSDF has reflection and transmission components, so need to sample lights in both hemispheres.
-    sample_entire_sphere = true;
+  double infinity_lights_probability = infinity_light_sources_num>0 ? _GetInfinityLightsProbability(i_selection) : 0.0;
+  double inv_infinity_lights_probability = infinity_light_sources_num>0 ? 1.0/infinity_lights_probability : 0.0;
 
   SamplesSequence1D::Iterator component_iterator = i_samples.m_bsdf_1D_samples.m_begin;
   SamplesSequence2D::Iterator bxdf_iterator = i_samples.m_bsdf_2D_samples.m_begin;
@@ -323,7 +373,7 @@ Spectrum_d DirectLightingIntegrator::_SampleBSDF(const Intersection &i_intersect
             {
             double light_pdf = p_area_light->LightingPDF(lighting_ray, isect.m_triangle_index);
             size_t light_index = _GetAreaLightIndex(p_area_light) + infinity_light_sources_num;
-            double light_component_pdf = light_index==0 ? ip_lights_CDF[0] : ip_lights_CDF[light_index]-ip_lights_CDF[light_index-1];
+            double light_component_pdf = _LightSelectionPDF(i_selection, light_index);
 
             // Compute weighting coefficient for the multiple importance sampling.
             double weight = SamplingRoutines::PowerHeuristic(m_bsdf_samples_num, bsdf_pdf, m_lights_samples_num, light_pdf*light_component_pdf);
@@ -334,11 +384,11 @@ Spectrum_d DirectLightingIntegrator::_SampleBSDF(const Intersection &i_intersect
         }
       else
         {
-        if (infinity_light_sources_num > 0)
+        if (infinity_lights_probability > 0.0)
           {
-          // Select a random infinity light based on the CDF.
+          // Select a random infinity light based on the lights selection probabilities.
           double light_component_pdf;
-          size_t sampled_index = MathRoutines::BinarySearchCDF(ip_lights_CDF, ip_lights_CDF+infinity_light_sources_num, (*p_rng)(infinity_lights_probability), &light_component_pdf) - ip_lights_CDF;
+          size_t sampled_index = _SelectInfinityLight(i_selection, (*p_rng)(infinity_lights_probability), light_component_pdf);
           ASSERT(sampled_index<infinity_light_sources_num);
           bsdf_pdf *= light_component_pdf*inv_infinity_lights_probability;
           ASSERT(bsdf_pdf > 0.0);
@@ -346,8 +396,8 @@ Spectrum_d DirectLightingIntegrator::_SampleBSDF(const Intersection &i_intersect
           Spectrum_d light = light_sources.m_infinite_light_sources[sampled_index]->Radiance(RayDifferential(lighting_ray));
           if (light.IsBlack()==false)
             {
-            double light_pdf = sample_entire_sphere ? light_sources.m_infinite_light_sources[sampled_index]->LightingPDF(lighting_direction) : 
-              light_sources.m_infinite_light_sources[sampled_index]->LightingPDF(normal, lighting_direction);
+            double light_pdf = i_selection.m_entire_sphere ? light_sources.m_infinite_light_sources[sampled_index]->LightingPDF(lighting_direction) : 
+              light_sources.m_infinite_light_sources[sampled_index]->LightingPDF(i_selection.m_normal, lighting_direction);
 
             // Compute weighting coefficient for the multiple importance sampling.
             double weight = SamplingRoutines::PowerHeuristic(m_bsdf_samples_num, bsdf_pdf, m_lights_samples_num, light_component_pdf*light_pdf);
@@ -365,6 +415,84 @@ Spectrum_d DirectLightingIntegrator::_SampleBSDF(const Intersection &i_intersect
   return radiance / (double)m_bsdf_samples_num;
   }
 
+size_t DirectLightingIntegrator::_SelectLight(const LightsSelection &i_selection, double i_sample, double &o_pdf, double &o_remapped_sample) const
+  {
+  if (i_selection.mp_lights_CDF)
+    {
+    // Binary search for the sampled light source.
+    const LightSources &light_sources = mp_scene->GetLightSources();
+    size_t light_sources_num = light_sources.m_infinite_light_sources.size() + light_sources.m_area_light_sources.size();
+
+    const double *p_CDF = i_selection.mp_lights_CDF;
+    size_t index = MathRoutines::BinarySearchCDF(p_CDF, p_CDF+light_sources_num, i_sample, &o_pdf) - p_CDF;
+    o_remapped_sample = (index==0 ? i_sample : i_sample-p_CDF[index-1]) / o_pdf;
+    return index;
+    }
+
+  if (i_selection.m_entire_sphere)
+    return mp_lights_sampling_strategy->SampleLight(i_selection.m_point, i_sample, o_pdf, o_remapped_sample);
+  else
+    return mp_lights_sampling_strategy->SampleLight(i_selection.m_point, i_selection.m_normal, i_sample, o_pdf, o_remapped_sample);
+  }
+
+double DirectLightingIntegrator::_LightSelectionPDF(const LightsSelection &i_selection, size_t i_light_index) const
+  {
+  if (i_selection.mp_lights_CDF)
+    return i_light_index==0 ? i_selection.mp_lights_CDF[0] : i_selection.mp_lights_CDF[i_light_index]-i_selection.mp_lights_CDF[i_light_index-1];
+
+  if (i_selection.m_entire_sphere)
+    return mp_lights_sampling_strategy->LightPDF(i_selection.m_point, i_light_index);
+  else
+    return mp_lights_sampling_strategy->LightPDF(i_selection.m_point, i_selection.m_normal, i_light_index);
+  }
+
+double DirectLightingIntegrator::_GetInfinityLightsProbability(const LightsSelection &i_selection) const
+  {
+  size_t infinity_light_sources_num = mp_scene->GetLightSources().m_infinite_light_sources.size();
+  if (infinity_light_sources_num==0)
+    return 0.0;
+
+  if (i_selection.mp_lights_CDF)
+    return i_selection.mp_lights_CDF[infinity_light_sources_num-1];
+
+  double probability = 0.0;
+  for(size_t i=0;i<infinity_light_sources_num;++i)
+    probability += _LightSelectionPDF(i_selection, i);
+  return probability;
+  }
+
+size_t DirectLightingIntegrator::_SelectInfinityLight(const LightsSelection &i_selection, double i_sample, double &o_pdf) const
+  {
+  size_t infinity_light_sources_num = mp_scene->GetLightSources().m_infinite_light_sources.size();
+  ASSERT(infinity_light_sources_num > 0);
+
+  if (i_selection.mp_lights_CDF)
+    {
+    const double *p_CDF = i_selection.mp_lights_CDF;
+    return MathRoutines::BinarySearchCDF(p_CDF, p_CDF+infinity_light_sources_num, i_sample, &o_pdf) - p_CDF;
+    }
+
+  // There are usually only a few infinity lights so the linear search is fine here.
+  double cumulative = 0.0;
+  size_t last_positive = 0;
+  o_pdf = 0.0;
+  for(size_t i=0;i<infinity_light_sources_num;++i)
+    {
+    double pdf = _LightSelectionPDF(i_selection, i);
+    if (pdf <= 0.0)
+      continue;
+
+    last_positive = i;
+    o_pdf = pdf;
+    if (i_sample < cumulative+pdf)
+      return i;
+    cumulative += pdf;
+    }
+
+  // Can only get here due to the rounding errors.
+  return last_positive;
+  }
+
 size_t DirectLightingIntegrator::_GetAreaLightIndex(const AreaLightSource *ip_area_light) const
   {
   if (m_area_lights_sorted.empty())
@@ -393,6 +521,5 @@ SpectrumCoef_d DirectLightingIntegrator::_MediaTransmittance(const Ray &i_ray, T
   if (p_volume==NULL)
     return SpectrumCoef_d(1.0);
 
-  SpectrumCoef_d opt_thickness = p_volume->OpticalThickness(i_ray, m_media_step_size, (*i_ts.mp_random_generator)(1.0));
-  return Exp(-1.0*opt_thickness);
+  return p_volume->Transmittance(i_ray, m_media_step_size, *i_ts.mp_random_generator);
   }
\ No newline at end of file
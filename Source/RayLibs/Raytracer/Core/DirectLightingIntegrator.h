@@ -32,11 +32,14 @@
 * The direct illumination is computed by sampling all scene lights and BSDF specified number of times.
 * Multiple importance sampling is used to sample the integral with different PDFs.
 * The class uses pluggable LightsSamplingStrategy implementation which defines the probability for each light to be sampled.
+* By default every delta light is evaluated with its own shadow ray. Optionally, a fixed number of delta lights can be sampled instead
+* with the probabilities proportional to their unoccluded lighting at the surface point so that the cost does not grow with the number of delta lights.
 */
 class DirectLightingIntegrator: public ReferenceCounted
   {
   private:
     struct DirectLightingSamples;
+    struct LightsSelection;
 
   public:
     /**
@@ -48,9 +51,11 @@ class DirectLightingIntegrator: public ReferenceCounted
     * @param i_bsdf_samples_num Number of BSDF samples. Should be equal or greater than zero.
     * @param i_media_step_size Step size to be used for participating media integration. Should be greater than 0.0
     * @param ip_lights_sampling_strategy Light sampling strategy implementation. If NULL, the default irradiance-based implementation will be used.
+    * @param i_delta_lights_samples_num Number of delta lights samples. If 0 (default) or if there are not more delta lights in the scene than the samples,
+    * all delta lights are evaluated. Otherwise the specified number of delta lights is sampled at each surface point.
     */
     DirectLightingIntegrator(intrusive_ptr<const Scene> ip_scene, size_t i_lights_samples_num, size_t i_bsdf_samples_num, double i_media_step_size,
-      intrusive_ptr<const LightsSamplingStrategy> ip_lights_sampling_strategy = NULL);
+      intrusive_ptr<const LightsSamplingStrategy> ip_lights_sampling_strategy = NULL, size_t i_delta_lights_samples_num = 0);
 
     /**
     * Requests 1D and 2D samples sequences needed for the direct lighting integrator.
@@ -76,17 +81,55 @@ class DirectLightingIntegrator: public ReferenceCounted
     DirectLightingIntegrator(const DirectLightingIntegrator&);
     DirectLightingIntegrator &operator=(const DirectLightingIntegrator&); 
 
+    /**
+    * Helper private method that computes direct lighting from the specified delta light.
+    */
+    Spectrum_d _DeltaLightLighting(const Intersection &i_intersection, const Vector3D_d &i_view_direction,
+      const BSDF *ip_bsdf, size_t i_light_index, ThreadSpecifics i_ts) const;
+
+    /**
+    * Helper private method that estimates direct lighting by sampling delta lights.
+    * The lights are sampled with the probabilities proportional to the luminance of their unoccluded lighting (weighted by the cosine term if only one hemisphere is sampled).
+    */
+    Spectrum_d _SampleDeltaLights(const Intersection &i_intersection, const Vector3D_d &i_view_direction,
+      const BSDF *ip_bsdf, const DirectLightingSamples &i_samples, const LightsSelection &i_selection, ThreadSpecifics i_ts) const;
+
     /**
     * Helper private method that estimates direct lighting by sampling infinite and area lights.
     */
     Spectrum_d _SampleLights(const Intersection &i_intersection, const Vector3D_d &i_view_direction,
-      const BSDF *ip_bsdf, const DirectLightingSamples &i_samples, double *ip_lights_CDF, ThreadSpecifics i_ts) const;
+      const BSDF *ip_bsdf, const DirectLightingSamples &i_samples, const LightsSelection &i_selection, ThreadSpecifics i_ts) const;
 
     /**
     * Helper private method that estimates direct lighting by sampling the BSDF.
     */
     Spectrum_d _SampleBSDF(const Intersection &i_intersection, const Vector3D_d &i_view_direction,
-      const BSDF *ip_bsdf, const DirectLightingSamples &i_samples, double *ip_lights_CDF, ThreadSpecifics i_ts) const;
+      const BSDF *ip_bsdf, const DirectLightingSamples &i_samples, const LightsSelection &i_selection, ThreadSpecifics i_ts) const;
+
+    /**
+    * Samples one of the infinity and area lights either with the lights CDF or directly with the LightsSamplingStrategy.
+    * Returns index of the light with the infinity lights going first. The sample is remapped to [0;1) range to be reused for sampling the light itself.
+    */
+    size_t _SelectLight(const LightsSelection &i_selection, double i_sample, double &o_pdf, double &o_remapped_sample) const;
+
+    /**
+    * Returns probability of the specified light to be selected by _SelectLight() method.
+    */
+    double _LightSelectionPDF(const LightsSelection &i_selection, size_t i_light_index) const;
+
+    /**
+    * Returns the total probability of the infinity lights to be selected by _SelectLight() method.
+    */
+    double _GetInfinityLightsProbability(const LightsSelection &i_selection) const;
+
+    /**
+    * Selects one of the infinity lights with the probability proportional to its probability to be selected by _SelectLight() method.
+    * @param i_selection Lights selection.
+    * @param i_sample Sample value in [0;P) range, where P is the value returned by _GetInfinityLightsProbability() method.
+    * @param[out] o_pdf Probability of the light to be selected by _SelectLight() method.
+    * @return Index of the infinity light.
+    */
+    size_t _SelectInfinityLight(const LightsSelection &i_selection, double i_sample, double &o_pdf) const;
 
     /**
     * Returns the index of the specified area light in the LightSources::m_area_light_sources vector returned by the Scene.
@@ -108,21 +151,37 @@ class DirectLightingIntegrator: public ReferenceCounted
     */
     struct DirectLightingSamples
       {
-      SamplesSequence1D m_light_1D_samples, m_bsdf_1D_samples;
+      SamplesSequence1D m_light_1D_samples, m_bsdf_1D_samples, m_delta_light_1D_samples;
       SamplesSequence2D m_light_2D_samples, m_bsdf_2D_samples;
       };
 
+    /**
+    * Internal structure defining how the lights are selected at the surface point.
+    * Created in ComputeDirectLighting() method and passed to _SampleLights() and _SampleBSDF() methods.
+    */
+    struct LightsSelection
+      {
+      Point3D_d m_point;
+
+      // The normal defining the hemisphere to sample the lights in. Only used if m_entire_sphere is false.
+      Vector3D_d m_normal;
+      bool m_entire_sphere;
+
+      // CDF for the infinity and area lights. NULL if the LightsSamplingStrategy samples the lights directly.
+      const double *mp_lights_CDF;
+      };
+
   private:
     intrusive_ptr<const Scene> mp_scene;
 
-    size_t m_lights_samples_num, m_bsdf_samples_num;
+    size_t m_lights_samples_num, m_bsdf_samples_num, m_delta_lights_samples_num;
     double m_media_step_size;
 
     intrusive_ptr<const LightsSamplingStrategy> mp_lights_sampling_strategy;
     std::vector<std::pair<const AreaLightSource *,size_t>> m_area_lights_sorted;
 
     // IDs of the samples sequences returned by the Sampler.
-    size_t m_light_1D_samples_id, m_light_2D_samples_id, m_bsdf_1D_samples_id, m_bsdf_2D_samples_id;
+    size_t m_light_1D_samples_id, m_light_2D_samples_id, m_bsdf_1D_samples_id, m_bsdf_2D_samples_id, m_delta_light_1D_samples_id;
 
     /**
     * True if the samples have been already requested. Used for asserts only.
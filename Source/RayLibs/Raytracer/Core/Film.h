@@ -19,6 +19,7 @@
 #include <Math/Point2D.h>
 #include <Math/Constants.h>
 #include "Spectrum.h"
+#include <vector>
 
 /**
 * An abstract class defining the contract for camera's film.
@@ -58,6 +59,18 @@ class Film: public ReferenceCounted
     */
     virtual bool GetPixel(const Point2D_i &i_image_point, Spectrum_d &o_spectrum,  bool i_clamp_values = true) const = 0;
 
+    /**
+    * Gets the Spectrum values for the specified rectangular region of pixels.
+    * The values are written to the contiguous buffer row by row, three float components per pixel. The pixels for which GetPixel() method fails are set to zero.
+    * The default implementation calls GetPixel() method for each pixel, derived classes may override it with a faster implementation.
+    * @param i_begin Left lower corner of the region. Should be in [0;GetXResolution()] x [0;GetYResolution()] range.
+    * @param i_end Right upper corner of the region (exclusive). Should be in [0;GetXResolution()] x [0;GetYResolution()] range. Should be higher or equal than i_begin in both dimensions.
+    * @param[out] o_values Buffer for the Spectrum values. The buffer is resized to the number of the region's pixels multiplied by three.
+    * @param i_clamp_values If true, the Spectrum values will be clamped before returning.
+    * @return Number of pixels whose values were computed successfully.
+    */
+    virtual size_t GetPixels(const Point2D_i &i_begin, const Point2D_i &i_end, std::vector<float> &o_values, bool i_clamp_values = true) const;
+
     /**
     * Returns the window in the image plane where samples need to be generated.
     * The window may differ from the actual film resolution (e.g. due to filtering sampling values).
@@ -103,4 +116,29 @@ inline size_t Film::GetYResolution() const
   return m_y_resolution;
   }
 
+inline size_t Film::GetPixels(const Point2D_i &i_begin, const Point2D_i &i_end, std::vector<float> &o_values, bool i_clamp_values) const
+  {
+  ASSERT(i_begin[0]>=0 && i_begin[1]>=0 && i_end[0]<=(int)m_x_resolution && i_end[1]<=(int)m_y_resolution);
+  ASSERT(i_begin[0]<=i_end[0] && i_begin[1]<=i_end[1]);
+
+  o_values.resize((size_t)(i_end[0]-i_begin[0])*(i_end[1]-i_begin[1])*3);
+
+  size_t pixels_read = 0;
+  float *p_value = o_values.empty() ? NULL : &o_values[0];
+  for(int y=i_begin[1];y<i_end[1];++y)
+    for(int x=i_begin[0];x<i_end[0];++x, p_value+=3)
+      {
+      Spectrum_d spectrum;
+      if (GetPixel(Point2D_i(x,y), spectrum, i_clamp_values))
+        {
+        p_value[0]=(float)spectrum[0]; p_value[1]=(float)spectrum[1]; p_value[2]=(float)spectrum[2];
+        ++pixels_read;
+        }
+      else
+        p_value[0]=p_value[1]=p_value[2]=0.f;
+      }
+
+  return pixels_read;
+  }
+
 #endif // FILM_H
\ No newline at end of file
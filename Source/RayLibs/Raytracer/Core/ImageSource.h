@@ -17,6 +17,7 @@
 
 #include <Common/Common.h>
 #include <vector>
+#include <algorithm>
 
 /**
 * An abstract class defining the contract for getting 2D array of values.
@@ -34,6 +35,17 @@ class ImageSource: public ReferenceCounted
     */
     virtual std::vector<std::vector<T>> GetImage() const = 0;
 
+    /**
+    * Gets the values of the specified rectangular region of the image. The values are written row by row.
+    * The default implementation calls GetImage() method and copies the region, implementations should override it to avoid converting the whole image.
+    * @param i_begin_x Left column of the region. Should be less than i_end_x.
+    * @param i_begin_y Top row of the region. Should be less than i_end_y.
+    * @param i_end_x Right column of the region (exclusive). Should be less or equal than the image width.
+    * @param i_end_y Bottom row of the region (exclusive). Should be less or equal than the image height.
+    * @param[out] o_values Values of the region. The vector is resized to the number of the region's values.
+    */
+    virtual void GetRegion(size_t i_begin_x, size_t i_begin_y, size_t i_end_x, size_t i_end_y, std::vector<T> &o_values) const;
+
     /**
     * Returns height of the image, i.e. the size of the outer vector which defines the image.
     */
@@ -68,4 +80,18 @@ ImageSource<T>::~ImageSource()
   {
   }
 
+template <typename T>
+void ImageSource<T>::GetRegion(size_t i_begin_x, size_t i_begin_y, size_t i_end_x, size_t i_end_y, std::vector<T> &o_values) const
+  {
+  ASSERT(i_begin_x<i_end_x && i_end_x<=GetWidth());
+  ASSERT(i_begin_y<i_end_y && i_end_y<=GetHeight());
+
+  std::vector<std::vector<T>> image = GetImage();
+  o_values.resize((i_end_x-i_begin_x)*(i_end_y-i_begin_y));
+
+  typename std::vector<T>::iterator it = o_values.begin();
+  for(size_t y=i_begin_y;y<i_end_y;++y)
+    it = std::copy(image[y].begin()+i_begin_x, image[y].begin()+i_end_x, it);
+  }
+
 #endif // IMAGE_SOURCE_H
\ No newline at end of file
@@ -474,7 +474,7 @@ void KDTree<TPoint3D>::_Build(size_t i_begin, size_t i_end)
 
 template<typename TPoint3D>
 template<typename LookupProc>
-void KDTree<TPoint3D>::Lookup(const Point3D_d &i_point, LookupProc &i_proc, double i_max_distance = DBL_INF) const
+void KDTree<TPoint3D>::Lookup(const Point3D_d &i_point, LookupProc &i_proc, double i_max_distance) const
   {
   ASSERT(i_max_distance>=0);
   double max_dist_sqr = i_max_distance*i_max_distance;
@@ -482,7 +482,7 @@ void KDTree<TPoint3D>::Lookup(const Point3D_d &i_point, LookupProc &i_proc, doub
   }
 
 template<typename TPoint3D>
-const TPoint3D *KDTree<TPoint3D>::GetNearestPoint(const Point3D_d &i_point, double i_max_distance = DBL_INF) const
+const TPoint3D *KDTree<TPoint3D>::GetNearestPoint(const Point3D_d &i_point, double i_max_distance) const
   {
   ASSERT(i_max_distance>=0);
 
@@ -494,7 +494,7 @@ const TPoint3D *KDTree<TPoint3D>::GetNearestPoint(const Point3D_d &i_point, doub
 
 template<typename TPoint3D>
 template<typename PointsFilter>
-const TPoint3D *KDTree<TPoint3D>::GetNearestPoint(const Point3D_d &i_point, const PointsFilter &i_filter, double i_max_distance = DBL_INF) const
+const TPoint3D *KDTree<TPoint3D>::GetNearestPoint(const Point3D_d &i_point, const PointsFilter &i_filter, double i_max_distance) const
   {
   ASSERT(i_max_distance>=0);
   NearestPointProc<PointsFilter> proc(i_filter);
@@ -504,7 +504,7 @@ const TPoint3D *KDTree<TPoint3D>::GetNearestPoint(const Point3D_d &i_point, cons
 
 template<typename TPoint3D>
 size_t KDTree<TPoint3D>::GetNearestPoints(const Point3D_d &i_point, size_t i_points_to_lookup,
-                                        NearestPoint *op_nearest_points, double i_max_distance = DBL_INF) const
+                                        NearestPoint *op_nearest_points, double i_max_distance) const
   {
   ASSERT(i_max_distance>=0);
   ASSERT(op_nearest_points);
@@ -519,7 +519,7 @@ size_t KDTree<TPoint3D>::GetNearestPoints(const Point3D_d &i_point, size_t i_poi
 
 template<typename TPoint3D>
 template<typename PointsFilter>
-size_t KDTree<TPoint3D>::GetNearestPoints(const Point3D_d &i_point, size_t i_points_to_lookup, NearestPoint *op_nearest_points, const PointsFilter &i_filter, double i_max_distance = DBL_INF) const
+size_t KDTree<TPoint3D>::GetNearestPoints(const Point3D_d &i_point, size_t i_points_to_lookup, NearestPoint *op_nearest_points, const PointsFilter &i_filter, double i_max_distance) const
   {
   ASSERT(i_max_distance>=0);
   ASSERT(op_nearest_points);
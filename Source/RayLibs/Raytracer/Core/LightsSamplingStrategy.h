@@ -23,6 +23,9 @@
 * The class has two methods that given a point in the scene return CDF for the lights contributing to the direct illumination at that point.
 * The CDF defines the distributions of samples needed for a Monte Carlo integration to estimate the direct lighting from infinity lights and area lights.
 * Delta lights are not sampled and therefore the CDF for them is not returned.
+*
+* Building the CDF costs time linear in the number of lights at each shading point. Implementations that can select a light without doing so
+* (e.g. by traversing a hierarchy of lights) should return true from SamplesLightsDirectly() method and implement SampleLight() and LightPDF() methods.
 */
 class LightsSamplingStrategy: public ReferenceCounted
   {
@@ -51,6 +54,49 @@ class LightsSamplingStrategy: public ReferenceCounted
     */
     virtual void GetLightsCDF(const Point3D_d &i_point, const Vector3D_d &i_normal, double *o_lights_CDF) const;
 
+    /**
+    * Returns true if the implementation samples the lights directly with SampleLight() and LightPDF() methods, so that the CDF for all lights does not need to be built.
+    * The default implementation returns false.
+    */
+    virtual bool SamplesLightsDirectly() const;
+
+    /**
+    * Samples one of the infinity and area lights at the specified 3D point being shaded.
+    * The lights are indexed in the same order as in the CDF returned by GetLightsCDF(), i.e. the infinity lights go first and are followed by the area lights.
+    * The method should only be called if SamplesLightsDirectly() returns true.
+    * @param i_point 3D point being shaded.
+    * @param i_sample 1D sample. Should be in [0;1) range.
+    * @param[out] o_pdf Probability of the sampled light to be selected.
+    * @param[out] o_remapped_sample The sample remapped to [0;1) range after the light has been selected. Can be used to sample the selected light itself.
+    * @return Index of the sampled light.
+    */
+    virtual size_t SampleLight(const Point3D_d &i_point, double i_sample, double &o_pdf, double &o_remapped_sample) const;
+
+    /**
+    * Samples one of the infinity and area lights at the specified 3D point being shaded and for the specified surface normal.
+    * The lights are indexed in the same order as in the CDF returned by GetLightsCDF(), i.e. the infinity lights go first and are followed by the area lights.
+    * The method should only be called if SamplesLightsDirectly() returns true.
+    * @param i_point 3D point being shaded.
+    * @param i_normal Surface normal at the specified point. Should be normalized.
+    * @param i_sample 1D sample. Should be in [0;1) range.
+    * @param[out] o_pdf Probability of the sampled light to be selected.
+    * @param[out] o_remapped_sample The sample remapped to [0;1) range after the light has been selected. Can be used to sample the selected light itself.
+    * @return Index of the sampled light.
+    */
+    virtual size_t SampleLight(const Point3D_d &i_point, const Vector3D_d &i_normal, double i_sample, double &o_pdf, double &o_remapped_sample) const;
+
+    /**
+    * Returns probability of the specified light to be selected by SampleLight() method at the specified 3D point being shaded.
+    * The method should only be called if SamplesLightsDirectly() returns true.
+    */
+    virtual double LightPDF(const Point3D_d &i_point, size_t i_light_index) const;
+
+    /**
+    * Returns probability of the specified light to be selected by SampleLight() method at the specified 3D point being shaded and for the specified surface normal.
+    * The method should only be called if SamplesLightsDirectly() returns true.
+    */
+    virtual double LightPDF(const Point3D_d &i_point, const Vector3D_d &i_normal, size_t i_light_index) const;
+
     virtual ~LightsSamplingStrategy();
  
   protected:
@@ -79,4 +125,35 @@ inline void LightsSamplingStrategy::GetLightsCDF(const Point3D_d &i_point, const
   GetLightsCDF(i_point, o_lights_CDF);
   }
 
+inline bool LightsSamplingStrategy::SamplesLightsDirectly() const
+  {
+  return false;
+  }
+
+inline size_t LightsSamplingStrategy::SampleLight(const Point3D_d &i_point, double i_sample, double &o_pdf, double &o_remapped_sample) const
+  {
+  ASSERT(0 && "The strategy does not sample lights directly.");
+  o_pdf = 0.0;
+  o_remapped_sample = i_sample;
+  return 0;
+  }
+
+inline size_t LightsSamplingStrategy::SampleLight(const Point3D_d &i_point, const Vector3D_d &i_normal, double i_sample, double &o_pdf, double &o_remapped_sample) const
+  {
+  ASSERT(i_normal.IsNormalized());
+  return SampleLight(i_point, i_sample, o_pdf, o_remapped_sample);
+  }
+
+inline double LightsSamplingStrategy::LightPDF(const Point3D_d &i_point, size_t i_light_index) const
+  {
+  ASSERT(0 && "The strategy does not sample lights directly.");
+  return 0.0;
+  }
+
+inline double LightsSamplingStrategy::LightPDF(const Point3D_d &i_point, const Vector3D_d &i_normal, size_t i_light_index) const
+  {
+  ASSERT(i_normal.IsNormalized());
+  return LightPDF(i_point, i_light_index);
+  }
+
 #endif // LIGHTS_SAMPLING_STRATEGY_H
\ No newline at end of file
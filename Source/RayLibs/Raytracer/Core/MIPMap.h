@@ -21,7 +21,13 @@
 #include <Math/MathRoutines.h>
 #include <Math/SamplingRoutines.h>
 #include "ImageSource.h"
+#include "TextureCache.h"
+#include "MIPMapFile.h"
+#include "MIPMapStorage.h"
 #include <tbb/tbb.h>
+#include <fstream>
+#include <stdexcept>
+#include <string>
 #include <vector>
 
 /**
@@ -30,6 +36,10 @@
 * with each copy being two times smaller than the previous one (in each dimension).
 * The MIP-map supports trilinear filtering which is an isotropic filter and anisotropic filtering (EWA filter).
 * The implementation supports non-power-of-two image size.
+* The MIP-map levels can either be built in memory when the MIPMap is created or loaded on demand tile by tile and kept in the TextureCache.
+* In the latter case only the tiles that are actually accessed are created and the total memory used by the tiles is bounded by the cache's memory budget.
+* The levels can also be saved to a MIP-map file (see MIPMapFile) and read directly from the mapped file later, which avoids building the levels on each load.
+* The levels built in memory can be kept in a reduced precision format (see MIPMapStorageFormat) in which case the texels are decoded when they are fetched.
 *
 * The template parameter corresponds to the values type.
 */
@@ -42,17 +52,72 @@ class MIPMap: public ReferenceCounted
     * @param i_values 2D array of the image values. All inner vectors should have the same size. Should have at least one row and at least one column.
     * @param i_repeat Sets whether to wrap the texture on its edges. If false, the value is considered zero (black) beyond the image.
     * @param i_max_anisotropy Maximum anisotropy allowed (ratio of the major ellipse axis to its minor axis). Should be greater or equal than 1.0.
+    * @param i_storage_format Format of the texels in memory. The reduced precision formats are only supported for the types specialized by MIPMapTexelChannels.
     */
-    MIPMap(const std::vector<std::vector<T>> &i_values, bool i_repeat, double i_max_anisotropy);
+    MIPMap(const std::vector<std::vector<T>> &i_values, bool i_repeat, double i_max_anisotropy, MIPMapStorageFormat i_storage_format = MIP_MAP_STORAGE_FULL);
 
     /**
     * Constructs MIPMap from the specified image source.
     * @param ip_image_source ImageSource implementation that defines image for the MIPMap. The image defined by the ImageSource should not be empty.
     * @param i_repeat Sets whether to wrap the texture on its edges. If false, the value is considered zero (black) beyond the image.
     * @param i_max_anisotropy Maximum anisotropy allowed (ratio of the major ellipse axis to its minor axis). Should be greater or equal than 1.0.
+    * @param i_storage_format Format of the texels in memory. The reduced precision formats are only supported for the types specialized by MIPMapTexelChannels.
     */
-    MIPMap(intrusive_ptr<const ImageSource<T>> ip_image_source, bool i_repeat, double i_max_anisotropy);
-    
+    MIPMap(intrusive_ptr<const ImageSource<T>> ip_image_source, bool i_repeat, double i_max_anisotropy, MIPMapStorageFormat i_storage_format = MIP_MAP_STORAGE_FULL);
+
+    /**
+    * Constructs MIPMap from the specified image source whose levels are loaded on demand and kept in the specified texture cache.
+    * The tiles of the original image are read from the image source when they are first accessed and the tiles of the other levels are filtered from the tiles of the previous level.
+    * The image source is referenced by the MIPMap, so the memory it uses is not bounded by the cache budget.
+    * @param ip_image_source ImageSource implementation that defines image for the MIPMap. The image defined by the ImageSource should not be empty.
+    * @param i_repeat Sets whether to wrap the texture on its edges. If false, the value is considered zero (black) beyond the image.
+    * @param i_max_anisotropy Maximum anisotropy allowed (ratio of the major ellipse axis to its minor axis). Should be greater or equal than 1.0.
+    * @param ip_texture_cache Texture cache to keep the tiles in. Can be shared by many MIPMap instances.
+    */
+    MIPMap(intrusive_ptr<const ImageSource<T>> ip_image_source, bool i_repeat, double i_max_anisotropy, intrusive_ptr<TextureCache> ip_texture_cache);
+
+    /**
+    * Constructs MIPMap whose levels are read from the specified MIP-map file.
+    * The values are read directly from the mapped memory of the file so no levels are built.
+    * Throws std::runtime_error if the size of the file values is not equal to the size of T or if the levels of the file do not form the MIP-map pyramid
+    * of its first level, so that the callers can fall back to building the levels from the image.
+    * @param ip_file MIP-map file with the levels previously written by Save() method.
+    * @param i_repeat Sets whether to wrap the texture on its edges. If false, the value is considered zero (black) beyond the image.
+    * @param i_max_anisotropy Maximum anisotropy allowed (ratio of the major ellipse axis to its minor axis). Should be greater or equal than 1.0.
+    */
+    MIPMap(intrusive_ptr<const MIPMapFile> ip_file, bool i_repeat, double i_max_anisotropy);
+
+    /**
+    * Writes all levels of the MIP-map to the specified MIP-map file.
+    * Throws std::runtime_error if the file can not be written.
+    * @param i_filename Name of the file.
+    * @param i_source_size Size (in bytes) of the source image the MIP-map was built from, 0 if unknown. Stored in the file, see MIPMapFile::GetSourceSize().
+    * @param i_source_modification_time Modification time of the source image, 0 if unknown. Stored in the file, see MIPMapFile::GetSourceModificationTime().
+    */
+    void Save(const std::string &i_filename, unsigned long long i_source_size = 0, unsigned long long i_source_modification_time = 0) const;
+
+    /**
+    * Creates MIPMap whose levels are read from the specified MIP-map file.
+    * Returns NULL if the file does not exist or if it is outdated, i.e. the stamp of the source image stored in the file does not match the specified one.
+    * The stamp is not checked if both the source size and the modification time are 0.
+    * Throws std::runtime_error if the file exists but can not be used (see MIPMapFile and the MIPMap constructor from the file).
+    */
+    static intrusive_ptr<const MIPMap<T>> LoadFile(const std::string &i_filename, bool i_repeat, double i_max_anisotropy,
+      unsigned long long i_source_size = 0, unsigned long long i_source_modification_time = 0);
+
+    /**
+    * Builds the levels for the specified image source, writes them to the specified MIP-map file and returns MIPMap that reads the levels from the written file.
+    * The built levels are released once they are written, so the returned MIPMap only keeps the mapped file.
+    * Throws std::runtime_error if the file can not be written.
+    */
+    static intrusive_ptr<const MIPMap<T>> BuildFile(intrusive_ptr<const ImageSource<T>> ip_image_source, const std::string &i_filename, bool i_repeat, double i_max_anisotropy,
+      unsigned long long i_source_size = 0, unsigned long long i_source_modification_time = 0);
+
+    /**
+    * Returns format of the texels in memory.
+    */
+    MIPMapStorageFormat GetStorageFormat() const;
+
     /**
     * Returns filtered value of image at the specified point using trilinear filter.
     * @param i_point Point at which the image is to be filtered. The range [0;1]x[0;1] corresponds to the points inside the image.
@@ -78,28 +143,61 @@ class MIPMap: public ReferenceCounted
   private:
     // Internal types.
     struct ResampleWeight;
+    class CachedTile;
 
   private:
     /**
     * This method is called from constructors to initialize the class instance.
     * It resamples the input image, builds the MIPMap levels and initializes EWA weights.
     */
-    void _Initialize(const std::vector<std::vector<T>> &i_values, double i_max_anisotropy);
+    void _Initialize(const std::vector<std::vector<T>> &i_values, double i_max_anisotropy, MIPMapStorageFormat i_storage_format);
+
+    /**
+    * Private method that converts the levels built in memory to the reduced precision storage format.
+    * For the 8-bit format it also computes the channels ranges and the decoding table.
+    */
+    void _PackLevels();
+
+    /**
+    * Private method that decodes the specified texel of the level kept in the reduced precision storage format.
+    */
+    T _UnpackTexel(size_t i_level, size_t i_x, size_t i_y) const;
+
+    /**
+    * Private method that computes sizes of all MIPMap levels for the specified size of the original image.
+    */
+    void _InitializeLevelSizes(size_t i_width, size_t i_height);
+
+    /**
+    * Private method that computes the texel of the specified level by filtering the texels of the previous level.
+    */
+    T _DownsampleTexel(size_t i_level, size_t i_x, size_t i_y, TextureCache::ThreadTiles *ip_tiles) const;
 
     /**
     * Private method that returns image value at the specified point at the specified level.
+    * The coordinates are wrapped if the image is repeated. The thread tiles should be NULL if the MIPMap does not use the texture cache.
+    */
+    T _GetTexel(size_t i_level, int i_x, int i_y, TextureCache::ThreadTiles *ip_tiles) const;
+
+    /**
+    * Private method that returns image value at the specified point at the specified level. The point should be inside the level.
+    */
+    T _GetLevelTexel(size_t i_level, size_t i_x, size_t i_y, TextureCache::ThreadTiles *ip_tiles) const;
+
+    /**
+    * Private method that creates the specified tile of the specified level.
     */
-    const T &_GetTexel(size_t i_level, int i_x, int i_y) const;
+    intrusive_ptr<const TextureCache::Tile> _LoadTile(size_t i_level, size_t i_tile_x, size_t i_tile_y, TextureCache::ThreadTiles &io_tiles) const;
 
     /**
     * Private method that interpolates image values using four nearest values from the map at the specified level.
     */
-    T _Interpolate(size_t i_level, Point2D_d i_point) const;
+    T _Interpolate(size_t i_level, Point2D_d i_point, TextureCache::ThreadTiles *ip_tiles) const;
     
     /**
     * Private method that filters image values using EWA filter at the specified point at the specified level.
     */
-    T _EWA(size_t i_level, Point2D_d i_point, Vector2D_d i_dxy_1, Vector2D_d i_dxy_2) const;
+    T _EWA(size_t i_level, Point2D_d i_point, Vector2D_d i_dxy_1, Vector2D_d i_dxy_2, TextureCache::ThreadTiles *ip_tiles) const;
 
     /**
     * Private method that computes EWA filter weights. This method is called once in the constructor.
@@ -110,12 +208,40 @@ class MIPMap: public ReferenceCounted
     size_t m_width, m_height, m_num_levels;
     double m_max_anisotropy;
     bool m_repeat;
+    MIPMapStorageFormat m_storage_format;
+
+    /**
+    * Sizes of the MIP-map levels. 0-th level corresponds to the original image and the highest level has 1x1 size.
+    */
+    std::vector<size_t> m_level_widths, m_level_heights;
 
     /**
-    * Levels of the MIP-map. 0-th level corresponds to the original image and the highest level has 1x1 size.
+    * Levels of the MIP-map. Empty if the levels are kept in the texture cache.
     */
     std::vector<BlockedArray<T> *> m_levels;
 
+    /**
+    * Levels of the MIP-map in the reduced precision storage format, stored row by row with m_packed_texel_size bytes per texel.
+    * Empty if the texels are stored as is.
+    */
+    std::vector<std::vector<unsigned char>> m_packed_levels;
+    size_t m_packed_texel_size;
+
+    /**
+    * Decoding table of the 8-bit storage format with 256 values for each channel. The values include the channel's range.
+    */
+    std::vector<float> m_srgb8_table;
+
+    /**
+    * Levels of the MIP-map in the mapped MIP-map file, stored row by row. Empty if the MIPMap is not created from a file.
+    */
+    intrusive_ptr<const MIPMapFile> mp_file;
+    std::vector<const T *> m_mapped_levels;
+
+    intrusive_ptr<const ImageSource<T>> mp_image_source;
+    intrusive_ptr<TextureCache> mp_texture_cache;
+    size_t m_texture_id, m_tile_size;
+
     // Number of EWA filter weights.
     static const size_t EWA_WEIGHTS_NUM = 128;
 
@@ -126,92 +252,285 @@ class MIPMap: public ReferenceCounted
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////
 
 template <typename T>
-MIPMap<T>::MIPMap(const std::vector<std::vector<T>> &i_values, bool i_repeat, double i_max_anisotropy):
-m_repeat(i_repeat)
+class MIPMap<T>::CachedTile: public TextureCache::Tile
+  {
+  public:
+    CachedTile(std::vector<T> &io_values)
+      {
+      ASSERT(io_values.empty() == false);
+      m_values.swap(io_values);
+      _SetData(&m_values[0], m_values.size()*sizeof(T));
+      }
+
+  private:
+    std::vector<T> m_values;
+  };
+
+template <typename T>
+MIPMap<T>::MIPMap(const std::vector<std::vector<T>> &i_values, bool i_repeat, double i_max_anisotropy, MIPMapStorageFormat i_storage_format):
+m_repeat(i_repeat), m_packed_texel_size(0), m_texture_id(0), m_tile_size(0)
   {
-  _Initialize(i_values, i_max_anisotropy);
+  _Initialize(i_values, i_max_anisotropy, i_storage_format);
   }
 
 template <typename T>
-MIPMap<T>::MIPMap(intrusive_ptr<const ImageSource<T>> ip_image_source, bool i_repeat, double i_max_anisotropy):
-m_repeat(i_repeat)
+MIPMap<T>::MIPMap(intrusive_ptr<const ImageSource<T>> ip_image_source, bool i_repeat, double i_max_anisotropy, MIPMapStorageFormat i_storage_format):
+m_repeat(i_repeat), m_packed_texel_size(0), m_texture_id(0), m_tile_size(0)
   {
   ASSERT(ip_image_source);
   ASSERT(ip_image_source->GetHeight()>0 && ip_image_source->GetWidth()>0);
 
-  _Initialize(ip_image_source->GetImage(), i_max_anisotropy);
+  _Initialize(ip_image_source->GetImage(), i_max_anisotropy, i_storage_format);
   }
 
 template <typename T>
-void MIPMap<T>::_Initialize(const std::vector<std::vector<T>> &i_values, double i_max_anisotropy)
+MIPMap<T>::MIPMap(intrusive_ptr<const ImageSource<T>> ip_image_source, bool i_repeat, double i_max_anisotropy, intrusive_ptr<TextureCache> ip_texture_cache):
+m_repeat(i_repeat), m_storage_format(MIP_MAP_STORAGE_FULL), m_packed_texel_size(0), mp_image_source(ip_image_source), mp_texture_cache(ip_texture_cache)
   {
+  ASSERT(ip_image_source);
+  ASSERT(ip_image_source->GetHeight()>0 && ip_image_source->GetWidth()>0);
+  ASSERT(ip_texture_cache);
+
   ASSERT(i_max_anisotropy>=1.0);
   m_max_anisotropy = std::max(i_max_anisotropy, 1.0);
 
-  size_t size_x = i_values[0].size(), size_y = i_values.size();
-  m_height = size_y;
-  m_width = size_x;
+  m_texture_id = mp_texture_cache->RegisterTexture();
+  m_tile_size = mp_texture_cache->GetTileSize();
 
-  BlockedArray<T> *p_image = new BlockedArray<T>(size_y, size_x);
-  for (size_t y=0; y<size_y; ++y)
-    for (size_t x=0; x<size_x; ++x)
-      p_image->Get(y, x) = i_values[y][x];
+  _InitializeLevelSizes(ip_image_source->GetWidth(), ip_image_source->GetHeight());
+  _InitializeEWA();
+  }
 
-  m_levels.push_back(p_image);
-  for(size_t level=1;size_y>1 || size_x>1;++level)
+template <typename T>
+MIPMap<T>::MIPMap(intrusive_ptr<const MIPMapFile> ip_file, bool i_repeat, double i_max_anisotropy):
+m_repeat(i_repeat), m_storage_format(MIP_MAP_STORAGE_FULL), m_packed_texel_size(0), mp_file(ip_file), m_texture_id(0), m_tile_size(0)
+  {
+  ASSERT(ip_file);
+  ASSERT(i_max_anisotropy>=1.0);
+  m_max_anisotropy = std::max(i_max_anisotropy, 1.0);
+
+  // The header of the file has already been validated against the file size, but the levels can still be inconsistent with each other.
+  // The lookups rely on the exact pyramid sizes so any mismatch is treated as an error rather than an assertion.
+  if (ip_file->GetValueSize() != sizeof(T))
+    throw std::runtime_error("MIP-map file values size mismatch.");
+
+  _InitializeLevelSizes(ip_file->GetLevelWidth(0), ip_file->GetLevelHeight(0));
+  if (ip_file->GetLevelsNumber() != m_num_levels)
+    throw std::runtime_error("MIP-map file has unexpected number of levels.");
+
+  for(size_t level=0;level<m_num_levels;++level)
     {
-    size_t prev_size_x = size_x, prev_size_y = size_y;
-    double inv_prev_size_x = 1.0/prev_size_x, inv_prev_size_y = 1.0/prev_size_y;
+    if (ip_file->GetLevelWidth(level) != m_level_widths[level] || ip_file->GetLevelHeight(level) != m_level_heights[level])
+      throw std::runtime_error("MIP-map file has unexpected level size.");
 
+    m_mapped_levels.push_back(static_cast<const T *>(ip_file->GetLevelData(level)));
+    }
+
+  _InitializeEWA();
+  }
+
+template <typename T>
+void MIPMap<T>::_InitializeLevelSizes(size_t i_width, size_t i_height)
+  {
+  m_width = i_width;
+  m_height = i_height;
+
+  m_level_widths.assign(1, i_width);
+  m_level_heights.assign(1, i_height);
+  while (m_level_widths.back()>1 || m_level_heights.back()>1)
+    {
     // The size of the new level is the ceiling of the half-size of the previous layer
-    size_y = (prev_size_y+1)/2;
-    size_x = (prev_size_x+1)/2;
+    m_level_widths.push_back((m_level_widths.back()+1)/2);
+    m_level_heights.push_back((m_level_heights.back()+1)/2);
+    }
 
-    // Each sample for a layer is computed as a weighted average of nine samples from the previous layer.
-    const BlockedArray<T> *p_previous_level = m_levels[level-1];
+  m_num_levels = m_level_widths.size();
+  }
+
+template <typename T>
+void MIPMap<T>::_Initialize(const std::vector<std::vector<T>> &i_values, double i_max_anisotropy, MIPMapStorageFormat i_storage_format)
+  {
+  ASSERT(i_max_anisotropy>=1.0);
+  m_max_anisotropy = std::max(i_max_anisotropy, 1.0);
+
+  ASSERT(i_storage_format == MIP_MAP_STORAGE_FULL || MIPMapTexelChannels<T>::CHANNELS_NUM > 0);
+  m_storage_format = MIPMapTexelChannels<T>::CHANNELS_NUM > 0 ? i_storage_format : MIP_MAP_STORAGE_FULL;
+
+  _InitializeLevelSizes(i_values[0].size(), i_values.size());
+
+  BlockedArray<T> *p_image = new BlockedArray<T>(m_height, m_width);
+  tbb::parallel_for(tbb::blocked_range<size_t>(0, m_height), [&](const tbb::blocked_range<size_t> &i_range)
+    {
+    for (size_t y=i_range.begin(); y<i_range.end(); ++y)
+      for (size_t x=0; x<m_width; ++x)
+        p_image->Get(y, x) = i_values[y][x];
+    });
+
+  // Each level only depends on the previous one so the rows of a level are filtered in parallel.
+  m_levels.push_back(p_image);
+  for(size_t level=1;level<m_num_levels;++level)
+    {
+    size_t size_x = m_level_widths[level], size_y = m_level_heights[level];
     BlockedArray<T> *p_level = new BlockedArray<T>(size_y, size_x);
 
-    // Set default weights for the case when the old size is even.
-    double y_weights[3] = { 0.0, 0.5, 0.5 }, x_weights[3] = { 0.0, 0.5, 0.5 };
-    for (int y=0; y<size_y; ++y)
+    tbb::parallel_for(tbb::blocked_range<size_t>(0, size_y), [&](const tbb::blocked_range<size_t> &i_range)
       {
-      // If the old size is odd, use polyphase filter weights (as described by Stefan Guthe and Paul Heckbert 2003).
-      if (prev_size_y&1)
-        {
-        y_weights[0] = y * inv_prev_size_y;
-        y_weights[1] = size_y * inv_prev_size_y;
-        y_weights[2] = (size_y-y-1) * inv_prev_size_y;
-        }
+      for (size_t y=i_range.begin(); y<i_range.end(); ++y)
+        for (size_t x=0; x<size_x; ++x)
+          p_level->Get(y, x) = _DownsampleTexel(level, x, y, NULL);
+      });
 
-      for (int x=0; x<size_x; ++x)
-        {
-        if (prev_size_x&1)
+    m_levels.push_back(p_level);
+    }
+
+  // The levels are packed after all of them are built so that the filtering of the levels does not accumulate the quantization errors.
+  if (m_storage_format != MIP_MAP_STORAGE_FULL)
+    _PackLevels();
+
+  _InitializeEWA();
+  }
+
+template <typename T>
+void MIPMap<T>::_PackLevels()
+  {
+  const size_t channels_num = MIPMapTexelChannels<T>::CHANNELS_NUM;
+  ASSERT(channels_num > 0 && m_levels.size() == m_num_levels);
+
+  // For the 8-bit format each channel is normalized to its range in the original image.
+  // The filtered levels are weighted averages of the original image so their values are in the same range.
+  std::vector<float> channel_min(channels_num, 0.f), channel_range(channels_num, 0.f);
+  if (m_storage_format == MIP_MAP_STORAGE_SRGB8)
+    {
+    std::vector<float> channel_max(channels_num, 0.f);
+    for(size_t c=0;c<channels_num;++c)
+      channel_min[c] = channel_max[c] = MIPMapTexelChannels<T>::Get(m_levels[0]->Get(0, 0), c);
+
+    for (size_t y=0; y<m_height; ++y)
+      for (size_t x=0; x<m_width; ++x)
+        for(size_t c=0;c<channels_num;++c)
           {
-          x_weights[0] = x * inv_prev_size_x;
-          x_weights[1] = size_x * inv_prev_size_x;
-          x_weights[2] = (size_x-x-1) * inv_prev_size_x;
+          float value = MIPMapTexelChannels<T>::Get(m_levels[0]->Get(y, x), c);
+          channel_min[c] = std::min(channel_min[c], value);
+          channel_max[c] = std::max(channel_max[c], value);
           }
 
-        T sum = T();
-        double weights_sum = 0.0; // used only for verification in debug mode
-        for (int dy = -1; dy <= 1; ++dy) if (2*y+dy>=0 && 2*y+dy<prev_size_y)
-          for (int dx = -1; dx <= 1; ++dx) if (2*x+dx>=0 && 2*x+dx<prev_size_x)
+    m_srgb8_table.resize(channels_num*256);
+    for(size_t c=0;c<channels_num;++c)
+      {
+      channel_range[c] = channel_max[c]-channel_min[c];
+      for(size_t i=0;i<256;++i)
+        m_srgb8_table[c*256+i] = channel_min[c] + channel_range[c] * SRGBDecode(i/255.f);
+      }
+    }
+
+  m_packed_texel_size = channels_num * (m_storage_format == MIP_MAP_STORAGE_HALF ? sizeof(HalfFloat) : sizeof(unsigned char));
+  m_packed_levels.resize(m_num_levels);
+  for(size_t level=0;level<m_num_levels;++level)
+    {
+    size_t size_x = m_level_widths[level], size_y = m_level_heights[level];
+    m_packed_levels[level].resize(size_x*size_y*m_packed_texel_size);
+
+    tbb::parallel_for(tbb::blocked_range<size_t>(0, size_y), [&](const tbb::blocked_range<size_t> &i_range)
+      {
+      for (size_t y=i_range.begin(); y<i_range.end(); ++y)
+        for (size_t x=0; x<size_x; ++x)
+          {
+          const T &value = m_levels[level]->Get(y, x);
+          unsigned char *p_texel = &m_packed_levels[level][(y*size_x+x)*m_packed_texel_size];
+          for(size_t c=0;c<channels_num;++c)
             {
-            double weight = y_weights[1+dy]*x_weights[1+dx];
-            sum += static_cast<T>(p_previous_level->Get(2*y+dy, 2*x+dx) * weight);
-            weights_sum += weight;
+            float channel_value = MIPMapTexelChannels<T>::Get(value, c);
+            if (m_storage_format == MIP_MAP_STORAGE_HALF)
+              {
+              unsigned short half_bits = HalfFloat(channel_value).bits();
+              memcpy(p_texel + c*sizeof(HalfFloat), &half_bits, sizeof(HalfFloat));
+              }
+            else
+              {
+              float normalized = channel_range[c] > 0.f ? MathRoutines::Clamp((channel_value-channel_min[c]) / channel_range[c], 0.f, 1.f) : 0.f;
+              p_texel[c] = (unsigned char)(SRGBEncode(normalized) * 255.f + 0.5f);
+              }
             }
+          }
+      });
+    }
 
-        ASSERT(fabs(weights_sum-1.0) < (1e-10));
-        p_level->Get(y, x) = sum;
-        }
+  for(size_t i=0;i<m_levels.size();++i)
+    delete m_levels[i];
+  m_levels.clear();
+  }
+
+template <typename T>
+T MIPMap<T>::_UnpackTexel(size_t i_level, size_t i_x, size_t i_y) const
+  {
+  const size_t channels_num = MIPMapTexelChannels<T>::CHANNELS_NUM;
+  const unsigned char *p_texel = &m_packed_levels[i_level][(i_y*m_level_widths[i_level]+i_x)*m_packed_texel_size];
+
+  T value = T();
+  if (m_storage_format == MIP_MAP_STORAGE_HALF)
+    for(size_t c=0;c<channels_num;++c)
+      {
+      // Copy the raw 16-bit value, HalfFloat itself is not trivially copyable.
+      unsigned short half_bits;
+      memcpy(&half_bits, p_texel + c*sizeof(HalfFloat), sizeof(HalfFloat));
+      HalfFloat half_value;
+      half_value.setBits(half_bits);
+      MIPMapTexelChannels<T>::Set(value, c, (float)half_value);
       }
+  else
+    for(size_t c=0;c<channels_num;++c)
+      MIPMapTexelChannels<T>::Set(value, c, m_srgb8_table[c*256+p_texel[c]]);
 
-    m_levels.push_back(p_level);
+  return value;
+  }
+
+template <typename T>
+MIPMapStorageFormat MIPMap<T>::GetStorageFormat() const
+  {
+  return m_storage_format;
+  }
+
+template <typename T>
+T MIPMap<T>::_DownsampleTexel(size_t i_level, size_t i_x, size_t i_y, TextureCache::ThreadTiles *ip_tiles) const
+  {
+  ASSERT(i_level>0 && i_level<m_num_levels);
+  int prev_size_x = (int)m_level_widths[i_level-1], prev_size_y = (int)m_level_heights[i_level-1];
+  int size_x = (int)m_level_widths[i_level], size_y = (int)m_level_heights[i_level];
+  int x = (int)i_x, y = (int)i_y;
+
+  // Each sample for a layer is computed as a weighted average of nine samples from the previous layer.
+  // Set default weights for the case when the old size is even.
+  double y_weights[3] = { 0.0, 0.5, 0.5 }, x_weights[3] = { 0.0, 0.5, 0.5 };
+
+  // If the old size is odd, use polyphase filter weights (as described by Stefan Guthe and Paul Heckbert 2003).
+  if (prev_size_y&1)
+    {
+    double inv_prev_size_y = 1.0/prev_size_y;
+    y_weights[0] = y * inv_prev_size_y;
+    y_weights[1] = size_y * inv_prev_size_y;
+    y_weights[2] = (size_y-y-1) * inv_prev_size_y;
     }
 
-  m_num_levels = m_levels.size();
-  _InitializeEWA();
+  if (prev_size_x&1)
+    {
+    double inv_prev_size_x = 1.0/prev_size_x;
+    x_weights[0] = x * inv_prev_size_x;
+    x_weights[1] = size_x * inv_prev_size_x;
+    x_weights[2] = (size_x-x-1) * inv_prev_size_x;
+    }
+
+  T sum = T();
+  double weights_sum = 0.0; // used only for verification in debug mode
+  for (int dy = -1; dy <= 1; ++dy) if (2*y+dy>=0 && 2*y+dy<prev_size_y)
+    for (int dx = -1; dx <= 1; ++dx) if (2*x+dx>=0 && 2*x+dx<prev_size_x)
+      {
+      double weight = y_weights[1+dy]*x_weights[1+dx];
+      sum += static_cast<T>(_GetLevelTexel(i_level-1, 2*x+dx, 2*y+dy, ip_tiles) * weight);
+      weights_sum += weight;
+      }
+
+  ASSERT(fabs(weights_sum-1.0) < (1e-10));
+  return sum;
   }
 
 template <typename T>
@@ -219,6 +538,9 @@ MIPMap<T>::~MIPMap()
   {
   for(size_t i=0;i<m_levels.size();++i)
     delete m_levels[i];
+
+  if (mp_texture_cache)
+    mp_texture_cache->UnregisterTexture(m_texture_id);
   }
 
 template <typename T>
@@ -235,66 +557,164 @@ void MIPMap<T>::_InitializeEWA()
   }
 
 template <typename T>
-const T &MIPMap<T>::_GetTexel(size_t i_level, int i_x, int i_y) const
+T MIPMap<T>::_GetTexel(size_t i_level, int i_x, int i_y, TextureCache::ThreadTiles *ip_tiles) const
   {
   ASSERT(i_level < m_num_levels);
 
-  const BlockedArray<T> &level = *m_levels[i_level];
-
   if (m_repeat)
     {
-    i_y = MathRoutines::Mod(i_y, (int)level.GetSizeU());
-    i_x = MathRoutines::Mod(i_x, (int)level.GetSizeV());
+    i_y = MathRoutines::Mod(i_y, (int)m_level_heights[i_level]);
+    i_x = MathRoutines::Mod(i_x, (int)m_level_widths[i_level]);
     }
   else
-    if (i_y<0 || i_y>=(int)level.GetSizeU() || i_x<0 || i_x>=(int)level.GetSizeV())
-      {
-      static const T black = T();
-      return black;
-      }
+    if (i_y<0 || i_y>=(int)m_level_heights[i_level] || i_x<0 || i_x>=(int)m_level_widths[i_level])
+      return T();
 
   ASSERT(i_x>=0 && i_y>=0);
-  return level.Get((size_t)i_y, (size_t)i_x);
+  return _GetLevelTexel(i_level, (size_t)i_x, (size_t)i_y, ip_tiles);
+  }
+
+template <typename T>
+T MIPMap<T>::_GetLevelTexel(size_t i_level, size_t i_x, size_t i_y, TextureCache::ThreadTiles *ip_tiles) const
+  {
+  ASSERT(i_x<m_level_widths[i_level] && i_y<m_level_heights[i_level]);
+  if (m_levels.empty() == false)
+    return m_levels[i_level]->Get(i_y, i_x);
+
+  if (m_packed_levels.empty() == false)
+    return _UnpackTexel(i_level, i_x, i_y);
+
+  if (m_mapped_levels.empty() == false)
+    return m_mapped_levels[i_level][i_y*m_level_widths[i_level] + i_x];
+
+  ASSERT(ip_tiles);
+  size_t tile_x = i_x/m_tile_size, tile_y = i_y/m_tile_size;
+  size_t tiles_x = (m_level_widths[i_level]+m_tile_size-1)/m_tile_size;
+  unsigned long long key = TextureCache::GetTileKey(m_texture_id, i_level, tile_y*tiles_x+tile_x);
+
+  // Look up the thread's tiles first and then the shared cache. Load the tile if it is not in the cache.
+  const T *p_values = static_cast<const T*>(ip_tiles->Find(key));
+  if (p_values == NULL)
+    {
+    intrusive_ptr<const TextureCache::Tile> p_tile = mp_texture_cache->GetTile(key);
+    if (p_tile == NULL)
+      p_tile = mp_texture_cache->AddTile(key, _LoadTile(i_level, tile_x, tile_y, *ip_tiles));
+
+    ip_tiles->Put(key, p_tile);
+    p_values = static_cast<const T*>(p_tile->GetData());
+    }
+
+  size_t tile_width = std::min(m_tile_size, m_level_widths[i_level]-tile_x*m_tile_size);
+  return p_values[(i_y-tile_y*m_tile_size)*tile_width + (i_x-tile_x*m_tile_size)];
+  }
+
+template <typename T>
+intrusive_ptr<const TextureCache::Tile> MIPMap<T>::_LoadTile(size_t i_level, size_t i_tile_x, size_t i_tile_y, TextureCache::ThreadTiles &io_tiles) const
+  {
+  size_t begin_x = i_tile_x*m_tile_size, end_x = std::min(begin_x+m_tile_size, m_level_widths[i_level]);
+  size_t begin_y = i_tile_y*m_tile_size, end_y = std::min(begin_y+m_tile_size, m_level_heights[i_level]);
+
+  std::vector<T> values;
+  if (i_level == 0)
+    mp_image_source->GetRegion(begin_x, begin_y, end_x, end_y, values);
+  else
+    {
+    values.reserve((end_x-begin_x)*(end_y-begin_y));
+    for(size_t y=begin_y;y<end_y;++y)
+      for(size_t x=begin_x;x<end_x;++x)
+        values.push_back(_DownsampleTexel(i_level, x, y, &io_tiles));
+    }
+
+  return intrusive_ptr<const TextureCache::Tile>(new CachedTile(values));
+  }
+
+template <typename T>
+void MIPMap<T>::Save(const std::string &i_filename, unsigned long long i_source_size, unsigned long long i_source_modification_time) const
+  {
+  TextureCache::ThreadTiles *p_tiles = mp_texture_cache ? &mp_texture_cache->GetThreadTiles() : NULL;
+
+  std::vector<std::vector<T>> levels(m_num_levels);
+  std::vector<const void *> level_pointers(m_num_levels);
+  for(size_t level=0;level<m_num_levels;++level)
+    {
+    levels[level].reserve(m_level_widths[level]*m_level_heights[level]);
+    for(size_t y=0;y<m_level_heights[level];++y)
+      for(size_t x=0;x<m_level_widths[level];++x)
+        levels[level].push_back(_GetLevelTexel(level, x, y, p_tiles));
+
+    level_pointers[level] = &levels[level][0];
+    }
+
+  MIPMapFile::Write(i_filename, sizeof(T), m_level_widths, m_level_heights, level_pointers, i_source_size, i_source_modification_time);
+  }
+
+template <typename T>
+intrusive_ptr<const MIPMap<T>> MIPMap<T>::LoadFile(const std::string &i_filename, bool i_repeat, double i_max_anisotropy,
+                                                   unsigned long long i_source_size, unsigned long long i_source_modification_time)
+  {
+  if (std::ifstream(i_filename.c_str(), std::ios::in | std::ios::binary).good() == false)
+    return NULL;
+
+  intrusive_ptr<const MIPMapFile> p_file(new MIPMapFile(i_filename, sizeof(T)));
+  if (i_source_size != 0 || i_source_modification_time != 0)
+    if (p_file->GetSourceSize() != i_source_size || p_file->GetSourceModificationTime() != i_source_modification_time)
+      return NULL;
+
+  return intrusive_ptr<const MIPMap<T>>(new MIPMap<T>(p_file, i_repeat, i_max_anisotropy));
+  }
+
+template <typename T>
+intrusive_ptr<const MIPMap<T>> MIPMap<T>::BuildFile(intrusive_ptr<const ImageSource<T>> ip_image_source, const std::string &i_filename, bool i_repeat, double i_max_anisotropy,
+                                                    unsigned long long i_source_size, unsigned long long i_source_modification_time)
+  {
+  MIPMap<T>(ip_image_source, i_repeat, i_max_anisotropy).Save(i_filename, i_source_size, i_source_modification_time);
+
+  intrusive_ptr<const MIPMapFile> p_file(new MIPMapFile(i_filename, sizeof(T)));
+  return intrusive_ptr<const MIPMap<T>>(new MIPMap<T>(p_file, i_repeat, i_max_anisotropy));
   }
 
 template <typename T>
 T MIPMap<T>::Evaluate(const Point2D_d &i_point, double i_width) const
   {
+  TextureCache::ThreadTiles *p_tiles = mp_texture_cache ? &mp_texture_cache->GetThreadTiles() : NULL;
+
   // Compute MIPMap level for trilinear filtering.
   double level = 0.0;
   if (i_width > 1e-10)
     if (i_width > 1.0)
       level = (double)m_num_levels - 1;
     else
-      level = m_num_levels - 1 + MathRoutines::Log2(i_width);
+      level = std::max(0.0, m_num_levels - 1 + MathRoutines::Log2(i_width));
 
   ASSERT(level>=0.0 && level<=m_num_levels-1);
 
   // Perform trilinear interpolation at appropriate MIPMap level. 
   if (level <= 0)
-    return _Interpolate(0, i_point);
+    return _Interpolate(0, i_point, p_tiles);
   else if (level >= m_num_levels-1)
     {
     if (m_repeat)
-      return _GetTexel(m_num_levels-1, 0, 0);
+      return _GetTexel(m_num_levels-1, 0, 0, p_tiles);
     else
       // We just return the highest layer's value if the point is inside the [0;1]x[0;1] range.
       // This way we don't filter the values though.
       if (i_point[0]>=0.0 && i_point[0]<=1.0 && i_point[1]>=0.0 && i_point[1]<=1.0)
-        return _GetTexel(m_num_levels-1, 0, 0);
+        return _GetTexel(m_num_levels-1, 0, 0, p_tiles);
       else
         return T();
     }
   else
     {
     double delta = level - (size_t)level;
-    return (1.0-delta) * _Interpolate((size_t)level, i_point) + delta * _Interpolate((size_t)level+1, i_point);
+    return (1.0-delta) * _Interpolate((size_t)level, i_point, p_tiles) + delta * _Interpolate((size_t)level+1, i_point, p_tiles);
     }
   }
 
 template <typename T>
 T MIPMap<T>::Evaluate(const Point2D_d &i_point, Vector2D_d i_dxy_1, Vector2D_d i_dxy_2) const
   {
+  TextureCache::ThreadTiles *p_tiles = mp_texture_cache ? &mp_texture_cache->GetThreadTiles() : NULL;
+
   // Compute ellipse minor and major axes.
   if (i_dxy_1.LengthSqr() < i_dxy_2.LengthSqr())
     std::swap(i_dxy_1, i_dxy_2);
@@ -303,7 +723,7 @@ T MIPMap<T>::Evaluate(const Point2D_d &i_point, Vector2D_d i_dxy_1, Vector2D_d i
   double minor_length = sqrt(i_dxy_2.LengthSqr());
 
   if (minor_length < DBL_EPS)
-    return _Interpolate(0, i_point);
+    return _Interpolate(0, i_point, p_tiles);
 
   // Clamp ellipse eccentricity if too large.
   if (minor_length * m_max_anisotropy < major_length)
@@ -324,12 +744,12 @@ T MIPMap<T>::Evaluate(const Point2D_d &i_point, Vector2D_d i_dxy_1, Vector2D_d i
   if (level >= m_num_levels-1)
     {
     if (m_repeat)
-      return _GetTexel(m_num_levels-1, 0, 0);
+      return _GetTexel(m_num_levels-1, 0, 0, p_tiles);
     else
       // We just return the highest layer's value if the point is inside the [0;1]x[0;1] range.
       // This way we don't filter the values though.
       if (i_point[0]>=0.0 && i_point[0]<=1.0 && i_point[1]>=0.0 && i_point[1]<=1.0)
-        return _GetTexel(m_num_levels-1, 0, 0);
+        return _GetTexel(m_num_levels-1, 0, 0, p_tiles);
       else
         return T();
     }
@@ -338,46 +758,46 @@ T MIPMap<T>::Evaluate(const Point2D_d &i_point, Vector2D_d i_dxy_1, Vector2D_d i
     // Choose level of detail for EWA lookup and perform EWA filtering.
     double delta = level - (size_t)level;
     return static_cast<T>(
-      (1.0-delta) * _EWA((size_t)level, i_point, i_dxy_1, i_dxy_2) + delta * _EWA((size_t)level+1, i_point, i_dxy_1, i_dxy_2)
+      (1.0-delta) * _EWA((size_t)level, i_point, i_dxy_1, i_dxy_2, p_tiles) + delta * _EWA((size_t)level+1, i_point, i_dxy_1, i_dxy_2, p_tiles)
       );
     }
   }
 
 template <typename T>
-T MIPMap<T>::_Interpolate(size_t i_level, Point2D_d i_point) const
+T MIPMap<T>::_Interpolate(size_t i_level, Point2D_d i_point, TextureCache::ThreadTiles *ip_tiles) const
   {
   ASSERT(i_level<m_num_levels);
-  BlockedArray<T> &level = *m_levels[i_level];
+  double level_width = (double)m_level_widths[i_level], level_height = (double)m_level_heights[i_level];
 
-  i_point[0] = i_point[0] * level.GetSizeV() - 0.5;
-  i_point[1] = i_point[1] * level.GetSizeU() - 0.5;
+  i_point[0] = i_point[0] * level_width - 0.5;
+  i_point[1] = i_point[1] * level_height - 0.5;
   int x = (int)floor(i_point[0]), y = (int)floor(i_point[1]);
   double dx = i_point[0] - x, dy = i_point[1] - y;
   ASSERT(dx>=0.0 && dy>=0.0);
 
   return static_cast<T>(
-    (1.0-dx)*(1.0-dy) * _GetTexel(i_level, x  , y  ) +
-    (1.0-dx)*dy       * _GetTexel(i_level, x  , y+1) +
-    dx*(1.0-dy)       * _GetTexel(i_level, x+1, y  ) +
-    dx*dy             * _GetTexel(i_level, x+1, y+1)
+    (1.0-dx)*(1.0-dy) * _GetTexel(i_level, x  , y  , ip_tiles) +
+    (1.0-dx)*dy       * _GetTexel(i_level, x  , y+1, ip_tiles) +
+    dx*(1.0-dy)       * _GetTexel(i_level, x+1, y  , ip_tiles) +
+    dx*dy             * _GetTexel(i_level, x+1, y+1, ip_tiles)
     );
   }
 
 template <typename T>
-T MIPMap<T>::_EWA(size_t i_level, Point2D_d i_point, Vector2D_d i_dxy_1, Vector2D_d i_dxy_2) const
+T MIPMap<T>::_EWA(size_t i_level, Point2D_d i_point, Vector2D_d i_dxy_1, Vector2D_d i_dxy_2, TextureCache::ThreadTiles *ip_tiles) const
   {
   ASSERT(i_level<m_num_levels);
-  BlockedArray<T> &level = *m_levels[i_level];
+  double level_width = (double)m_level_widths[i_level], level_height = (double)m_level_heights[i_level];
 
   // Convert EWA coordinates to appropriate scale for level.
-  i_point[0] = i_point[0] * level.GetSizeV() - 0.5;
-  i_point[1] = i_point[1] * level.GetSizeU() - 0.5;
+  i_point[0] = i_point[0] * level_width - 0.5;
+  i_point[1] = i_point[1] * level_height - 0.5;
 
-  i_dxy_1[0] *= level.GetSizeV();
-  i_dxy_1[1] *= level.GetSizeU();
+  i_dxy_1[0] *= level_width;
+  i_dxy_1[1] *= level_height;
 
-  i_dxy_2[0] *= level.GetSizeV();
-  i_dxy_2[1] *= level.GetSizeU();
+  i_dxy_2[0] *= level_width;
+  i_dxy_2[1] *= level_height;
 
   // Compute ellipse coefficients to bound EWA filter region.
   double A = i_dxy_1[1]*i_dxy_1[1] + i_dxy_2[1]*i_dxy_2[1] + 1.0;
@@ -398,24 +818,50 @@ T MIPMap<T>::_EWA(size_t i_level, Point2D_d i_point, Vector2D_d i_dxy_1, Vector2
   int y1 = (int) ceil(i_point[1] - 2.0 * inv_det * y_sqrt);
   int y2 = (int)floor(i_point[1] + 2.0 * inv_det * y_sqrt);
 
-  // Scan over ellipse bound and compute quadratic equation.
+  // Scan over the ellipse row by row. Each row is clipped to the ellipse so that only the texels inside it (or very close to its boundary) are visited.
+  int width = (int)m_level_widths[i_level], height = (int)m_level_heights[i_level];
+  double inv_2A = 0.5 / A;
   T num = T();
   double den = 0.0;
   for (int y=y1;y<=y2;++y)
     {
     double yy = y - i_point[1];
 
-    for (int x=x1;x<=x2;++x)
+    // Solve A*xx^2 + B*yy*xx + C*yy^2 < 1 for xx to find the texels of the row that are inside the ellipse.
+    double b = B*yy, c = C*yy*yy;
+    double discriminant = b*b - 4.0*A*(c-1.0);
+    if (discriminant <= 0.0)
+      continue;
+
+    double sqrt_discriminant = sqrt(discriminant);
+    int row_x1 = std::max(x1, (int) ceil(i_point[0] + (-b-sqrt_discriminant)*inv_2A));
+    int row_x2 = std::min(x2, (int)floor(i_point[0] + (-b+sqrt_discriminant)*inv_2A));
+
+    // The rows that are entirely inside the level need no wrapping or clamping, so the texels are read directly from the level storage.
+    bool interior = y>=0 && y<height && row_x1>=0 && row_x2<width;
+    const BlockedArray<T> *p_level = (interior && m_levels.empty() == false) ? m_levels[i_level] : NULL;
+    const T *p_row = (interior && m_mapped_levels.empty() == false) ? m_mapped_levels[i_level] + (size_t)y*width : NULL;
+
+    for (int x=row_x1;x<=row_x2;++x)
       {
       double xx = x - i_point[0];
 
       // Compute squared radius and filter texel if inside the ellipse.
-      double r_sqr = A*xx*xx + B*xx*yy + C*yy*yy;
+      // The check is still needed for the texels at the row ends due to the rounding errors.
+      double r_sqr = (A*xx + b)*xx + c;
       if (r_sqr < 1.0)
         {
-        ASSERT(r_sqr>=0.0);
-        double weight = m_EWA_weights[std::min((size_t)floor(r_sqr * EWA_WEIGHTS_NUM), EWA_WEIGHTS_NUM-1)];
-        num += static_cast<T>( _GetTexel(i_level, x, y) * weight );
+        // Small negative values due to the rounding errors are truncated to the zero index.
+        ASSERT(r_sqr>-1e-10);
+        double weight = m_EWA_weights[(int)(r_sqr * EWA_WEIGHTS_NUM)];
+        if (p_level)
+          num += static_cast<T>( p_level->Get(y, x) * weight );
+        else if (p_row)
+          num += static_cast<T>( p_row[x] * weight );
+        else if (interior)
+          num += static_cast<T>( _GetLevelTexel(i_level, (size_t)x, (size_t)y, ip_tiles) * weight );
+        else
+          num += static_cast<T>( _GetTexel(i_level, x, y, ip_tiles) * weight );
         den += weight;
         }
       }
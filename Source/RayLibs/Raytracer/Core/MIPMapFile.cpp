@@ -0,0 +1,225 @@
+/*
+* Copyright (C) 2014 by Volodymyr Kachurovskyi <Volodymyr.Kachurovskyi@gmail.com>
+*
+* This file is part of Skwarka.
+*
+* Skwarka is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+*
+* Skwarka is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License along with Skwarka.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "MIPMapFile.h"
+#include <boost/iostreams/device/mapped_file.hpp>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <stdexcept>
+
+namespace
+  {
+  const char MIP_MAP_FILE_MAGIC[8] = {'S','K','W','M','I','P','M','P'};
+  const unsigned int MIP_MAP_FILE_VERSION = 2;
+
+  // The levels data is aligned so that the values can be read directly from the mapped memory.
+  const size_t MIP_MAP_FILE_ALIGNMENT = 64;
+
+  // Header layout: magic, version, value size, source image size and modification time, number of levels, followed by the width and height of each level.
+  const size_t MIP_MAP_FILE_HEADER_SIZE = sizeof(MIP_MAP_FILE_MAGIC) + 2*sizeof(unsigned int) + 3*sizeof(unsigned long long);
+  const size_t MIP_MAP_FILE_LEVEL_HEADER_SIZE = 2*sizeof(unsigned long long);
+
+  /**
+  * Rounds the offset up to the alignment. Returns false if the result does not fit into size_t.
+  */
+  bool _Align(size_t i_offset, size_t &o_aligned_offset)
+    {
+    if (i_offset > std::numeric_limits<size_t>::max()-(MIP_MAP_FILE_ALIGNMENT-1))
+      return false;
+
+    o_aligned_offset = (i_offset+MIP_MAP_FILE_ALIGNMENT-1) / MIP_MAP_FILE_ALIGNMENT * MIP_MAP_FILE_ALIGNMENT;
+    return true;
+    }
+
+  /**
+  * Multiplies the values. Returns false if the result does not fit into size_t.
+  */
+  bool _Multiply(size_t i_value1, size_t i_value2, size_t &o_result)
+    {
+    if (i_value2 != 0 && i_value1 > std::numeric_limits<size_t>::max()/i_value2)
+      return false;
+
+    o_result = i_value1*i_value2;
+    return true;
+    }
+
+  template<typename T>
+  T _Read(const char *&iop_data)
+    {
+    T value;
+    memcpy(&value, iop_data, sizeof(T));
+    iop_data += sizeof(T);
+    return value;
+    }
+
+  template<typename T>
+  void _Write(std::ostream &io_stream, T i_value)
+    {
+    io_stream.write(reinterpret_cast<const char *>(&i_value), sizeof(T));
+    }
+  }
+
+MIPMapFile::MIPMapFile(const std::string &i_filename, size_t i_value_size): m_value_size(i_value_size), m_source_size(0), m_source_modification_time(0)
+  {
+  ASSERT(i_value_size > 0);
+
+  try
+    {
+    mp_file = new boost::iostreams::mapped_file_source(i_filename);
+    }
+  catch(const std::exception &)
+    {
+    throw std::runtime_error("Could not map MIP-map file: " + i_filename);
+    }
+
+  try
+    {
+    const char *p_data = mp_file->data();
+    size_t file_size = mp_file->size();
+
+    if (file_size < MIP_MAP_FILE_HEADER_SIZE || memcmp(p_data, MIP_MAP_FILE_MAGIC, sizeof(MIP_MAP_FILE_MAGIC)) != 0)
+      throw std::runtime_error("Not a MIP-map file: " + i_filename);
+    p_data += sizeof(MIP_MAP_FILE_MAGIC);
+
+    if (_Read<unsigned int>(p_data) != MIP_MAP_FILE_VERSION)
+      throw std::runtime_error("Unsupported MIP-map file version: " + i_filename);
+
+    if (_Read<unsigned int>(p_data) != i_value_size)
+      throw std::runtime_error("MIP-map file values size mismatch: " + i_filename);
+
+    m_source_size = _Read<unsigned long long>(p_data);
+    m_source_modification_time = _Read<unsigned long long>(p_data);
+
+    unsigned long long levels_num = _Read<unsigned long long>(p_data);
+    if (levels_num == 0 || levels_num > (file_size-MIP_MAP_FILE_HEADER_SIZE)/MIP_MAP_FILE_LEVEL_HEADER_SIZE)
+      throw std::runtime_error("Corrupted MIP-map file: " + i_filename);
+
+    for(size_t i=0;i<levels_num;++i)
+      {
+      unsigned long long width = _Read<unsigned long long>(p_data);
+      unsigned long long height = _Read<unsigned long long>(p_data);
+
+      // The sizes are stored as 64-bit values, make sure they are not truncated on 32-bit platforms.
+      if (width > std::numeric_limits<size_t>::max() || height > std::numeric_limits<size_t>::max())
+        throw std::runtime_error("Corrupted MIP-map file: " + i_filename);
+
+      m_level_widths.push_back((size_t)width);
+      m_level_heights.push_back((size_t)height);
+      }
+
+    std::vector<size_t> offsets;
+    size_t expected_file_size;
+    if (_GetLevelOffsets(i_value_size, m_level_widths, m_level_heights, file_size, offsets, expected_file_size) == false)
+      throw std::runtime_error("Corrupted MIP-map file: " + i_filename);
+
+    for(size_t i=0;i<offsets.size();++i)
+      m_levels.push_back(mp_file->data() + offsets[i]);
+    }
+  catch(...)
+    {
+    delete mp_file;
+    throw;
+    }
+  }
+
+MIPMapFile::~MIPMapFile()
+  {
+  delete mp_file;
+  }
+
+bool MIPMapFile::_GetLevelOffsets(size_t i_value_size, const std::vector<size_t> &i_level_widths, const std::vector<size_t> &i_level_heights, size_t i_max_file_size,
+                                  std::vector<size_t> &o_offsets, size_t &o_file_size)
+  {
+  ASSERT(i_level_widths.size() == i_level_heights.size());
+  o_offsets.clear();
+
+  size_t headers_size, offset;
+  if (i_max_file_size < MIP_MAP_FILE_HEADER_SIZE || _Multiply(i_level_widths.size(), MIP_MAP_FILE_LEVEL_HEADER_SIZE, headers_size) == false ||
+    headers_size > i_max_file_size-MIP_MAP_FILE_HEADER_SIZE ||
+    _Align(MIP_MAP_FILE_HEADER_SIZE + headers_size, offset) == false)
+    return false;
+
+  for(size_t i=0;i<i_level_widths.size();++i)
+    {
+    // Each level size is checked against the maximum size separately so that the sum below can not overflow.
+    size_t level_texels, level_size;
+    if (_Multiply(i_level_widths[i], i_level_heights[i], level_texels) == false || _Multiply(level_texels, i_value_size, level_size) == false ||
+      level_size == 0 || level_size > i_max_file_size || offset > i_max_file_size-level_size)
+      return false;
+
+    o_offsets.push_back(offset);
+    if (_Align(offset+level_size, offset) == false)
+      return false;
+    }
+
+  if (offset > i_max_file_size)
+    return false;
+
+  o_file_size = offset;
+  return true;
+  }
+
+void MIPMapFile::Write(const std::string &i_filename, size_t i_value_size,
+                       const std::vector<size_t> &i_level_widths, const std::vector<size_t> &i_level_heights, const std::vector<const void *> &i_levels,
+                       unsigned long long i_source_size, unsigned long long i_source_modification_time)
+  {
+  ASSERT(i_value_size > 0);
+  ASSERT(i_level_widths.empty() == false);
+  ASSERT(i_level_widths.size() == i_level_heights.size() && i_level_widths.size() == i_levels.size());
+
+  std::vector<size_t> offsets;
+  size_t file_size;
+  if (_GetLevelOffsets(i_value_size, i_level_widths, i_level_heights, std::numeric_limits<size_t>::max(), offsets, file_size) == false)
+    throw std::runtime_error("Invalid MIP-map levels sizes: " + i_filename);
+
+  std::ofstream file(i_filename.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+  if (file.good() == false)
+    throw std::runtime_error("Could not create MIP-map file: " + i_filename);
+
+  file.write(MIP_MAP_FILE_MAGIC, sizeof(MIP_MAP_FILE_MAGIC));
+  _Write<unsigned int>(file, MIP_MAP_FILE_VERSION);
+  _Write<unsigned int>(file, (unsigned int)i_value_size);
+  _Write<unsigned long long>(file, i_source_size);
+  _Write<unsigned long long>(file, i_source_modification_time);
+  _Write<unsigned long long>(file, i_levels.size());
+  for(size_t i=0;i<i_levels.size();++i)
+    {
+    _Write<unsigned long long>(file, i_level_widths[i]);
+    _Write<unsigned long long>(file, i_level_heights[i]);
+    }
+
+  // Pad the data up to the offset of each level and to the end of the file.
+  const std::vector<char> padding(MIP_MAP_FILE_ALIGNMENT, 0);
+  size_t position = MIP_MAP_FILE_HEADER_SIZE + i_levels.size()*MIP_MAP_FILE_LEVEL_HEADER_SIZE;
+  for(size_t i=0;i<=i_levels.size();++i)
+    {
+    size_t next_position = i<i_levels.size() ? offsets[i] : file_size;
+    ASSERT(next_position>=position && next_position-position<MIP_MAP_FILE_ALIGNMENT);
+    file.write(&padding[0], next_position-position);
+
+    if (i<i_levels.size())
+      {
+      ASSERT(i_levels[i]);
+      size_t level_size = i_level_widths[i]*i_level_heights[i]*i_value_size;
+      file.write(static_cast<const char *>(i_levels[i]), level_size);
+      position = next_position + level_size;
+      }
+    }
+
+  file.close();
+  if (file.fail())
+    throw std::runtime_error("Could not write MIP-map file: " + i_filename);
+  }
@@ -0,0 +1,149 @@
+/*
+* Copyright (C) 2014 by Volodymyr Kachurovskyi <Volodymyr.Kachurovskyi@gmail.com>
+*
+* This file is part of Skwarka.
+*
+* Skwarka is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+*
+* Skwarka is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License along with Skwarka.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef MIP_MAP_FILE_H
+#define MIP_MAP_FILE_H
+
+#include <Common/Common.h>
+#include <string>
+#include <vector>
+
+namespace boost { namespace iostreams { class mapped_file_source; } }
+
+/**
+* Binary file with all prefiltered levels of a MIP-map.
+* The file starts with a header that specifies the size of the values, the stamp of the source image and the sizes of the levels, followed by the levels themselves.
+* The stamp (size and modification time of the source image) lets the callers detect the files that are outdated with respect to the image they were built from.
+* Each level is stored row by row as raw values so that the file can be mapped into memory and the values can be read directly from the mapped memory.
+* The instances of this class map an existing file into memory (read-only), the files are written by the static Write() method.
+* The raw values are stored in the native format of the platform so the files are not portable between platforms with different endianness or types layout.
+* @sa MIPMap
+*/
+class MIPMapFile: public ReferenceCounted
+  {
+  public:
+    /**
+    * Opens the specified file and maps it into memory.
+    * Throws std::runtime_error if the file can not be opened, is not a valid MIP-map file, contains values of a different size
+    * or if the sizes of the levels in the header are not consistent with the size of the file.
+    * @param i_filename Name of the file.
+    * @param i_value_size Expected size (in bytes) of a single value.
+    */
+    MIPMapFile(const std::string &i_filename, size_t i_value_size);
+
+    ~MIPMapFile();
+
+    size_t GetValueSize() const;
+
+    size_t GetLevelsNumber() const;
+
+    size_t GetLevelWidth(size_t i_level) const;
+
+    size_t GetLevelHeight(size_t i_level) const;
+
+    /**
+    * Returns pointer to the values of the specified level stored row by row. The pointer remains valid until the instance is destroyed.
+    */
+    const void *GetLevelData(size_t i_level) const;
+
+    /**
+    * Returns size (in bytes) of the source image the file was built from or 0 if it is unknown.
+    */
+    unsigned long long GetSourceSize() const;
+
+    /**
+    * Returns modification time of the source image the file was built from or 0 if it is unknown.
+    */
+    unsigned long long GetSourceModificationTime() const;
+
+    /**
+    * Writes the specified MIP-map levels to the file.
+    * Throws std::runtime_error if the file can not be written.
+    * @param i_filename Name of the file.
+    * @param i_value_size Size (in bytes) of a single value.
+    * @param i_level_widths Widths of the levels.
+    * @param i_level_heights Heights of the levels. Should have the same number of elements as i_level_widths.
+    * @param i_levels Pointers to the values of the levels stored row by row. Should have the same number of elements as i_level_widths.
+    * @param i_source_size Size (in bytes) of the source image the levels were built from, 0 if unknown.
+    * @param i_source_modification_time Modification time of the source image the levels were built from, 0 if unknown.
+    */
+    static void Write(const std::string &i_filename, size_t i_value_size,
+      const std::vector<size_t> &i_level_widths, const std::vector<size_t> &i_level_heights, const std::vector<const void *> &i_levels,
+      unsigned long long i_source_size = 0, unsigned long long i_source_modification_time = 0);
+
+  private:
+    /**
+    * Private method that computes offsets of the levels data from the beginning of the file and the total size of the file.
+    * Returns false if any of the levels is empty or if the file would be larger than i_max_file_size (this includes the arithmetic overflows).
+    */
+    static bool _GetLevelOffsets(size_t i_value_size, const std::vector<size_t> &i_level_widths, const std::vector<size_t> &i_level_heights, size_t i_max_file_size,
+      std::vector<size_t> &o_offsets, size_t &o_file_size);
+
+  private:
+    // Not implemented, not a value type.
+    MIPMapFile(const MIPMapFile&);
+    MIPMapFile &operator=(const MIPMapFile&);
+
+  private:
+    boost::iostreams::mapped_file_source *mp_file;
+
+    size_t m_value_size;
+    unsigned long long m_source_size, m_source_modification_time;
+    std::vector<size_t> m_level_widths, m_level_heights;
+    std::vector<const void *> m_levels;
+  };
+
+/////////////////////////////////////////// IMPLEMENTATION ////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+inline size_t MIPMapFile::GetValueSize() const
+  {
+  return m_value_size;
+  }
+
+inline size_t MIPMapFile::GetLevelsNumber() const
+  {
+  return m_levels.size();
+  }
+
+inline size_t MIPMapFile::GetLevelWidth(size_t i_level) const
+  {
+  ASSERT(i_level < m_level_widths.size());
+  return m_level_widths[i_level];
+  }
+
+inline size_t MIPMapFile::GetLevelHeight(size_t i_level) const
+  {
+  ASSERT(i_level < m_level_heights.size());
+  return m_level_heights[i_level];
+  }
+
+inline const void *MIPMapFile::GetLevelData(size_t i_level) const
+  {
+  ASSERT(i_level < m_levels.size());
+  return m_levels[i_level];
+  }
+
+inline unsigned long long MIPMapFile::GetSourceSize() const
+  {
+  return m_source_size;
+  }
+
+inline unsigned long long MIPMapFile::GetSourceModificationTime() const
+  {
+  return m_source_modification_time;
+  }
+
+#endif // MIP_MAP_FILE_H
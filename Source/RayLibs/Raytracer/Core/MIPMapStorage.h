@@ -0,0 +1,174 @@
+/*
+* Copyright (C) 2014 by Volodymyr Kachurovskyi <Volodymyr.Kachurovskyi@gmail.com>
+*
+* This file is part of Skwarka.
+*
+* Skwarka is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+*
+* Skwarka is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License along with Skwarka.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef MIP_MAP_STORAGE_H
+#define MIP_MAP_STORAGE_H
+
+#include <Common/Common.h>
+#include <Math/HalfFloat.h>
+#include "Spectrum.h"
+#include "SpectrumCoef.h"
+#include <cmath>
+
+/**
+* Formats of the MIP-map texels in memory.
+* The reduced precision formats store each channel of a texel separately and decode the texels when they are fetched.
+* @sa MIPMap, MIPMapTexelChannels
+*/
+enum MIPMapStorageFormat
+  {
+  /**
+  * The texels are stored as is.
+  */
+  MIP_MAP_STORAGE_FULL,
+
+  /**
+  * Each channel is stored as a 16-bit half float. Suitable for the high dynamic range images.
+  */
+  MIP_MAP_STORAGE_HALF,
+
+  /**
+  * Each channel is stored as an 8-bit value with the sRGB transfer function applied to the channel's value normalized to the channel's range in the image.
+  * Suitable for the low dynamic range images, in which case the loss of precision is comparable to that of the source image.
+  */
+  MIP_MAP_STORAGE_SRGB8
+  };
+
+/**
+* Traits class that gives MIPMap access to the channels of the texel values for the reduced precision storage formats.
+* The generic implementation has no channels, so only MIP_MAP_STORAGE_FULL format can be used for such types.
+* The class is specialized for float, double, Spectrum and SpectrumCoef types.
+*/
+template<typename T>
+struct MIPMapTexelChannels
+  {
+  static const size_t CHANNELS_NUM = 0;
+
+  static float Get(const T &i_value, size_t i_channel)
+    {
+    ASSERT(0 && "The type does not support reduced precision MIP-map storage.");
+    return 0.f;
+    }
+
+  static void Set(T &o_value, size_t i_channel, float i_channel_value)
+    {
+    ASSERT(0 && "The type does not support reduced precision MIP-map storage.");
+    }
+  };
+
+/**
+* Converts the value in [0;1] range from linear to sRGB space.
+*/
+inline float SRGBEncode(float i_value);
+
+/**
+* Converts the value in [0;1] range from sRGB to linear space.
+*/
+inline float SRGBDecode(float i_value);
+
+/////////////////////////////////////////// IMPLEMENTATION ////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+template<>
+struct MIPMapTexelChannels<float>
+  {
+  static const size_t CHANNELS_NUM = 1;
+
+  static float Get(float i_value, size_t i_channel)
+    {
+    ASSERT(i_channel == 0);
+    return i_value;
+    }
+
+  static void Set(float &o_value, size_t i_channel, float i_channel_value)
+    {
+    ASSERT(i_channel == 0);
+    o_value = i_channel_value;
+    }
+  };
+
+template<>
+struct MIPMapTexelChannels<double>
+  {
+  static const size_t CHANNELS_NUM = 1;
+
+  static float Get(double i_value, size_t i_channel)
+    {
+    ASSERT(i_channel == 0);
+    return (float)i_value;
+    }
+
+  static void Set(double &o_value, size_t i_channel, float i_channel_value)
+    {
+    ASSERT(i_channel == 0);
+    o_value = i_channel_value;
+    }
+  };
+
+template<typename T>
+struct MIPMapTexelChannels<Spectrum<T>>
+  {
+  static const size_t CHANNELS_NUM = 3;
+
+  static float Get(const Spectrum<T> &i_value, size_t i_channel)
+    {
+    ASSERT(i_channel < CHANNELS_NUM);
+    return (float)i_value[i_channel];
+    }
+
+  static void Set(Spectrum<T> &o_value, size_t i_channel, float i_channel_value)
+    {
+    ASSERT(i_channel < CHANNELS_NUM);
+    o_value[i_channel] = (T)i_channel_value;
+    }
+  };
+
+template<typename T>
+struct MIPMapTexelChannels<SpectrumCoef<T>>
+  {
+  static const size_t CHANNELS_NUM = 3;
+
+  static float Get(const SpectrumCoef<T> &i_value, size_t i_channel)
+    {
+    ASSERT(i_channel < CHANNELS_NUM);
+    return (float)i_value[i_channel];
+    }
+
+  static void Set(SpectrumCoef<T> &o_value, size_t i_channel, float i_channel_value)
+    {
+    ASSERT(i_channel < CHANNELS_NUM);
+    o_value[i_channel] = (T)i_channel_value;
+    }
+  };
+
+inline float SRGBEncode(float i_value)
+  {
+  ASSERT(i_value>=0.f && i_value<=1.f);
+  if (i_value <= 0.0031308f)
+    return 12.92f * i_value;
+  else
+    return 1.055f * pow(i_value, 1.f/2.4f) - 0.055f;
+  }
+
+inline float SRGBDecode(float i_value)
+  {
+  ASSERT(i_value>=0.f && i_value<=1.f);
+  if (i_value <= 0.04045f)
+    return i_value / 12.92f;
+  else
+    return pow((i_value + 0.055f) / 1.055f, 2.4f);
+  }
+
+#endif // MIP_MAP_STORAGE_H
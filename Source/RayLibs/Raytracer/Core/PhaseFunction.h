@@ -17,11 +17,13 @@
 
 #include <Common/Common.h>
 #include <Math/Geometry.h>
+#include <Math/SamplingRoutines.h>
 #include <Raytracer/Core/Spectrum.h>
 
 /**
 * An abstract class defining the contract for phase functions.
-* Defines a single method that returns probability density of light scattering for the specified incoming and outgoing directions.
+* Defines a method that returns probability density of light scattering for the specified incoming and outgoing directions
+* and the methods for importance sampling of the outgoing direction.
 * @sa VolumeRegion
 */
 class PhaseFunction: public ReferenceCounted
@@ -31,6 +33,35 @@ class PhaseFunction: public ReferenceCounted
     * Returns probability density for the light to be scattered in the specified outgoing direction given the specified incoming direction.
     */
     virtual double ScatteringPDF(const Vector3D_d &i_incoming, const Vector3D_d &i_outgoing) const = 0;
+
+    /**
+    * Samples outgoing direction for the specified incoming direction.
+    * The default implementation samples the sphere uniformly. The implementations can override it to sample the directions proportionally to the phase function.
+    * @param i_incoming Incoming direction, i.e. the direction of the light ray before the scattering. Should be normalized.
+    * @param i_sample 2D sample. Should be in [0;1)^2 range.
+    * @param[out] o_outgoing Sampled outgoing direction. Normalized.
+    * @return PDF of the sampled direction.
+    */
+    virtual double Sample(const Vector3D_d &i_incoming, const Point2D_d &i_sample, Vector3D_d &o_outgoing) const;
+
+    /**
+    * Returns PDF of sampling the specified outgoing direction by the Sample() method.
+    */
+    virtual double PDF(const Vector3D_d &i_incoming, const Vector3D_d &i_outgoing) const;
   };
 
+/////////////////////////////////////////// IMPLEMENTATION ////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+inline double PhaseFunction::Sample(const Vector3D_d &i_incoming, const Point2D_d &i_sample, Vector3D_d &o_outgoing) const
+  {
+  o_outgoing = SamplingRoutines::UniformSphereSampling(i_sample);
+  return SamplingRoutines::UniformSpherePDF();
+  }
+
+inline double PhaseFunction::PDF(const Vector3D_d &i_incoming, const Vector3D_d &i_outgoing) const
+  {
+  return SamplingRoutines::UniformSpherePDF();
+  }
+
 #endif // PHASE_FUNCTION_H
\ No newline at end of file
@@ -62,7 +62,13 @@ class Primitive: public ReferenceCounted
     /**
     * Returns transformation object from the instance space to the world space.
     */
-    Transform GetMeshToWorldTransform() const;
+    const Transform &GetMeshToWorldTransform() const;
+
+    /**
+    * Returns transformation object from the world space to the instance space.
+    * The inverse transformation is precomputed so the method is cheaper than calling Inverted() on the mesh-to-world transformation.
+    */
+    const Transform &GetWorldToMeshTransform() const;
 
     /**
     * Returns a pointer to the Material the primitive is associated with.
@@ -125,7 +131,7 @@ class Primitive: public ReferenceCounted
 
   private:
     intrusive_ptr<const TriangleMesh> mp_mesh;
-    Transform m_mesh_to_world;
+    Transform m_mesh_to_world, m_world_to_mesh;
 
     intrusive_ptr<const Material> mp_material;
     intrusive_ptr<const Texture<double>> mp_bump_map;
@@ -137,7 +143,7 @@ class Primitive: public ReferenceCounted
 
 inline Primitive::Primitive(intrusive_ptr<const TriangleMesh> ip_mesh, const Transform &i_mesh_to_world, intrusive_ptr<const Material> ip_material,
                             intrusive_ptr<const AreaLightSource> ip_area_light_source, intrusive_ptr<const Texture<double>> ip_bump_map):
-mp_mesh(ip_mesh), m_mesh_to_world(i_mesh_to_world), mp_material(ip_material), mp_area_light_source(ip_area_light_source), mp_bump_map(ip_bump_map)
+mp_mesh(ip_mesh), m_mesh_to_world(i_mesh_to_world), m_world_to_mesh(i_mesh_to_world.Inverted()), mp_material(ip_material), mp_area_light_source(ip_area_light_source), mp_bump_map(ip_bump_map)
   {
   ASSERT(ip_mesh);
   ASSERT(ip_material);
@@ -153,11 +159,16 @@ inline const TriangleMesh *Primitive::GetTriangleMesh_RawPtr() const
   return mp_mesh.get();
   }
 
-inline Transform Primitive::GetMeshToWorldTransform() const
+inline const Transform &Primitive::GetMeshToWorldTransform() const
   {
   return m_mesh_to_world;
   }
 
+inline const Transform &Primitive::GetWorldToMeshTransform() const
+  {
+  return m_world_to_mesh;
+  }
+
 inline intrusive_ptr<const Material> Primitive::GetMaterial() const
   {
   return mp_material;
@@ -0,0 +1,305 @@
+/*
+* Copyright (C) 2014 by Volodymyr Kachurovskyi <Volodymyr.Kachurovskyi@gmail.com>
+*
+* This file is part of Skwarka.
+*
+* Skwarka is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+*
+* Skwarka is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License along with Skwarka.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "RenderThreadPool.h"
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <cerrno>
+
+#if defined(_WIN32)
+  #ifndef NOMINMAX
+    #define NOMINMAX
+  #endif
+  #include <windows.h>
+#elif defined(__linux__)
+  #include <sched.h>
+  #include <unistd.h>
+  #include <sys/resource.h>
+  #include <sys/syscall.h>
+#endif
+
+#if defined(_WIN32)
+
+struct RenderThreadPool::ThreadRecord
+  {
+  DWORD m_thread_id;
+  int m_priority;
+  DWORD_PTR m_affinity_mask;
+  bool m_affinity_changed;
+  };
+
+#elif defined(__linux__)
+
+struct RenderThreadPool::ThreadRecord
+  {
+  pid_t m_thread_id;
+  int m_niceness;
+  bool m_niceness_changed;
+  cpu_set_t m_affinity;
+  bool m_affinity_changed;
+  };
+
+#else
+
+// Thread settings are not supported on this platform.
+struct RenderThreadPool::ThreadRecord
+  {
+  };
+
+#endif
+
+RenderThreadPoolParams::RenderThreadPoolParams(): m_low_priority(false), m_niceness(10), m_max_concurrency(0), m_numa_node(-1), m_pin_threads(false)
+  {
+  }
+
+RenderThreadPoolParams RenderThreadPoolParams::LowPriority()
+  {
+  RenderThreadPoolParams params;
+  params.m_low_priority = true;
+  return params;
+  }
+
+RenderThreadPool::RenderThreadPool(const RenderThreadPoolParams &i_params): m_params(i_params)
+  {
+  ASSERT(i_params.m_niceness >= 1 && i_params.m_niceness <= 19);
+
+  m_processors = m_params.m_processors;
+  if (m_params.m_numa_node >= 0)
+    {
+    std::vector<size_t> node_processors = _GetNUMANodeProcessors((size_t)m_params.m_numa_node);
+    if (m_processors.empty())
+      m_processors = node_processors;
+    else
+      {
+      std::vector<size_t> processors;
+      for(size_t i=0;i<m_processors.size();++i)
+        if (std::find(node_processors.begin(), node_processors.end(), m_processors[i]) != node_processors.end())
+          processors.push_back(m_processors[i]);
+      m_processors.swap(processors);
+      }
+
+    ASSERT(m_processors.empty()==false && "No processors left for the threads to run on.");
+    }
+
+  std::sort(m_processors.begin(), m_processors.end());
+  m_processors.erase(std::unique(m_processors.begin(), m_processors.end()), m_processors.end());
+
+  m_changes_threads = m_params.m_low_priority || m_processors.empty()==false;
+  m_next_thread_index = 0;
+  m_unlowered_threads_num = 0;
+  }
+
+RenderThreadPool::~RenderThreadPool()
+  {
+  RestoreThreads();
+  }
+
+void RenderThreadPool::RestoreThreads()
+  {
+  tbb::spin_mutex::scoped_lock lock(m_records_mutex);
+
+  for(size_t i=0;i<m_records.size();++i)
+    _RestoreThread(*m_records[i]);
+
+  m_records.clear();
+  m_prepared.clear();
+  m_next_thread_index = 0;
+  m_unlowered_threads_num = 0;
+  }
+
+#if defined(_WIN32)
+
+std::vector<size_t> RenderThreadPool::_GetNUMANodeProcessors(size_t i_node)
+  {
+  std::vector<size_t> processors;
+
+  ULONGLONG mask = 0;
+  if (i_node <= 0xFF && ::GetNumaNodeProcessorMask((UCHAR)i_node, &mask))
+    for(size_t i=0;i<64;++i)
+      if (mask & (1ULL<<i))
+        processors.push_back(i);
+
+  return processors;
+  }
+
+shared_ptr<RenderThreadPool::ThreadRecord> RenderThreadPool::_ApplyToCurrentThread(size_t i_thread_index, bool &o_priority_lowered) const
+  {
+  const HANDLE h_thread = ::GetCurrentThread();
+
+  shared_ptr<ThreadRecord> p_record(new ThreadRecord);
+  p_record->m_thread_id = ::GetCurrentThreadId();
+  p_record->m_priority = ::GetThreadPriority(h_thread);
+  p_record->m_affinity_mask = 0;
+  p_record->m_affinity_changed = false;
+
+  if (m_params.m_low_priority)
+    o_priority_lowered = ::SetThreadPriority(h_thread, THREAD_PRIORITY_LOWEST) != FALSE;
+
+  if (m_processors.empty() == false)
+    {
+    DWORD_PTR mask = 0;
+    if (m_params.m_pin_threads)
+      mask = ((DWORD_PTR)1) << m_processors[i_thread_index % m_processors.size()];
+    else
+      for(size_t i=0;i<m_processors.size();++i)
+        mask |= ((DWORD_PTR)1) << m_processors[i];
+
+    // SetThreadAffinityMask() returns the previous mask or zero if it fails.
+    p_record->m_affinity_mask = ::SetThreadAffinityMask(h_thread, mask);
+    p_record->m_affinity_changed = p_record->m_affinity_mask != 0;
+    }
+
+  return p_record;
+  }
+
+void RenderThreadPool::_RestoreThread(const ThreadRecord &i_record)
+  {
+  HANDLE h_thread = ::OpenThread(THREAD_SET_INFORMATION | THREAD_QUERY_INFORMATION, FALSE, i_record.m_thread_id);
+  if (h_thread == NULL)
+    return;
+
+  ::SetThreadPriority(h_thread, i_record.m_priority);
+  if (i_record.m_affinity_changed)
+    ::SetThreadAffinityMask(h_thread, i_record.m_affinity_mask);
+
+  ::CloseHandle(h_thread);
+  }
+
+#elif defined(__linux__)
+
+namespace
+  {
+  const int CAP_SYS_NICE_BIT = 23;
+
+  /**
+  * Returns true if the calling thread is allowed to set its nice value back to the specified value after it has been increased.
+  * This requires CAP_SYS_NICE capability or RLIMIT_NICE limit that allows the value (the limit is 20 minus the lowest allowed nice value).
+  */
+  bool _CanRestoreNiceness(int i_niceness)
+    {
+    struct rlimit limit;
+    if (::getrlimit(RLIMIT_NICE, &limit) == 0 && (limit.rlim_cur == RLIM_INFINITY || (rlim_t)(20 - i_niceness) <= limit.rlim_cur))
+      return true;
+
+    // The effective capabilities are listed as a hexadecimal mask in the status file.
+    std::ifstream file("/proc/self/status");
+    std::string line;
+    while (std::getline(file, line))
+      if (line.compare(0, 7, "CapEff:") == 0)
+        {
+        unsigned long long capabilities = 0;
+        std::istringstream stream(line.substr(7));
+        return (stream >> std::hex >> capabilities) && (capabilities & (1ULL << CAP_SYS_NICE_BIT)) != 0;
+        }
+
+    return false;
+    }
+  }
+
+std::vector<size_t> RenderThreadPool::_GetNUMANodeProcessors(size_t i_node)
+  {
+  std::vector<size_t> processors;
+
+  // The file contains comma separated list of processor ranges, e.g. "0-3,8-11".
+  std::ifstream file("/sys/devices/system/node/node" + std::to_string((unsigned long long)i_node) + "/cpulist");
+  std::string list;
+  if (!file || !std::getline(file, list))
+    return processors;
+
+  std::istringstream stream(list);
+  std::string range;
+  while (std::getline(stream, range, ','))
+    {
+    size_t first = 0, last = 0;
+    char dash = 0;
+    std::istringstream range_stream(range);
+    if (!(range_stream >> first))
+      continue;
+    if (range_stream >> dash >> last)
+      ASSERT(dash == '-');
+    else
+      last = first;
+
+    for(size_t i=first;i<=last;++i)
+      processors.push_back(i);
+    }
+
+  return processors;
+  }
+
+shared_ptr<RenderThreadPool::ThreadRecord> RenderThreadPool::_ApplyToCurrentThread(size_t i_thread_index, bool &o_priority_lowered) const
+  {
+  shared_ptr<ThreadRecord> p_record(new ThreadRecord);
+  p_record->m_thread_id = (pid_t)::syscall(SYS_gettid);
+  p_record->m_niceness_changed = false;
+  p_record->m_affinity_changed = false;
+
+  // On Linux the nice value is a per-thread attribute when the thread id is passed.
+  if (m_params.m_low_priority)
+    {
+    errno = 0;
+    p_record->m_niceness = ::getpriority(PRIO_PROCESS, p_record->m_thread_id);
+    if (errno == 0 && p_record->m_niceness >= m_params.m_niceness)
+      o_priority_lowered = true;
+    else if (errno == 0 && _CanRestoreNiceness(p_record->m_niceness))
+      {
+      // The thread pools of TBB are reused by the later work, so the nice value is only increased if it can be decreased back.
+      p_record->m_niceness_changed = ::setpriority(PRIO_PROCESS, p_record->m_thread_id, m_params.m_niceness) == 0;
+      o_priority_lowered = p_record->m_niceness_changed;
+      }
+    }
+
+  if (m_processors.empty() == false && ::sched_getaffinity(0, sizeof(cpu_set_t), &p_record->m_affinity) == 0)
+    {
+    cpu_set_t affinity;
+    CPU_ZERO(&affinity);
+    if (m_params.m_pin_threads)
+      CPU_SET(m_processors[i_thread_index % m_processors.size()], &affinity);
+    else
+      for(size_t i=0;i<m_processors.size();++i)
+        CPU_SET(m_processors[i], &affinity);
+
+    p_record->m_affinity_changed = ::sched_setaffinity(0, sizeof(cpu_set_t), &affinity) == 0;
+    }
+
+  return p_record;
+  }
+
+void RenderThreadPool::_RestoreThread(const ThreadRecord &i_record)
+  {
+  if (i_record.m_niceness_changed)
+    ::setpriority(PRIO_PROCESS, i_record.m_thread_id, i_record.m_niceness);
+
+  if (i_record.m_affinity_changed)
+    ::sched_setaffinity(i_record.m_thread_id, sizeof(cpu_set_t), &i_record.m_affinity);
+  }
+
+#else
+
+std::vector<size_t> RenderThreadPool::_GetNUMANodeProcessors(size_t i_node)
+  {
+  return std::vector<size_t>();
+  }
+
+shared_ptr<RenderThreadPool::ThreadRecord> RenderThreadPool::_ApplyToCurrentThread(size_t i_thread_index, bool &o_priority_lowered) const
+  {
+  return shared_ptr<ThreadRecord>(new ThreadRecord);
+  }
+
+void RenderThreadPool::_RestoreThread(const ThreadRecord &i_record)
+  {
+  }
+
+#endif
@@ -0,0 +1,197 @@
+/*
+* Copyright (C) 2014 by Volodymyr Kachurovskyi <Volodymyr.Kachurovskyi@gmail.com>
+*
+* This file is part of Skwarka.
+*
+* Skwarka is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+*
+* Skwarka is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License along with Skwarka.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef RENDER_THREAD_POOL_H
+#define RENDER_THREAD_POOL_H
+
+#include <Common/Common.h>
+#include <tbb/enumerable_thread_specific.h>
+#include <tbb/spin_mutex.h>
+#include <tbb/atomic.h>
+#include <vector>
+#include <algorithm>
+
+/**
+* Parameters of the RenderThreadPool.
+* The default parameters do not change any of the threads' settings and do not limit the number of threads.
+*/
+struct RenderThreadPoolParams
+  {
+  RenderThreadPoolParams();
+
+  /**
+  * Returns the parameters that lower the OS scheduling priority of the threads and do not change anything else.
+  */
+  static RenderThreadPoolParams LowPriority();
+
+  // If true, the scheduling priority of the threads is lowered.
+  // On Windows THREAD_PRIORITY_LOWEST priority is used. On Linux the nice value is set to m_niceness if the process is allowed to restore it afterwards,
+  // otherwise the priority is left unchanged (see RenderThreadPool::GetUnloweredThreadsNumber()).
+  bool m_low_priority;
+
+  // The nice value the threads are set to on Linux when m_low_priority is true. Should be in [1;19] range.
+  int m_niceness;
+
+  // Maximum number of items the pipelines process concurrently, i.e. the maximum number of the pipeline tokens. Zero value means no limit.
+  // The value does not limit the number of TBB threads, but no more than this number of threads perform the work at the same time.
+  size_t m_max_concurrency;
+
+  // Indices of the logical processors the threads are allowed to run on. Empty vector means no restriction.
+  std::vector<size_t> m_processors;
+
+  // Index of the NUMA node whose processors the threads are allowed to run on. Negative value means no restriction.
+  // If both m_processors and m_numa_node are specified, the threads are allowed to run only on the processors of the node listed in m_processors.
+  int m_numa_node;
+
+  // If true, each thread is pinned to a single processor from the allowed set (the processors are assigned in round-robin order).
+  // Otherwise each thread is allowed to run on any processor from the set.
+  bool m_pin_threads;
+  };
+
+/**
+* Controls the OS scheduling settings of the threads performing the rendering work.
+* The class is used by TBB pipelines (see SamplerBasedRenderer and PhotonLTEIntegrator) whose parallel filters call PrepareCurrentThread() before processing each item.
+* The scheduling priority and processor affinity are set only once per thread, on the first item the thread processes, so there are no OS calls per item.
+* The original settings of all the changed threads are restored by RestoreThreads() method which should be called after the pipeline completes.
+* The number of the pipeline tokens is limited (see GetMaxConcurrency()) so that no more than the specified number of items are processed concurrently.
+*
+* On Linux unprivileged processes are not allowed to decrease the nice value, so the nice value is only changed if it can be restored (see RenderThreadPoolParams::m_low_priority).
+* SCHED_IDLE policy is not used instead since leaving it requires the same privilege, and SCHED_BATCH does not reduce the CPU share of the threads.
+* The threads whose priority was not lowered are counted, see GetUnloweredThreadsNumber().
+* The class is thread-safe except for RestoreThreads() method which must not be called concurrently with PrepareCurrentThread().
+*/
+class RenderThreadPool
+  {
+  public:
+    /**
+    * Creates RenderThreadPool instance with the specified parameters.
+    */
+    RenderThreadPool(const RenderThreadPoolParams &i_params = RenderThreadPoolParams());
+
+    /**
+    * Restores the original settings of all the changed threads.
+    */
+    ~RenderThreadPool();
+
+    /**
+    * Returns the parameters the pool was created with.
+    */
+    const RenderThreadPoolParams &GetParams() const;
+
+    /**
+    * Returns indices of the logical processors the threads are allowed to run on.
+    * This is the result of combining m_processors and m_numa_node parameters. Empty vector means no restriction.
+    */
+    const std::vector<size_t> &GetProcessors() const;
+
+    /**
+    * Returns the maximum number of tokens a TBB pipeline should be run with.
+    * @param i_max_tokens Maximum number of tokens the pipeline supports.
+    * @return The minimum of i_max_tokens and the maximum concurrency parameter.
+    */
+    size_t GetMaxConcurrency(size_t i_max_tokens) const;
+
+    /**
+    * Applies the scheduling settings to the current thread if they have not been applied yet.
+    * The method only performs a thread local lookup if the thread has already been prepared or if the parameters do not change any settings.
+    */
+    void PrepareCurrentThread();
+
+    /**
+    * Returns the number of threads prepared since the last call to RestoreThreads() whose scheduling priority could not be lowered.
+    * Always returns zero if m_low_priority parameter is false.
+    */
+    size_t GetUnloweredThreadsNumber() const;
+
+    /**
+    * Restores the original scheduling settings of all the threads changed by PrepareCurrentThread() since the last call to this method.
+    * The threads will be prepared again on the next call to PrepareCurrentThread().
+    */
+    void RestoreThreads();
+
+  private:
+    // Not implemented, not a value type.
+    RenderThreadPool(const RenderThreadPool&);
+    RenderThreadPool &operator=(const RenderThreadPool&);
+
+    // Platform-specific original settings of a changed thread.
+    struct ThreadRecord;
+
+    static std::vector<size_t> _GetNUMANodeProcessors(size_t i_node);
+
+    shared_ptr<ThreadRecord> _ApplyToCurrentThread(size_t i_thread_index, bool &o_priority_lowered) const;
+
+    static void _RestoreThread(const ThreadRecord &i_record);
+
+  private:
+    RenderThreadPoolParams m_params;
+    std::vector<size_t> m_processors;
+
+    // True if the parameters change any of the threads' settings.
+    bool m_changes_threads;
+
+    tbb::enumerable_thread_specific<bool> m_prepared;
+    tbb::atomic<size_t> m_next_thread_index;
+    tbb::atomic<size_t> m_unlowered_threads_num;
+
+    tbb::spin_mutex m_records_mutex;
+    std::vector<shared_ptr<ThreadRecord>> m_records;
+  };
+
+/////////////////////////////////////////// IMPLEMENTATION ////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+inline const RenderThreadPoolParams &RenderThreadPool::GetParams() const
+  {
+  return m_params;
+  }
+
+inline const std::vector<size_t> &RenderThreadPool::GetProcessors() const
+  {
+  return m_processors;
+  }
+
+inline size_t RenderThreadPool::GetMaxConcurrency(size_t i_max_tokens) const
+  {
+  if (m_params.m_max_concurrency == 0)
+    return i_max_tokens;
+  else
+    return std::min(i_max_tokens, m_params.m_max_concurrency);
+  }
+
+inline size_t RenderThreadPool::GetUnloweredThreadsNumber() const
+  {
+  return m_unlowered_threads_num;
+  }
+
+inline void RenderThreadPool::PrepareCurrentThread()
+  {
+  if (m_changes_threads == false)
+    return;
+
+  bool &prepared = m_prepared.local();
+  if (prepared)
+    return;
+
+  prepared = true;
+  bool priority_lowered = false;
+  shared_ptr<ThreadRecord> p_record = _ApplyToCurrentThread(m_next_thread_index++, priority_lowered);
+  if (m_params.m_low_priority && priority_lowered == false)
+    ++m_unlowered_threads_num;
+
+  tbb::spin_mutex::scoped_lock lock(m_records_mutex);
+  m_records.push_back(p_record);
+  }
+
+#endif // RENDER_THREAD_POOL_H
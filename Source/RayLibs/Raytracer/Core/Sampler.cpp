@@ -122,7 +122,7 @@ m_pixels(i_pixels), m_samples_per_pixel(i_samples_per_pixel), mp_rng(ip_rng), m_
     m_pixel_sample_index=m_samples_per_pixel;
   }
 
-bool SubSampler::GetNextSample(intrusive_ptr<Sample> op_sample)
+bool SubSampler::GetNextSample(Sample *op_sample)
   {
   ASSERT(op_sample);
 
@@ -195,7 +195,7 @@ class SubSampler: public ReferenceCounted
     * param[out] op_sample Sample instance to be populated with the data.
     * return true if sample was successfully populated and false if there's no more samples.
     */
-    bool GetNextSample(intrusive_ptr<Sample> op_sample);
+    bool GetNextSample(Sample *op_sample);
 
     /**
     * Resets the sampler.
@@ -222,7 +222,7 @@ class SubSampler: public ReferenceCounted
     /**
     * Populates the Sample with the samples data for the specified image pixel and specified sample's index inside that pixel.
     */
-    virtual void _GetSample(const Point2D_i &i_current_pixel, size_t i_pixel_sample_index, intrusive_ptr<Sample> op_sample) = 0;
+    virtual void _GetSample(const Point2D_i &i_current_pixel, size_t i_pixel_sample_index, Sample *op_sample) = 0;
 
     /**
     * The SubSampler calls this method for each new pixel before calling _GetSample() method for that pixel.
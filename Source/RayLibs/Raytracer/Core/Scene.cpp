@@ -0,0 +1,111 @@
+/*
+* Copyright (C) 2014 by Volodymyr Kachurovskyi <Volodymyr.Kachurovskyi@gmail.com>
+*
+* This file is part of Skwarka.
+*
+* Skwarka is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+*
+* Skwarka is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License along with Skwarka.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "Scene.h"
+
+void Scene::SetPrimitive(size_t i_index, intrusive_ptr<const Primitive> ip_primitive)
+  {
+  ASSERT(i_index < m_primitives.size());
+  ASSERT(ip_primitive);
+
+  intrusive_ptr<const AreaLightSource> p_old_light_source = m_primitives[i_index]->GetAreaLightSource();
+
+  m_primitives[i_index] = ip_primitive;
+  m_triangle_accelerator.SetPrimitive(i_index, ip_primitive);
+
+  _ReplaceAreaLightSource(p_old_light_source.get(), ip_primitive->GetAreaLightSource());
+  }
+
+void Scene::AddPrimitive(intrusive_ptr<const Primitive> ip_primitive)
+  {
+  ASSERT(ip_primitive);
+
+  m_primitives.push_back(ip_primitive);
+  m_triangle_accelerator.AddPrimitive(ip_primitive);
+
+  _ReplaceAreaLightSource(NULL, ip_primitive->GetAreaLightSource());
+  }
+
+void Scene::RemovePrimitive(size_t i_index)
+  {
+  ASSERT(i_index < m_primitives.size());
+
+  intrusive_ptr<const AreaLightSource> p_old_light_source = m_primitives[i_index]->GetAreaLightSource();
+
+  m_primitives.erase(m_primitives.begin()+i_index);
+  m_triangle_accelerator.RemovePrimitive(i_index);
+
+  _ReplaceAreaLightSource(p_old_light_source.get(), NULL);
+  }
+
+void Scene::SetDeltaLightSources(const std::vector<intrusive_ptr<const DeltaLightSource>> &i_delta_light_sources)
+  {
+  m_light_sources.m_delta_light_sources = i_delta_light_sources;
+  }
+
+void Scene::SetInfiniteLightSources(const std::vector<intrusive_ptr<const InfiniteLightSource>> &i_infinite_light_sources)
+  {
+  m_light_sources.m_infinite_light_sources = i_infinite_light_sources;
+  }
+
+void Scene::SetVolumeRegion(intrusive_ptr<const VolumeRegion> ip_volume_region)
+  {
+  mp_volume_region = ip_volume_region;
+  }
+
+void Scene::UpdateMesh(const TriangleMesh *ip_mesh)
+  {
+  ASSERT(ip_mesh);
+  m_triangle_accelerator.UpdateMesh(ip_mesh);
+  }
+
+void Scene::CommitChanges()
+  {
+  m_triangle_accelerator.UpdateTopLevelTree();
+  _UpdateBounds();
+  }
+
+void Scene::_ReplaceAreaLightSource(const AreaLightSource *ip_old_light_source, intrusive_ptr<const AreaLightSource> ip_new_light_source)
+  {
+  if (ip_old_light_source == ip_new_light_source.get())
+    return;
+
+  // The same area light source can be shared by several primitives (e.g. instances of one emissive mesh), so it is only removed when no primitive references it anymore.
+  bool old_light_source_used = false;
+  if (ip_old_light_source)
+    for(size_t i=0;i<m_primitives.size() && old_light_source_used == false;++i)
+      old_light_source_used = m_primitives[i]->GetAreaLightSource_RawPtr() == ip_old_light_source;
+
+  std::vector<intrusive_ptr<const AreaLightSource>> &area_light_sources = m_light_sources.m_area_light_sources;
+  bool new_light_source_found = false;
+  for(size_t i=0;i<area_light_sources.size();)
+    if (old_light_source_used == false && area_light_sources[i].get() == ip_old_light_source)
+      area_light_sources.erase(area_light_sources.begin()+i);
+    else
+      {
+      if (area_light_sources[i] == ip_new_light_source)
+        new_light_source_found = true;
+      ++i;
+      }
+
+  if (ip_new_light_source && new_light_source_found == false)
+    area_light_sources.push_back(ip_new_light_source);
+  }
+
+void Scene::_UpdateBounds()
+  {
+  m_bounds = m_triangle_accelerator.GetWorldBounds();
+  if (mp_volume_region)
+    m_bounds.Unite(mp_volume_region->GetBounds());
+  }
@@ -27,14 +27,21 @@
 * Describes the geometrical, scattering and lighting properties of the scene to be rendered.
 * The class encapsulates all primitives, volume region and lights in the scene.
 * It also constructs accelerating structure for primitives and volume regions and provides methods to compute ray intersections.
+*
+* The scene can be edited after it has been constructed. Editing methods only update the affected parts of the acceleration structure,
+* CommitChanges() method should be called after all the changes are done and before the scene is used for rendering.
+* LTEIntegrator instances cache the light sources of the scene (e.g. in the lights sampling strategies), so they should be re-created after the light sources are changed.
+* The editing methods are not thread-safe and should not be called while the scene is being rendered.
 */
 class Scene: public ReferenceCounted
   {
   public:
     /**
     * Constructs Scene instance with specified primitives, volume region and lights. Volume region can be NULL.
+    * The build mode of the acceleration structure can be set to one of the Morton modes to trade the traversal speed for the construction time, e.g. for interactive previews.
     */
-    Scene(const std::vector<intrusive_ptr<const Primitive>> &i_primitives, intrusive_ptr<const VolumeRegion> ip_volume_region, const LightSources &i_light_sources);
+    Scene(const std::vector<intrusive_ptr<const Primitive>> &i_primitives, intrusive_ptr<const VolumeRegion> ip_volume_region, const LightSources &i_light_sources,
+      TriangleAccelerator::BuildMode i_build_mode = TriangleAccelerator::BUILD_MODE_SAH);
 
     /**
     * Returns all primitives in the scene.
@@ -84,11 +91,82 @@ class Scene: public ReferenceCounted
     */
     bool IntersectTest(const Ray &i_ray) const;
 
+    /**
+    * Returns true if the specified ray intersects any primitive in the scene.
+    * The last occluder stored in the hint is tested first, this makes the method faster for coherent shadow rays (see TriangleAccelerator::IntersectTest()).
+    * @param i_ray Intersecting ray.
+    * @param iop_hint Last occluder hint, it is updated if a new occluder is found. Can be NULL.
+    * @return true if the specified ray intersects any primitive in the scene and false otherwise.
+    */
+    bool IntersectTest(const Ray &i_ray, OccluderHint *iop_hint) const;
+
+    /**
+    * Replaces the primitive with the specified index.
+    * Replacing the material, area light source or bump map of the primitive does not affect the acceleration structure at all.
+    * Changing the transformation or the mesh only updates the primitive's instance in the acceleration structure (see TriangleAccelerator::SetPrimitive()).
+    * The area light source of the new primitive (if any) is added to the scene's light sources.
+    * The area light source of the replaced primitive (if any) is removed from the scene's light sources unless it is still used by another primitive.
+    * @param i_index Index of the primitive in the vector returned by GetPrimitives() method.
+    * @param ip_primitive New primitive. Should not be NULL.
+    */
+    void SetPrimitive(size_t i_index, intrusive_ptr<const Primitive> ip_primitive);
+
+    /**
+    * Adds new primitive to the end of the primitives vector.
+    * The area light source of the primitive (if any) is added to the scene's light sources.
+    * @param ip_primitive Primitive to be added. Should not be NULL.
+    */
+    void AddPrimitive(intrusive_ptr<const Primitive> ip_primitive);
+
+    /**
+    * Removes the primitive with the specified index. The indices of the following primitives are decremented by one.
+    * The area light source of the primitive (if any) is removed from the scene's light sources unless it is still used by another primitive.
+    * @param i_index Index of the primitive in the vector returned by GetPrimitives() method.
+    */
+    void RemovePrimitive(size_t i_index);
+
+    /**
+    * Sets the delta light sources of the scene.
+    */
+    void SetDeltaLightSources(const std::vector<intrusive_ptr<const DeltaLightSource>> &i_delta_light_sources);
+
+    /**
+    * Sets the infinite light sources of the scene.
+    */
+    void SetInfiniteLightSources(const std::vector<intrusive_ptr<const InfiniteLightSource>> &i_infinite_light_sources);
+
+    /**
+    * Sets the volume region of the scene. Can be NULL.
+    */
+    void SetVolumeRegion(intrusive_ptr<const VolumeRegion> ip_volume_region);
+
+    /**
+    * Updates the acceleration structure after the vertices of the specified mesh have been changed by TriangleMesh::SetVertices() method.
+    * The bottom-level tree of the mesh is refitted or rebuilt (see TriangleAccelerator::UpdateMesh()), CommitChanges() method should be called afterwards.
+    * Area light sources cache the triangles' areas of their meshes, so they should be re-created (with SetPrimitive() method) if the mesh is emissive.
+    * @param ip_mesh Mesh which vertices have been changed. Should be referenced by one of the scene's primitives.
+    */
+    void UpdateMesh(const TriangleMesh *ip_mesh);
+
+    /**
+    * Updates the acceleration structure and the world bounds after the scene has been edited.
+    * Only the top-level tree of the acceleration structure is refitted or rebuilt (see TriangleAccelerator::UpdateTopLevelTree()).
+    */
+    void CommitChanges();
+
   private:
     // Not implemented, not a value type.
     Scene(const Scene&);
     Scene &operator=(const Scene&);
 
+    /**
+    * Replaces the specified area light source in the scene's light sources with the new one. Any of the two light sources can be NULL.
+    * Should be called after the primitives have been updated, the old light source is kept if any of the primitives still references it.
+    */
+    void _ReplaceAreaLightSource(const AreaLightSource *ip_old_light_source, intrusive_ptr<const AreaLightSource> ip_new_light_source);
+
+    void _UpdateBounds();
+
   private:
     std::vector<intrusive_ptr<const Primitive>> m_primitives;
     
@@ -104,12 +182,11 @@ class Scene: public ReferenceCounted
 /////////////////////////////////////////// IMPLEMENTATION ////////////////////////////////////////////////
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////
 
-inline Scene::Scene(const std::vector<intrusive_ptr<const Primitive>> &i_primitives, intrusive_ptr<const VolumeRegion> ip_volume_region, const LightSources &i_light_sources):
-m_primitives(i_primitives), mp_volume_region(ip_volume_region), m_light_sources(i_light_sources), m_triangle_accelerator(i_primitives)
+inline Scene::Scene(const std::vector<intrusive_ptr<const Primitive>> &i_primitives, intrusive_ptr<const VolumeRegion> ip_volume_region, const LightSources &i_light_sources,
+                    TriangleAccelerator::BuildMode i_build_mode):
+m_primitives(i_primitives), mp_volume_region(ip_volume_region), m_light_sources(i_light_sources), m_triangle_accelerator(i_primitives, i_build_mode)
   {
-  m_bounds = m_triangle_accelerator.GetWorldBounds();
-  if (ip_volume_region)
-    m_bounds.Unite(ip_volume_region->GetBounds());
+  _UpdateBounds();
   }
 
 inline const std::vector<intrusive_ptr<const Primitive>> &Scene::GetPrimitives() const
@@ -147,4 +224,9 @@ inline bool Scene::IntersectTest(const Ray &i_ray) const
   return m_triangle_accelerator.IntersectTest(i_ray);
   }
 
+inline bool Scene::IntersectTest(const Ray &i_ray, OccluderHint *iop_hint) const
+  {
+  return m_triangle_accelerator.IntersectTest(i_ray, iop_hint);
+  }
+
 #endif // SCENE_H
\ No newline at end of file
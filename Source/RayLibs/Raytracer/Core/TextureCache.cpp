@@ -0,0 +1,175 @@
+/*
+* Copyright (C) 2014 by Volodymyr Kachurovskyi <Volodymyr.Kachurovskyi@gmail.com>
+*
+* This file is part of Skwarka.
+*
+* Skwarka is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+*
+* Skwarka is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License along with Skwarka.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "TextureCache.h"
+#include <algorithm>
+
+TextureCache::TextureCache(size_t i_memory_budget, size_t i_tile_size, size_t i_shards_num):
+m_memory_budget(i_memory_budget), m_shard_memory_budget(i_memory_budget/std::max(i_shards_num, (size_t)1)), m_tile_size(i_tile_size)
+  {
+  ASSERT(i_tile_size > 0);
+  ASSERT(i_shards_num > 0);
+  m_next_texture_id = 0;
+
+  m_shards.resize(std::max(i_shards_num, (size_t)1));
+  for(size_t i=0;i<m_shards.size();++i)
+    m_shards[i].reset(new Shard());
+  }
+
+size_t TextureCache::GetMemoryUsage() const
+  {
+  size_t memory_usage = 0;
+  for(size_t i=0;i<m_shards.size();++i)
+    memory_usage += m_shards[i]->mp_memory_counter->m_memory_usage;
+  return memory_usage;
+  }
+
+size_t TextureCache::GetTilesNumber() const
+  {
+  size_t tiles_num = 0;
+  for(size_t i=0;i<m_shards.size();++i)
+    {
+    tbb::spin_mutex::scoped_lock lock(m_shards[i]->m_mutex);
+    tiles_num += m_shards[i]->m_tiles_map.size();
+    }
+  return tiles_num;
+  }
+
+size_t TextureCache::RegisterTexture()
+  {
+  return m_next_texture_id++;
+  }
+
+void TextureCache::UnregisterTexture(size_t i_texture_id)
+  {
+  // The removed tiles are released after the lock is released.
+  TilesList removed_tiles;
+
+  for(size_t i=0;i<m_shards.size();++i)
+    {
+    Shard &shard = *m_shards[i];
+    tbb::spin_mutex::scoped_lock lock(shard.m_mutex);
+
+    TilesList::iterator it = shard.m_tiles.begin();
+    while (it != shard.m_tiles.end())
+      {
+      TilesList::iterator next = it;
+      ++next;
+
+      if ((it->first >> 40) == i_texture_id)
+        {
+        shard.m_tiles_map.erase(it->first);
+        removed_tiles.splice(removed_tiles.begin(), shard.m_tiles, it);
+        }
+
+      it = next;
+      }
+    }
+  }
+
+intrusive_ptr<const TextureCache::Tile> TextureCache::GetTile(unsigned long long i_key)
+  {
+  Shard &shard = _GetShard(i_key);
+  tbb::spin_mutex::scoped_lock lock(shard.m_mutex);
+
+  std::unordered_map<unsigned long long, TilesList::iterator>::const_iterator it = shard.m_tiles_map.find(i_key);
+  if (it == shard.m_tiles_map.end())
+    return NULL;
+
+  // Move the tile to the front of the list.
+  shard.m_tiles.splice(shard.m_tiles.begin(), shard.m_tiles, it->second);
+  return it->second->second;
+  }
+
+intrusive_ptr<const TextureCache::Tile> TextureCache::AddTile(unsigned long long i_key, intrusive_ptr<const Tile> ip_tile)
+  {
+  ASSERT(ip_tile);
+  ASSERT(ip_tile->mp_memory_counter == NULL);
+
+  // The evicted tiles are released after the lock is released.
+  TilesList evicted_tiles;
+
+  Shard &shard = _GetShard(i_key);
+  tbb::spin_mutex::scoped_lock lock(shard.m_mutex);
+
+  std::unordered_map<unsigned long long, TilesList::iterator>::const_iterator it = shard.m_tiles_map.find(i_key);
+  if (it != shard.m_tiles_map.end())
+    {
+    shard.m_tiles.splice(shard.m_tiles.begin(), shard.m_tiles, it->second);
+    return it->second->second;
+    }
+
+  shard.m_tiles.push_front(std::make_pair(i_key, ip_tile));
+  shard.m_tiles_map[i_key] = shard.m_tiles.begin();
+
+  ip_tile->mp_memory_counter = shard.mp_memory_counter;
+  size_t memory_usage = (shard.mp_memory_counter->m_memory_usage += ip_tile->GetMemorySize());
+
+  // The memory of the evicted tiles is only freed when the threads' tables release them, until then it is still counted in the memory usage.
+  // The loop assumes the evicted tiles are freed, otherwise the tiles evicted earlier would cause the whole shard to be evicted.
+  // The most recently added tile is never evicted even if it alone exceeds the budget.
+  while (memory_usage > m_shard_memory_budget && shard.m_tiles.size() > 1)
+    {
+    TilesList::iterator last = --shard.m_tiles.end();
+    memory_usage -= std::min(memory_usage, last->second->GetMemorySize());
+    shard.m_tiles_map.erase(last->first);
+    evicted_tiles.splice(evicted_tiles.begin(), shard.m_tiles, last);
+    }
+
+  lock.release();
+  return ip_tile;
+  }
+
+TextureCache::MemoryCounter::MemoryCounter()
+  {
+  m_memory_usage = 0;
+  }
+
+TextureCache::Shard::Shard(): mp_memory_counter(new MemoryCounter())
+  {
+  }
+
+TextureCache::Tile::Tile(): mp_data(NULL), m_memory_size(0)
+  {
+  }
+
+TextureCache::Tile::~Tile()
+  {
+  if (mp_memory_counter)
+    mp_memory_counter->m_memory_usage -= m_memory_size;
+  }
+
+void TextureCache::Tile::_SetData(const void *ip_data, size_t i_memory_size)
+  {
+  mp_data = ip_data;
+  m_memory_size = i_memory_size;
+  }
+
+TextureCache::ThreadTiles::Slot::Slot(): m_key(~0ULL), mp_data(NULL)
+  {
+  }
+
+TextureCache::ThreadTiles::ThreadTiles()
+  {
+  }
+
+void TextureCache::ThreadTiles::Put(unsigned long long i_key, intrusive_ptr<const Tile> ip_tile)
+  {
+  ASSERT(ip_tile);
+
+  Slot &slot = m_slots[_GetSlotIndex(i_key)];
+  slot.m_key = i_key;
+  slot.mp_tile = ip_tile;
+  slot.mp_data = ip_tile->GetData();
+  }
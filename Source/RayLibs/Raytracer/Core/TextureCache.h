@@ -0,0 +1,298 @@
+/*
+* Copyright (C) 2014 by Volodymyr Kachurovskyi <Volodymyr.Kachurovskyi@gmail.com>
+*
+* This file is part of Skwarka.
+*
+* Skwarka is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+*
+* Skwarka is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License along with Skwarka.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef TEXTURE_CACHE_H
+#define TEXTURE_CACHE_H
+
+#include <Common/Common.h>
+#include <tbb/atomic.h>
+#include <tbb/spin_mutex.h>
+#include <tbb/enumerable_thread_specific.h>
+#include <list>
+#include <vector>
+#include <unordered_map>
+#include <utility>
+
+/**
+* Memory-bounded cache of texture tiles shared by all textures that load their data on demand (see MIPMap).
+* Each tile is identified by the texture ID, the MIP-map level and the tile index within the level. The tiles are created by the textures
+* when they are first accessed and added to the cache, and the least recently used tiles are evicted when the total memory size of the tiles exceeds the budget.
+* The cache is split into shards with separate locks and LRU lists, each shard gets an equal part of the budget. The tiles are distributed between the shards by their keys.
+* Since the most recently added tile of a shard is never evicted, the budget should be large enough for at least a few tiles per shard.
+* To avoid contention on the shard locks, each thread keeps a small table of the tiles it has accessed recently (see ThreadTiles).
+* The memory of the tiles is accounted until the tiles are destroyed, so the tiles evicted from the cache but still referenced by the threads' tables are counted in the budget too.
+* The tiles are never changed and their keys are never reused (the texture IDs are unique), so the threads' tables keep returning the evicted tiles until their slots are reused.
+* Thus an eviction does not affect the other tiles of the tables and the memory usage can exceed the budget by at most ThreadTiles::SLOTS_NUM tiles per thread.
+* The class is thread-safe.
+* @sa MIPMap
+*/
+class TextureCache: public ReferenceCounted
+  {
+  public:
+    class Tile;
+    class ThreadTiles;
+
+    /**
+    * Creates TextureCache instance.
+    * @param i_memory_budget Maximum total size (in bytes) of the tiles kept in memory.
+    * @param i_tile_size Size of the square tiles in texels. Should be greater than 0.
+    * @param i_shards_num Number of the cache shards. Should be greater than 0.
+    */
+    TextureCache(size_t i_memory_budget, size_t i_tile_size = 64, size_t i_shards_num = 16);
+
+    size_t GetMemoryBudget() const;
+
+    size_t GetTileSize() const;
+
+    size_t GetShardsNumber() const;
+
+    /**
+    * Returns total size (in bytes) of the tiles currently kept in memory.
+    * This includes the tiles evicted from the cache that are still referenced by the threads' tables.
+    */
+    size_t GetMemoryUsage() const;
+
+    /**
+    * Returns number of the tiles currently kept in the cache.
+    */
+    size_t GetTilesNumber() const;
+
+    /**
+    * Returns new unique ID for a texture that is going to use the cache.
+    */
+    size_t RegisterTexture();
+
+    /**
+    * Removes all tiles of the specified texture from the cache. Should be called when the texture is destroyed.
+    */
+    void UnregisterTexture(size_t i_texture_id);
+
+    /**
+    * Returns the table of recently accessed tiles of the calling thread.
+    * The method involves a thread-local storage lookup so it should be called once per texture lookup and the returned reference should only be used in the calling thread.
+    */
+    ThreadTiles &GetThreadTiles() const;
+
+    /**
+    * Returns the tile with the specified key and marks it as the most recently used one. Returns NULL if the tile is not in the cache.
+    */
+    intrusive_ptr<const Tile> GetTile(unsigned long long i_key);
+
+    /**
+    * Adds the tile to the cache and evicts the least recently used tiles of the same shard if its memory budget is exceeded.
+    * If a tile with the same key has been added meanwhile (by another thread), the tile is not added and the existing one is returned instead.
+    * @param i_key Key of the tile.
+    * @param ip_tile Tile to add. Should not have been added to a cache before.
+    * @return The tile kept in the cache for the specified key.
+    */
+    intrusive_ptr<const Tile> AddTile(unsigned long long i_key, intrusive_ptr<const Tile> ip_tile);
+
+    /**
+    * Returns the key of the tile with the specified texture ID, MIP-map level and tile index.
+    */
+    static unsigned long long GetTileKey(size_t i_texture_id, size_t i_level, size_t i_tile_index);
+
+  private:
+    // Not implemented, not a value type.
+    TextureCache(const TextureCache&);
+    TextureCache &operator=(const TextureCache&);
+
+  private:
+    // Internal types.
+    class MemoryCounter;
+    struct Shard;
+
+    typedef std::list<std::pair<unsigned long long, intrusive_ptr<const Tile>>> TilesList;
+
+  private:
+    Shard &_GetShard(unsigned long long i_key) const;
+
+  private:
+    size_t m_memory_budget, m_shard_memory_budget, m_tile_size;
+
+    tbb::atomic<size_t> m_next_texture_id;
+
+    std::vector<intrusive_ptr<Shard>> m_shards;
+
+    mutable tbb::enumerable_thread_specific<ThreadTiles> m_thread_tiles;
+  };
+
+/**
+* Counter of the memory used by the tiles of a cache shard.
+* The tiles keep a reference to the counter so that they can subtract their size when they are destroyed.
+*/
+class TextureCache::MemoryCounter: public ReferenceCounted
+  {
+  public:
+    MemoryCounter();
+
+    tbb::atomic<size_t> m_memory_usage;
+  };
+
+/**
+* Part of the cache with its own lock and LRU list of tiles.
+*/
+struct TextureCache::Shard: public ReferenceCounted
+  {
+  Shard();
+
+  // The tiles are sorted from the most recently used to the least recently used.
+  TilesList m_tiles;
+  std::unordered_map<unsigned long long, TilesList::iterator> m_tiles_map;
+
+  intrusive_ptr<MemoryCounter> mp_memory_counter;
+  tbb::spin_mutex m_mutex;
+  };
+
+/**
+* Base class for the tiles kept in the TextureCache. Derived classes own the texel data.
+*/
+class TextureCache::Tile: public ReferenceCounted
+  {
+  public:
+    /**
+    * Returns pointer to the texel data.
+    */
+    const void *GetData() const;
+
+    /**
+    * Returns size (in bytes) of the texel data.
+    */
+    size_t GetMemorySize() const;
+
+    virtual ~Tile();
+
+  protected:
+    Tile();
+
+    /**
+    * Sets the texel data pointer and its size. Should be called by the derived classes once the data is allocated.
+    */
+    void _SetData(const void *ip_data, size_t i_memory_size);
+
+  private:
+    // Not implemented, not a value type.
+    Tile(const Tile&);
+    Tile &operator=(const Tile&);
+
+  private:
+    friend class TextureCache;
+
+    const void *mp_data;
+    size_t m_memory_size;
+
+    // Memory counter of the shard the tile has been added to, NULL if the tile has not been added to a cache yet.
+    mutable intrusive_ptr<MemoryCounter> mp_memory_counter;
+  };
+
+/**
+* Direct-mapped table of the tiles recently accessed by a thread.
+* The table keeps references to its tiles so that the texel data stays valid while the tile is in the table, even if the tile is evicted from the cache.
+* The tiles evicted from the cache are still returned by the table and are released when their slots are reused.
+*/
+class TextureCache::ThreadTiles
+  {
+  public:
+    ThreadTiles();
+
+    /**
+    * Returns pointer to the texel data of the tile with the specified key or NULL if the tile is not in the table.
+    */
+    const void *Find(unsigned long long i_key) const;
+
+    /**
+    * Puts the tile into the table, replacing the tile with the same hash if any.
+    * The texel data pointers returned by Find() for the replaced tile may become invalid.
+    */
+    void Put(unsigned long long i_key, intrusive_ptr<const Tile> ip_tile);
+
+    // Number of the slots in the table.
+    static const size_t SLOTS_NUM = 64;
+
+  private:
+    struct Slot
+      {
+      Slot();
+
+      unsigned long long m_key;
+      intrusive_ptr<const Tile> mp_tile;
+      const void *mp_data;
+      };
+
+    static size_t _GetSlotIndex(unsigned long long i_key);
+
+  private:
+    Slot m_slots[SLOTS_NUM];
+  };
+
+/////////////////////////////////////////// IMPLEMENTATION ////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+inline size_t TextureCache::GetMemoryBudget() const
+  {
+  return m_memory_budget;
+  }
+
+inline size_t TextureCache::GetTileSize() const
+  {
+  return m_tile_size;
+  }
+
+inline size_t TextureCache::GetShardsNumber() const
+  {
+  return m_shards.size();
+  }
+
+inline TextureCache::ThreadTiles &TextureCache::GetThreadTiles() const
+  {
+  return m_thread_tiles.local();
+  }
+
+inline unsigned long long TextureCache::GetTileKey(size_t i_texture_id, size_t i_level, size_t i_tile_index)
+  {
+  // 24 bits for the texture ID, 6 bits for the level and 34 bits for the tile index.
+  ASSERT(i_texture_id < (1ULL<<24) && i_level < 64 && (unsigned long long)i_tile_index < (1ULL<<34));
+  return ((unsigned long long)i_texture_id << 40) | ((unsigned long long)i_level << 34) | (unsigned long long)i_tile_index;
+  }
+
+inline TextureCache::Shard &TextureCache::_GetShard(unsigned long long i_key) const
+  {
+  // The neighbouring tiles are spread between the shards so that the threads rendering the same region of the texture do not contend for one lock.
+  return *m_shards[(size_t)((i_key * 0x9E3779B97F4A7C15ULL) >> 32) % m_shards.size()];
+  }
+
+inline const void *TextureCache::Tile::GetData() const
+  {
+  return mp_data;
+  }
+
+inline size_t TextureCache::Tile::GetMemorySize() const
+  {
+  return m_memory_size;
+  }
+
+inline size_t TextureCache::ThreadTiles::_GetSlotIndex(unsigned long long i_key)
+  {
+  // Mix the texture ID and the level bits into the lower bits so that the neighbouring tiles of different textures do not collide.
+  unsigned long long hash = i_key ^ (i_key >> 29) ^ (i_key >> 40);
+  return (size_t)(hash * 0x9E3779B97F4A7C15ULL >> 58) & (SLOTS_NUM-1);
+  }
+
+inline const void *TextureCache::ThreadTiles::Find(unsigned long long i_key) const
+  {
+  const Slot &slot = m_slots[_GetSlotIndex(i_key)];
+  return slot.m_key == i_key ? slot.mp_data : NULL;
+  }
+
+#endif // TEXTURE_CACHE_H
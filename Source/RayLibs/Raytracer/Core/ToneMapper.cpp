@@ -0,0 +1,105 @@
+/*
+* Copyright (C) 2014 by Volodymyr Kachurovskyi <Volodymyr.Kachurovskyi@gmail.com>
+*
+* This file is part of Skwarka.
+*
+* Skwarka is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+*
+* Skwarka is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License along with Skwarka.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "ToneMapper.h"
+#include "Spectrum.h"
+#include "SpectrumRoutines.h"
+#include <tbb/tbb.h>
+
+ToneMapper::ToneMapper(double i_scale, double i_white_value, const ColorSystem &i_color_system)
+  {
+  ASSERT(i_scale > 0.0);
+  ASSERT(i_white_value > 0.0);
+
+  // Both conversions are linear so the combined matrix is obtained by converting the basis vectors.
+  for(unsigned char j=0;j<3;++j)
+    {
+    Spectrum_d basis;
+    basis[j] = i_scale;
+    XYZColor_d xyz = SpectrumRoutines::SpectrumToXYZ(basis);
+    RGBColor_d rgb = i_color_system.XYZ_To_RGB(xyz, false);
+
+    for(unsigned char i=0;i<3;++i)
+      m_spectrum_to_rgb[i][j] = rgb[i];
+    m_spectrum_to_luminance[j] = xyz[1];
+    }
+
+  // The value is quantized to i if (value/white_value)^(1/gamma)*256 is in [i;i+1) range.
+  m_thresholds[0] = 0.0;
+  for(size_t i=1;i<256;++i)
+    m_thresholds[i] = i_white_value * pow(i/256.0, i_color_system.GetGamma());
+  }
+
+void ToneMapper::ToneMap(const float i_value[3], unsigned char o_rgb[3]) const
+  {
+  unsigned char pixel[4];
+  _ToneMapRow(i_value, 1, 0, 2, pixel);
+  o_rgb[0] = pixel[0];
+  o_rgb[1] = pixel[1];
+  o_rgb[2] = pixel[2];
+  }
+
+void ToneMapper::ToneMap(const std::vector<float> &i_values, size_t i_width, size_t i_height, PixelFormat i_format, bool i_flip_rows, unsigned char *op_pixels, size_t i_row_pitch) const
+  {
+  ASSERT(i_values.size() == i_width*i_height*3);
+  ASSERT(op_pixels);
+  ASSERT(i_row_pitch >= i_width*4);
+  if (i_values.empty())
+    return;
+
+  size_t red_offset = i_format==PIXEL_FORMAT_RGBA ? 0 : 2;
+  size_t blue_offset = 2-red_offset;
+
+  const float *p_values = &i_values[0];
+  tbb::parallel_for(tbb::blocked_range<size_t>(0, i_height), [&](const tbb::blocked_range<size_t> &i_range)
+    {
+    for(size_t y=i_range.begin();y!=i_range.end();++y)
+      {
+      size_t output_row = i_flip_rows ? i_height-y-1 : y;
+      _ToneMapRow(p_values + y*i_width*3, i_width, red_offset, blue_offset, op_pixels + output_row*i_row_pitch);
+      }
+    });
+  }
+
+void ToneMapper::_ToneMapRow(const float *ip_values, size_t i_width, size_t i_red_offset, size_t i_blue_offset, unsigned char *op_pixels) const
+  {
+  for(size_t x=0;x<i_width;++x, ip_values+=3, op_pixels+=4)
+    {
+    double s0 = ip_values[0], s1 = ip_values[1], s2 = ip_values[2];
+    double r = m_spectrum_to_rgb[0][0]*s0 + m_spectrum_to_rgb[0][1]*s1 + m_spectrum_to_rgb[0][2]*s2;
+    double g = m_spectrum_to_rgb[1][0]*s0 + m_spectrum_to_rgb[1][1]*s1 + m_spectrum_to_rgb[1][2]*s2;
+    double b = m_spectrum_to_rgb[2][0]*s0 + m_spectrum_to_rgb[2][1]*s1 + m_spectrum_to_rgb[2][2]*s2;
+
+    // Desaturate out-of-gamut colors towards the white point of the same luminance, the same way ColorSystem::XYZ_To_RGB() does.
+    double min_component = std::min(r, std::min(g, b));
+    if (min_component < 0.0)
+      {
+      double luminance = m_spectrum_to_luminance[0]*s0 + m_spectrum_to_luminance[1]*s1 + m_spectrum_to_luminance[2]*s2;
+      if (luminance < 0.0)
+        r = g = b = 0.0;
+      else
+        {
+        double t = luminance / (luminance - min_component);
+        r = luminance*(1.0-t) + r*t;
+        g = luminance*(1.0-t) + g*t;
+        b = luminance*(1.0-t) + b*t;
+        }
+      }
+
+    op_pixels[i_red_offset] = _Quantize(r);
+    op_pixels[1] = _Quantize(g);
+    op_pixels[i_blue_offset] = _Quantize(b);
+    op_pixels[3] = 255;
+    }
+  }
@@ -0,0 +1,96 @@
+/*
+* Copyright (C) 2014 by Volodymyr Kachurovskyi <Volodymyr.Kachurovskyi@gmail.com>
+*
+* This file is part of Skwarka.
+*
+* Skwarka is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+*
+* Skwarka is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License along with Skwarka.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef TONE_MAPPER_H
+#define TONE_MAPPER_H
+
+#include <Common/Common.h>
+#include "Color.h"
+#include <vector>
+
+/**
+* Converts the Spectrum values exported by the Film to 8-bit RGBA pixels suitable for displaying and saving to image files.
+* Each value is scaled, converted to the RGB space of the color system (with out-of-gamut colors desaturated), gamma encoded and quantized to 8 bits.
+* The result is the same as of applying SpectrumRoutines::SpectrumToXYZ(), ColorSystem::XYZ_To_RGB() and ColorSystem::GammaEncode() to each pixel,
+* but the Spectrum to RGB conversion is done with a single precomputed matrix and the gamma encoding is replaced with a search in the table of quantization thresholds.
+* The class is thread-safe.
+* @sa Film
+*/
+class ToneMapper
+  {
+  public:
+    /**
+    * Defines the order of the color components in the output pixels.
+    */
+    enum PixelFormat
+      {
+      PIXEL_FORMAT_RGBA,
+      PIXEL_FORMAT_BGRA
+      };
+
+    /**
+    * Creates ToneMapper instance.
+    * @param i_scale Scale factor the Spectrum values are multiplied by before converting. Should be positive.
+    * @param i_white_value RGB component value (after scaling) which is mapped to the maximum intensity. Larger values are clamped. Should be positive.
+    * @param i_color_system Color system to convert the values to. Defines the RGB primaries and the gamma.
+    */
+    ToneMapper(double i_scale, double i_white_value, const ColorSystem &i_color_system = global_sRGB_D65_ColorSystem);
+
+    /**
+    * Converts the Spectrum values to 8-bit pixels. The rows are processed in parallel.
+    * @param i_values Spectrum values as returned by Film::GetPixels() method, three float components per pixel. Should have i_width*i_height*3 elements.
+    * @param i_width Number of pixels in each row.
+    * @param i_height Number of rows.
+    * @param i_format Order of the color components in the output pixels. Each output pixel has four bytes, the alpha component is always set to 255.
+    * @param i_flip_rows If true, the first row of the values is written to the last row of the output and vice versa.
+    * @param[out] op_pixels Output pixels. Should point to the buffer of at least i_height*i_row_pitch bytes.
+    * @param i_row_pitch Number of bytes between the beginnings of the consecutive output rows. Should be greater or equal than i_width*4.
+    */
+    void ToneMap(const std::vector<float> &i_values, size_t i_width, size_t i_height, PixelFormat i_format, bool i_flip_rows, unsigned char *op_pixels, size_t i_row_pitch) const;
+
+    /**
+    * Converts a single Spectrum value to the 8-bit RGB color.
+    * @param i_value Spectrum value components.
+    * @param[out] o_rgb Red, green and blue components of the resulting color.
+    */
+    void ToneMap(const float i_value[3], unsigned char o_rgb[3]) const;
+
+  private:
+    void _ToneMapRow(const float *ip_values, size_t i_width, size_t i_red_offset, size_t i_blue_offset, unsigned char *op_pixels) const;
+
+    unsigned char _Quantize(double i_value) const;
+
+  private:
+    // Matrix converting the scaled Spectrum values to the RGB values and the row converting them to the luminance.
+    double m_spectrum_to_rgb[3][3], m_spectrum_to_luminance[3];
+
+    // m_thresholds[i] is the smallest linear RGB value that is quantized to i (for i>0).
+    double m_thresholds[256];
+  };
+
+/////////////////////////////////////////// IMPLEMENTATION ////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+inline unsigned char ToneMapper::_Quantize(double i_value) const
+  {
+  // Binary search over the thresholds. Negative and NaN values are quantized to zero.
+  size_t index = 0;
+  for(size_t step=128;step>0;step>>=1)
+    if (i_value >= m_thresholds[index+step])
+      index += step;
+
+  return (unsigned char)index;
+  }
+
+#endif // TONE_MAPPER_H
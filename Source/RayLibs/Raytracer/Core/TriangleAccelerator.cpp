@@ -17,133 +17,582 @@
 #include <tbb/tbb.h>
 #include <numeric>
 #include <cstring>
-#include <map>
+#include <set>
 
-TriangleAccelerator::TriangleAccelerator(std::vector<intrusive_ptr<const Primitive>> i_primitives):
-mp_root(NULL), m_primitives(i_primitives), m_pool(100000*sizeof(TriangleAccelerator::Node))
+namespace
   {
-  typedef std::map<const TriangleMesh *, std::vector<size_t>> InstancesMap;
-  typedef InstancesMap::const_iterator InstancesIterator;
+  // Number of bits per coordinate in the Morton codes, the codes have 3*MORTON_BITS_PER_AXIS bits in total.
+  const unsigned int MORTON_BITS_PER_AXIS = 10;
 
-  /*
-  * Step 1. Group all primitives by their meshes.
-  * Some meshes can be shared by more than one primitive in which case we deal with instanced objects.
+  /**
+  * Inserts two zero bits before each of the lower ten bits of the specified value.
   */
-  InstancesMap instances_map;
-  for(size_t i=0;i<i_primitives.size();++i)
+  unsigned int _ExpandBits(unsigned int i_value)
     {
-    const TriangleMesh *p_mesh = i_primitives[i]->GetTriangleMesh_RawPtr();
-    std::vector<size_t> &instanced_primitives = instances_map[p_mesh];
-    instanced_primitives.push_back(i);
+    i_value = (i_value * 0x00010001u) & 0xFF0000FFu;
+    i_value = (i_value * 0x00000101u) & 0x0F00F00Fu;
+    i_value = (i_value * 0x00000011u) & 0xC30C30C3u;
+    i_value = (i_value * 0x00000005u) & 0x49249249u;
+    return i_value;
     }
 
+  /**
+  * Returns the Morton code of the specified point with the coordinates in [0;1] range.
+  * The bits of the coordinates are interleaved so that the bit 3k+2 of the code belongs to X coordinate, the bit 3k+1 to Y coordinate and the bit 3k to Z coordinate.
+  */
+  unsigned int _ComputeMortonCode(double i_x, double i_y, double i_z)
+    {
+    const double scale = (double)(1<<MORTON_BITS_PER_AXIS);
+    unsigned int x = (unsigned int) std::min(std::max(i_x*scale, 0.0), scale-1.0);
+    unsigned int y = (unsigned int) std::min(std::max(i_y*scale, 0.0), scale-1.0);
+    unsigned int z = (unsigned int) std::min(std::max(i_z*scale, 0.0), scale-1.0);
+    return (_ExpandBits(x)<<2) | (_ExpandBits(y)<<1) | _ExpandBits(z);
+    }
+
+  /**
+  * Sorts the Morton codes (along with the associated triangle indices) with the least significant digit radix sort, one coordinate's worth of bits per pass.
+  */
+  void _RadixSort(std::vector<std::pair<unsigned int,size_t>> &io_codes)
+    {
+    const unsigned int digits_count = 1<<MORTON_BITS_PER_AXIS;
+    std::vector<std::pair<unsigned int,size_t>> buffer(io_codes.size());
+    std::vector<size_t> offsets(digits_count);
+
+    for(unsigned int pass=0;pass<3;++pass)
+      {
+      unsigned int shift = pass*MORTON_BITS_PER_AXIS;
+
+      std::fill(offsets.begin(), offsets.end(), 0);
+      for(size_t i=0;i<io_codes.size();++i)
+        ++offsets[(io_codes[i].first>>shift) & (digits_count-1)];
+
+      // Convert the counts to the offsets of the first elements with the corresponding digits.
+      size_t offset = 0;
+      for(unsigned int i=0;i<digits_count;++i)
+        {
+        size_t count = offsets[i];
+        offsets[i] = offset;
+        offset += count;
+        }
+
+      // The pass is stable so the order established by the previous passes is preserved for the codes with the same digit.
+      for(size_t i=0;i<io_codes.size();++i)
+        buffer[offsets[(io_codes[i].first>>shift) & (digits_count-1)]++] = io_codes[i];
+
+      io_codes.swap(buffer);
+      }
+    }
+
+  }
+
+const double TriangleAccelerator::MAX_REFIT_COST_RATIO = 1.5;
+const double TriangleAccelerator::BBOX_TEST_TOLERANCE = 16.0*FLT_EPS;
+
+TriangleAccelerator::TriangleAccelerator(std::vector<intrusive_ptr<const Primitive>> i_primitives, BuildMode i_build_mode):
+mp_root(NULL), m_primitives(i_primitives), m_pool(100000*sizeof(TriangleAccelerator::Node)), m_top_level_pool(1000*sizeof(TriangleAccelerator::Node)),
+m_triangle_bboxes_offset(0), m_top_level_tree_refit_needed(false), m_top_level_tree_rebuild_needed(false), m_build_mode(i_build_mode)
+  {
   // Count triangles from unique meshes (different primitives can share the same mesh).
+  std::set<const TriangleMesh *> meshes;
   size_t number_of_triangles=0;
-  for(InstancesIterator it = instances_map.begin(); it!=instances_map.end(); ++it)
-    number_of_triangles += (it->first)->GetNumberOfTriangles();
+  for(size_t i=0;i<i_primitives.size();++i)
+    if (meshes.insert(i_primitives[i]->GetTriangleMesh_RawPtr()).second)
+      number_of_triangles += i_primitives[i]->GetTriangleMesh_RawPtr()->GetNumberOfTriangles();
 
   m_triangles.reserve(number_of_triangles);
-  m_primitive_indices.reserve(number_of_triangles);
   m_triangle_indices.reserve(number_of_triangles);
-  m_triangle_bboxes.reserve(number_of_triangles);
+
+  m_instance_nodes.reserve(i_primitives.size());
+  m_world_to_instance_transformations.reserve(i_primitives.size());
+  m_instance_primitive_indices.reserve(i_primitives.size());
+  m_instance_bboxes.reserve(i_primitives.size());
 
   /*
-  * Step 2. Process the primitives that share mesh with other primitive(s).
-  * For each shared mesh we construct its own (sub)tree that will later be included in the final tree.
+  * Step 1. For each unique mesh construct its bottom-level tree in the mesh space.
+  * Each primitive referencing the mesh becomes an instance of that tree.
   */
-  for(InstancesIterator it = instances_map.begin(); it!=instances_map.end(); ++it)
-    if (it->second.size() > 1) // Test that this primitive shares the mesh.
+  for(size_t i=0;i<i_primitives.size();++i)
+    _AddInstance(i, _GetMeshTree(i_primitives[i]->GetTriangleMesh()));
+
+  // Check the final size of the triangles vector, each uniques triangle should have been added exactly once.
+  ASSERT(m_triangles.size() == number_of_triangles);
+
+  /*
+  * Step 2. Finally, construct the top-level tree over all instances.
+  */
+  _BuildTopLevelTree();
+  }
+
+const TriangleAccelerator::Node *TriangleAccelerator::_GetMeshTree(intrusive_ptr<const TriangleMesh> ip_mesh)
+  {
+  ASSERT(ip_mesh);
+  std::map<const TriangleMesh *, MeshTree>::const_iterator it = m_mesh_trees.find(ip_mesh.get());
+  if (it != m_mesh_trees.end())
+    return it->second.mp_root;
+
+  size_t triangles_begin = m_triangles.size();
+  for(size_t j=0;j<ip_mesh->GetNumberOfTriangles();++j)
+    {
+    MeshTriangle triangle = ip_mesh->GetTriangle(j);
+    m_triangles.push_back(Triangle3D_f(
+      ip_mesh->GetVertex(triangle.m_vertices[0]),
+      ip_mesh->GetVertex(triangle.m_vertices[1]),
+      ip_mesh->GetVertex(triangle.m_vertices[2])));
+    m_triangle_indices.push_back(j);
+    }
+
+  MeshTree mesh_tree;
+  mesh_tree.mp_root = _BuildMeshTree(triangles_begin, m_triangles.size(), m_pool);
+  mesh_tree.m_cost = _ComputeTreeCost(mesh_tree.mp_root);
+
+  m_mesh_trees[ip_mesh.get()] = mesh_tree;
+  m_meshes.push_back(ip_mesh);
+  return mesh_tree.mp_root;
+  }
+
+TriangleAccelerator::Node *TriangleAccelerator::_BuildMeshTree(size_t i_triangles_begin, size_t i_triangles_end, MemoryPool &i_pool)
+  {
+  ASSERT(i_triangles_begin<=i_triangles_end && i_triangles_end<=m_triangles.size());
+
+  // The bboxes are only stored for the triangles of the mesh being processed.
+  m_triangle_bboxes_offset = i_triangles_begin;
+  m_triangle_bboxes.resize(i_triangles_end-i_triangles_begin);
+
+  for(size_t i=i_triangles_begin;i<i_triangles_end;++i)
+    {
+    BBox3D_f &triangle_bbox = m_triangle_bboxes[i-m_triangle_bboxes_offset];
+    triangle_bbox.Unite(m_triangles[i][0]);
+    triangle_bbox.Unite(m_triangles[i][1]);
+    triangle_bbox.Unite(m_triangles[i][2]);
+    }
+
+  Node *p_mesh_tree;
+  if (m_build_mode == BUILD_MODE_SAH)
+    {
+    void *ptr = i_pool.Alloc(sizeof(Node));
+    p_mesh_tree = new (ptr) Node(*this, i_pool, i_triangles_begin, i_triangles_end, 0, 0, 0, 0);
+    }
+  else
+    p_mesh_tree = _BuildMortonTree(i_triangles_begin, i_triangles_end, i_pool);
+
+  // Release the memory, we don't longer need the triangles bboxes.
+  std::vector<BBox3D_f>().swap(m_triangle_bboxes);
+  return p_mesh_tree;
+  }
+
+TriangleAccelerator::Node *TriangleAccelerator::_BuildMortonTree(size_t i_triangles_begin, size_t i_triangles_end, MemoryPool &i_pool)
+  {
+  ASSERT(m_triangle_bboxes_offset == i_triangles_begin && m_triangle_bboxes.size() == i_triangles_end-i_triangles_begin);
+  size_t triangles_count = i_triangles_end-i_triangles_begin;
+
+  // The centers of the triangles bboxes are used as the centroids.
+  BBox3D_d centroids_bbox;
+  for(size_t i=0;i<triangles_count;++i)
+    centroids_bbox.Unite( (Convert<double>(m_triangle_bboxes[i].m_min) + Convert<double>(m_triangle_bboxes[i].m_max)) * 0.5 );
+
+  // The codes are computed relative to the centroids bbox. Flat dimensions of the bbox get zero bits.
+  double inv_extents[3];
+  for(unsigned char k=0;k<3;++k)
+    {
+    double extent = centroids_bbox.m_max[k]-centroids_bbox.m_min[k];
+    inv_extents[k] = extent>0.0 ? 1.0/extent : 0.0;
+    }
+
+  std::vector<std::pair<unsigned int,size_t>> codes(triangles_count);
+  tbb::parallel_for(tbb::blocked_range<size_t>(0, triangles_count), [&](const tbb::blocked_range<size_t> &i_range)
+    {
+    for(size_t i=i_range.begin();i!=i_range.end();++i)
       {
-      const TriangleMesh *p_mesh = it->first;
-      const std::vector<size_t> &instanced_primitives = it->second;
+      Point3D_d centroid = (Convert<double>(m_triangle_bboxes[i].m_min) + Convert<double>(m_triangle_bboxes[i].m_max)) * 0.5;
+      codes[i].first = _ComputeMortonCode(
+        (centroid[0]-centroids_bbox.m_min[0])*inv_extents[0],
+        (centroid[1]-centroids_bbox.m_min[1])*inv_extents[1],
+        (centroid[2]-centroids_bbox.m_min[2])*inv_extents[2]);
+      codes[i].second = i_triangles_begin+i;
+      }
+    });
 
-      size_t previous_triangles_num = m_triangles.size();
-      for(size_t j=0;j<p_mesh->GetNumberOfTriangles();++j)
-        {
-        MeshTriangle triangle = p_mesh->GetTriangle(j);
-        Triangle3D_f triangle_3d(
-          p_mesh->GetVertex(triangle.m_vertices[0]),
-          p_mesh->GetVertex(triangle.m_vertices[1]),
-          p_mesh->GetVertex(triangle.m_vertices[2]));
-
-        m_triangles.push_back(triangle_3d);
-        m_primitive_indices.push_back(std::numeric_limits<size_t>::max()); // No specific primitive associated with the triangle.
-        m_triangle_indices.push_back(j);
-
-        BBox3D_f triangle_bbox;
-        triangle_bbox.Unite(triangle_3d[0]);
-        triangle_bbox.Unite(triangle_3d[1]);
-        triangle_bbox.Unite(triangle_3d[2]);
-        m_triangle_bboxes.push_back(triangle_bbox);
-        }
+  _RadixSort(codes);
 
-      void *ptr = m_pool.Alloc(sizeof(Node));
-      const Node *p_sub_tree = new (ptr) Node(*this, previous_triangles_num, m_triangles.size(), 0, 0, 0, 0);
+  // Reorder the triangles along the Z-order curve.
+  std::vector<Triangle3D_f> triangles(triangles_count);
+  std::vector<size_t> triangle_indices(triangles_count);
+  std::vector<BBox3D_f> triangle_bboxes(triangles_count);
+  std::vector<unsigned int> sorted_codes(triangles_count);
+  tbb::parallel_for(tbb::blocked_range<size_t>(0, triangles_count), [&](const tbb::blocked_range<size_t> &i_range)
+    {
+    for(size_t i=i_range.begin();i!=i_range.end();++i)
+      {
+      triangles[i] = m_triangles[codes[i].second];
+      triangle_indices[i] = m_triangle_indices[codes[i].second];
+      triangle_bboxes[i] = m_triangle_bboxes[codes[i].second-m_triangle_bboxes_offset];
+      sorted_codes[i] = codes[i].first;
+      }
+    });
 
-      // Now for all primitives sharing this mesh store the information such as world space bbox, pointer to the subtree etc.
-      for(size_t i=0;i<instanced_primitives.size();++i)
-        {
-        ASSERT( m_primitives[instanced_primitives[i]]->GetTriangleMesh_RawPtr() == p_mesh );
+  std::copy(triangles.begin(), triangles.end(), m_triangles.begin()+i_triangles_begin);
+  std::copy(triangle_indices.begin(), triangle_indices.end(), m_triangle_indices.begin()+i_triangles_begin);
+  m_triangle_bboxes.swap(triangle_bboxes);
 
-        Transform instance_to_world = m_primitives[instanced_primitives[i]]->GetMeshToWorldTransform();
-        BBox3D_f instance_bbox;
-        for(unsigned char j=0;j<8;++j)
-          {
-          Point3D_f mn = p_sub_tree->m_bbox.m_min, mx = p_sub_tree->m_bbox.m_max;
-          Point3D_f bbox_vertex((j&1)?mn[0]:mx[0], (j&2)?mn[1]:mx[1], (j&4)?mn[2]:mx[2]);
-          instance_bbox.Unite(instance_to_world(bbox_vertex));
-          }
+  // The nodes are emitted in the calling thread because the memory pool is not thread-safe, the emission is linear in the number of triangles anyway.
+  Node *p_root = _EmitMortonNode(sorted_codes, i_triangles_begin, i_triangles_begin, i_triangles_end, 3*MORTON_BITS_PER_AXIS-1, i_pool, 0);
 
-        m_instance_primitive_indices.push_back(instanced_primitives[i]);
-        m_instance_nodes.push_back(p_sub_tree);
-        m_instance_to_world_transformations.push_back(instance_to_world);
-        m_instance_bboxes.push_back(instance_bbox);
-        }
+  if (m_build_mode == BUILD_MODE_MORTON_OPTIMIZED)
+    {
+    _OptimizeTreelets(p_root);
+    _LayoutTriangles(p_root);
+    }
+
+  return p_root;
+  }
+
+TriangleAccelerator::Node *TriangleAccelerator::_EmitMortonNode(const std::vector<unsigned int> &i_codes, size_t i_codes_offset,
+                                                                size_t i_triangles_begin, size_t i_triangles_end, int i_bit, MemoryPool &i_pool, size_t i_depth)
+  {
+  ASSERT(i_triangles_begin<i_triangles_end);
+  void *ptr = i_pool.Alloc(sizeof(Node));
+  Node *p_node = new (ptr) Node(i_triangles_begin, i_triangles_end, 0, 0);
+
+  if (i_triangles_end-i_triangles_begin <= MAX_TRIANGLES_IN_LEAF || i_depth>=MAX_TREE_DEPTH)
+    {
+    p_node->m_bbox = _ConstructBBox(i_triangles_begin, i_triangles_end, 0, 0);
+    return p_node;
+    }
+
+  // Skip the bits all codes in the range share. The codes are sorted so it is enough to compare the first and the last ones.
+  unsigned int first_code = i_codes[i_triangles_begin-i_codes_offset], last_code = i_codes[i_triangles_end-1-i_codes_offset];
+  while (i_bit>=0 && ((first_code^last_code) & (1u<<i_bit)) == 0)
+    --i_bit;
+
+  size_t split;
+  unsigned char split_axis;
+  if (i_bit>=0)
+    {
+    // Find the first code with the bit set.
+    unsigned int split_code = ((first_code>>i_bit) | 1u) << i_bit;
+    split = i_codes_offset + (std::lower_bound(i_codes.begin()+(i_triangles_begin-i_codes_offset), i_codes.begin()+(i_triangles_end-i_codes_offset), split_code) - i_codes.begin());
+    split_axis = (unsigned char) (2 - i_bit%3);
+    }
+  else
+    {
+    // All codes are equal, split the range in the middle.
+    split = (i_triangles_begin+i_triangles_end)/2;
+    split_axis = 0;
+    }
+  ASSERT(split>i_triangles_begin && split<i_triangles_end);
+
+  p_node->m_children[0] = _EmitMortonNode(i_codes, i_codes_offset, i_triangles_begin, split, i_bit-1, i_pool, i_depth+1);
+  p_node->m_children[2] = _EmitMortonNode(i_codes, i_codes_offset, split, i_triangles_end, i_bit-1, i_pool, i_depth+1);
+  p_node->SetType(false, split_axis);
+
+  p_node->m_bbox = p_node->m_children[0]->m_bbox;
+  p_node->m_bbox.Unite(p_node->m_children[2]->m_bbox);
+  return p_node;
+  }
+
+void TriangleAccelerator::_OptimizeTreelets(Node *ip_node)
+  {
+  if (ip_node->IsLeaf())
+    return;
+
+  ASSERT(ip_node->m_children[0] && ip_node->m_children[1]==NULL && ip_node->m_children[2]);
+  _OptimizeTreelets(ip_node->m_children[0]);
+  _OptimizeTreelets(ip_node->m_children[2]);
+
+  Node *p_left = ip_node->m_children[0], *p_right = ip_node->m_children[2];
+  if (p_left->IsLeaf() || p_right->IsLeaf())
+    return;
+
+  // The grandchildren are fixed, so the cost of the treelet only depends on the areas of the two intermediate nodes.
+  Node *grandchildren[4] = {p_left->m_children[0], p_left->m_children[2], p_right->m_children[0], p_right->m_children[2]};
+  static const unsigned char pairings[3][4] = {{0,1,2,3}, {0,2,1,3}, {0,3,1,2}};
+
+  unsigned char best_pairing = 0;
+  double best_area = DBL_INF;
+  for(unsigned char i=0;i<3;++i)
+    {
+    BBox3D_f bbox1 = grandchildren[pairings[i][0]]->m_bbox, bbox2 = grandchildren[pairings[i][2]]->m_bbox;
+    bbox1.Unite(grandchildren[pairings[i][1]]->m_bbox);
+    bbox2.Unite(grandchildren[pairings[i][3]]->m_bbox);
+
+    double area = bbox1.Area()+bbox2.Area();
+    if (area < best_area)
+      {
+      best_area = area;
+      best_pairing = i;
       }
+    }
 
-  /*
-  * Step 3. Process the primitives that do not share mesh with other primitives.
-  */
-  size_t previous_triangles_num = m_triangles.size();
-  for(InstancesIterator it = instances_map.begin(); it!=instances_map.end(); ++it)
-    if (it->second.size() == 1)
+  if (best_pairing != 0)
+    {
+    const unsigned char *pairing = pairings[best_pairing];
+    p_left->SetChildren(grandchildren[pairing[0]], grandchildren[pairing[1]]);
+    p_right->SetChildren(grandchildren[pairing[2]], grandchildren[pairing[3]]);
+    ip_node->SetChildren(p_left, p_right);
+    }
+  }
+
+void TriangleAccelerator::_LayoutTriangles(Node *ip_root)
+  {
+  size_t triangles_begin = ip_root->m_triangles_begin, triangles_end = ip_root->m_triangles_end;
+
+  std::vector<Triangle3D_f> triangles;
+  std::vector<size_t> triangle_indices;
+  triangles.reserve(triangles_end-triangles_begin);
+  triangle_indices.reserve(triangles_end-triangles_begin);
+
+  _LayoutNode(ip_root, triangles_begin, triangles, triangle_indices);
+  ASSERT(triangles.size() == triangles_end-triangles_begin);
+
+  std::copy(triangles.begin(), triangles.end(), m_triangles.begin()+triangles_begin);
+  std::copy(triangle_indices.begin(), triangle_indices.end(), m_triangle_indices.begin()+triangles_begin);
+  }
+
+void TriangleAccelerator::_LayoutNode(Node *ip_node, size_t i_triangles_offset, std::vector<Triangle3D_f> &o_triangles, std::vector<size_t> &o_triangle_indices) const
+  {
+  size_t triangles_begin = i_triangles_offset+o_triangles.size();
+
+  if (ip_node->IsLeaf())
+    for(size_t i=ip_node->m_triangles_begin;i<ip_node->m_triangles_end;++i)
       {
-      const TriangleMesh *p_mesh = it->first;
-      size_t primitive_index = it->second[0];
-      Transform mesh_to_world = m_primitives[primitive_index]->GetMeshToWorldTransform();
+      o_triangles.push_back(m_triangles[i]);
+      o_triangle_indices.push_back(m_triangle_indices[i]);
+      }
+  else
+    for(unsigned char i=0;i<3;++i)
+      if (ip_node->m_children[i])
+        _LayoutNode(ip_node->m_children[i], i_triangles_offset, o_triangles, o_triangle_indices);
 
-      for(size_t j=0;j<p_mesh->GetNumberOfTriangles();++j)
-        {
-        MeshTriangle triangle = p_mesh->GetTriangle(j);
-        Triangle3D_f triangle_3d(
-          mesh_to_world( p_mesh->GetVertex(triangle.m_vertices[0]) ),
-          mesh_to_world( p_mesh->GetVertex(triangle.m_vertices[1]) ),
-          mesh_to_world( p_mesh->GetVertex(triangle.m_vertices[2]) ));
-
-        m_triangles.push_back(triangle_3d);
-        m_primitive_indices.push_back(primitive_index);
-        m_triangle_indices.push_back(j);
-
-        BBox3D_f triangle_bbox;
-        triangle_bbox.Unite(triangle_3d[0]);
-        triangle_bbox.Unite(triangle_3d[1]);
-        triangle_bbox.Unite(triangle_3d[2]);
-        m_triangle_bboxes.push_back(triangle_bbox);
-        }
+  ip_node->m_triangles_begin = triangles_begin;
+  ip_node->m_triangles_end = i_triangles_offset+o_triangles.size();
+  }
+
+void TriangleAccelerator::_AddInstance(size_t i_primitive_index, const Node *ip_mesh_tree)
+  {
+  const Primitive *p_primitive = m_primitives[i_primitive_index].get();
+  ASSERT(m_mesh_trees.find(p_primitive->GetTriangleMesh_RawPtr())->second.mp_root == ip_mesh_tree);
+
+  m_instance_primitive_indices.push_back(i_primitive_index);
+  m_instance_nodes.push_back(ip_mesh_tree);
+  m_world_to_instance_transformations.push_back(InstanceTransform(p_primitive->GetWorldToMeshTransform()));
+  m_instance_bboxes.push_back(_ConstructInstanceBBox(ip_mesh_tree, p_primitive->GetMeshToWorldTransform()));
+  }
+
+void TriangleAccelerator::_UpdatePrimitiveInstanceIndices()
+  {
+  m_primitive_instance_indices.resize(m_primitives.size());
+  for(size_t i=0;i<m_instance_primitive_indices.size();++i)
+    m_primitive_instance_indices[m_instance_primitive_indices[i]] = i;
+  }
+
+void TriangleAccelerator::_BuildTopLevelTree()
+  {
+  m_top_level_pool.FreeAll();
+
+  void *ptr = m_top_level_pool.Alloc(sizeof(Node));
+  mp_root = new (ptr) Node(*this, m_top_level_pool, 0, 0, 0, m_instance_nodes.size(), 0, 0);
+
+  // The construction reorders the instances so the primitive-to-instance mapping needs to be updated.
+  _UpdatePrimitiveInstanceIndices();
+
+  m_top_level_tree_cost = _ComputeTreeCost(mp_root);
+  m_top_level_tree_refit_needed = m_top_level_tree_rebuild_needed = false;
+  }
+
+void TriangleAccelerator::SetPrimitive(size_t i_index, intrusive_ptr<const Primitive> ip_primitive)
+  {
+  ASSERT(i_index < m_primitives.size());
+  ASSERT(ip_primitive);
+
+  size_t instance_index = m_primitive_instance_indices[i_index];
+  m_primitives[i_index] = ip_primitive;
+
+  const Node *p_mesh_tree = _GetMeshTree(ip_primitive->GetTriangleMesh());
+  InstanceTransform world_to_instance(ip_primitive->GetWorldToMeshTransform());
+
+  // Nothing else to do if the geometry is not changed (e.g. if only the material is changed).
+  if (p_mesh_tree == m_instance_nodes[instance_index] &&
+    memcmp(&world_to_instance, &m_world_to_instance_transformations[instance_index], sizeof(InstanceTransform)) == 0)
+    return;
+
+  m_instance_nodes[instance_index] = p_mesh_tree;
+  m_world_to_instance_transformations[instance_index] = world_to_instance;
+  m_instance_bboxes[instance_index] = _ConstructInstanceBBox(p_mesh_tree, ip_primitive->GetMeshToWorldTransform());
+  m_top_level_tree_refit_needed = true;
+  }
+
+void TriangleAccelerator::AddPrimitive(intrusive_ptr<const Primitive> ip_primitive)
+  {
+  ASSERT(ip_primitive);
+
+  m_primitives.push_back(ip_primitive);
+  _AddInstance(m_primitives.size()-1, _GetMeshTree(ip_primitive->GetTriangleMesh()));
+  m_primitive_instance_indices.push_back(m_instance_nodes.size()-1);
+  m_top_level_tree_rebuild_needed = true;
+  }
+
+void TriangleAccelerator::RemovePrimitive(size_t i_index)
+  {
+  ASSERT(i_index < m_primitives.size());
+
+  // Move the instance to the end and remove it.
+  size_t instance_index = m_primitive_instance_indices[i_index];
+  _SwapInstances(instance_index, m_instance_nodes.size()-1);
+  m_instance_nodes.pop_back();
+  m_world_to_instance_transformations.pop_back();
+  m_instance_primitive_indices.pop_back();
+  m_instance_bboxes.pop_back();
+
+  m_primitives.erase(m_primitives.begin()+i_index);
+  for(size_t i=0;i<m_instance_primitive_indices.size();++i)
+    if (m_instance_primitive_indices[i] > i_index)
+      --m_instance_primitive_indices[i];
+
+  _UpdatePrimitiveInstanceIndices();
+  m_top_level_tree_rebuild_needed = true;
+  }
+
+bool TriangleAccelerator::UpdateTopLevelTree()
+  {
+  if (m_top_level_tree_rebuild_needed)
+    {
+    _BuildTopLevelTree();
+    return true;
+    }
+
+  if (m_top_level_tree_refit_needed == false)
+    return false;
+
+  _RefitNode(mp_root);
+  m_top_level_tree_refit_needed = false;
+
+  if (_ComputeTreeCost(mp_root) > MAX_REFIT_COST_RATIO*m_top_level_tree_cost)
+    {
+    _BuildTopLevelTree();
+    return true;
+    }
+  else
+    return false;
+  }
+
+bool TriangleAccelerator::UpdateMesh(const TriangleMesh *ip_mesh)
+  {
+  ASSERT(ip_mesh);
+  std::map<const TriangleMesh *, MeshTree>::iterator it = m_mesh_trees.find(ip_mesh);
+  ASSERT(it != m_mesh_trees.end());
+  if (it == m_mesh_trees.end())
+    return false;
+
+  MeshTree &mesh_tree = it->second;
+  Node *p_old_root = mesh_tree.mp_root;
+  size_t triangles_begin = p_old_root->m_triangles_begin, triangles_end = p_old_root->m_triangles_end;
+
+  // Re-read the triangles from the mesh. The triangles are stored in the order of the tree leaves so m_triangle_indices is used to find them in the mesh.
+  tbb::parallel_for(tbb::blocked_range<size_t>(triangles_begin, triangles_end), [&](const tbb::blocked_range<size_t> &i_range)
+    {
+    for(size_t i=i_range.begin();i!=i_range.end();++i)
+      {
+      MeshTriangle triangle = ip_mesh->GetTriangle(m_triangle_indices[i]);
+      m_triangles[i] = Triangle3D_f(
+        ip_mesh->GetVertex(triangle.m_vertices[0]),
+        ip_mesh->GetVertex(triangle.m_vertices[1]),
+        ip_mesh->GetVertex(triangle.m_vertices[2]));
       }
+    });
 
-  /*
-  * Step 4. Finally, construct the resulting tree with all the triangles and instanced objects.
-  */
-  void *ptr = m_pool.Alloc(sizeof(Node));
-  mp_root = new (ptr) Node(*this, previous_triangles_num, m_triangles.size(), 0, m_instance_nodes.size(), 0, 0);
+  _RefitNode(p_old_root);
 
-  // Check the final size of the triangles vector, each uniques triangle should have been added exactly once.
-  ASSERT(m_triangles.size() == number_of_triangles);
+  bool rebuilt = false;
+  if (_ComputeTreeCost(p_old_root) > MAX_REFIT_COST_RATIO*mesh_tree.m_cost)
+    {
+    // The nodes of the initially built trees are allocated from the shared m_pool and can not be released, so the rebuilt tree gets its own pool.
+    if (mesh_tree.mp_pool)
+      mesh_tree.mp_pool->FreeAll();
+    else
+      mesh_tree.mp_pool.reset(new MemoryPool(std::max((size_t)65536, (triangles_end-triangles_begin)*sizeof(Node))));
+
+    mesh_tree.mp_root = _BuildMeshTree(triangles_begin, triangles_end, *mesh_tree.mp_pool);
+    mesh_tree.m_cost = _ComputeTreeCost(mesh_tree.mp_root);
+    rebuilt = true;
+    }
+
+  // Update the bboxes of all the instances of the mesh.
+  for(size_t i=0;i<m_instance_nodes.size();++i)
+    if (m_instance_nodes[i] == p_old_root)
+      {
+      m_instance_nodes[i] = mesh_tree.mp_root;
+      m_instance_bboxes[i] = _ConstructInstanceBBox(mesh_tree.mp_root, m_primitives[m_instance_primitive_indices[i]]->GetMeshToWorldTransform());
+      m_top_level_tree_refit_needed = true;
+      }
+
+  return rebuilt;
+  }
+
+void TriangleAccelerator::_RefitNode(Node *ip_node)
+  {
+  if (ip_node->IsLeaf())
+    {
+    // The triangles bboxes are only available during the construction so the bbox is computed from the vertices.
+    ip_node->m_bbox = BBox3D_f();
+    for(size_t i=ip_node->m_triangles_begin;i<ip_node->m_triangles_end;++i)
+      {
+      ip_node->m_bbox.Unite(m_triangles[i][0]);
+      ip_node->m_bbox.Unite(m_triangles[i][1]);
+      ip_node->m_bbox.Unite(m_triangles[i][2]);
+      }
 
-  // Release the memory, we don't longer need the bboxes.
-  m_triangle_bboxes.swap(std::vector<BBox3D_f>());
-  m_instance_bboxes.swap(std::vector<BBox3D_f>());
+    for(size_t i=ip_node->m_instances_begin;i<ip_node->m_instances_end;++i)
+      ip_node->m_bbox.Unite(m_instance_bboxes[i]);
+    return;
+    }
+
+  // The children are independent so they can be refitted in parallel. Small subtrees are refitted in the calling thread to avoid the scheduling overhead.
+  size_t node_size = (ip_node->m_triangles_end-ip_node->m_triangles_begin) + (ip_node->m_instances_end-ip_node->m_instances_begin);
+  if (node_size >= MIN_PARALLEL_REFIT_SIZE)
+    tbb::parallel_for((size_t)0, (size_t)3, [&](size_t i)
+      {
+      if (ip_node->m_children[i])
+        _RefitNode(ip_node->m_children[i]);
+      });
+  else
+    for(unsigned char i=0;i<3;++i)
+      if (ip_node->m_children[i])
+        _RefitNode(ip_node->m_children[i]);
+
+  // The children partition the node's triangles and instances so the node's bbox is the union of the children bboxes.
+  ip_node->m_bbox = BBox3D_f();
+  for(unsigned char i=0;i<3;++i)
+    if (ip_node->m_children[i])
+      ip_node->m_bbox.Unite(ip_node->m_children[i]->m_bbox);
+  }
+
+double TriangleAccelerator::_ComputeTreeCost(const Node *ip_root) const
+  {
+  double root_area = ip_root->m_bbox.Area();
+  if ((ip_root->m_triangles_begin==ip_root->m_triangles_end && ip_root->m_instances_begin==ip_root->m_instances_end) || root_area <= 0.0)
+    return 0.0;
+
+  return _ComputeNodeCost(ip_root) / root_area;
+  }
+
+double TriangleAccelerator::_ComputeNodeCost(const Node *ip_node) const
+  {
+  if (ip_node->IsLeaf())
+    {
+    // Each instance is weighted by the number of triangles in it, the same way as in _DetermineBestSplit() method.
+    size_t triangles_count = ip_node->m_triangles_end-ip_node->m_triangles_begin;
+    for(size_t i=ip_node->m_instances_begin;i<ip_node->m_instances_end;++i)
+      triangles_count += m_instance_nodes[i]->m_triangles_end-m_instance_nodes[i]->m_triangles_begin;
+
+    return ip_node->m_bbox.Area()*triangles_count;
+    }
+
+  double cost = ip_node->m_bbox.Area();
+  for(unsigned char i=0;i<3;++i)
+    if (ip_node->m_children[i])
+      cost += _ComputeNodeCost(ip_node->m_children[i]);
+
+  return cost;
   }
 
 BBox3D_d TriangleAccelerator::GetWorldBounds() const
@@ -151,9 +600,13 @@ BBox3D_d TriangleAccelerator::GetWorldBounds() const
   return Convert<double>(mp_root->m_bbox);
   }
 
-bool TriangleAccelerator::_NodeIntersect(const TriangleAccelerator::Node *ip_node, Ray &io_ray, size_t &o_primitive_index, size_t &o_triangle_index) const
+bool TriangleAccelerator::_NodeIntersect(const TriangleAccelerator::Node *ip_node, Ray &io_ray, size_t &o_primitive_index, size_t &o_triangle_index, float &o_b1, float &o_b2) const
   {
   Ray ray(io_ray);
+  WatertightRay watertight_ray(ray);
+
+  // The bboxes are tested against the same single precision ray origin the triangles are tested against.
+  Point3D_d bbox_origin = Convert<double>(watertight_ray.m_origin);
 
   double invs[3];
   invs[0]=1.0/ray.m_direction[0];
@@ -173,17 +626,21 @@ bool TriangleAccelerator::_NodeIntersect(const TriangleAccelerator::Node *ip_nod
     const Node *p_node = todo[--todo_size];
 
     // Check whether the ray intersects the bbox of the node.
-    double tNear1 = (p_node->m_bbox.m_min[0] - ray.m_origin[0]) * invs[0];
-    double tFar1  = (p_node->m_bbox.m_max[0] - ray.m_origin[0]) * invs[0];
+    // The far distances are enlarged so that the rounding errors can not cull the nodes with the triangles the watertight test is positive for.
+    double tNear1 = (p_node->m_bbox.m_min[0] - bbox_origin[0]) * invs[0];
+    double tFar1  = (p_node->m_bbox.m_max[0] - bbox_origin[0]) * invs[0];
     if (tNear1 > tFar1) std::swap(tNear1, tFar1);
+    tFar1 += fabs(tFar1)*BBOX_TEST_TOLERANCE;
 
-    double tNear2 = (p_node->m_bbox.m_min[1] - ray.m_origin[1]) * invs[1];
-    double tFar2  = (p_node->m_bbox.m_max[1] - ray.m_origin[1]) * invs[1];
+    double tNear2 = (p_node->m_bbox.m_min[1] - bbox_origin[1]) * invs[1];
+    double tFar2  = (p_node->m_bbox.m_max[1] - bbox_origin[1]) * invs[1];
     if (tNear2 > tFar2) std::swap(tNear2, tFar2);
+    tFar2 += fabs(tFar2)*BBOX_TEST_TOLERANCE;
 
-    double tNear3 = (p_node->m_bbox.m_min[2] - ray.m_origin[2]) * invs[2];
-    double tFar3  = (p_node->m_bbox.m_max[2] - ray.m_origin[2]) * invs[2];
+    double tNear3 = (p_node->m_bbox.m_min[2] - bbox_origin[2]) * invs[2];
+    double tFar3  = (p_node->m_bbox.m_max[2] - bbox_origin[2]) * invs[2];
     if (tNear3 > tFar3) std::swap(tNear3, tFar3);
+    tFar3 += fabs(tFar3)*BBOX_TEST_TOLERANCE;
 
     if (
       ray.m_min_t > tFar1 || tNear1 > tFar2 || tNear2 > tFar1 || tNear3 > tFar1 ||
@@ -215,10 +672,10 @@ bool TriangleAccelerator::_NodeIntersect(const TriangleAccelerator::Node *ip_nod
       for(size_t i=p_node->m_instances_begin;i<p_node->m_instances_end;++i)
         {
         Ray transformed_ray;
-        m_instance_to_world_transformations[i].Inverted().operator()(ray, transformed_ray);
+        m_world_to_instance_transformations[i](ray, transformed_ray);
 
         size_t triangle_index2, primitive_index2;
-        if ( _NodeIntersect(m_instance_nodes[i], transformed_ray, primitive_index2, triangle_index2) )
+        if ( _NodeIntersect(m_instance_nodes[i], transformed_ray, primitive_index2, triangle_index2, o_b1, o_b2) )
           {
           intersected = true;
           instanced_primitive_intersected = true;
@@ -235,41 +692,20 @@ bool TriangleAccelerator::_NodeIntersect(const TriangleAccelerator::Node *ip_nod
       // And finally process all triangles in the leaf.
       for(size_t i=p_node->m_triangles_begin;i<p_node->m_triangles_end;++i)
         {
-        const Triangle3D_f &triangle = m_triangles[i];
-
-        Point3D_d v0 = Convert<double>(triangle[0]);
-        Point3D_d v1 = Convert<double>(triangle[1]);
-        Point3D_d v2 = Convert<double>(triangle[2]);
-
-        Vector3D_d e1 = Vector3D_d(v1-v0);
-        Vector3D_d e2 = Vector3D_d(v2-v0);
-        Vector3D_d s1 = ray.m_direction^e2;
-        double divisor = s1*e1;
-        double inv_divisor = 1.0/divisor;
-
-        // Compute first barycentric coordinate.
-        Vector3D_d d = Vector3D_d(ray.m_origin - v0);
-        double b1 = (d*s1) * inv_divisor;
-
-        // The two nested if-s are structured carefully to deal with the cases when the ray is parallel to the triangle's plane.
-        // In this case the barycentric coordinates will have NaN values and the if-s will return false.
-        if (b1 > -DBL_EPS && b1 < (1.0+DBL_EPS))
+        float b1, b2;
+        if (watertight_ray.Intersect(m_triangles[i], b1, b2))
           {
-          // Compute second barycentric coordinate.
-          Vector3D_d s2 = d^e1;
-          double b2 = (ray.m_direction*s2) * inv_divisor;
-          if (b2 > -DBL_EPS && b1 + b2 < (1.0+DBL_EPS))
+          // The comparisons are structured carefully to reject NaN values (in case the ray is nearly parallel to the triangle's plane).
+          double t = _ComputeRayParameter(m_triangles[i], ray);
+          if (t >= ray.m_min_t && t <= ray.m_max_t)
             {
-            // Compute t to intersection point.
-            double t = (e2*s2) * inv_divisor;
-            if (t >= ray.m_min_t && t <= ray.m_max_t)
-              {
-              ray.m_max_t = t;
-              triangle_index = i;
-
-              intersected = true;
-              instanced_primitive_intersected = false;
-              }
+            ray.m_max_t = t;
+            triangle_index = i;
+            o_b1 = b1;
+            o_b2 = b2;
+
+            intersected = true;
+            instanced_primitive_intersected = false;
             }
           }
         } // end of loop by triangles in the leaf
@@ -284,7 +720,8 @@ bool TriangleAccelerator::_NodeIntersect(const TriangleAccelerator::Node *ip_nod
   else
     if (intersected)
       {
-      o_primitive_index = m_primitive_indices[triangle_index];
+      // The triangles are stored in the mesh space, the primitive is determined by the instance in the calling method.
+      o_primitive_index = std::numeric_limits<size_t>::max();
       o_triangle_index = m_triangle_indices[triangle_index];
       return true;
       }
@@ -295,20 +732,22 @@ bool TriangleAccelerator::_NodeIntersect(const TriangleAccelerator::Node *ip_nod
 bool TriangleAccelerator::Intersect(const RayDifferential &i_ray, Intersection &o_intersection, double *o_t) const
   {
   ASSERT(i_ray.m_base_ray.m_direction.IsNormalized());
+  ASSERT(m_top_level_tree_refit_needed==false && m_top_level_tree_rebuild_needed==false);
   size_t primitive_index, triangle_index;
+  float b1, b2;
 
   Ray ray(i_ray.m_base_ray);
-  if (_NodeIntersect(mp_root, ray, primitive_index, triangle_index))
+  if (_NodeIntersect(mp_root, ray, primitive_index, triangle_index, b1, b2))
     {
     if (o_t) *o_t = ray.m_max_t;
 
-    intrusive_ptr<const Primitive> p_primitive = m_primitives[primitive_index];
-    o_intersection.mp_primitive = p_primitive.get();
+    const Primitive *p_primitive = m_primitives[primitive_index].get();
+    o_intersection.mp_primitive = p_primitive;
     o_intersection.m_triangle_index = triangle_index;
 
     const TriangleMesh *p_mesh = p_primitive->GetTriangleMesh_RawPtr();
-    Transform mesh_to_world = p_primitive->GetMeshToWorldTransform();
-    Transform world_to_mesh = mesh_to_world.Inverted();
+    const Transform &mesh_to_world = p_primitive->GetMeshToWorldTransform();
+    const Transform &world_to_mesh = p_primitive->GetWorldToMeshTransform();
 
     // Transform ray to the instance space.
     RayDifferential transformed_ray(i_ray);
@@ -318,8 +757,9 @@ bool TriangleAccelerator::Intersect(const RayDifferential &i_ray, Intersection &
     world_to_mesh(i_ray.m_direction_dx, transformed_ray.m_direction_dx);
     world_to_mesh(i_ray.m_direction_dy, transformed_ray.m_direction_dy);
 
+    // The ray parameter is preserved by the transformation and the barycentric coordinates are the ones computed by the intersection test.
     DifferentialGeometry transformed_dg;
-    p_mesh->ComputeDifferentialGeometry(o_intersection.m_triangle_index, transformed_ray, transformed_dg);
+    p_mesh->ComputeDifferentialGeometry(o_intersection.m_triangle_index, transformed_ray, b1, b2, ray.m_max_t, transformed_dg);
 
     // Transform DifferentialGeometry back to the world space.
     o_intersection.m_dg = transformed_dg;
@@ -339,10 +779,11 @@ bool TriangleAccelerator::Intersect(const RayDifferential &i_ray, Intersection &
     Point3D_d v2 = Convert<double>(p_mesh->GetVertex(triangle.m_vertices[2]));
 
     // Compute the values of the ray-triangle intersection test which are used later to avoid the intersection with the same triangle.
-    // Notice that instead of using transformed_dg.m_point we call world_to_mesh(o_intersection.m_dg.m_point) to get *exactly* the same coordinates
+    // The values are computed the same way as in _ComputeRayParameter() method.
+    // Notice that instead of using transformed_dg.m_point we call world_to_mesh(o_intersection.m_dg.m_point) to get the same coordinates
     // that would be used later during the intersection test.
     o_intersection.m_cross = Vector3D_d(v1-v0)^Vector3D_d(v2-v0);
-    o_intersection.m_dot = (Vector3D_d(v0-world_to_mesh(o_intersection.m_dg.m_point)) ^ Vector3D_d(v1-v0)) * Vector3D_d(v2-v0);
+    o_intersection.m_dot = Vector3D_d(v0-world_to_mesh(o_intersection.m_dg.m_point)) * o_intersection.m_cross;
 
     return true;
     }
@@ -351,9 +792,13 @@ bool TriangleAccelerator::Intersect(const RayDifferential &i_ray, Intersection &
   return false;
   }
 
-bool TriangleAccelerator::_NodeIntersectTest(const TriangleAccelerator::Node *ip_node, const Ray &i_ray) const
+bool TriangleAccelerator::_NodeIntersectTest(const TriangleAccelerator::Node *ip_node, const Ray &i_ray, OccluderHint *op_hint) const
   {
   Ray ray(i_ray);
+  WatertightRay watertight_ray(ray);
+
+  // The bboxes are tested against the same single precision ray origin the triangles are tested against.
+  Point3D_d bbox_origin = Convert<double>(watertight_ray.m_origin);
 
   double invs[3];
   invs[0]=1.0/ray.m_direction[0];
@@ -371,17 +816,21 @@ bool TriangleAccelerator::_NodeIntersectTest(const TriangleAccelerator::Node *ip
     const Node *p_node = todo[--todo_size];
 
     // Check whether the ray intersects the bbox of the node.
-    double tNear1 = (p_node->m_bbox.m_min[0] - ray.m_origin[0]) * invs[0];
-    double tFar1  = (p_node->m_bbox.m_max[0] - ray.m_origin[0]) * invs[0];
+    // The far distances are enlarged so that the rounding errors can not cull the nodes with the triangles the watertight test is positive for.
+    double tNear1 = (p_node->m_bbox.m_min[0] - bbox_origin[0]) * invs[0];
+    double tFar1  = (p_node->m_bbox.m_max[0] - bbox_origin[0]) * invs[0];
     if (tNear1 > tFar1) std::swap(tNear1, tFar1);
+    tFar1 += fabs(tFar1)*BBOX_TEST_TOLERANCE;
 
-    double tNear2 = (p_node->m_bbox.m_min[1] - ray.m_origin[1]) * invs[1];
-    double tFar2  = (p_node->m_bbox.m_max[1] - ray.m_origin[1]) * invs[1];
+    double tNear2 = (p_node->m_bbox.m_min[1] - bbox_origin[1]) * invs[1];
+    double tFar2  = (p_node->m_bbox.m_max[1] - bbox_origin[1]) * invs[1];
     if (tNear2 > tFar2) std::swap(tNear2, tFar2);
+    tFar2 += fabs(tFar2)*BBOX_TEST_TOLERANCE;
 
-    double tNear3 = (p_node->m_bbox.m_min[2] - ray.m_origin[2]) * invs[2];
-    double tFar3  = (p_node->m_bbox.m_max[2] - ray.m_origin[2]) * invs[2];
+    double tNear3 = (p_node->m_bbox.m_min[2] - bbox_origin[2]) * invs[2];
+    double tFar3  = (p_node->m_bbox.m_max[2] - bbox_origin[2]) * invs[2];
     if (tNear3 > tFar3) std::swap(tNear3, tFar3);
+    tFar3 += fabs(tFar3)*BBOX_TEST_TOLERANCE;
 
     if (
       ray.m_min_t > tFar1 || tNear1 > tFar2 || tNear2 > tFar1 || tNear3 > tFar1 ||
@@ -413,46 +862,26 @@ bool TriangleAccelerator::_NodeIntersectTest(const TriangleAccelerator::Node *ip
       for(size_t i=p_node->m_instances_begin;i<p_node->m_instances_end;++i)
         {
         Ray transformed_ray;
-        m_instance_to_world_transformations[i].Inverted().operator()(ray, transformed_ray);
-        if ( _NodeIntersectTest(m_instance_nodes[i], transformed_ray) )
+        m_world_to_instance_transformations[i](ray, transformed_ray);
+        if ( _NodeIntersectTest(m_instance_nodes[i], transformed_ray, op_hint) )
+          {
+          if (op_hint) op_hint->m_instance_index = i;
           return true;
+          }
         }
 
       // And finally process all triangles in the leaf.
       for(size_t i=p_node->m_triangles_begin;i<p_node->m_triangles_end;++i)
-        {
-        const Triangle3D_f &triangle = m_triangles[i];
-
-        Point3D_d v0 = Convert<double>(triangle[0]);
-        Point3D_d v1 = Convert<double>(triangle[1]);
-        Point3D_d v2 = Convert<double>(triangle[2]);
-
-        Vector3D_d e1 = Vector3D_d(v1-v0);
-        Vector3D_d e2 = Vector3D_d(v2-v0);
-        Vector3D_d s1 = ray.m_direction^e2;
-        double divisor = s1*e1;
-        double inv_divisor = 1.0/divisor;
-
-        // Compute first barycentric coordinate.
-        Vector3D_d d = Vector3D_d(ray.m_origin - v0);
-        double b1 = (d*s1) * inv_divisor;
-
-        // The two nested if-s are structured carefully to deal with the cases when the ray is parallel to the triangle's plane.
-        // In this case the barycentric coordinates will have NaN values and the if-s will return false.
-        if (b1 > -DBL_EPS && b1 < (1.0+DBL_EPS))
+        if (_TriangleIntersectTest(watertight_ray, ray, i))
           {
-          // Compute second barycentric coordinate.
-          Vector3D_d s2 = d^e1;
-          double b2 = (ray.m_direction*s2) * inv_divisor;
-          if (b2 > -DBL_EPS && b1 + b2 < (1.0+DBL_EPS))
+          if (op_hint)
             {
-            // Compute t to intersection point.
-            double t = (e2*s2) * inv_divisor;
-            if (t >= ray.m_min_t && t <= ray.m_max_t)
-              return true;
+            op_hint->m_triangle_index = i;
+            op_hint->m_leaf_triangles_begin = p_node->m_triangles_begin;
+            op_hint->m_leaf_triangles_end = p_node->m_triangles_end;
             }
+          return true;
           }
-        } // end of loop by triangles in the leaf
 
       }
 
@@ -464,7 +893,45 @@ bool TriangleAccelerator::_NodeIntersectTest(const TriangleAccelerator::Node *ip
 bool TriangleAccelerator::IntersectTest(const Ray &i_ray) const
   {
   ASSERT(i_ray.m_direction.IsNormalized());
-  return _NodeIntersectTest(mp_root, i_ray);
+  ASSERT(m_top_level_tree_refit_needed==false && m_top_level_tree_rebuild_needed==false);
+  return _NodeIntersectTest(mp_root, i_ray, NULL);
+  }
+
+bool TriangleAccelerator::IntersectTest(const Ray &i_ray, OccluderHint *iop_hint) const
+  {
+  ASSERT(i_ray.m_direction.IsNormalized());
+  ASSERT(m_top_level_tree_refit_needed==false && m_top_level_tree_rebuild_needed==false);
+
+  if (iop_hint && _OccluderIntersectTest(i_ray, *iop_hint))
+    return true;
+
+  return _NodeIntersectTest(mp_root, i_ray, iop_hint);
+  }
+
+bool TriangleAccelerator::_OccluderIntersectTest(const Ray &i_ray, const OccluderHint &i_hint) const
+  {
+  // The hint may have been filled by another accelerator or before the accelerator was edited, so make sure it references the triangles of the instance's mesh.
+  if (i_hint.m_instance_index >= m_instance_nodes.size())
+    return false;
+
+  const Node *p_mesh_tree = m_instance_nodes[i_hint.m_instance_index];
+  if (i_hint.m_leaf_triangles_begin < p_mesh_tree->m_triangles_begin || i_hint.m_leaf_triangles_end > p_mesh_tree->m_triangles_end ||
+    i_hint.m_triangle_index < i_hint.m_leaf_triangles_begin || i_hint.m_triangle_index >= i_hint.m_leaf_triangles_end)
+    return false;
+
+  Ray ray;
+  m_world_to_instance_transformations[i_hint.m_instance_index](i_ray, ray);
+  WatertightRay watertight_ray(ray);
+
+  // Test the occluding triangle first and then the rest of its leaf.
+  if (_TriangleIntersectTest(watertight_ray, ray, i_hint.m_triangle_index))
+    return true;
+
+  for(size_t i=i_hint.m_leaf_triangles_begin;i<i_hint.m_leaf_triangles_end;++i)
+    if (i != i_hint.m_triangle_index && _TriangleIntersectTest(watertight_ray, ray, i))
+      return true;
+
+  return false;
   }
 
 BBox3D_f TriangleAccelerator::_ConstructBBox(size_t i_triangles_begin, size_t i_triangles_end, size_t i_instances_begin, size_t i_instances_end) const
@@ -472,7 +939,7 @@ BBox3D_f TriangleAccelerator::_ConstructBBox(size_t i_triangles_begin, size_t i_
   BBox3D_f bbox;
 
   for(size_t i=i_triangles_begin;i!=i_triangles_end;++i)
-    bbox.Unite(m_triangle_bboxes[i]);
+    bbox.Unite(m_triangle_bboxes[i-m_triangle_bboxes_offset]);
 
   for(size_t i=i_instances_begin;i!=i_instances_end;++i)
     bbox.Unite(m_instance_bboxes[i]);
@@ -480,15 +947,27 @@ BBox3D_f TriangleAccelerator::_ConstructBBox(size_t i_triangles_begin, size_t i_
   return bbox;
   }
 
+BBox3D_f TriangleAccelerator::_ConstructInstanceBBox(const Node *ip_mesh_tree, const Transform &i_mesh_to_world) const
+  {
+  BBox3D_f instance_bbox;
+  Point3D_f mn = ip_mesh_tree->m_bbox.m_min, mx = ip_mesh_tree->m_bbox.m_max;
+  for(unsigned char j=0;j<8;++j)
+    {
+    Point3D_f bbox_vertex((j&1)?mn[0]:mx[0], (j&2)?mn[1]:mx[1], (j&4)?mn[2]:mx[2]);
+    instance_bbox.Unite(i_mesh_to_world(bbox_vertex));
+    }
+
+  return instance_bbox;
+  }
+
 void TriangleAccelerator::_SwapTriangles(size_t i_index1, size_t i_index2)
   {
   ASSERT(i_index1<m_triangles.size());
   ASSERT(i_index2<m_triangles.size());
 
   std::swap(m_triangles[i_index1], m_triangles[i_index2]);
-  std::swap(m_primitive_indices[i_index1], m_primitive_indices[i_index2]);
   std::swap(m_triangle_indices[i_index1], m_triangle_indices[i_index2]);
-  std::swap(m_triangle_bboxes[i_index1], m_triangle_bboxes[i_index2]);
+  std::swap(m_triangle_bboxes[i_index1-m_triangle_bboxes_offset], m_triangle_bboxes[i_index2-m_triangle_bboxes_offset]);
   }
 
 void TriangleAccelerator::_SwapInstances(size_t i_index1, size_t i_index2)
@@ -497,7 +976,7 @@ void TriangleAccelerator::_SwapInstances(size_t i_index1, size_t i_index2)
   ASSERT(i_index2<m_instance_nodes.size());
 
   std::swap(m_instance_nodes[i_index1], m_instance_nodes[i_index2]);
-  std::swap(m_instance_to_world_transformations[i_index1], m_instance_to_world_transformations[i_index2]);
+  std::swap(m_world_to_instance_transformations[i_index1], m_world_to_instance_transformations[i_index2]);
   std::swap(m_instance_primitive_indices[i_index1], m_instance_primitive_indices[i_index2]);
   std::swap(m_instance_bboxes[i_index1], m_instance_bboxes[i_index2]);
   }
@@ -531,11 +1010,11 @@ std::pair<unsigned char,double> TriangleAccelerator::_DetermineBestSplit(const B
       memset(middle_num, 0, MAX_SPLIT_TRIES*sizeof(size_t));
       memset(right_num, 0, MAX_SPLIT_TRIES*sizeof(size_t));
 
-      size_t num_tries = std::min(MAX_SPLIT_TRIES, 2*(i_triangles_end-i_triangles_begin) + 2*(i_instances_end-i_instances_begin));
+      size_t num_tries = std::min((size_t)MAX_SPLIT_TRIES, 2*(i_triangles_end-i_triangles_begin) + 2*(i_instances_end-i_instances_begin));
       double coef = num_tries/(i_node_bbox.m_max[split_axis]-i_node_bbox.m_min[split_axis]);
       for (size_t i = 0; i<num_triangles+num_instances; ++i)
         {
-        const BBox3D_f &bbox = i<num_triangles ? m_triangle_bboxes[i_triangles_begin+i] : m_instance_bboxes[i_instances_begin+i-num_triangles];
+        const BBox3D_f &bbox = i<num_triangles ? m_triangle_bboxes[i_triangles_begin+i-m_triangle_bboxes_offset] : m_instance_bboxes[i_instances_begin+i-num_triangles];
 
         size_t lefts_begin = std::min(num_tries, (size_t)((bbox.m_max[split_axis]-i_node_bbox.m_min[split_axis]) * coef + 1.0));
         size_t rights_end = std::min(num_tries, (size_t)((bbox.m_min[split_axis]-i_node_bbox.m_min[split_axis]) * coef + 1.0));
@@ -618,8 +1097,44 @@ std::pair<unsigned char,double> TriangleAccelerator::_DetermineBestSplit(const B
 
 //////////////////////////////////////////////////////////// NODE //////////////////////////////////////////////////////
 
+TriangleAccelerator::Node::Node(size_t i_triangles_begin, size_t i_triangles_end, size_t i_instances_begin, size_t i_instances_end):
+m_triangles_begin(i_triangles_begin), m_triangles_end(i_triangles_end), m_instances_begin(i_instances_begin), m_instances_end(i_instances_end), m_flags(0)
+  {
+  m_children[0] = m_children[1] = m_children[2] = NULL;
+  SetType(true,0);
+  }
+
+void TriangleAccelerator::Node::SetChildren(Node *ip_left, Node *ip_right)
+  {
+  ASSERT(ip_left && ip_right);
+
+  // Pick the axis along which the children are separated the most.
+  unsigned char split_axis = 0;
+  float max_distance = -1.f;
+  for(unsigned char k=0;k<3;++k)
+    {
+    float distance = (ip_right->m_bbox.m_min[k]+ip_right->m_bbox.m_max[k]) - (ip_left->m_bbox.m_min[k]+ip_left->m_bbox.m_max[k]);
+    if (fabs(distance) > max_distance)
+      {
+      max_distance = fabs(distance);
+      split_axis = k;
+      }
+    }
+
+  if ((ip_right->m_bbox.m_min[split_axis]+ip_right->m_bbox.m_max[split_axis]) < (ip_left->m_bbox.m_min[split_axis]+ip_left->m_bbox.m_max[split_axis]))
+    std::swap(ip_left, ip_right);
+
+  m_children[0] = ip_left;
+  m_children[1] = NULL;
+  m_children[2] = ip_right;
+  SetType(false, split_axis);
+
+  m_bbox = ip_left->m_bbox;
+  m_bbox.Unite(ip_right->m_bbox);
+  }
+
 TriangleAccelerator::Node::
-  Node(TriangleAccelerator &i_accelerator,
+  Node(TriangleAccelerator &i_accelerator, MemoryPool &i_pool,
   size_t i_triangles_begin, size_t i_triangles_end, 
   size_t i_instances_begin, size_t i_instances_end,
   unsigned char i_middle_split_mask, size_t i_depth): 
@@ -651,7 +1166,7 @@ m_bbox(i_accelerator._ConstructBBox(i_triangles_begin, i_triangles_end, i_instan
   // 3. The triangles lying above the splitting plane.
   while(i<triangles_right_begin)
     {
-    const BBox3D_f &bbox = i_accelerator.m_triangle_bboxes[i];
+    const BBox3D_f &bbox = i_accelerator.m_triangle_bboxes[i-i_accelerator.m_triangle_bboxes_offset];
 
     if (bbox.m_max[split_axis] < split_coord)
       {
@@ -703,8 +1218,8 @@ m_bbox(i_accelerator._ConstructBBox(i_triangles_begin, i_triangles_end, i_instan
   // Create left child node.
   if (i_triangles_begin<triangles_middle_begin || i_instances_begin<instances_middle_begin)
     {
-    void * ptr = i_accelerator.m_pool.Alloc(sizeof(Node));
-    m_children[0] = new (ptr) Node(i_accelerator, i_triangles_begin, triangles_middle_begin, i_instances_begin, instances_middle_begin, i_middle_split_mask, i_depth+1);
+    void * ptr = i_pool.Alloc(sizeof(Node));
+    m_children[0] = new (ptr) Node(i_accelerator, i_pool, i_triangles_begin, triangles_middle_begin, i_instances_begin, instances_middle_begin, i_middle_split_mask, i_depth+1);
     }
   else
     m_children[0] = NULL;
@@ -712,8 +1227,8 @@ m_bbox(i_accelerator._ConstructBBox(i_triangles_begin, i_triangles_end, i_instan
   // Create middle child node.
   if (triangles_middle_begin<triangles_right_begin || instances_middle_begin<instances_right_begin)
     {
-    void * ptr = i_accelerator.m_pool.Alloc(sizeof(Node));
-    m_children[1] = new (ptr) Node(i_accelerator, triangles_middle_begin, triangles_right_begin, instances_middle_begin, instances_right_begin, i_middle_split_mask | (1<<split_axis), i_depth+1);
+    void * ptr = i_pool.Alloc(sizeof(Node));
+    m_children[1] = new (ptr) Node(i_accelerator, i_pool, triangles_middle_begin, triangles_right_begin, instances_middle_begin, instances_right_begin, i_middle_split_mask | (1<<split_axis), i_depth+1);
     }
   else
     m_children[1] = NULL;
@@ -721,8 +1236,8 @@ m_bbox(i_accelerator._ConstructBBox(i_triangles_begin, i_triangles_end, i_instan
   // Create right child node.
   if (triangles_right_begin<i_triangles_end || instances_right_begin<i_instances_end)
     {
-    void * ptr = i_accelerator.m_pool.Alloc(sizeof(Node));
-    m_children[2] = new (ptr) Node(i_accelerator, triangles_right_begin, i_triangles_end, instances_right_begin, i_instances_end, i_middle_split_mask, i_depth+1);
+    void * ptr = i_pool.Alloc(sizeof(Node));
+    m_children[2] = new (ptr) Node(i_accelerator, i_pool, triangles_right_begin, i_triangles_end, instances_right_begin, i_instances_end, i_middle_split_mask, i_depth+1);
     }
   else
     m_children[2] = NULL;
@@ -21,24 +21,86 @@
 #include "Primitive.h"
 #include "Intersection.h"
 #include <vector>
+#include <map>
+#include <tbb/cache_aligned_allocator.h>
+
+/**
+* The structure holds the information about the last occluder found by TriangleAccelerator::IntersectTest() method.
+* Shadow rays traced from nearby points towards the same light source are likely to be blocked by the same triangle, so the next query tests
+* the occluding triangle and the other triangles of its leaf first, before traversing the tree from the root.
+* Each thread should use its own instance (see ThreadSpecifics).
+* The hint is validated before it is used, so it stays safe to use after the accelerator is edited or with another accelerator.
+*/
+struct OccluderHint
+  {
+  /**
+  * Creates OccluderHint instance with no occluder.
+  */
+  OccluderHint();
+
+  // Index of the instance the occluding triangle belongs to. Equals to std::numeric_limits<size_t>::max() if there is no occluder.
+  size_t m_instance_index;
+
+  // Index of the occluding triangle in the accelerator.
+  size_t m_triangle_index;
+
+  // Begin and end iterators of the triangles of the leaf the occluding triangle belongs to.
+  size_t m_leaf_triangles_begin, m_leaf_triangles_end;
+  };
 
 /**
 * The class computes intersection of rays with the primitives.
-* The class constructs a kd-tree-like structure for the triangles. Each internal node of the tree splits the triangles by x,y or z coordinate and
+* The class constructs a two-level structure. For each unique TriangleMesh a bottom-level tree is constructed over the mesh triangles in the mesh space.
+* Each primitive is an instance of its mesh's bottom-level tree and the top-level tree is constructed over the instances in the world space.
+* When only the primitives' transformations change the top-level tree can be refitted or rebuilt without touching the bottom-level trees.
+* When the vertices of a mesh change (see TriangleMesh::SetVertices()) its bottom-level tree can be refitted or rebuilt by UpdateMesh() method.
+*
+* Both levels are kd-tree-like structures. Each internal node of the tree splits the triangles (or instances) by x,y or z coordinate and
 * can have up to three child nodes which are called left, middle and right children respectively.
 * The left child contains all triangles that are strictly below the splitting plane.
 * The right child contains all triangles that are strictly above the splitting plane.
 * The middle child contains all triangles that are intersected by the splitting plane.
 * Due to the middle children each triangle corresponds to exactly one leaf and therefore no mailboxing technique is used.
+* The bottom-level trees can also be built much faster from the Morton codes of the triangles (see BuildMode), such trees only have left and right children
+* which partition the triangles by their centroids, i.e. the bounding boxes of the children may overlap.
+*
+* The rays are tested against the triangles with the watertight single precision test (see WatertightRay) so that no ray can leak through the edges
+* shared by adjacent triangles. The ray parameter of the hit is computed in double precision consistently with CoreUtils::GetNextMinT().
 * The class is thread-safe.
 */
 class TriangleAccelerator
   {
+  public:
+    /**
+    * Defines the algorithm used for building the bottom-level trees. The top-level tree is always built with BUILD_MODE_SAH algorithm.
+    */
+    enum BuildMode
+      {
+      /**
+      * Top-down construction that evaluates the cost function for many split positions at every node.
+      * Produces the trees of the highest quality but takes the longest time.
+      */
+      BUILD_MODE_SAH,
+
+      /**
+      * The triangles are sorted along the Z-order curve by the Morton codes of their centroids and the tree is emitted from the sorted codes in linear time.
+      * The construction is an order of magnitude faster but the traversal is slower, suitable for interactive previews.
+      */
+      BUILD_MODE_MORTON,
+
+      /**
+      * Same as BUILD_MODE_MORTON followed by a bottom-up pass that restructures each treelet of four nodes to minimize the tree cost.
+      */
+      BUILD_MODE_MORTON_OPTIMIZED
+      };
+
   public:
     /**
     * Creates TriangleAccelerator instance for the specified primitives.
+    * @param i_primitives Primitives to build the accelerator for.
+    * @param i_build_mode Algorithm used for building the bottom-level trees. It is also used when the trees are rebuilt by UpdateMesh() method.
     */
-    TriangleAccelerator(std::vector<intrusive_ptr<const Primitive>> i_primitives);
+    TriangleAccelerator(std::vector<intrusive_ptr<const Primitive>> i_primitives, BuildMode i_build_mode = BUILD_MODE_SAH);
 
     /**
     * Finds intersection of the specified ray.
@@ -56,13 +118,90 @@ class TriangleAccelerator
     */
     bool IntersectTest(const Ray &i_ray) const;
 
+    /**
+    * Returns true if the ray intersects any triangle.
+    * The last occluder stored in the specified hint is tested first and the hint is updated if the tree traversal finds a new occluder.
+    * @param i_ray Input ray. Direction component should be normalized.
+    * @param iop_hint Last occluder hint. Can be NULL, in this case the method is equivalent to IntersectTest(const Ray &).
+    * @return true if an intersection is found and false otherwise.
+    */
+    bool IntersectTest(const Ray &i_ray, OccluderHint *iop_hint) const;
+
     /**
     * Returns bounding box of all triangles.
     */
     BBox3D_d GetWorldBounds() const;
 
+    /**
+    * Replaces the primitive with the specified index.
+    * If the new primitive references the same TriangleMesh with the same transformation (e.g. only the material is changed) the tree is not affected at all.
+    * If only the transformation is changed the transformation and bounds of the corresponding instance are updated.
+    * If the mesh is changed the bottom-level tree for the new mesh is constructed unless there is one already.
+    * The top-level tree is not updated until UpdateTopLevelTree() is called.
+    * The method is not thread-safe and should not be called concurrently with the intersection methods.
+    * @param i_index Index of the primitive. Should be less than the number of primitives.
+    * @param ip_primitive New primitive. Should not be NULL.
+    */
+    void SetPrimitive(size_t i_index, intrusive_ptr<const Primitive> ip_primitive);
+
+    /**
+    * Adds new primitive. The index of the new primitive equals to the number of primitives before the call.
+    * The bottom-level tree for the primitive's mesh is constructed unless there is one already.
+    * The top-level tree is not updated until UpdateTopLevelTree() is called.
+    * The method is not thread-safe and should not be called concurrently with the intersection methods.
+    * @param ip_primitive Primitive to be added. Should not be NULL.
+    */
+    void AddPrimitive(intrusive_ptr<const Primitive> ip_primitive);
+
+    /**
+    * Removes the primitive with the specified index. The indices of the following primitives are decremented by one.
+    * The bottom-level tree of the primitive's mesh is kept even if the mesh is not referenced by other primitives anymore and is only released when the accelerator is destroyed.
+    * The top-level tree is not updated until UpdateTopLevelTree() is called.
+    * The method is not thread-safe and should not be called concurrently with the intersection methods.
+    * @param i_index Index of the primitive. Should be less than the number of primitives.
+    */
+    void RemovePrimitive(size_t i_index);
+
+    /**
+    * Updates the top-level tree after the primitives have been changed by SetPrimitive(), AddPrimitive() or RemovePrimitive() methods.
+    * If primitives have been added or removed the top-level tree is rebuilt. Otherwise the bounding boxes of the top-level nodes are refitted bottom-up.
+    * If the cost of the refitted tree exceeds the cost of the tree at the time it was built by more than MAX_REFIT_COST_RATIO times the top-level tree is rebuilt instead.
+    * The method does nothing if the top-level tree is up to date.
+    * The method is not thread-safe and should not be called concurrently with the intersection methods.
+    * @return true if the top-level tree was rebuilt and false otherwise.
+    */
+    bool UpdateTopLevelTree();
+
+    /**
+    * Updates the bottom-level tree of the specified mesh after its vertices have been changed by TriangleMesh::SetVertices() method.
+    * The triangles are re-read from the mesh and the bounding boxes of the tree nodes are refitted bottom-up.
+    * If the cost of the refitted tree exceeds the cost of the tree at the time it was built by more than MAX_REFIT_COST_RATIO times the tree is rebuilt instead.
+    * The bounding boxes of all the instances of the mesh are updated as well but the top-level tree is not updated until UpdateTopLevelTree() is called.
+    * The method is not thread-safe and should not be called concurrently with the intersection methods.
+    * @param ip_mesh Mesh which vertices have been changed. Should be referenced by one of the primitives the accelerator was created for or added later.
+    * @return true if the bottom-level tree was rebuilt and false otherwise.
+    */
+    bool UpdateMesh(const TriangleMesh *ip_mesh);
+
   private:
     struct Node;
+    struct InstanceTransform;
+    struct WatertightRay;
+
+    /**
+    * Bottom-level tree of a unique mesh.
+    */
+    struct MeshTree
+      {
+      // Root node of the tree.
+      Node *mp_root;
+
+      // Cost of the tree at the time it was built.
+      double m_cost;
+
+      // Memory pool the nodes are allocated from if the tree has been rebuilt by UpdateMesh() method. NULL if the nodes are allocated from m_pool.
+      shared_ptr<MemoryPool> mp_pool;
+      };
 
   private:
     // Not implemented, not a value type.
@@ -72,6 +211,81 @@ class TriangleAccelerator
 
     BBox3D_f _ConstructBBox(size_t i_triangles_begin, size_t i_triangles_end, size_t i_instances_begin, size_t i_instances_end) const;
 
+    /**
+    * Returns the bottom-level tree for the specified mesh. The tree is constructed if it does not exist yet.
+    */
+    const Node *_GetMeshTree(intrusive_ptr<const TriangleMesh> ip_mesh);
+
+    /**
+    * Builds the bottom-level tree over the specified range of triangles. The nodes are allocated from the specified memory pool.
+    */
+    Node *_BuildMeshTree(size_t i_triangles_begin, size_t i_triangles_end, MemoryPool &i_pool);
+
+    /**
+    * Builds the bottom-level tree over the specified range of triangles from the Morton codes of the triangles' centroids.
+    * The triangles are reordered along the Z-order curve. Should be called from _BuildMeshTree() method when the triangles bboxes are available.
+    */
+    Node *_BuildMortonTree(size_t i_triangles_begin, size_t i_triangles_end, MemoryPool &i_pool);
+
+    /**
+    * Helper method that recursively creates the subtree for the specified range of triangles sorted by their Morton codes.
+    * The range is split at the highest bit (not greater than i_bit) the codes in the range differ in.
+    */
+    Node *_EmitMortonNode(const std::vector<unsigned int> &i_codes, size_t i_codes_offset, size_t i_triangles_begin, size_t i_triangles_end,
+      int i_bit, MemoryPool &i_pool, size_t i_depth);
+
+    /**
+    * Restructures the specified subtree bottom-up. For each node which children are both internal the four grandchildren are regrouped
+    * into the pair of children with the minimum total area. The triangles ranges of the internal nodes are invalid after the call, see _LayoutTriangles().
+    */
+    void _OptimizeTreelets(Node *ip_node);
+
+    /**
+    * Reorders the triangles of the specified tree in the depth-first order of its leaves and updates the triangles ranges of all nodes.
+    */
+    void _LayoutTriangles(Node *ip_root);
+
+    /**
+    * Helper method for _LayoutTriangles() that appends the triangles of the specified subtree to the output vectors.
+    */
+    void _LayoutNode(Node *ip_node, size_t i_triangles_offset, std::vector<Triangle3D_f> &o_triangles, std::vector<size_t> &o_triangle_indices) const;
+
+    /**
+    * Adds the instance of the specified bottom-level tree for the primitive with the specified index.
+    */
+    void _AddInstance(size_t i_primitive_index, const Node *ip_mesh_tree);
+
+    /**
+    * Recomputes m_primitive_instance_indices from m_instance_primitive_indices.
+    */
+    void _UpdatePrimitiveInstanceIndices();
+
+    /**
+    * Computes world space bounding box of the instance of the specified bottom-level tree.
+    */
+    BBox3D_f _ConstructInstanceBBox(const Node *ip_mesh_tree, const Transform &i_mesh_to_world) const;
+
+    /**
+    * Builds the top-level tree over all instances. The nodes of the previous top-level tree (if any) are released.
+    */
+    void _BuildTopLevelTree();
+
+    /**
+    * Recomputes the bounding boxes of the specified subtree bottom-up.
+    * The bounding boxes of the leaves are computed from the triangles' vertices and the instances' bounding boxes. Large subtrees are processed in parallel.
+    */
+    void _RefitNode(Node *ip_node);
+
+    /**
+    * Computes the cost of the specified tree. The cost is the expected number of node traversals and triangle tests for a random ray hitting the root's bounding box.
+    */
+    double _ComputeTreeCost(const Node *ip_root) const;
+
+    /**
+    * Helper method that computes the cost of the specified subtree not normalized by the root's bounding box area.
+    */
+    double _ComputeNodeCost(const Node *ip_node) const;
+
     void _SwapTriangles(size_t i_index1, size_t i_index2);
     void _SwapInstances(size_t i_index1, size_t i_index2);
 
@@ -83,47 +297,91 @@ class TriangleAccelerator
     std::pair<unsigned char,double> _DetermineBestSplit(const BBox3D_f &i_node_bbox, size_t i_triangles_begin, size_t i_triangles_end,
       size_t i_instances_begin, size_t i_instances_end, unsigned char i_middle_split_mask) const;
     
+    /**
+    * Computes the ray parameter of the intersection of the specified ray with the triangle's plane.
+    * The computation is done in double precision exactly the same way as in CoreUtils::GetNextMinT() so that the outgoing rays do not intersect the triangle they start from.
+    */
+    static double _ComputeRayParameter(const Triangle3D_f &i_triangle, const Ray &i_ray);
+
     /**
     * Helper method that search the nearest intersection with the specified subtree. The method recursively processes all the nested instances.
+    * The barycentric coordinates of the intersection point computed by the intersection test are returned so that they do not need to be recomputed.
     */
-    bool _NodeIntersect(const TriangleAccelerator::Node *ip_node, Ray &i_ray, size_t &o_primitive_index, size_t &o_triangle_index) const;
+    bool _NodeIntersect(const TriangleAccelerator::Node *ip_node, Ray &i_ray, size_t &o_primitive_index, size_t &o_triangle_index, float &o_b1, float &o_b2) const;
+
+    /**
+    * Returns true if the ray intersects the triangle with the specified index within the ray parameter range.
+    */
+    bool _TriangleIntersectTest(const WatertightRay &i_watertight_ray, const Ray &i_ray, size_t i_triangle_index) const;
 
     /**
     * Helper method that looks for any intersection with the specified subtree. The method recursively processes all the nested instances.
+    * If an intersection is found and the hint is not NULL the occluding triangle is stored in the hint.
     */
-    bool _NodeIntersectTest(const TriangleAccelerator::Node *ip_node, const Ray &i_ray) const;
+    bool _NodeIntersectTest(const TriangleAccelerator::Node *ip_node, const Ray &i_ray, OccluderHint *op_hint) const;
+
+    /**
+    * Returns true if the ray intersects the occluding triangle stored in the specified hint or any other triangle of its leaf.
+    */
+    bool _OccluderIntersectTest(const Ray &i_ray, const OccluderHint &i_hint) const;
 
   private:
-    // All the triangles of the primitives.
+    // All the triangles of the unique meshes in the mesh space. The triangles of each mesh occupy a contiguous range.
     std::vector<Triangle3D_f> m_triangles;
 
-    // Indices of the primitives (in m_primitives field vector) the corresponding triangles belong to.
-    std::vector<size_t> m_primitive_indices;
-
     // Indices of the triangles in their meshes the corresponding triangles belong to.
     std::vector<size_t> m_triangle_indices;
 
     std::vector<intrusive_ptr<const Primitive>> m_primitives;
 
-    // Root node of the tree.
+    // Root node of the top-level tree.
     Node *mp_root;
 
-    // Memory pool that is used for allocating the nodes.
+    // Memory pool that is used for allocating the nodes of the bottom-level trees.
     MemoryPool m_pool;
 
-    // Bounding boxes of the (unique) triangles and instanced objects.
-    // These vectors are only used during the tree constructions.
-    std::vector<BBox3D_f> m_triangle_bboxes, m_instance_bboxes;
+    // Memory pool that is used for allocating the nodes of the top-level tree. It is cleared every time the top-level tree is rebuilt.
+    MemoryPool m_top_level_pool;
 
-    // Contains pointers to the subtrees associated with the instanced primitives.
+    // Bounding boxes of the triangles of the mesh which bottom-level tree is being constructed.
+    // This vector is only used during the bottom-level trees construction.
+    std::vector<BBox3D_f> m_triangle_bboxes;
+
+    // Index of the triangle (in m_triangles vector) that corresponds to the first element of m_triangle_bboxes vector.
+    size_t m_triangle_bboxes_offset;
+
+    // Maps the unique meshes to their bottom-level trees.
+    std::map<const TriangleMesh *, MeshTree> m_mesh_trees;
+
+    // The meshes which bottom-level trees have been constructed.
+    // Keeps the meshes alive as long as their trees exist so that the keys in m_mesh_trees can not be reused by new meshes.
+    std::vector<intrusive_ptr<const TriangleMesh>> m_meshes;
+
+    // World space bounding boxes of the instances. Kept after the construction for refitting and rebuilding the top-level tree.
+    std::vector<BBox3D_f> m_instance_bboxes;
+
+    // Contains pointers to the bottom-level trees associated with the instanced primitives.
     std::vector<const Node *> m_instance_nodes;
 
-    // Contains the transformations associated with the instanced primitives.
-    std::vector<Transform> m_instance_to_world_transformations;
+    // Contains the world-to-instance transformations associated with the instanced primitives.
+    // The transformations are stored in a separate array so that the traversal of the instances in a leaf touches as few cache lines as possible.
+    std::vector<InstanceTransform, tbb::cache_aligned_allocator<InstanceTransform>> m_world_to_instance_transformations;
 
     // Contains the indices of the primitives (in m_primitives field vector) associated with the instanced primitives.
     std::vector<size_t> m_instance_primitive_indices;
 
+    // Contains the indices of the instances associated with the primitives. This is the inverse of m_instance_primitive_indices.
+    std::vector<size_t> m_primitive_instance_indices;
+
+    // Cost of the top-level tree at the time it was built.
+    double m_top_level_tree_cost;
+
+    // Flags defining whether the top-level tree needs to be refitted or rebuilt by UpdateTopLevelTree() method.
+    bool m_top_level_tree_refit_needed, m_top_level_tree_rebuild_needed;
+
+    // Algorithm used for building the bottom-level trees.
+    BuildMode m_build_mode;
+
     // Maximum number of triangles in leaves. The actual number of triangles may be greater for middle children if an effective split is not possible.
     static const size_t MAX_TRIANGLES_IN_LEAF = 4;
 
@@ -132,6 +390,16 @@ class TriangleAccelerator
 
     // Maximum tree depth.
     static const size_t MAX_TREE_DEPTH = 200;
+
+    // Minimum number of triangles and instances in a subtree for its children to be refitted in parallel.
+    static const size_t MIN_PARALLEL_REFIT_SIZE = 10000;
+
+    // Maximum ratio of the refitted tree cost to the cost of the freshly built tree. The tree is rebuilt if the ratio is exceeded.
+    static const double MAX_REFIT_COST_RATIO;
+
+    // Relative tolerance the far distances of the ray-bbox test are enlarged by.
+    // It should cover the single precision rounding errors of the watertight triangle test so that the traversal is watertight too.
+    static const double BBOX_TEST_TOLERANCE;
   };
 
 /////////////////////////////////////////// IMPLEMENTATION ////////////////////////////////////////////////
@@ -142,6 +410,7 @@ class TriangleAccelerator
 * It is used for both internal nodes and leaves.
 * Contains bounding box of the triangles and instanced primitives associated with the node, pointers to children,
 * begin and end iterators of the associated triangles and instanced primitives and the flags bitset.
+* Nodes of the bottom-level trees only have triangles associated with them and nodes of the top-level tree only have instances associated with them.
 */
 struct TriangleAccelerator::Node
   {
@@ -179,6 +448,7 @@ struct TriangleAccelerator::Node
   * Creates the Node instance.
   * The constructor recursively creates the children if the node is internal.
   * @param i_accelerator TriangleAccelerator instance the node belongs to.
+  * @param i_pool Memory pool used for allocating the children nodes.
   * @param i_triangles_begin Begin iterator of the corresponding triangles.
   * @param i_triangles_end End iterator of the corresponding triangles.
   * @param i_instances_begin Begin iterator of the corresponding instances.
@@ -186,10 +456,171 @@ struct TriangleAccelerator::Node
   * @param i_middle_split_mask The bitset that defines what middle splits have been done in the ancestor nodes.
   * @param i_depth Depth of the node (0 for root).
   */
-  Node(TriangleAccelerator &i_accelerator, size_t i_triangles_begin, size_t i_triangles_end, size_t i_instances_begin, size_t i_instances_end,
+  Node(TriangleAccelerator &i_accelerator, MemoryPool &i_pool, size_t i_triangles_begin, size_t i_triangles_end, size_t i_instances_begin, size_t i_instances_end,
     unsigned char i_middle_split_mask, size_t i_depth);
+
+  /**
+  * Creates the leaf Node instance with an empty bounding box.
+  * Used by the Morton builder which computes the bounding boxes and sets the children itself.
+  */
+  Node(size_t i_triangles_begin, size_t i_triangles_end, size_t i_instances_begin, size_t i_instances_end);
+
+  /**
+  * Makes the node internal with the specified left and right children and no middle child. The bounding box is set to the union of the children bboxes.
+  * The split axis is the one along which the centers of the children bboxes are the farthest apart, the children are swapped if needed
+  * so that the left child comes first along the axis.
+  */
+  void SetChildren(Node *ip_left, Node *ip_right);
   };
 
+/**
+* Internal structure for the world-to-instance transformations of the instanced primitives.
+* Only the upper 3x4 part of the affine transformation matrix is stored, so the structure takes less than half the size of the Transform
+* and transforming a ray does not need to invert the matrix.
+*/
+struct TriangleAccelerator::InstanceTransform
+  {
+  double m_values[3][4];
+
+  /**
+  * Creates InstanceTransform instance from the specified affine transformation.
+  */
+  InstanceTransform(const Transform &i_transform);
+
+  /**
+  * Transforms the specified ray. The direction is not normalized, so the ray parameter values are preserved.
+  */
+  void operator()(const Ray &i_ray, Ray &o_transformed_ray) const;
+  };
+
+inline TriangleAccelerator::InstanceTransform::InstanceTransform(const Transform &i_transform)
+  {
+  Matrix4x4_d matrix = i_transform.GetMatrix();
+  ASSERT(matrix.m_values[3][0]==0.0 && matrix.m_values[3][1]==0.0 && matrix.m_values[3][2]==0.0 && matrix.m_values[3][3]==1.0);
+
+  for(unsigned char i=0;i<3;++i)
+    for(unsigned char j=0;j<4;++j)
+      m_values[i][j] = matrix.m_values[i][j];
+  }
+
+inline void TriangleAccelerator::InstanceTransform::operator()(const Ray &i_ray, Ray &o_transformed_ray) const
+  {
+  double x = i_ray.m_origin[0], y = i_ray.m_origin[1], z = i_ray.m_origin[2];
+  o_transformed_ray.m_origin[0] = m_values[0][0]*x + m_values[0][1]*y + m_values[0][2]*z + m_values[0][3];
+  o_transformed_ray.m_origin[1] = m_values[1][0]*x + m_values[1][1]*y + m_values[1][2]*z + m_values[1][3];
+  o_transformed_ray.m_origin[2] = m_values[2][0]*x + m_values[2][1]*y + m_values[2][2]*z + m_values[2][3];
+
+  x = i_ray.m_direction[0], y = i_ray.m_direction[1], z = i_ray.m_direction[2];
+  o_transformed_ray.m_direction[0] = m_values[0][0]*x + m_values[0][1]*y + m_values[0][2]*z;
+  o_transformed_ray.m_direction[1] = m_values[1][0]*x + m_values[1][1]*y + m_values[1][2]*z;
+  o_transformed_ray.m_direction[2] = m_values[2][0]*x + m_values[2][1]*y + m_values[2][2]*z;
+
+  o_transformed_ray.m_min_t = i_ray.m_min_t;
+  o_transformed_ray.m_max_t = i_ray.m_max_t;
+  }
+
+/**
+* Internal structure for the watertight ray-triangle intersection test (see "Watertight Ray/Triangle Intersection" paper by Woop, Benthin and Wald).
+* The triangle vertices are translated to the ray origin, the axes are permuted so that the largest component of the ray direction becomes z and the vertices are sheared
+* so that the ray goes along the z axis. The intersection is then determined by the signs of the 2D edge functions which are computed in single precision.
+* The edge functions of a shared edge are computed from exactly the same values by both adjacent triangles so no ray can leak through the edge.
+* The permutation and the shear only depend on the ray and are computed once per ray.
+*/
+struct TriangleAccelerator::WatertightRay
+  {
+  Point3D_f m_origin;
+  unsigned char m_kx, m_ky, m_kz;
+  float m_shear_x, m_shear_y;
+
+  /**
+  * Creates WatertightRay instance for the specified ray. The ray direction should not be zero.
+  */
+  WatertightRay(const Ray &i_ray);
+
+  /**
+  * Returns true if the ray line passes through the specified triangle. The ray parameter range is not checked.
+  * @param i_triangle Triangle to be tested.
+  * @param[out] o_b1 Barycentric coordinate of the intersection point corresponding to the 1th vertex of the triangle (0-based).
+  * @param[out] o_b2 Barycentric coordinate of the intersection point corresponding to the 2nd vertex of the triangle (0-based).
+  */
+  bool Intersect(const Triangle3D_f &i_triangle, float &o_b1, float &o_b2) const;
+  };
+
+inline TriangleAccelerator::WatertightRay::WatertightRay(const Ray &i_ray): m_origin(Convert<float>(i_ray.m_origin))
+  {
+  double abs_x = fabs(i_ray.m_direction[0]), abs_y = fabs(i_ray.m_direction[1]), abs_z = fabs(i_ray.m_direction[2]);
+  m_kz = (abs_x > abs_y) ? (abs_x > abs_z ? 0 : 2) : (abs_y > abs_z ? 1 : 2);
+  m_kx = (m_kz+1)%3;
+  m_ky = (m_kx+1)%3;
+  ASSERT(i_ray.m_direction[m_kz] != 0.0);
+
+  m_shear_x = (float) (i_ray.m_direction[m_kx] / i_ray.m_direction[m_kz]);
+  m_shear_y = (float) (i_ray.m_direction[m_ky] / i_ray.m_direction[m_kz]);
+  }
+
+inline bool TriangleAccelerator::WatertightRay::Intersect(const Triangle3D_f &i_triangle, float &o_b1, float &o_b2) const
+  {
+  const Point3D_f &v0 = i_triangle[0], &v1 = i_triangle[1], &v2 = i_triangle[2];
+
+  // Translate the vertices to the ray origin and shear them.
+  float a_z = v0[m_kz]-m_origin[m_kz], b_z = v1[m_kz]-m_origin[m_kz], c_z = v2[m_kz]-m_origin[m_kz];
+  float a_x = (v0[m_kx]-m_origin[m_kx]) - m_shear_x*a_z, a_y = (v0[m_ky]-m_origin[m_ky]) - m_shear_y*a_z;
+  float b_x = (v1[m_kx]-m_origin[m_kx]) - m_shear_x*b_z, b_y = (v1[m_ky]-m_origin[m_ky]) - m_shear_y*b_z;
+  float c_x = (v2[m_kx]-m_origin[m_kx]) - m_shear_x*c_z, c_y = (v2[m_ky]-m_origin[m_ky]) - m_shear_y*c_z;
+
+  // Compute the scaled barycentric coordinates.
+  float u = c_x*b_y - c_y*b_x;
+  float v = a_x*c_y - a_y*c_x;
+  float w = b_x*a_y - b_y*a_x;
+
+  // If the ray passes exactly through an edge or a vertex the edge functions are recomputed in double precision so that the adjacent triangles get consistent results.
+  if (u == 0.f || v == 0.f || w == 0.f)
+    {
+    u = (float) ((double)c_x*(double)b_y - (double)c_y*(double)b_x);
+    v = (float) ((double)a_x*(double)c_y - (double)a_y*(double)c_x);
+    w = (float) ((double)b_x*(double)a_y - (double)b_y*(double)a_x);
+    }
+
+  // The triangles are two-sided so the ray passes through the triangle if all edge functions have the same sign.
+  if ((u < 0.f || v < 0.f || w < 0.f) && (u > 0.f || v > 0.f || w > 0.f))
+    return false;
+
+  // The determinant is zero if the ray is parallel to the triangle's plane.
+  float determinant = u+v+w;
+  if (determinant == 0.f)
+    return false;
+
+  float inv_determinant = 1.f/determinant;
+  o_b1 = v*inv_determinant;
+  o_b2 = w*inv_determinant;
+  return true;
+  }
+
+inline OccluderHint::OccluderHint(): m_instance_index(std::numeric_limits<size_t>::max()), m_triangle_index(0), m_leaf_triangles_begin(0), m_leaf_triangles_end(0)
+  {
+  }
+
+inline double TriangleAccelerator::_ComputeRayParameter(const Triangle3D_f &i_triangle, const Ray &i_ray)
+  {
+  Point3D_d v0 = Convert<double>(i_triangle[0]);
+  Point3D_d v1 = Convert<double>(i_triangle[1]);
+  Point3D_d v2 = Convert<double>(i_triangle[2]);
+
+  Vector3D_d normal = Vector3D_d(v1-v0)^Vector3D_d(v2-v0);
+  return (Vector3D_d(v0-i_ray.m_origin)*normal) / (i_ray.m_direction*normal);
+  }
+
+inline bool TriangleAccelerator::_TriangleIntersectTest(const WatertightRay &i_watertight_ray, const Ray &i_ray, size_t i_triangle_index) const
+  {
+  float b1, b2;
+  if (i_watertight_ray.Intersect(m_triangles[i_triangle_index], b1, b2) == false)
+    return false;
+
+  // The comparisons are structured carefully to reject NaN values (in case the ray is nearly parallel to the triangle's plane).
+  double t = _ComputeRayParameter(m_triangles[i_triangle_index], i_ray);
+  return t >= i_ray.m_min_t && t <= i_ray.m_max_t;
+  }
+
 inline void TriangleAccelerator::Node::SetType(bool i_is_leaf, unsigned char i_split_axis)
   {
   if (i_is_leaf)
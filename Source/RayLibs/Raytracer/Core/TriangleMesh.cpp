@@ -185,6 +185,24 @@ void TriangleMesh::_Initialize(const std::vector<Point3D_f> &i_vertices, const s
     m_triangles.erase(it,m_triangles.end());
     }
 
+  _ComputeBoundsAndArea();
+  _SetNormalsAndTangents(i_shading_normals, i_tangents);
+  }
+
+void TriangleMesh::SetVertices(const std::vector<Point3D_f> &i_vertices, const std::vector<Vector3D_f> &i_shading_normals, const std::vector<Vector3D_f> &i_tangents)
+  {
+  ASSERT(i_vertices.size() == m_vertices.size());
+  ASSERT(i_shading_normals.empty() || i_shading_normals.size()==i_vertices.size());
+  ASSERT(i_tangents.empty() || i_tangents.size()==i_vertices.size());
+
+  m_vertices.assign(i_vertices.begin(), i_vertices.end());
+
+  _ComputeBoundsAndArea();
+  _SetNormalsAndTangents(i_shading_normals, i_tangents);
+  }
+
+void TriangleMesh::_ComputeBoundsAndArea()
+  {
   // Compute the bounding box and ares.
   m_area = 0.f;
   if (m_triangles.empty())
@@ -204,7 +222,10 @@ void TriangleMesh::_Initialize(const std::vector<Point3D_f> &i_vertices, const s
       m_area += triangle_3D.GetArea();
       }
     }
+  }
 
+void TriangleMesh::_SetNormalsAndTangents(const std::vector<Vector3D_f> &i_shading_normals, const std::vector<Vector3D_f> &i_tangents)
+  {
   if (i_shading_normals.size() == m_vertices.size())
     {
     m_shading_normals.resize(i_shading_normals.size());
@@ -226,6 +247,8 @@ void TriangleMesh::_Initialize(const std::vector<Point3D_f> &i_vertices, const s
     for(size_t i=0;i<i_tangents.size();++i)
       m_tangents[i] = i_tangents[i].Normalized();
     }
+  else
+    m_tangents.clear();
   }
 
 /**
@@ -446,19 +469,33 @@ void TriangleMesh::ComputeDifferentialGeometry(size_t i_triangle_index, const Ra
     Convert<double>(m_vertices[triangle.m_vertices[1]]),
     Convert<double>(m_vertices[triangle.m_vertices[2]])};
 
-  double b0,b1,b2,t;
+  double b1,b2,t;
   if (_ComputeIntersectionPoint(vertices, i_ray.m_base_ray.m_origin, i_ray.m_base_ray.m_direction, b1, b2, t)==false)
     ASSERT(0 && "The ray does not intersect the specified triangle of the mesh.");
 
-  ASSERT(b1 > -DBL_EPS && b1 < 1.0+DBL_EPS);
-  ASSERT(b2 > -DBL_EPS && b1 + b2 < 1.0+DBL_EPS);
-  ASSERT(t >= i_ray.m_base_ray.m_min_t && t <= i_ray.m_base_ray.m_max_t);
-  o_dg.m_point=i_ray.m_base_ray(t);
+  ComputeDifferentialGeometry(i_triangle_index, i_ray, b1, b2, t, o_dg);
+  }
+
+void TriangleMesh::ComputeDifferentialGeometry(size_t i_triangle_index, const RayDifferential &i_ray, double i_b1, double i_b2, double i_t, DifferentialGeometry &o_dg) const
+  {
+  ASSERT(i_triangle_index < m_triangles.size());
+  // The barycentric coordinates may have been computed in single precision.
+  ASSERT(i_b1 > -4.0*FLT_EPS && i_b1 < 1.0+4.0*FLT_EPS);
+  ASSERT(i_b2 > -4.0*FLT_EPS && i_b1 + i_b2 < 1.0+4.0*FLT_EPS);
+  ASSERT(i_t >= i_ray.m_base_ray.m_min_t && i_t <= i_ray.m_base_ray.m_max_t);
+  const MeshTriangle &triangle = m_triangles[i_triangle_index];
+
+  Point3D_d vertices[3] = {
+    Convert<double>(m_vertices[triangle.m_vertices[0]]),
+    Convert<double>(m_vertices[triangle.m_vertices[1]]),
+    Convert<double>(m_vertices[triangle.m_vertices[2]])};
+
+  double b0 = 1.0 - i_b1 - i_b2, b1 = i_b1, b2 = i_b2;
+  o_dg.m_point=i_ray.m_base_ray(i_t);
 
   Point2D_d uv[3]={Convert<double>(triangle.m_uvs[0]), Convert<double>(triangle.m_uvs[1]), Convert<double>(triangle.m_uvs[2])};
 
   // Interpolate triangle uv coordinates.
-  b0 = 1.0 - b1 - b2;
   o_dg.m_uv=b0*uv[0] + b1*uv[1] + b2*uv[2];
 
   // Get shading normals at the vertices.
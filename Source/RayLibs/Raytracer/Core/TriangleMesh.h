@@ -64,7 +64,8 @@ struct MeshTriangle
 * The UV values are linearly interpolated inside the triangles.
 * The class provides an option to interpolate the normals inside the triangles to imitate a smooth surface.
 *
-* The mesh is constant in the sense that once created the geometry and connectivity never changes.
+* The mesh is constant in the sense that once created the connectivity never changes.
+* The vertices coordinates can be updated with SetVertices() method (e.g. for deforming meshes in animations), see the method's description for the restrictions.
 */
 class TriangleMesh: public ReferenceCounted
   {
@@ -118,6 +119,19 @@ class TriangleMesh: public ReferenceCounted
     */
     bool GetInvertNormals() const;
 
+    /**
+    * Replaces the vertices coordinates keeping the triangles (and therefore the connectivity and UV parameterization) unchanged.
+    * The bounding box and the area are recomputed. If shading normals are not specified they are interpolated from the new geometric normals.
+    * If tangent vectors are not specified they will be computed from UV coordinates.
+    * The method is not thread-safe and should not be called while the mesh is being rendered.
+    * The objects that precompute data from the mesh are not updated automatically, e.g. TriangleAccelerator::UpdateMesh() should be called for the accelerator.
+    * @param i_vertices Vertices coordinates. Should have the same size as the current vertices.
+    * @param i_shading_normals Vector of shading normals. Should be either empty or have the same size that i_vertices has. Vectors are not required to be normalized.
+    * @param i_tangents Vector of tangent directions. Should be either empty or have the same size that i_vertices has. Vectors are not required to be normalized.
+    */
+    void SetVertices(const std::vector<Point3D_f> &i_vertices,
+      const std::vector<Vector3D_f> &i_shading_normals = std::vector<Vector3D_f>(), const std::vector<Vector3D_f> &i_tangents = std::vector<Vector3D_f>());
+
     size_t GetNumberOfVertices() const;
 
     size_t GetNumberOfTriangles() const;
@@ -141,6 +155,18 @@ class TriangleMesh: public ReferenceCounted
     */
     void ComputeDifferentialGeometry(size_t i_triangle_index, const RayDifferential &i_ray, DifferentialGeometry &o_dg) const;
 
+    /**
+    * Populates the DifferentialGeometry for the specified intersection point of the ray with the triangle.
+    * This version should be used when the barycentric coordinates and the ray parameter of the intersection point are already known (e.g. computed by the intersection test).
+    * @param i_triangle_index Index of the intersected triangle.
+    * @param i_ray Intersecting ray.
+    * @param i_b1 Barycentric coordinate of the intersection point corresponding to the 1th vertex of the triangle (0-based).
+    * @param i_b2 Barycentric coordinate of the intersection point corresponding to the 2nd vertex of the triangle (0-based).
+    * @param i_t Ray parameter of the intersection point.
+    * @param[out] o_dg Resulting DifferentialGeometry.
+    */
+    void ComputeDifferentialGeometry(size_t i_triangle_index, const RayDifferential &i_ray, double i_b1, double i_b2, double i_t, DifferentialGeometry &o_dg) const;
+
     /**
     * Returns bounding box of the triangle mesh.
     */
@@ -171,6 +197,9 @@ class TriangleMesh: public ReferenceCounted
     void _Initialize(const std::vector<Point3D_f> &i_vertices, const std::vector<MeshTriangle> &i_triangles,
       const std::vector<Vector3D_f> &i_shading_normals, const std::vector<Vector3D_f> &i_tangents);
 
+    void _ComputeBoundsAndArea();
+    void _SetNormalsAndTangents(const std::vector<Vector3D_f> &i_shading_normals, const std::vector<Vector3D_f> &i_tangents);
+
     void _ComputeShadingNormals(const ConnectivityData &i_connectivity);
     bool _ConsistentlyOriented(size_t i_triangle_index1, size_t i_triangle_index2) const;
     bool _ComputeIntersectionPoint(const Point3D_d i_vertices[3], const Point3D_d &i_origin, const Vector3D_d &i_direction, double &o_b1, double &o_b2, double &o_t) const;
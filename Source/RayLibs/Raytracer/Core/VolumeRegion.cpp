@@ -15,6 +15,27 @@
 #include "VolumeRegion.h"
 #include <algorithm>
 
+SpectrumCoef_d VolumeRegion::Transmittance(const Ray &i_ray, double i_step, RandomGenerator<double> &io_random_generator) const
+  {
+  return Exp(-1.0*OpticalThickness(i_ray, i_step, io_random_generator(1.0)));
+  }
+
+double VolumeRegion::SkipEmptySpace(const Ray &i_ray, double i_t_begin, double i_t_end) const
+  {
+  return i_t_begin;
+  }
+
+double VolumeRegion::SamplePhase(const Point3D_d &i_point, const Vector3D_d &i_incoming, const Point2D_d &i_sample, Vector3D_d &o_outgoing) const
+  {
+  o_outgoing = SamplingRoutines::UniformSphereSampling(i_sample);
+  return SamplingRoutines::UniformSpherePDF();
+  }
+
+double VolumeRegion::PhasePDF(const Point3D_d &i_point, const Vector3D_d &i_incoming, const Vector3D_d &i_outgoing) const
+  {
+  return SamplingRoutines::UniformSpherePDF();
+  }
+
 DensityVolumeRegion::DensityVolumeRegion(const BBox3D_d &i_bounds, Spectrum_d &i_base_emission, SpectrumCoef_d &i_base_absorption,
                                          SpectrumCoef_d &i_base_scattering, intrusive_ptr<const PhaseFunction> ip_phase_function):
 m_bounds(i_bounds), m_base_emission(i_base_emission), m_base_absorption(i_base_absorption), m_base_scattering(i_base_scattering), mp_phase_function(ip_phase_function)
@@ -62,6 +83,16 @@ double DensityVolumeRegion::Phase(const Point3D_d &i_point, const Vector3D_d &i_
   return m_bounds.Inside(i_point) ? mp_phase_function->ScatteringPDF(i_incoming, i_outgoing) : 0.0;
   }
 
+double DensityVolumeRegion::SamplePhase(const Point3D_d &i_point, const Vector3D_d &i_incoming, const Point2D_d &i_sample, Vector3D_d &o_outgoing) const
+  {
+  return mp_phase_function->Sample(i_incoming, i_sample, o_outgoing);
+  }
+
+double DensityVolumeRegion::PhasePDF(const Point3D_d &i_point, const Vector3D_d &i_incoming, const Vector3D_d &i_outgoing) const
+  {
+  return mp_phase_function->PDF(i_incoming, i_outgoing);
+  }
+
 SpectrumCoef_d DensityVolumeRegion::OpticalThickness(const Ray &i_ray, double i_step, double i_offset_sample) const
   {
   ASSERT(i_ray.m_direction.IsNormalized());
@@ -17,6 +17,7 @@
 
 #include <Common/Common.h>
 #include <Math/Geometry.h>
+#include <Math/RandomGenerator.h>
 #include "Spectrum.h"
 #include "PhaseFunction.h"
 
@@ -73,6 +74,22 @@ class VolumeRegion: public ReferenceCounted
     */
     virtual double Phase(const Point3D_d &i_point, const Vector3D_d &i_incoming, const Vector3D_d &i_outgoing) const = 0;
 
+    /**
+    * Samples outgoing direction for the specified incoming direction according to the phase function at the specified point.
+    * The default implementation samples the sphere uniformly.
+    * @param i_point Point in the volume region.
+    * @param i_incoming Incoming direction, i.e. the direction of the light ray before the scattering. Should be normalized.
+    * @param i_sample 2D sample. Should be in [0;1)^2 range.
+    * @param[out] o_outgoing Sampled outgoing direction. Normalized.
+    * @return PDF of the sampled direction.
+    */
+    virtual double SamplePhase(const Point3D_d &i_point, const Vector3D_d &i_incoming, const Point2D_d &i_sample, Vector3D_d &o_outgoing) const;
+
+    /**
+    * Returns PDF of sampling the specified outgoing direction by the SamplePhase() method.
+    */
+    virtual double PhasePDF(const Point3D_d &i_point, const Vector3D_d &i_incoming, const Vector3D_d &i_outgoing) const;
+
     /**
     * Returns optical thickness of the volume region for the specified ray.
     * The method also takes two additional parameters used by MonteCarlo integration if there's no analytical solution.
@@ -83,6 +100,28 @@ class VolumeRegion: public ReferenceCounted
     */
     virtual SpectrumCoef_d OpticalThickness(const Ray &i_ray, double i_step, double i_offset_sample) const = 0;
 
+    /**
+    * Returns transmittance of the volume region for the specified ray.
+    * The default implementation computes exponent of the optical thickness estimated by OpticalThickness() method.
+    * The implementations can override it to estimate the transmittance directly, e.g. with the ratio tracking which gives unbiased estimate.
+    * @param i_ray Ray for which the transmittance is to be computed. Ray direction should be normalized.
+    * @param i_step Step size for the MonteCarlo integration. Should be greater than 0.0
+    * @param io_random_generator Random generator used for MonteCarlo integration.
+    * @return Transmittance. Each component is in [0;1] range.
+    */
+    virtual SpectrumCoef_d Transmittance(const Ray &i_ray, double i_step, RandomGenerator<double> &io_random_generator) const;
+
+    /**
+    * Returns the parametric coordinate of the first point of the ray segment where the media can be non-empty.
+    * The media has no emission, absorption or scattering between i_t_begin and the returned value, so the integrators can skip that part of the ray.
+    * The default implementation does not skip anything and returns i_t_begin, so the segment should be inside the intersection region of the ray.
+    * @param i_ray Input ray. Direction component should be normalized.
+    * @param i_t_begin Parametric coordinate of the begin of the segment.
+    * @param i_t_end Parametric coordinate of the end of the segment.
+    * @return Parametric coordinate in [i_t_begin;i_t_end] range. Equals i_t_end if the whole segment is empty.
+    */
+    virtual double SkipEmptySpace(const Ray &i_ray, double i_t_begin, double i_t_end) const;
+
     virtual ~VolumeRegion() {};
 
   protected:
@@ -142,6 +181,16 @@ class DensityVolumeRegion: public VolumeRegion
     */
     double Phase(const Point3D_d &i_point, const Vector3D_d &i_incoming, const Vector3D_d &i_outgoing) const;
 
+    /**
+    * Samples outgoing direction for the specified incoming direction with the phase function's sampling method.
+    */
+    double SamplePhase(const Point3D_d &i_point, const Vector3D_d &i_incoming, const Point2D_d &i_sample, Vector3D_d &o_outgoing) const;
+
+    /**
+    * Returns PDF of sampling the specified outgoing direction by the SamplePhase() method.
+    */
+    double PhasePDF(const Point3D_d &i_point, const Vector3D_d &i_incoming, const Vector3D_d &i_outgoing) const;
+
     /**
     * Returns optical thickness of the volume region for the specified ray.
     * The method takes two additional parameters used by MonteCarlo integration.
@@ -14,6 +14,7 @@
 
 #include "InteractiveFilm.h"
 #include <Math/MathRoutines.h>
+#include <tbb/tbb.h>
 
 InteractiveFilm::InteractiveFilm(size_t i_x_resolution, size_t i_y_resolution, intrusive_ptr<const FilmFilter> ip_filter):
 Film(i_x_resolution, i_y_resolution), m_x_resolution(i_x_resolution), m_y_resolution(i_y_resolution)
@@ -81,6 +82,45 @@ bool InteractiveFilm::GetPixel(const Point2D_i &i_image_point, Spectrum_d &o_spe
   return false;
   }
 
+size_t InteractiveFilm::GetPixels(const Point2D_i &i_begin, const Point2D_i &i_end, std::vector<float> &o_values, bool i_clamp_values) const
+  {
+  ASSERT(i_begin[0]>=0 && i_begin[1]>=0 && i_end[0]<=(int)m_x_resolution && i_end[1]<=(int)m_y_resolution);
+  ASSERT(i_begin[0]<=i_end[0] && i_begin[1]<=i_end[1]);
+
+  size_t width = i_end[0]-i_begin[0], height = i_end[1]-i_begin[1];
+  o_values.resize(width*height*3);
+  if (o_values.empty())
+    return 0;
+
+  // GetPixel() method only reads the layers so the rows can be processed concurrently.
+  tbb::atomic<size_t> pixels_read;
+  pixels_read = 0;
+  float *p_values = &o_values[0];
+  tbb::parallel_for(tbb::blocked_range<int>(i_begin[1], i_end[1]), [&](const tbb::blocked_range<int> &i_range)
+    {
+    size_t row_pixels_read = 0;
+    for(int y=i_range.begin();y!=i_range.end();++y)
+      {
+      float *p_value = p_values + (y-i_begin[1])*width*3;
+      for(int x=i_begin[0];x<i_end[0];++x, p_value+=3)
+        {
+        Spectrum_d spectrum;
+        if (GetPixel(Point2D_i(x,y), spectrum, i_clamp_values))
+          {
+          p_value[0]=(float)spectrum[0]; p_value[1]=(float)spectrum[1]; p_value[2]=(float)spectrum[2];
+          ++row_pixels_read;
+          }
+        else
+          p_value[0]=p_value[1]=p_value[2]=0.f;
+        }
+      }
+
+    pixels_read += row_pixels_read;
+    });
+
+  return pixels_read;
+  }
+
 void InteractiveFilm::GetSamplingExtent(Point2D_i &o_begin, Point2D_i &o_end) const
   {
   if (m_image_films.empty()==false)
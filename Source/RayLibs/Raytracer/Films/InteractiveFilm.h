@@ -15,7 +15,7 @@
 #ifndef INTERACTIVE_FILM_H
 #define INTERACTIVE_FILM_H
 
-#include <Common\Common.h>
+#include <Common/Common.h>
 #include <Raytracer/Core/Film.h>
 #include <Raytracer/Core/FilmFilter.h>
 #include "ImageFilm.h"
@@ -67,6 +67,18 @@ class InteractiveFilm: public Film
     */
     virtual bool GetPixel(const Point2D_i &i_image_point, Spectrum_d &o_spectrum, bool i_clamp_values = true) const;
 
+    /**
+    * Gets the Spectrum values for the specified rectangular region of pixels.
+    * The values are written to the contiguous buffer row by row, three float components per pixel. The pixels for which GetPixel() method fails are set to zero.
+    * The rows are processed in parallel.
+    * @param i_begin Left lower corner of the region. Should be in [0;m_x_resolution] x [0;m_y_resolution] range.
+    * @param i_end Right upper corner of the region (exclusive). Should be in [0;m_x_resolution] x [0;m_y_resolution] range. Should be higher or equal than i_begin in both dimensions.
+    * @param[out] o_values Buffer for the Spectrum values. The buffer is resized to the number of the region's pixels multiplied by three.
+    * @param i_clamp_values If true, the Spectrum values will be clamped before returning.
+    * @return Number of pixels whose values were computed successfully.
+    */
+    virtual size_t GetPixels(const Point2D_i &i_begin, const Point2D_i &i_end, std::vector<float> &o_values, bool i_clamp_values = true) const;
+
     /**
     * Returns the window in the image plane where samples need to be generated.
     * The window may be larger than the actual film resolution due to filter's width.
@@ -0,0 +1,359 @@
+/*
+* Copyright (C) 2014 by Volodymyr Kachurovskyi <Volodymyr.Kachurovskyi@gmail.com>
+*
+* This file is part of Skwarka.
+*
+* Skwarka is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+*
+* Skwarka is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License along with Skwarka.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "TiledInteractiveFilm.h"
+#include <Math/MathRoutines.h>
+#include <tbb/tbb.h>
+#include <algorithm>
+
+TiledInteractiveFilm::TiledInteractiveFilm(size_t i_x_resolution, size_t i_y_resolution, intrusive_ptr<const FilmFilter> ip_filter):
+Film(i_x_resolution, i_y_resolution), m_x_resolution(i_x_resolution), m_y_resolution(i_y_resolution), mp_filter(ip_filter)
+  {
+  ASSERT(i_x_resolution>0 && i_y_resolution>0);
+  ASSERT(mp_filter != NULL);
+  ASSERT(TILE_SIZE % FRACTION_FACTOR == 0);
+
+  m_filter_x_width=mp_filter->GetXWidth();
+  m_filter_y_width=mp_filter->GetYWidth();
+  ASSERT(m_filter_x_width > 0.0 && m_filter_y_width > 0.0);
+
+  m_crop_window_begin = Point2D_i(0, 0);
+  m_crop_window_end = Point2D_i((int)m_x_resolution, (int)m_y_resolution);
+
+  m_x_tiles = (m_x_resolution+TILE_SIZE-1)/TILE_SIZE;
+  m_y_tiles = (m_y_resolution+TILE_SIZE-1)/TILE_SIZE;
+  m_tiles.resize(m_x_tiles*m_y_tiles);
+  m_pixels.resize(m_tiles.size()*TILE_SIZE*TILE_SIZE);
+
+  size_t layer_x_resolution=m_x_resolution, layer_y_resolution=m_y_resolution;
+  while (layer_x_resolution>1 || layer_y_resolution>1)
+    {
+    layer_x_resolution = (layer_x_resolution+FRACTION_FACTOR-1)/FRACTION_FACTOR;
+    layer_y_resolution = (layer_y_resolution+FRACTION_FACTOR-1)/FRACTION_FACTOR;
+
+    Layer layer;
+    layer.m_x_resolution = layer_x_resolution;
+    layer.m_y_resolution = layer_y_resolution;
+    m_layers.push_back(layer);
+    m_layers.back().m_pixels.resize(layer_x_resolution*layer_y_resolution);
+    }
+
+  ClearFilm();
+  }
+
+unsigned int TiledInteractiveFilm::_LockTile(Tile &io_tile)
+  {
+  while (true)
+    {
+    unsigned int sequence = io_tile.m_sequence;
+    if ((sequence & 1) == 0 && io_tile.m_sequence.compare_and_swap(sequence+1, sequence) == sequence)
+      return sequence;
+    }
+  }
+
+void TiledInteractiveFilm::_UnlockTile(Tile &io_tile, unsigned int i_sequence)
+  {
+  ASSERT((i_sequence & 1) == 0);
+  io_tile.m_sequence = i_sequence+2;
+  }
+
+void TiledInteractiveFilm::AddSample(const Point2D_d &i_image_point, const Spectrum_d &i_spectrum)
+  {
+  double image_x = i_image_point[0] - 0.5;
+  double image_y = i_image_point[1] - 0.5;
+  int x0 = (int) (image_x - m_filter_x_width + 1.0-(1e-10));
+  int x1 = (int) (image_x + m_filter_x_width);
+  int y0 = (int) (image_y - m_filter_y_width + 1.0-(1e-10));
+  int y1 = (int) (image_y + m_filter_y_width);
+  x0 = std::max(x0, m_crop_window_begin[0]);
+  x1 = std::min(x1, m_crop_window_end[0]-1);
+  y0 = std::max(y0, m_crop_window_begin[1]);
+  y1 = std::min(y1, m_crop_window_end[1]-1);
+  if (x0>x1 || y0>y1)
+    return;
+
+  // Loop over the tiles overlapping the filter support and add sample to their pixels.
+  for (size_t tile_y = y0/TILE_SIZE; tile_y <= y1/TILE_SIZE; ++tile_y)
+    for (size_t tile_x = x0/TILE_SIZE; tile_x <= x1/TILE_SIZE; ++tile_x)
+      {
+      int begin_x = std::max(x0, (int)(tile_x*TILE_SIZE)), end_x = std::min(x1, (int)(tile_x*TILE_SIZE+TILE_SIZE-1));
+      int begin_y = std::max(y0, (int)(tile_y*TILE_SIZE)), end_y = std::min(y1, (int)(tile_y*TILE_SIZE+TILE_SIZE-1));
+
+      size_t tile_index = tile_y*m_x_tiles+tile_x;
+      Tile &tile = m_tiles[tile_index];
+
+      unsigned int sequence = _LockTile(tile);
+      for (int y = begin_y; y <= end_y; ++y)
+        for (int x = begin_x; x <= end_x; ++x)
+          {
+          FilmPixel &pixel = m_pixels[_GetPixelIndex(x,y)];
+
+          double filter_weight = mp_filter->Evaluate(x-image_x, y-image_y);
+
+          pixel.m_spectrum.AddWeighted(i_spectrum, filter_weight);
+          pixel.m_weight_sum += filter_weight;
+          }
+      _UnlockTile(tile, sequence);
+
+      // The tile is queued only once until the coarser layers are updated.
+      if (tile.m_dirty.fetch_and_store(true) == false)
+        m_dirty_tiles.push(tile_index);
+      }
+  }
+
+void TiledInteractiveFilm::ClearFilm()
+  {
+  std::fill(m_pixels.begin(), m_pixels.end(), FilmPixel());
+  for(size_t i=0;i<m_tiles.size();++i)
+    {
+    m_tiles[i].m_sequence = 0;
+    m_tiles[i].m_dirty = false;
+    }
+
+  m_dirty_tiles.clear();
+  for(size_t i=0;i<m_layers.size();++i)
+    std::fill(m_layers[i].m_pixels.begin(), m_layers[i].m_pixels.end(), FilmPixel());
+  }
+
+void TiledInteractiveFilm::_UpdateLayers() const
+  {
+  if (m_layers.empty())
+    return;
+
+  // Indices of the pixels of the current layer that have been updated.
+  std::vector<size_t> updated_pixels;
+
+  // Update the first layer for all dirty tiles. Each pixel of the layer is completely inside a single tile.
+  std::vector<FilmPixel> tile_pixels(TILE_SIZE*TILE_SIZE);
+  Layer &first_layer = m_layers[0];
+  size_t tile_index;
+  while (m_dirty_tiles.try_pop(tile_index))
+    {
+    Tile &tile = const_cast<Tile&>(m_tiles[tile_index]);
+
+    // The flag is reset before reading the pixels so that the samples added after that will queue the tile again.
+    tile.m_dirty = false;
+
+    // Read the tile's pixels and retry if a writer has changed them meanwhile.
+    const FilmPixel *p_pixels = &m_pixels[tile_index*TILE_SIZE*TILE_SIZE];
+    while (true)
+      {
+      unsigned int sequence = tile.m_sequence;
+      if (sequence & 1)
+        continue;
+
+      std::copy(p_pixels, p_pixels+TILE_SIZE*TILE_SIZE, tile_pixels.begin());
+      tbb::atomic_fence();
+      if (tile.m_sequence == sequence)
+        break;
+      }
+
+    size_t tile_x = tile_index%m_x_tiles, tile_y = tile_index/m_x_tiles;
+    size_t begin_x = tile_x*(TILE_SIZE/FRACTION_FACTOR), end_x = std::min(begin_x+TILE_SIZE/FRACTION_FACTOR, first_layer.m_x_resolution);
+    size_t begin_y = tile_y*(TILE_SIZE/FRACTION_FACTOR), end_y = std::min(begin_y+TILE_SIZE/FRACTION_FACTOR, first_layer.m_y_resolution);
+    for(size_t y=begin_y;y<end_y;++y)
+      for(size_t x=begin_x;x<end_x;++x)
+        {
+        FilmPixel sum;
+        size_t local_x = (x-begin_x)*FRACTION_FACTOR, local_y = (y-begin_y)*FRACTION_FACTOR;
+        for(size_t j=0;j<FRACTION_FACTOR;++j)
+          for(size_t i=0;i<FRACTION_FACTOR;++i)
+            {
+            const FilmPixel &pixel = tile_pixels[(local_y+j)*TILE_SIZE+local_x+i];
+            sum.m_spectrum += pixel.m_spectrum;
+            sum.m_weight_sum += pixel.m_weight_sum;
+            }
+
+        size_t index = y*first_layer.m_x_resolution+x;
+        first_layer.m_pixels[index] = sum;
+        updated_pixels.push_back(index);
+        }
+    }
+
+  // Propagate the changes to the next layers.
+  for(size_t l=1;l<m_layers.size() && updated_pixels.empty()==false;++l)
+    {
+    const Layer &prev_layer = m_layers[l-1];
+    Layer &layer = m_layers[l];
+
+    std::vector<size_t> parent_pixels(updated_pixels.size());
+    for(size_t i=0;i<updated_pixels.size();++i)
+      {
+      size_t x = updated_pixels[i]%prev_layer.m_x_resolution, y = updated_pixels[i]/prev_layer.m_x_resolution;
+      parent_pixels[i] = (y/FRACTION_FACTOR)*layer.m_x_resolution + x/FRACTION_FACTOR;
+      }
+    std::sort(parent_pixels.begin(), parent_pixels.end());
+    parent_pixels.erase(std::unique(parent_pixels.begin(), parent_pixels.end()), parent_pixels.end());
+
+    for(size_t i=0;i<parent_pixels.size();++i)
+      {
+      size_t x = parent_pixels[i]%layer.m_x_resolution, y = parent_pixels[i]/layer.m_x_resolution;
+      size_t end_x = std::min((x+1)*FRACTION_FACTOR, prev_layer.m_x_resolution);
+      size_t end_y = std::min((y+1)*FRACTION_FACTOR, prev_layer.m_y_resolution);
+
+      FilmPixel sum;
+      for(size_t prev_y=y*FRACTION_FACTOR;prev_y<end_y;++prev_y)
+        for(size_t prev_x=x*FRACTION_FACTOR;prev_x<end_x;++prev_x)
+          {
+          const FilmPixel &pixel = prev_layer.m_pixels[prev_y*prev_layer.m_x_resolution+prev_x];
+          sum.m_spectrum += pixel.m_spectrum;
+          sum.m_weight_sum += pixel.m_weight_sum;
+          }
+
+      layer.m_pixels[parent_pixels[i]] = sum;
+      }
+
+    updated_pixels.swap(parent_pixels);
+    }
+  }
+
+void TiledInteractiveFilm::_ReadPixel(size_t i_x, size_t i_y, FilmPixel &o_pixel) const
+  {
+  const Tile &tile = m_tiles[(i_y/TILE_SIZE)*m_x_tiles + i_x/TILE_SIZE];
+  const FilmPixel &film_pixel = m_pixels[_GetPixelIndex(i_x, i_y)];
+  while (true)
+    {
+    unsigned int sequence = tile.m_sequence;
+    if (sequence & 1)
+      continue;
+
+    o_pixel = film_pixel;
+    tbb::atomic_fence();
+    if (tile.m_sequence == sequence)
+      break;
+    }
+  }
+
+void TiledInteractiveFilm::_ReadLayersPixel(size_t i_x, size_t i_y, FilmPixel &o_pixel) const
+  {
+  // Read pixel value from the coarser layers until it is read successfully.
+  o_pixel = FilmPixel();
+  for(size_t i=0;i<m_layers.size() && o_pixel.m_weight_sum == 0.0;++i)
+    {
+    i_x/=FRACTION_FACTOR;
+    i_y/=FRACTION_FACTOR;
+    o_pixel = m_layers[i].m_pixels[i_y*m_layers[i].m_x_resolution+i_x];
+    }
+  }
+
+bool TiledInteractiveFilm::GetPixel(const Point2D_i &i_image_point, Spectrum_d &o_spectrum, bool i_clamp_values) const
+  {
+  ASSERT(i_image_point[0]>=0 && i_image_point[1]>=0 && i_image_point[0]<(int)m_x_resolution && i_image_point[1]<(int)m_y_resolution);
+
+  // Check if the specified pixel is inside the crop window and return false if it is not.
+  if (i_image_point[0]<m_crop_window_begin[0] || i_image_point[1]<m_crop_window_begin[1] || i_image_point[0]>=m_crop_window_end[0] || i_image_point[1]>=m_crop_window_end[1])
+    return false;
+
+  FilmPixel pixel;
+  _ReadPixel(i_image_point[0], i_image_point[1], pixel);
+
+  if (pixel.m_weight_sum == 0.0)
+    {
+    tbb::spin_mutex::scoped_lock lock(m_layers_mutex);
+    _UpdateLayers();
+    _ReadLayersPixel(i_image_point[0], i_image_point[1], pixel);
+
+    if (pixel.m_weight_sum == 0.0)
+      return false;
+    }
+
+  o_spectrum=pixel.m_spectrum / pixel.m_weight_sum;
+  if (i_clamp_values)
+    o_spectrum.Clamp(0.0, DBL_INF);
+  return true;
+  }
+
+size_t TiledInteractiveFilm::GetPixels(const Point2D_i &i_begin, const Point2D_i &i_end, std::vector<float> &o_values, bool i_clamp_values) const
+  {
+  ASSERT(i_begin[0]>=0 && i_begin[1]>=0 && i_end[0]<=(int)m_x_resolution && i_end[1]<=(int)m_y_resolution);
+  ASSERT(i_begin[0]<=i_end[0] && i_begin[1]<=i_end[1]);
+
+  size_t width = i_end[0]-i_begin[0], height = i_end[1]-i_begin[1];
+  o_values.resize(width*height*3);
+  if (o_values.empty())
+    return 0;
+
+  // The lock is held for the whole region so that the coarser layers are not changed while they are being read. Writers are not blocked by this lock.
+  tbb::spin_mutex::scoped_lock lock(m_layers_mutex);
+  _UpdateLayers();
+
+  tbb::atomic<size_t> pixels_read;
+  pixels_read = 0;
+  float *p_values = &o_values[0];
+  tbb::parallel_for(tbb::blocked_range<int>(i_begin[1], i_end[1]), [&](const tbb::blocked_range<int> &i_range)
+    {
+    size_t row_pixels_read = 0;
+    for(int y=i_range.begin();y!=i_range.end();++y)
+      {
+      float *p_value = p_values + (y-i_begin[1])*width*3;
+      bool row_inside = y>=m_crop_window_begin[1] && y<m_crop_window_end[1];
+      for(int x=i_begin[0];x<i_end[0];++x, p_value+=3)
+        {
+        FilmPixel pixel;
+        if (row_inside && x>=m_crop_window_begin[0] && x<m_crop_window_end[0])
+          {
+          _ReadPixel(x, y, pixel);
+          if (pixel.m_weight_sum == 0.0)
+            _ReadLayersPixel(x, y, pixel);
+          }
+
+        if (pixel.m_weight_sum != 0.0)
+          {
+          Spectrum_d spectrum = pixel.m_spectrum / pixel.m_weight_sum;
+          if (i_clamp_values)
+            spectrum.Clamp(0.0, DBL_INF);
+
+          p_value[0]=(float)spectrum[0]; p_value[1]=(float)spectrum[1]; p_value[2]=(float)spectrum[2];
+          ++row_pixels_read;
+          }
+        else
+          p_value[0]=p_value[1]=p_value[2]=0.f;
+        }
+      }
+
+    pixels_read += row_pixels_read;
+    });
+
+  return pixels_read;
+  }
+
+void TiledInteractiveFilm::GetSamplingExtent(Point2D_i &o_begin, Point2D_i &o_end) const
+  {
+  Point2D_d begin = Convert<double>(m_crop_window_begin) + Point2D_d(0.5-m_filter_x_width, 0.5-m_filter_y_width);
+  Point2D_d end = Convert<double>(m_crop_window_end) + Point2D_d(0.5+m_filter_x_width, 0.5+m_filter_y_width);
+
+  o_begin = Point2D_i( (int)floor(begin[0]), (int)floor(begin[1]) );
+  o_end = Point2D_i( (int)floor(end[0]), (int)floor(end[1]) );
+  }
+
+void TiledInteractiveFilm::SetCropWindow(const Point2D_i &i_begin, const Point2D_i &i_end)
+  {
+  ASSERT(i_begin[0]>=0 && i_begin[1]>=0 && i_end[0]<=(int)m_x_resolution && i_end[1]<=(int)m_y_resolution && "Crop window coordinates are out of range.");
+
+  // Check if crop window coordinates are invalid.
+  if (i_begin[0]>i_end[0] || i_begin[1]>i_end[1])
+    {
+    ASSERT(0 && "Crop window coordinates are invalid. Skipping");
+    return;
+    }
+
+  m_crop_window_begin = Point2D_i(std::max(0,i_begin[0]), std::max(0,i_begin[1]));
+  m_crop_window_end = Point2D_i(std::min((int)m_x_resolution,i_end[0]), std::min((int)m_y_resolution,i_end[1]));
+  }
+
+void TiledInteractiveFilm::GetCropWindow(Point2D_i &o_begin, Point2D_i &o_end) const
+  {
+  o_begin = m_crop_window_begin;
+  o_end = m_crop_window_end;
+  }
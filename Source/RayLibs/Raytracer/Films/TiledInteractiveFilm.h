@@ -0,0 +1,189 @@
+/*
+* Copyright (C) 2014 by Volodymyr Kachurovskyi <Volodymyr.Kachurovskyi@gmail.com>
+*
+* This file is part of Skwarka.
+*
+* Skwarka is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+*
+* Skwarka is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License along with Skwarka.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef TILED_INTERACTIVE_FILM_H
+#define TILED_INTERACTIVE_FILM_H
+
+#include <Common/Common.h>
+#include <Raytracer/Core/Film.h>
+#include <Raytracer/Core/FilmFilter.h>
+#include <Raytracer/Core/Spectrum.h>
+#include <Math/Point2D.h>
+#include <tbb/atomic.h>
+#include <tbb/spin_mutex.h>
+#include <tbb/concurrent_queue.h>
+#include <vector>
+
+/**
+* Film implementation for displaying the generated image in "real time" while new samples are added to the film.
+* Unlike InteractiveFilm, the samples are added to a single full resolution accumulation buffer only. The buffer is divided into square tiles and each tile is guarded by a sequence lock.
+* Writers serialize on the tile's sequence counter, while readers read the pixels optimistically and retry if the counter has changed, so readers never block writers.
+* When a pixel has no samples yet, its value is approximated from coarser layers. Each next layer has FRACTION_FACTOR times smaller resolution and its pixels
+* accumulate the samples of the corresponding blocks of the previous layer. The coarser layers are not updated when samples are added,
+* instead they are lazily updated for the tiles changed since the last update when GetPixel() method needs them.
+* AddSample() method can be called concurrently with itself and with GetPixel() method. ClearFilm() and SetCropWindow() methods should not be called concurrently with any other method.
+* @sa InteractiveFilm, ImageFilm, FilmFilter
+*/
+class TiledInteractiveFilm: public Film
+  {
+  public:
+    /**
+    * Creates an instance of TiledInteractiveFilm with the specified resolution and FilmFilter implementation.
+    * @param i_x_resolution X resolution. Should be greater than 0.
+    * @param i_y_resolution Y resolution. Should be greater than 0.
+    * @param ip_filter FilmFilter to be used for filtering pixel samples.
+    */
+    TiledInteractiveFilm(size_t i_x_resolution, size_t i_y_resolution, intrusive_ptr<const FilmFilter> ip_filter);
+
+    /**
+    * Adds sample value to the film.
+    * The method is thread-safe.
+    */
+    virtual void AddSample(const Point2D_d &i_image_point, const Spectrum_d &i_spectrum);
+
+    /**
+    * Clears the film.
+    * The method removes all samples from the film saved so far.
+    */
+    virtual void ClearFilm();
+
+    /**
+    * Gets the Spectrum value for the specified pixel.
+    * If no samples contribute to the pixel, the value is approximated from the coarser layers.
+    * The method returns true on success and false if no samples were added to the film or if the specified pixel is out of the cropping window.
+    * @param i_image_point Coordinates of the pixel.
+    * @param[out] o_spectrum Spectrum value of the pixel.
+    * @param i_clamp_values If true, the Spectrum value will be clamped before returning.
+    * @return true if the spectrum value were computed successfully and false otherwise.
+    */
+    virtual bool GetPixel(const Point2D_i &i_image_point, Spectrum_d &o_spectrum, bool i_clamp_values = true) const;
+
+    /**
+    * Gets the Spectrum values for the specified rectangular region of pixels.
+    * The values are written to the contiguous buffer row by row, three float components per pixel. The pixels for which GetPixel() method fails are set to zero.
+    * The rows are processed in parallel, the coarser layers are updated only once for the whole region.
+    * @param i_begin Left lower corner of the region. Should be in [0;m_x_resolution] x [0;m_y_resolution] range.
+    * @param i_end Right upper corner of the region (exclusive). Should be in [0;m_x_resolution] x [0;m_y_resolution] range. Should be higher or equal than i_begin in both dimensions.
+    * @param[out] o_values Buffer for the Spectrum values. The buffer is resized to the number of the region's pixels multiplied by three.
+    * @param i_clamp_values If true, the Spectrum values will be clamped before returning.
+    * @return Number of pixels whose values were computed successfully.
+    */
+    virtual size_t GetPixels(const Point2D_i &i_begin, const Point2D_i &i_end, std::vector<float> &o_values, bool i_clamp_values = true) const;
+
+    /**
+    * Returns the window in the image plane where samples need to be generated.
+    * The window may be larger than the actual film resolution due to filter's width.
+    * @param[out] o_begin Left lower corner of the sampling window.
+    * @param[out] o_end Right upper corner of the sampling window (exclusive).
+    */
+    virtual void GetSamplingExtent(Point2D_i &o_begin, Point2D_i &o_end) const;
+
+    /**
+    * Sets cropping window for the film. The image will be generated only inside that window.
+    * @param i_begin Left lower corner of the crop window. Should be in [0;m_x_resolution] x [0;m_y_resolution] range. Should be lesser or equal than i_end in both dimensions.
+    * @param i_end Right upper corner of the crop window. Should be in [0;m_x_resolution] x [0;m_y_resolution] range. Should be higher or equal than i_begin in both dimensions.
+    */
+    void SetCropWindow(const Point2D_i &i_begin, const Point2D_i &i_end);
+
+    /**
+    * Gets cropping window for the film.
+    * @param o_begin out Left lower corner of the crop window. Will be in [0;m_x_resolution] x [0;m_y_resolution] range. Will be lesser or equal than o_end in both dimensions.
+    * @param o_end out Right upper corner of the crop window. Will be in [0;m_x_resolution] x [0;m_y_resolution] range. Will be higher or equal than o_begin in both dimensions.
+    */
+    void GetCropWindow(Point2D_i &o_begin, Point2D_i &o_end) const;
+
+  private:
+    // Internal types.
+    struct FilmPixel;
+    struct Tile;
+
+    struct Layer
+      {
+      size_t m_x_resolution, m_y_resolution;
+      std::vector<FilmPixel> m_pixels;
+      };
+
+  private:
+    // Returns index of the pixel in m_pixels array. The pixels of each tile are stored contiguously.
+    size_t _GetPixelIndex(size_t i_x, size_t i_y) const;
+
+    // Reads the pixel of the full resolution buffer and retries if a writer has changed it meanwhile.
+    void _ReadPixel(size_t i_x, size_t i_y, FilmPixel &o_pixel) const;
+
+    // Reads the pixel from the coarser layers. Should be called with m_layers_mutex locked.
+    void _ReadLayersPixel(size_t i_x, size_t i_y, FilmPixel &o_pixel) const;
+
+    // Acquires the tile for writing and returns the sequence value the tile had before.
+    static unsigned int _LockTile(Tile &io_tile);
+
+    static void _UnlockTile(Tile &io_tile, unsigned int i_sequence);
+
+    // Recomputes the coarser layers' pixels for all tiles changed since the last call.
+    void _UpdateLayers() const;
+
+  private:
+    size_t m_x_resolution, m_y_resolution;
+    double m_filter_x_width, m_filter_y_width;
+
+    intrusive_ptr<const FilmFilter> mp_filter;
+
+    size_t m_x_tiles, m_y_tiles;
+    std::vector<Tile> m_tiles;
+    std::vector<FilmPixel> m_pixels;
+
+    // Indices of the tiles changed since the last update of the coarser layers.
+    mutable tbb::concurrent_queue<size_t> m_dirty_tiles;
+
+    // Coarser layers, the first layer has FRACTION_FACTOR times smaller resolution than the film and the last layer is one pixel sized.
+    mutable std::vector<Layer> m_layers;
+    mutable tbb::spin_mutex m_layers_mutex;
+
+    Point2D_i m_crop_window_begin, m_crop_window_end;
+
+    // Defines the size factor between consecutive layers.
+    static const size_t FRACTION_FACTOR = 4;
+
+    // Size of the square tiles the film is divided into. Should be a multiple of FRACTION_FACTOR.
+    static const size_t TILE_SIZE = 16;
+  };
+
+/////////////////////////////////////////// IMPLEMENTATION ////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+struct TiledInteractiveFilm::FilmPixel
+  {
+  FilmPixel() : m_spectrum(), m_weight_sum(0.0)
+    {
+    }
+
+  Spectrum_d m_spectrum;
+  double m_weight_sum;
+  };
+
+struct TiledInteractiveFilm::Tile
+  {
+  // Sequence lock counter. The value is odd while the tile is being written to.
+  tbb::atomic<unsigned int> m_sequence;
+
+  // True if the tile has been changed since the last update of the coarser layers.
+  tbb::atomic<bool> m_dirty;
+  };
+
+inline size_t TiledInteractiveFilm::_GetPixelIndex(size_t i_x, size_t i_y) const
+  {
+  size_t tile_index = (i_y/TILE_SIZE)*m_x_tiles + i_x/TILE_SIZE;
+  return tile_index*TILE_SIZE*TILE_SIZE + (i_y%TILE_SIZE)*TILE_SIZE + (i_x%TILE_SIZE);
+  }
+
+#endif // TILED_INTERACTIVE_FILM_H
@@ -17,6 +17,7 @@
 #include <vector>
 #include <string>
 #include <exception>
+#include <stdexcept>
 #include <Raytracer/Core/Color.h>
 #include <FreeImage.h>
 
@@ -68,7 +69,7 @@ std::vector<std::vector<RGBColor_f>> LoadImageFromFile(const std::string &i_file
       FreeImage_Unload(p_converted_image);
       return values;
       }
-    else throw std::exception(std::string("Could not convert image to RGB: " + i_filename).c_str());
+    else throw std::runtime_error("Could not convert image to RGB: " + i_filename);
     }
-  else throw std::exception(std::string("Could not load image file: " + i_filename).c_str());
+  else throw std::runtime_error("Could not load image file: " + i_filename);
   }
\ No newline at end of file
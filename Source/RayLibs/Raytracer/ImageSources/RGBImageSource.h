@@ -49,6 +49,11 @@ class RGBImageSource: public ImageSource<T>
     */
     std::vector<std::vector<T>> GetImage() const;
 
+    /**
+    * Gets the values of the specified rectangular region of the image. Only the values of the region are converted to the target type.
+    */
+    void GetRegion(size_t i_begin_x, size_t i_begin_y, size_t i_end_x, size_t i_end_y, std::vector<T> &o_values) const;
+
     /**
     * Returns height of the image, i.e. the size of the outer vector which defines the image.
     */
@@ -60,6 +65,8 @@ class RGBImageSource: public ImageSource<T>
     size_t GetWidth() const;
 
   private:
+    T _Convert(const RGBColor_f &i_color) const;
+
     /**
     * Helper private method that converts XYZColor to the target type.
     * Specializations for float, double, Spectrum_f, Spectrum_d, SpectrumCoef_f and SpectrumCoef_d are provided.
@@ -104,20 +111,38 @@ std::vector<std::vector<T>> RGBImageSource<T>::GetImage() const
 
     // Just copy the values and multiply them by the scale factor.
     for(size_t j=0;j<m_values[i].size();++j)
-      {
-      RGBColor_d scaled
-        {
-        source_row[j].m_rgb[0] * m_scale,
-        source_row[j].m_rgb[1] * m_scale,
-        source_row[j].m_rgb[2] * m_scale
-        };
-      dest_row[j] = _XYZ_To_T(m_color_system.RGB_To_XYZ(scaled));
-      }
+      dest_row[j] = _Convert(source_row[j]);
     }
 
   return ret;
   }
 
+template<typename T>
+void RGBImageSource<T>::GetRegion(size_t i_begin_x, size_t i_begin_y, size_t i_end_x, size_t i_end_y, std::vector<T> &o_values) const
+  {
+  ASSERT(i_begin_x<i_end_x && i_end_x<=GetWidth());
+  ASSERT(i_begin_y<i_end_y && i_end_y<=GetHeight());
+
+  o_values.resize((i_end_x-i_begin_x)*(i_end_y-i_begin_y));
+
+  typename std::vector<T>::iterator it = o_values.begin();
+  for(size_t y=i_begin_y;y<i_end_y;++y)
+    for(size_t x=i_begin_x;x<i_end_x;++x)
+      *it++ = _Convert(m_values[y][x]);
+  }
+
+template<typename T>
+T RGBImageSource<T>::_Convert(const RGBColor_f &i_color) const
+  {
+  RGBColor_d scaled
+    {
+    i_color.m_rgb[0] * m_scale,
+    i_color.m_rgb[1] * m_scale,
+    i_color.m_rgb[2] * m_scale
+    };
+  return _XYZ_To_T(m_color_system.RGB_To_XYZ(scaled));
+  }
+
 template<typename T>
 size_t RGBImageSource<T>::GetHeight() const
   {
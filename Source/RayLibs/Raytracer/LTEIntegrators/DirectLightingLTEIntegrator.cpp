@@ -24,7 +24,7 @@ LTEIntegrator(ip_scene), mp_scene(ip_scene), m_params(i_params)
 
   // We double the media step size for secondary rays to reduce computation time (since the accuracy is usually less important for such rays).
   mp_direct_lighting_integrator.reset(new DirectLightingIntegrator(ip_scene, i_params.m_direct_light_samples_num,
-    i_params.m_direct_light_samples_num, 2.0*i_params.m_media_step_size));
+    i_params.m_direct_light_samples_num, 2.0*i_params.m_media_step_size, NULL, i_params.m_delta_light_samples_num));
 
   if (m_params.m_max_specular_depth > 50)
     m_params.m_max_specular_depth = 50;
@@ -114,12 +114,23 @@ Spectrum_d DirectLightingLTEIntegrator::_MediaRadianceAndTranmsittance(const Ray
   double step = base_step;
   for (size_t i=0;t0<t1-DBL_EPS;++i)
     {
+    // Empty parts of the ray neither emit nor scatter light and do not change the transmittance, so they are skipped entirely.
+    double t_non_empty = p_volume->SkipEmptySpace(ray, t0, t1);
+    if (t_non_empty > t0)
+      {
+      t0 = t_non_empty;
+      point = ray(t0);
+      if (t0 >= t1-DBL_EPS)
+        break;
+      }
+
     step = std::min(step, t1-t0);
 
     // We use low discrepancy samples. The point here is that we don't know the exact number of samples needed.
     // RadicalInverse produce well stratified samples for any number of samples.
     double sample1D = SamplingRoutines::RadicalInverse((unsigned int)i+1, 2);
     Point2D_d sample2D(SamplingRoutines::RadicalInverse((unsigned int)i+1, 3), SamplingRoutines::RadicalInverse((unsigned int)i+1, 5));
+    Point2D_d phase_sample(SamplingRoutines::RadicalInverse((unsigned int)i+1, 7), SamplingRoutines::RadicalInverse((unsigned int)i+1, 11));
 
     prev_point = point;
     point = ray(t0+offset1*step);
@@ -157,10 +168,53 @@ Spectrum_d DirectLightingLTEIntegrator::_MediaRadianceAndTranmsittance(const Ray
       else
         light_radiance = lights.m_area_light_sources[light_index-delta_lights-infinite_lights]->SampleLighting(point, (*p_rng)(1.0), sample2D, lighting_ray, light_pdf);
 
-      if (light_radiance.IsBlack()==false && light_pdf > 0.0 && mp_scene->IntersectTest(lighting_ray)==false)
+      // For non-delta lights the phase function is sampled too and the two strategies are combined with the multiple importance sampling.
+      bool delta_light = light_index < delta_lights;
+      if (light_radiance.IsBlack()==false && light_pdf > 0.0 && mp_scene->IntersectTest(lighting_ray, i_ts.mp_occluder_hint)==false)
         {
+        Vector3D_d incoming = lighting_ray.m_direction*(-1.0);
+        double weight = delta_light ? 1.0 : SamplingRoutines::PowerHeuristic(1, light_pdf, 1, p_volume->PhasePDF(point, incoming, direction));
+
         Spectrum_d tmp = light_radiance * _MediaTransmittance(lighting_ray, i_ts);
-        radiance += transmittance * scattering * tmp * (p_volume->Phase(point, lighting_ray.m_direction*(-1.0), direction) * step * double(num_lights) / light_pdf);
+        radiance += transmittance * scattering * tmp * (p_volume->Phase(point, incoming, direction) * weight * step * double(num_lights) / light_pdf);
+        }
+
+      if (delta_light == false)
+        {
+        // The phase functions only depend on the angle between the directions, so the incoming direction can be sampled as the outgoing one for the view direction.
+        Vector3D_d incoming;
+        double phase_pdf = p_volume->SamplePhase(point, direction, phase_sample, incoming);
+        if (phase_pdf > 0.0)
+          {
+          Ray phase_ray(point, incoming*(-1.0));
+          Spectrum_d phase_light_radiance;
+          double phase_light_pdf = 0.0;
+
+          Intersection isect;
+          if (mp_scene->Intersect(RayDifferential(phase_ray), isect, &phase_ray.m_max_t))
+            {
+            // Only the light source chosen above contributes since the estimate is already divided by the probability of choosing it.
+            const AreaLightSource *p_area_light = isect.mp_primitive->GetAreaLightSource_RawPtr();
+            if (light_index >= delta_lights+infinite_lights && p_area_light == lights.m_area_light_sources[light_index-delta_lights-infinite_lights].get())
+              {
+              phase_light_radiance = p_area_light->Radiance(isect.m_dg, isect.m_triangle_index, incoming);
+              phase_light_pdf = p_area_light->LightingPDF(phase_ray, isect.m_triangle_index);
+              }
+            }
+          else if (light_index < delta_lights+infinite_lights)
+            {
+            phase_light_radiance = lights.m_infinite_light_sources[light_index-delta_lights]->Radiance(RayDifferential(phase_ray));
+            phase_light_pdf = lights.m_infinite_light_sources[light_index-delta_lights]->LightingPDF(phase_ray.m_direction);
+            }
+
+          if (phase_light_radiance.IsBlack()==false)
+            {
+            double weight = SamplingRoutines::PowerHeuristic(1, phase_pdf, 1, phase_light_pdf);
+
+            Spectrum_d tmp = phase_light_radiance * _MediaTransmittance(phase_ray, i_ts);
+            radiance += transmittance * scattering * tmp * (p_volume->Phase(point, incoming, direction) * weight * step * double(num_lights) / phase_pdf);
+            }
+          }
         }
       }
 
@@ -183,8 +237,7 @@ SpectrumCoef_d DirectLightingLTEIntegrator::_MediaTransmittance(const Ray &i_ray
     return SpectrumCoef_d(1.0);
 
   // Increase step size for secondary rays to reduce computation time.
-  SpectrumCoef_d opt_thickness = p_volume->OpticalThickness(i_ray, 2.0*m_params.m_media_step_size, (*i_ts.mp_random_generator)(1.0));
-  return SpectrumCoef_d(exp(-opt_thickness[0]), exp(-opt_thickness[1]), exp(-opt_thickness[2]));
+  return p_volume->Transmittance(i_ray, 2.0*m_params.m_media_step_size, *i_ts.mp_random_generator);
   }
 
 void DirectLightingLTEIntegrator::_RequestSamples(intrusive_ptr<Sampler> ip_sampler)
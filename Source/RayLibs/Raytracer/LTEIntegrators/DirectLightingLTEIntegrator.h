@@ -40,6 +40,12 @@ struct DirectLightingLTEIntegratorParams
   * Step size to be used for participating media integration. Should be greater than 0.0
   */
   double m_media_step_size;
+
+  /**
+  * Number of delta lights (e.g. point and spot lights) to be sampled at each surface point.
+  * This is optional parameter - if the value is 0 (default) or if there are not more delta lights in the scene, all delta lights are evaluated at each surface point.
+  */
+  size_t m_delta_light_samples_num = 0;
   };
 
 /**
@@ -20,6 +20,7 @@
 #include <Raytracer/Core/LTEIntegrator.h>
 #include <Raytracer/Core/DirectLightingIntegrator.h>
 #include <Raytracer/Core/KDTree.h>
+#include <Raytracer/Core/RenderThreadPool.h>
 
 /**
 * DTO for parameters for PhotonLTEIntegrator.
@@ -76,6 +77,12 @@ struct PhotonLTEIntegratorParams
   * This is optional parameter - if the value is 0 (default), no restriction will be applied.
   */
   size_t m_max_indirect_photons = 0;
+
+  /**
+  * Number of delta lights (e.g. point and spot lights) to be sampled at each surface point.
+  * This is optional parameter - if the value is 0 (default) or if there are not more delta lights in the scene, all delta lights are evaluated at each surface point.
+  */
+  size_t m_delta_light_samples_num = 0;
   };
 
 /**
@@ -109,6 +116,15 @@ class PhotonLTEIntegrator: public LTEIntegrator
     */
     void ShootPhotons(size_t i_photons, bool i_low_thread_priority = false);
 
+    /**
+    * Shoots photons and construct photon maps using the specified thread pool settings.
+    * The thread pool defines the OS scheduling settings of the threads shooting the photons and limits the number of threads.
+    * The original settings of the threads are restored by the time the method returns.
+    * @param i_photons Number of photon paths to be shot.
+    * @param io_thread_pool Thread pool the photon shooting threads are prepared with.
+    */
+    void ShootPhotons(size_t i_photons, RenderThreadPool &io_thread_pool);
+
     /**
     * Stops photon shooting.
     * This method can be called concurrently with the ShootPhotons() method to stop the shooting process.
@@ -20,7 +20,7 @@
 #include <Common/MemoryPool.h>
 #include <Math/Geometry.h>
 #include <Math/RandomGenerator.h>
-#include <MAth/CompressedDirection.h>
+#include <Math/CompressedDirection.h>
 #include <Raytracer/Core/Spectrum.h>
 #include <tbb/pipeline.h>
 #include <tbb/tbb.h>
@@ -398,7 +398,7 @@ class PhotonLTEIntegrator::PhotonsInputFilter: public tbb::filter
 class PhotonLTEIntegrator::PhotonsShootingFilter: public tbb::filter
   {
   public:
-    PhotonsShootingFilter(const PhotonLTEIntegrator *ip_integrator, intrusive_ptr<const Scene> ip_scene, const std::vector<double> &i_lights_CDF, bool i_low_thread_priority);
+    PhotonsShootingFilter(const PhotonLTEIntegrator *ip_integrator, intrusive_ptr<const Scene> ip_scene, const std::vector<double> &i_lights_CDF, RenderThreadPool &io_thread_pool);
 
     void* operator()(void* ip_chunk);
 
@@ -406,7 +406,7 @@ class PhotonLTEIntegrator::PhotonsShootingFilter: public tbb::filter
     const PhotonLTEIntegrator *mp_integrator;
     intrusive_ptr<const Scene> mp_scene;
     std::vector<double> m_lights_CDF;
-    bool m_low_thread_priority;
+    RenderThreadPool &m_thread_pool;
   };
 
 //////////////////////////////////////// PhotonsMergingFilter /////////////////////////////////////////////
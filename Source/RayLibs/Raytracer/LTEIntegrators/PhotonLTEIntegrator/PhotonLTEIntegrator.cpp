@@ -34,7 +34,7 @@ LTEIntegrator(ip_scene), mp_scene(ip_scene), m_params(i_params), mp_log(ip_log),
 
   // We double the media step size for secondary rays to reduce computation time (since the accuracy is less important here).
   mp_direct_lighting_integrator.reset(new DirectLightingIntegrator(ip_scene, i_params.m_direct_light_samples_num,
-    i_params.m_direct_light_samples_num, 2.0*i_params.m_media_step_size));
+    i_params.m_direct_light_samples_num, 2.0*i_params.m_media_step_size, NULL, i_params.m_delta_light_samples_num));
 
   if (m_params.m_max_specular_depth > 50)
     m_params.m_max_specular_depth = 50;
@@ -245,6 +245,12 @@ void PhotonLTEIntegrator::_ConstructIrradiancePhotonMap()
   }
 
 void PhotonLTEIntegrator::ShootPhotons(size_t i_photons, bool i_low_thread_priority)
+  {
+  RenderThreadPool thread_pool(i_low_thread_priority ? RenderThreadPoolParams::LowPriority() : RenderThreadPoolParams());
+  ShootPhotons(i_photons, thread_pool);
+  }
+
+void PhotonLTEIntegrator::ShootPhotons(size_t i_photons, RenderThreadPool &io_thread_pool)
   {
   auto start_time = std::chrono::system_clock::now();
   mp_photon_maps.reset(new PhotonMaps());
@@ -260,7 +266,7 @@ void PhotonLTEIntegrator::ShootPhotons(size_t i_photons, bool i_low_thread_prior
   _GetLightsPowerCDF(lights, lights_CDF);
 
   PhotonsInputFilter input_filter(this, mp_photon_maps, i_photons, m_params.m_max_caustic_photons, m_params.m_max_direct_photons, m_params.m_max_indirect_photons, MAX_PIPELINE_TOKENS_NUM, 4096);
-  PhotonsShootingFilter shooting_filter(this, mp_scene, lights_CDF, i_low_thread_priority);
+  PhotonsShootingFilter shooting_filter(this, mp_scene, lights_CDF, io_thread_pool);
   PhotonsMergingFilter merging_filter(mp_photon_maps);
 
   tbb::pipeline pipeline;
@@ -268,10 +274,15 @@ void PhotonLTEIntegrator::ShootPhotons(size_t i_photons, bool i_low_thread_prior
   pipeline.add_filter(shooting_filter);
   pipeline.add_filter(merging_filter);
 
-  pipeline.run(MAX_PIPELINE_TOKENS_NUM);
+  pipeline.run(io_thread_pool.GetMaxConcurrency(MAX_PIPELINE_TOKENS_NUM));
   pipeline.clear();
+  size_t unlowered_threads_num = io_thread_pool.GetUnloweredThreadsNumber();
+  io_thread_pool.RestoreThreads();
   m_shooting_in_progress = false;
 
+  if (mp_log && unlowered_threads_num > 0)
+    mp_log->LogMessage(Log::WARNING_LEVEL, "Could not lower the scheduling priority of " + std::to_string((unsigned long long)unlowered_threads_num) + " photon shooting thread(s).");
+
   // Construct the KD trees. We explicitly do this now while we are still in a single thread to avoid concurrency issues later.
   tbb::parallel_invoke([&]{mp_photon_maps->GetCausticMap(); },
                        [&]{mp_photon_maps->GetDirectMap(); },
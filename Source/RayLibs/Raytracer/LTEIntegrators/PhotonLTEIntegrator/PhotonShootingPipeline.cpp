@@ -100,8 +100,8 @@ void* PhotonLTEIntegrator::PhotonsInputFilter::operator()(void*)
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////
 
 PhotonLTEIntegrator::PhotonsShootingFilter::PhotonsShootingFilter(const PhotonLTEIntegrator *ip_integrator,
-                                                                  intrusive_ptr<const Scene> ip_scene, const std::vector<double> &i_lights_CDF, bool i_low_thread_priority):
-tbb::filter(parallel), mp_integrator(ip_integrator), mp_scene(ip_scene), m_lights_CDF(i_lights_CDF), m_low_thread_priority(i_low_thread_priority)
+                                                                  intrusive_ptr<const Scene> ip_scene, const std::vector<double> &i_lights_CDF, RenderThreadPool &io_thread_pool):
+tbb::filter(parallel), mp_integrator(ip_integrator), mp_scene(ip_scene), m_lights_CDF(i_lights_CDF), m_thread_pool(io_thread_pool)
   {
   ASSERT(ip_integrator);
   ASSERT(ip_scene);
@@ -109,9 +109,7 @@ tbb::filter(parallel), mp_integrator(ip_integrator), mp_scene(ip_scene), m_light
 
 void* PhotonLTEIntegrator::PhotonsShootingFilter::operator()(void* ip_chunk)
   {
-  int prev_thread_priority = 0;
-  if (m_low_thread_priority)
-    prev_thread_priority = CoreUtils::SetCurrentThreadPriority(THREAD_PRIORITY_LOWEST);
+  m_thread_pool.PrepareCurrentThread();
 
   PhotonsChunk *p_chunk = static_cast<PhotonsChunk*>(ip_chunk);
   MemoryPool *p_pool = p_chunk->mp_memory_pool;
@@ -120,6 +118,7 @@ void* PhotonLTEIntegrator::PhotonsShootingFilter::operator()(void* ip_chunk)
   ThreadSpecifics ts;
   ts.mp_pool = p_pool;
   ts.mp_random_generator = p_rng;
+  ts.mp_occluder_hint = NULL;
 
   const LightSources &lights = mp_scene->GetLightSources();
 
@@ -132,9 +131,6 @@ void* PhotonLTEIntegrator::PhotonsShootingFilter::operator()(void* ip_chunk)
   if (num_lights == 0)
     {
     ASSERT(0 && "If there are no lights in the scene we should not have got here.");
-
-    if (m_low_thread_priority)
-      CoreUtils::SetCurrentThreadPriority(prev_thread_priority);
     return p_chunk;
     }
 
@@ -261,8 +257,6 @@ void* PhotonLTEIntegrator::PhotonsShootingFilter::operator()(void* ip_chunk)
     p_pool->FreeAll();
     } // for (size_t path_index=path_begin; path_index<path_end; ++path_index)
 
-  if (m_low_thread_priority)
-    CoreUtils::SetCurrentThreadPriority(prev_thread_priority);
   return p_chunk;
   }
 
@@ -344,7 +338,7 @@ shared_ptr<const KDTree<PhotonLTEIntegrator::Photon>> PhotonLTEIntegrator::Photo
   if (mp_caustic_map==NULL && m_caustic_photons.size() > 0)
     {
     mp_caustic_map.reset( new KDTree<Photon>(std::move(m_caustic_photons)) );
-    m_caustic_photons.swap(std::vector<Photon>());
+    std::vector<Photon>().swap(m_caustic_photons);
     }
   return mp_caustic_map;
   }
@@ -354,7 +348,7 @@ shared_ptr<const KDTree<PhotonLTEIntegrator::Photon>> PhotonLTEIntegrator::Photo
   if (mp_direct_map==NULL && m_direct_photons.size() > 0)
     {
     mp_direct_map.reset( new KDTree<Photon>(std::move(m_direct_photons)) );
-    m_direct_photons.swap(std::vector<Photon>());
+    std::vector<Photon>().swap(m_direct_photons);
     }
   return mp_direct_map;
   }
@@ -364,7 +358,7 @@ shared_ptr<const KDTree<PhotonLTEIntegrator::Photon>> PhotonLTEIntegrator::Photo
   if (mp_indirect_map==NULL && m_indirect_photons.size() > 0)
     {
     mp_indirect_map.reset( new KDTree<Photon>(std::move(m_indirect_photons)) );
-    m_indirect_photons.swap(std::vector<Photon>());
+    std::vector<Photon>().swap(m_indirect_photons);
     }
   return mp_indirect_map;
   }
\ No newline at end of file
@@ -16,11 +16,35 @@
 #include <Raytracer/Core/SpectrumRoutines.h>
 #include <Math/CompressedDirection.h>
 #include <Math/MathRoutines.h>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
 #include <tbb/tbb.h>
 
+namespace
+  {
+  const char ENVIRONMENTAL_LIGHT_CACHE_FILE_MAGIC[8] = {'S','K','W','E','N','V','L','C'};
+  const unsigned int ENVIRONMENTAL_LIGHT_CACHE_FILE_VERSION = 1;
+
+  /*
+  * Header of the cache file. It is followed by the irradiance values for all normals and then by the nodes PDFs for all normals.
+  * The image hash and the number of tree nodes are used to detect stale files.
+  */
+  struct EnvironmentalLightCacheHeader
+    {
+    char m_magic[8];
+    unsigned int m_version;
+    unsigned int m_nodes_num;
+    unsigned long long m_image_hash;
+    };
+  }
+
 ImageEnvironmentalLight::ImageEnvironmentalLight(const BBox3D_d &i_world_bounds, const Transform &i_light_to_world,
-                                                 const std::vector<std::vector<Spectrum_f>> &i_image, SpectrumCoef_d i_scale):
-m_world_bounds(i_world_bounds), m_light_to_world(i_light_to_world), m_world_to_light(i_light_to_world.Inverted()), m_image(i_image), m_scale(i_scale)
+                                                 const std::vector<std::vector<Spectrum_f>> &i_image, SpectrumCoef_d i_scale,
+                                                 const std::string &i_cache_directory, bool i_lazy_precomputation):
+m_world_bounds(i_world_bounds), m_light_to_world(i_light_to_world), m_world_to_light(i_light_to_world.Inverted()), m_image(i_image), m_scale(i_scale),
+m_lazy_precomputation(i_lazy_precomputation)
   {
   ASSERT(i_image.size()>0 && i_image[0].size()>0);
 
@@ -43,12 +67,14 @@ m_world_bounds(i_world_bounds), m_light_to_world(i_light_to_world), m_world_to_l
     }
 
   mp_image_map.reset(new MIPMap<Spectrum_f>(m_image, true, 9.0));
-  _Initialize();
+  _Initialize(i_cache_directory);
   }
 
 ImageEnvironmentalLight::ImageEnvironmentalLight(const BBox3D_d &i_world_bounds, const Transform &i_light_to_world,
-                                                 intrusive_ptr<const ImageSource<Spectrum_f>> ip_image_source, SpectrumCoef_d i_scale):
-m_world_bounds(i_world_bounds), m_light_to_world(i_light_to_world), m_world_to_light(i_light_to_world.Inverted()), m_scale(i_scale)
+                                                 intrusive_ptr<const ImageSource<Spectrum_f>> ip_image_source, SpectrumCoef_d i_scale,
+                                                 const std::string &i_cache_directory, bool i_lazy_precomputation):
+m_world_bounds(i_world_bounds), m_light_to_world(i_light_to_world), m_world_to_light(i_light_to_world.Inverted()), m_scale(i_scale),
+m_lazy_precomputation(i_lazy_precomputation)
   {
   ASSERT(ip_image_source);
   ASSERT(ip_image_source->GetHeight()>0 && ip_image_source->GetWidth()>0);
@@ -66,7 +92,18 @@ m_world_bounds(i_world_bounds), m_light_to_world(i_light_to_world), m_world_to_l
     }
 
   mp_image_map.reset(new MIPMap<Spectrum_f>(m_image, true, 9.0));
-  _Initialize();
+  _Initialize(i_cache_directory);
+  }
+
+ImageEnvironmentalLight::~ImageEnvironmentalLight()
+  {
+  for(size_t i=0;i<m_normals_data.size();++i)
+    delete m_normals_data[i];
+  }
+
+std::string ImageEnvironmentalLight::GetCacheFilename() const
+  {
+  return m_cache_filename;
   }
 
 void ImageEnvironmentalLight::_IncreaseSize(size_t i_height_factor, size_t i_width_factor)
@@ -80,7 +117,7 @@ void ImageEnvironmentalLight::_IncreaseSize(size_t i_height_factor, size_t i_wid
   m_image.swap(tmp);
   }
 
-void ImageEnvironmentalLight::_Initialize()
+void ImageEnvironmentalLight::_Initialize(const std::string &i_cache_directory)
   {
   m_theta_coef = M_PI / m_height;
   m_phi_coef = 2.0*M_PI / m_width;
@@ -91,11 +128,26 @@ void ImageEnvironmentalLight::_Initialize()
   _Build(0, 0, Point2D_i(0,0), Point2D_i((int)m_width, (int)m_height), m_nodes_num);
   ASSERT(m_nodes_num < 2*(1<<MAX_TREE_DEPTH));
 
+  // The cache file is named after the image hash. The transformation is not a part of the key because the precomputed data is defined in the light space.
+  unsigned long long image_hash = 0;
+  if (m_lazy_precomputation == false && i_cache_directory.empty() == false)
+    {
+    image_hash = _ComputeImageHash();
+
+    std::ostringstream filename;
+    filename << i_cache_directory;
+    char last = i_cache_directory[i_cache_directory.size()-1];
+    if (last != '/' && last != '\\')
+      filename << '/';
+    filename << std::hex << std::setfill('0') << std::setw(16) << image_hash << ".envcache";
+    m_cache_filename = filename.str();
+    }
+
   // Release the memory.
   std::vector<std::vector<Spectrum_f>>().swap(m_image);
 
   // Precompute irradiance values and PDFs.
-  _PrecomputeData();
+  _PrecomputeData(image_hash);
   }
 
 // Recursively builds tree by initializing the specified node and calling itself for the children.
@@ -187,21 +239,29 @@ void ImageEnvironmentalLight::_Build(size_t i_node_index, size_t i_depth, const
   }
 
 // Precomputes irradiance values for nodes and PDFs for light sampling.
-void ImageEnvironmentalLight::_PrecomputeData()
+void ImageEnvironmentalLight::_PrecomputeData(unsigned long long i_image_hash)
   {
-  m_nodes_hemispherical_PDF.assign((1<<16) * m_nodes_num, 0.f);
-  m_irradiances.resize(1<<16);
-
   // We use CompressedDirection to discretize the sphere directions.
   // There are total of 2^16 discretized directions and when a normal is later passed to the sampling method the nearest discretized direction will be picked.
-  tbb::parallel_for((size_t)0, (size_t)(1<<16), [&](size_t i)
+  if (m_lazy_precomputation)
     {
-    Vector3D_d normal = CompressedDirection::FromID((unsigned short)i).ToVector3D<double>();
+    m_normals_data.resize(1<<16);
+    for(size_t i=0;i<m_normals_data.size();++i)
+      m_normals_data[i] = NULL;
+    }
+  else if (m_cache_filename.empty() || _LoadCache(i_image_hash) == false)
+    {
+    m_nodes_hemispherical_PDF.assign((1<<16) * m_nodes_num, 0.f);
+    m_irradiances.resize(1<<16);
+
+    tbb::parallel_for((size_t)0, (size_t)(1<<16), [&](size_t i)
+      {
+      m_irradiances[i] = _PrecomputeNormalData(i, &m_nodes_hemispherical_PDF[m_nodes_num*i]);
+      });
 
-    Point2D_d normal_angles(MathRoutines::SphericalPhi(normal), MathRoutines::SphericalTheta(normal));
-    m_irradiances[i] = _PrecomputeIrradiance(0, normal, normal_angles, &m_nodes_hemispherical_PDF[m_nodes_num*i]);
-    m_nodes_hemispherical_PDF[m_nodes_num*i] = 1.f;
-    });
+    if (m_cache_filename.empty() == false)
+      _SaveCache(i_image_hash);
+    }
 
   // Compute PDF for sampling without normal. The PDF is simply proportional to the node total luminance.
   m_nodes_spherical_PDF.assign(m_nodes_num, 0.f);
@@ -221,6 +281,124 @@ void ImageEnvironmentalLight::_PrecomputeData()
   m_nodes_spherical_PDF[0] = 1.f;
   }
 
+// Computes FNV-1a hash of the image size and values.
+unsigned long long ImageEnvironmentalLight::_ComputeImageHash() const
+  {
+  unsigned long long hash = 14695981039346656037ULL;
+  unsigned long long sizes[2] = {m_width, m_height};
+
+  const unsigned char *p_bytes = reinterpret_cast<const unsigned char*>(sizes);
+  for(size_t i=0;i<sizeof(sizes);++i)
+    hash = (hash ^ p_bytes[i]) * 1099511628211ULL;
+
+  for(size_t y=0;y<m_height;++y)
+    {
+    p_bytes = reinterpret_cast<const unsigned char*>(&m_image[y][0]);
+    for(size_t i=0;i<m_width*sizeof(Spectrum_f);++i)
+      hash = (hash ^ p_bytes[i]) * 1099511628211ULL;
+    }
+
+  return hash;
+  }
+
+// Reads the irradiance values and the nodes PDFs from the cache file. Returns false if the file does not exist or does not match the image.
+bool ImageEnvironmentalLight::_LoadCache(unsigned long long i_image_hash)
+  {
+  std::ifstream stream(m_cache_filename.c_str(), std::ios::binary);
+  if (stream.good() == false)
+    return false;
+
+  EnvironmentalLightCacheHeader header;
+  stream.read(reinterpret_cast<char*>(&header), sizeof(EnvironmentalLightCacheHeader));
+  if (stream.good() == false || memcmp(header.m_magic, ENVIRONMENTAL_LIGHT_CACHE_FILE_MAGIC, sizeof(ENVIRONMENTAL_LIGHT_CACHE_FILE_MAGIC)) != 0 ||
+    header.m_version != ENVIRONMENTAL_LIGHT_CACHE_FILE_VERSION || header.m_nodes_num != m_nodes_num || header.m_image_hash != i_image_hash)
+    return false;
+
+  m_irradiances.resize(1<<16);
+  m_nodes_hemispherical_PDF.resize((1<<16) * m_nodes_num);
+  stream.read(reinterpret_cast<char*>(&m_irradiances[0]), m_irradiances.size()*sizeof(Spectrum_d));
+  stream.read(reinterpret_cast<char*>(&m_nodes_hemispherical_PDF[0]), m_nodes_hemispherical_PDF.size()*sizeof(float));
+
+  if (stream.good() == false)
+    {
+    m_irradiances.clear();
+    m_nodes_hemispherical_PDF.clear();
+    return false;
+    }
+
+  return true;
+  }
+
+// Writes the irradiance values and the nodes PDFs to the cache file. Failures are ignored since the cache is only an optimization.
+void ImageEnvironmentalLight::_SaveCache(unsigned long long i_image_hash) const
+  {
+  std::ofstream stream(m_cache_filename.c_str(), std::ios::binary);
+  if (stream.good() == false)
+    return;
+
+  EnvironmentalLightCacheHeader header;
+  memset(&header, 0, sizeof(EnvironmentalLightCacheHeader));
+  memcpy(header.m_magic, ENVIRONMENTAL_LIGHT_CACHE_FILE_MAGIC, sizeof(ENVIRONMENTAL_LIGHT_CACHE_FILE_MAGIC));
+  header.m_version = ENVIRONMENTAL_LIGHT_CACHE_FILE_VERSION;
+  header.m_nodes_num = (unsigned int)m_nodes_num;
+  header.m_image_hash = i_image_hash;
+
+  stream.write(reinterpret_cast<const char*>(&header), sizeof(EnvironmentalLightCacheHeader));
+  stream.write(reinterpret_cast<const char*>(&m_irradiances[0]), m_irradiances.size()*sizeof(Spectrum_d));
+  stream.write(reinterpret_cast<const char*>(&m_nodes_hemispherical_PDF[0]), m_nodes_hemispherical_PDF.size()*sizeof(float));
+  }
+
+// Precomputes irradiance and nodes PDF for the discretized normal with the specified index.
+Spectrum_d ImageEnvironmentalLight::_PrecomputeNormalData(size_t i_direction_index, float *op_nodes_PDF) const
+  {
+  Vector3D_d normal = CompressedDirection::FromID((unsigned short)i_direction_index).ToVector3D<double>();
+
+  Point2D_d normal_angles(MathRoutines::SphericalPhi(normal), MathRoutines::SphericalTheta(normal));
+  Spectrum_d irradiance = _PrecomputeIrradiance(0, normal, normal_angles, op_nodes_PDF);
+  op_nodes_PDF[0] = 1.f;
+
+  return irradiance;
+  }
+
+Spectrum_d ImageEnvironmentalLight::_GetIrradiance(size_t i_direction_index) const
+  {
+  if (m_lazy_precomputation)
+    return _GetNormalData(i_direction_index)->m_irradiance;
+  else
+    return m_irradiances[i_direction_index];
+  }
+
+const float *ImageEnvironmentalLight::_GetNodesHemisphericalPDF(size_t i_direction_index) const
+  {
+  if (m_lazy_precomputation)
+    return &_GetNormalData(i_direction_index)->m_nodes_PDF[0];
+  else
+    return &m_nodes_hemispherical_PDF[m_nodes_num*i_direction_index];
+  }
+
+// Returns the data for the specified discretized normal computing it first if needed. Used only in the lazy precomputation mode.
+const ImageEnvironmentalLight::NormalData *ImageEnvironmentalLight::_GetNormalData(size_t i_direction_index) const
+  {
+  ASSERT(m_lazy_precomputation);
+  const NormalData *p_data = m_normals_data[i_direction_index];
+  if (p_data)
+    return p_data;
+
+  NormalData *p_new_data = new NormalData;
+  p_new_data->m_nodes_PDF.assign(m_nodes_num, 0.f);
+  p_new_data->m_irradiance = _PrecomputeNormalData(i_direction_index, &p_new_data->m_nodes_PDF[0]);
+
+  // Other thread might have computed the data for the same normal concurrently. In this case its data is used and ours is discarded.
+  p_data = m_normals_data[i_direction_index].compare_and_swap(p_new_data, NULL);
+  if (p_data)
+    {
+    delete p_new_data;
+    return p_data;
+    }
+
+  return p_new_data;
+  }
+
 // Precomputes irradiance and PDF values for the specified surface normal.
 Spectrum_d ImageEnvironmentalLight::_PrecomputeIrradiance(size_t i_node_index, const Vector3D_d &i_normal, const Point2D_d &i_normal_angles, float *op_nodes_PDF) const
   {
@@ -330,9 +508,9 @@ Spectrum_d ImageEnvironmentalLight::Power() const
   double dy = m_world_bounds.m_max[1]-m_world_bounds.m_min[1];
   double dz = m_world_bounds.m_max[2]-m_world_bounds.m_min[2];
 
-  Spectrum_d irradiance_xy = m_irradiances[CompressedDirection(m_world_to_light(Vector3D_d(0,0,1))).GetID()] + m_irradiances[CompressedDirection(m_world_to_light(Vector3D_d(0,0,-1))).GetID()];
-  Spectrum_d irradiance_xz = m_irradiances[CompressedDirection(m_world_to_light(Vector3D_d(0,1,0))).GetID()] + m_irradiances[CompressedDirection(m_world_to_light(Vector3D_d(0,-1,0))).GetID()];
-  Spectrum_d irradiance_yz = m_irradiances[CompressedDirection(m_world_to_light(Vector3D_d(1,0,0))).GetID()] + m_irradiances[CompressedDirection(m_world_to_light(Vector3D_d(-1,0,0))).GetID()];
+  Spectrum_d irradiance_xy = _GetIrradiance(CompressedDirection(m_world_to_light(Vector3D_d(0,0,1))).GetID()) + _GetIrradiance(CompressedDirection(m_world_to_light(Vector3D_d(0,0,-1))).GetID());
+  Spectrum_d irradiance_xz = _GetIrradiance(CompressedDirection(m_world_to_light(Vector3D_d(0,1,0))).GetID()) + _GetIrradiance(CompressedDirection(m_world_to_light(Vector3D_d(0,-1,0))).GetID());
+  Spectrum_d irradiance_yz = _GetIrradiance(CompressedDirection(m_world_to_light(Vector3D_d(1,0,0))).GetID()) + _GetIrradiance(CompressedDirection(m_world_to_light(Vector3D_d(-1,0,0))).GetID());
 
   return m_scale * (irradiance_xy*fabs(dx*dy) + irradiance_xz*fabs(dx*dz) + irradiance_yz*fabs(dy*dz));
   }
@@ -354,7 +532,7 @@ Spectrum_d ImageEnvironmentalLight::SampleLighting(const Vector3D_d &i_normal, c
   ASSERT(i_normal.IsNormalized());
   size_t direction_index = CompressedDirection(m_world_to_light(i_normal)).GetID();
 
-  Spectrum_d radiance = _LightingSample(i_sample, &m_nodes_hemispherical_PDF[m_nodes_num*direction_index], o_lighting_direction, o_pdf);
+  Spectrum_d radiance = _LightingSample(i_sample, _GetNodesHemisphericalPDF(direction_index), o_lighting_direction, o_pdf);
   m_light_to_world(o_lighting_direction, o_lighting_direction);
   return m_scale * radiance;
   }
@@ -364,7 +542,7 @@ double ImageEnvironmentalLight::LightingPDF(const Vector3D_d &i_normal, const Ve
   ASSERT(i_normal.IsNormalized());
   size_t direction_index = CompressedDirection(m_world_to_light(i_normal)).GetID();
 
-  return _LightingPDF(m_world_to_light(i_lighting_direction), &m_nodes_hemispherical_PDF[m_nodes_num*direction_index]);
+  return _LightingPDF(m_world_to_light(i_lighting_direction), _GetNodesHemisphericalPDF(direction_index));
   }
 
 Spectrum_d ImageEnvironmentalLight::_LightingSample(Point2D_d i_sample, const float *ip_nodes_pdf, Vector3D_d &o_lighting_direction, double &o_pdf) const
@@ -449,8 +627,8 @@ double ImageEnvironmentalLight::_LightingPDF(const Vector3D_d &i_lighting_direct
   double theta = MathRoutines::SphericalTheta(i_lighting_direction);
   Point2D_i texel((int) (phi*m_width*INV_2PI), (int) (theta*m_height*INV_PI));
 
-  if (texel[0] == m_width) texel[0] = (int)m_width-1;
-  if (texel[1] == m_height) texel[1] = (int)m_height-1;
+  if (texel[0] == (int)m_width) texel[0] = (int)m_width-1;
+  if (texel[1] == (int)m_height) texel[1] = (int)m_height-1;
 
   size_t index=0;
   double leaf_pdf = 1.0;
@@ -527,7 +705,7 @@ Spectrum_d ImageEnvironmentalLight::SamplePhoton(const Point2D_d &i_position_sam
 Spectrum_d ImageEnvironmentalLight::Irradiance(const Vector3D_d &i_normal) const
   {
   ASSERT(m_nodes_num>0);
-  return m_scale * m_irradiances[CompressedDirection(m_world_to_light(i_normal)).GetID()];
+  return m_scale * _GetIrradiance(CompressedDirection(m_world_to_light(i_normal)).GetID());
   }
 
 Spectrum_d ImageEnvironmentalLight::Fluence() const
@@ -20,7 +20,9 @@
 #include <Raytracer/Core/LightSources.h>
 #include <Raytracer/Core/MIPMap.h>
 #include <Raytracer/Core/Spectrum.h>
+#include <string>
 #include <vector>
+#include <tbb/atomic.h>
 
 /**
 * Environment light source that uses 2D array of spectrum values (i.e. image) to determine radiance coming from different directions.
@@ -30,6 +32,11 @@
 * For each possible normal (discretized with CompressedDirection) the probability (to be sampled) for each tree node is precomputed.
 * Having the probabilities the sampling comes down to constructing a path from the root of the tree to one of the leaves each time using children's probabilities to decide which path to go.
 * Inside each leaf the texels are sampled based on their radiance luminance.
+*
+* The precomputed data depends only on the image (it is defined in the light space) so it can be stored in a cache file and reused for the same image.
+* If the cache directory is specified the data is loaded from the file named after the image hash or is written to that file if it does not exist yet.
+* Alternatively the data can be precomputed lazily, for each discretized normal on first use. This mode uses less memory if only a fraction of the normals is ever
+* used by the scene and does not require any precomputation in the constructor.
 */
 class ImageEnvironmentalLight: public InfiniteLightSource
   {
@@ -40,9 +47,12 @@ class ImageEnvironmentalLight: public InfiniteLightSource
     * @param i_light_to_world Transform object that defines transformation from the light space to the world space.
     * @param i_image 2D array of the image values. All inner vectors should have the same size. Should have at least one row and at least one column.
     * @param i_scale Scale factor for the image values.
+    * @param i_cache_directory Directory for the cache file with the precomputed data. If empty, the data is not cached.
+    * @param i_lazy_precomputation If true, the data for each discretized normal is precomputed on first use. The cache directory is ignored in this mode.
     */
     ImageEnvironmentalLight(const BBox3D_d &i_world_bounds, const Transform &i_light_to_world,
-      const std::vector<std::vector<Spectrum_f>> &i_image, SpectrumCoef_d i_scale = SpectrumCoef_d(1.0));
+      const std::vector<std::vector<Spectrum_f>> &i_image, SpectrumCoef_d i_scale = SpectrumCoef_d(1.0),
+      const std::string &i_cache_directory = std::string(), bool i_lazy_precomputation = false);
 
     /**
     * Constructs ImageEnvironmentalLight from the specified image source.
@@ -50,9 +60,19 @@ class ImageEnvironmentalLight: public InfiniteLightSource
     * @param i_light_to_world Transform object that defines transformation from the light space to the world space.
     * @param ip_image_source ImageSource implementation that defines image for the ImageEnvironmentalLight. The image defined by the ImageSource should not be empty.
     * @param i_scale Scale factor for the image values.
+    * @param i_cache_directory Directory for the cache file with the precomputed data. If empty, the data is not cached.
+    * @param i_lazy_precomputation If true, the data for each discretized normal is precomputed on first use. The cache directory is ignored in this mode.
     */
     ImageEnvironmentalLight(const BBox3D_d &i_world_bounds, const Transform &i_light_to_world,
-      intrusive_ptr<const ImageSource<Spectrum_f>> ip_image_source, SpectrumCoef_d i_scale = SpectrumCoef_d(1.0));
+      intrusive_ptr<const ImageSource<Spectrum_f>> ip_image_source, SpectrumCoef_d i_scale = SpectrumCoef_d(1.0),
+      const std::string &i_cache_directory = std::string(), bool i_lazy_precomputation = false);
+
+    ~ImageEnvironmentalLight();
+
+    /**
+    * Returns name of the cache file with the precomputed data or empty string if the data is not cached.
+    */
+    std::string GetCacheFilename() const;
 
     /**
     * Returns the light source radiance for the specified ray.
@@ -164,6 +184,14 @@ class ImageEnvironmentalLight: public InfiniteLightSource
       bool m_leaf;
       };
 
+    // Irradiance and nodes PDF for a single discretized normal. Used only in the lazy precomputation mode.
+    struct NormalData
+      {
+      Spectrum_d m_irradiance;
+
+      std::vector<float> m_nodes_PDF;
+      };
+
     // Maximum depth of the tree. Higher values increase PDF accuracy but require more memory.
     // IMPORTANT! It is very important not to make this value too high because the memory requirements grow exponentially. Value of 8 is probably the best trade-off.
     static const size_t MAX_TREE_DEPTH = 8;
@@ -173,13 +201,27 @@ class ImageEnvironmentalLight: public InfiniteLightSource
     static const size_t MIN_IMAGE_SIZE = 32;
 
   private:
-    void _Initialize();
+    void _Initialize(const std::string &i_cache_directory);
 
     void _IncreaseSize(size_t i_height_factor, size_t i_width_factor);
 
     void _Build(size_t i_node_index, size_t i_depth, const Point2D_i &i_begin, const Point2D_i &i_end, size_t &io_next_free_node_index);
 
-    void _PrecomputeData();
+    void _PrecomputeData(unsigned long long i_image_hash);
+
+    unsigned long long _ComputeImageHash() const;
+
+    bool _LoadCache(unsigned long long i_image_hash);
+
+    void _SaveCache(unsigned long long i_image_hash) const;
+
+    Spectrum_d _PrecomputeNormalData(size_t i_direction_index, float *op_nodes_PDF) const;
+
+    Spectrum_d _GetIrradiance(size_t i_direction_index) const;
+
+    const float *_GetNodesHemisphericalPDF(size_t i_direction_index) const;
+
+    const NormalData *_GetNormalData(size_t i_direction_index) const;
 
     Spectrum_d _PrecomputeIrradiance(size_t i_node_index, const Vector3D_d &i_normal, const Point2D_d &i_normal_angles, float *op_nodes_PDF) const;
 
@@ -221,6 +263,12 @@ class ImageEnvironmentalLight: public InfiniteLightSource
     // PDF for sampling with no normal provided. Contains as many elements as there are nodes in the tree.
     std::vector<float> m_nodes_spherical_PDF;
 
+    // If true, m_irradiances and m_nodes_hemispherical_PDF are empty and the data for the normals is computed on first use and stored in m_normals_data.
+    bool m_lazy_precomputation;
+    mutable std::vector<tbb::atomic<const NormalData*>> m_normals_data;
+
+    std::string m_cache_filename;
+
     // CDFs for selecting row to be sampled.
     // The vector contains concatenated CDFs for all leaves and each leaf stores the index of the first element of it's CDf sequence.
     std::vector<double> m_CDF_rows;
@@ -0,0 +1,496 @@
+/*
+* Copyright (C) 2014 by Volodymyr Kachurovskyi <Volodymyr.Kachurovskyi@gmail.com>
+*
+* This file is part of Skwarka.
+*
+* Skwarka is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+*
+* Skwarka is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License along with Skwarka.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "LightTreeLightsSamplingStrategy.h"
+#include <Raytracer/Core/SpectrumRoutines.h>
+#include <Math/MathRoutines.h>
+#include <algorithm>
+
+namespace
+  {
+  // Half-angle of the cone bounding the emission directions around each triangle normal.
+  // The area lights are assumed to emit light into the positive hemisphere only.
+  const double THETA_E = 0.5*M_PI;
+
+  double _SafeAcos(double i_value)
+    {
+    return acos(MathRoutines::Clamp(i_value, -1.0, 1.0));
+    }
+
+  /**
+  * Returns the cone bounding both specified cones of the directions.
+  */
+  void _UniteCones(const Vector3D_d &i_axis1, double i_theta1, const Vector3D_d &i_axis2, double i_theta2, Vector3D_d &o_axis, double &o_theta)
+    {
+    if (i_theta1 < i_theta2)
+      {
+      _UniteCones(i_axis2, i_theta2, i_axis1, i_theta1, o_axis, o_theta);
+      return;
+      }
+
+    double theta_d = _SafeAcos(i_axis1*i_axis2);
+    if (std::min(theta_d+i_theta2, M_PI) <= i_theta1)
+      {
+      o_axis = i_axis1;
+      o_theta = i_theta1;
+      return;
+      }
+
+    o_theta = 0.5*(i_theta1+theta_d+i_theta2);
+    if (o_theta >= M_PI)
+      {
+      o_axis = i_axis1;
+      o_theta = M_PI;
+      return;
+      }
+
+    // Rotate the first axis towards the second one.
+    Vector3D_d ortho = i_axis2 - i_axis1*(i_axis1*i_axis2);
+    if (ortho.Normalize()==false)
+      {
+      o_axis = i_axis1;
+      o_theta = M_PI;
+      return;
+      }
+
+    double theta_r = o_theta-i_theta1;
+    o_axis = (i_axis1*cos(theta_r) + ortho*sin(theta_r)).Normalized();
+    }
+
+  /**
+  * Returns the measure of the solid angle of the cone of emission directions (integrated with the cosine weight) used by the split heuristic.
+  */
+  double _OrientationMeasure(double i_theta_o)
+    {
+    double theta_w = std::min(i_theta_o+THETA_E, M_PI);
+    double sin_o = sin(i_theta_o), cos_o = cos(i_theta_o);
+    return 2.0*M_PI*(1.0-cos_o) + 0.5*M_PI*(2.0*theta_w*sin_o - cos(i_theta_o-2.0*theta_w) - 2.0*i_theta_o*sin_o + cos_o);
+    }
+
+  Point3D_d _Center(const BBox3D_d &i_bbox)
+    {
+    return (i_bbox.m_min+i_bbox.m_max)*0.5;
+    }
+
+  }
+
+LightTreeLightsSamplingStrategy::LightTreeLightsSamplingStrategy(const LightSources &i_light_sources): LightsSamplingStrategy(),
+m_light_sources(i_light_sources)
+  {
+  m_infinity_lights_num = i_light_sources.m_infinite_light_sources.size();
+  m_area_lights_num = i_light_sources.m_area_light_sources.size();
+
+  if (m_area_lights_num==0)
+    return;
+
+  std::vector<Node> lights(m_area_lights_num);
+  for(size_t i=0;i<m_area_lights_num;++i)
+    {
+    const TriangleMesh *p_mesh = m_light_sources.m_area_light_sources[i]->GetTriangleMesh_RawPtr();
+
+    Node &light = lights[i];
+    light.m_bounds = Convert<double>(p_mesh->GetBounds());
+    light.m_power = SpectrumRoutines::Luminance(m_light_sources.m_area_light_sources[i]->Power());
+    light.m_second_child = 0;
+    light.m_light_index = i;
+
+    // The cone axis is the area-weighted average normal.
+    // Degenerate triangles are skipped since they have no valid normal and do not emit light anyway.
+    Vector3D_d normals_sum;
+    std::vector<Vector3D_d> normals;
+    size_t triangles_num = p_mesh->GetNumberOfTriangles();
+    for(size_t j=0;j<triangles_num;++j)
+      {
+      MeshTriangle mesh_triangle = p_mesh->GetTriangle(j);
+      Triangle3D_f triangle(p_mesh->GetVertex(mesh_triangle.m_vertices[0]), p_mesh->GetVertex(mesh_triangle.m_vertices[1]), p_mesh->GetVertex(mesh_triangle.m_vertices[2]));
+      double area = triangle.GetArea();
+      if (area <= 0.0)
+        continue;
+
+      normals.push_back(Convert<double>(p_mesh->GetTriangleNormal(j)));
+      normals_sum += normals.back() * area;
+      }
+
+    light.m_axis = Vector3D_d(0.0,0.0,1.0);
+    light.m_theta_o = M_PI;
+    if (normals_sum.Normalize())
+      {
+      light.m_axis = normals_sum;
+      light.m_theta_o = 0.0;
+      for(size_t j=0;j<normals.size();++j)
+        light.m_theta_o = std::max(light.m_theta_o, _SafeAcos(normals_sum*normals[j]));
+      }
+    }
+
+  m_nodes.reserve(2*m_area_lights_num-1);
+  _Build(lights, 0, m_area_lights_num, 0);
+  ASSERT(m_nodes.size() == 2*m_area_lights_num-1);
+
+  m_parents.assign(m_nodes.size(), 0);
+  m_light_leaves.assign(m_area_lights_num, 0);
+  for(size_t i=0;i<m_nodes.size();++i)
+    if (m_nodes[i].m_second_child)
+      {
+      m_parents[i+1] = i;
+      m_parents[m_nodes[i].m_second_child] = i;
+      }
+    else
+      m_light_leaves[m_nodes[i].m_light_index] = i;
+  }
+
+size_t LightTreeLightsSamplingStrategy::_Build(std::vector<Node> &io_lights, size_t i_begin, size_t i_end, size_t i_depth)
+  {
+  ASSERT(i_begin < i_end);
+
+  size_t node_index = m_nodes.size();
+  if (i_end-i_begin == 1)
+    {
+    m_nodes.push_back(io_lights[i_begin]);
+    return node_index;
+    }
+
+  Node node = io_lights[i_begin];
+  BBox3D_d centroid_bounds;
+  centroid_bounds.Unite(_Center(node.m_bounds));
+  for(size_t i=i_begin+1;i<i_end;++i)
+    {
+    node.m_bounds.Unite(io_lights[i].m_bounds);
+    node.m_power += io_lights[i].m_power;
+    _UniteCones(node.m_axis, node.m_theta_o, io_lights[i].m_axis, io_lights[i].m_theta_o, node.m_axis, node.m_theta_o);
+    centroid_bounds.Unite(_Center(io_lights[i].m_bounds));
+    }
+
+  Vector3D_d extent = Vector3D_d(node.m_bounds.m_max-node.m_bounds.m_min);
+  double max_extent = std::max(std::max(extent[0], extent[1]), extent[2]);
+
+  // Find the split with the minimal surface area orientation heuristic cost.
+  size_t best_axis = 0, best_bucket = 0;
+  double best_cost = DBL_INF;
+  if (i_depth < MAX_TREE_DEPTH)
+    for(unsigned char axis=0;axis<3;++axis)
+      {
+      double min = centroid_bounds.m_min[axis], max = centroid_bounds.m_max[axis];
+      if (max-min < DBL_EPS)
+        continue;
+
+      Node buckets[BUCKETS_NUM];
+      bool non_empty[BUCKETS_NUM] = {false};
+      for(size_t i=i_begin;i<i_end;++i)
+        {
+        size_t b = std::min((size_t)(BUCKETS_NUM*(_Center(io_lights[i].m_bounds)[axis]-min)/(max-min)), (size_t)BUCKETS_NUM-1);
+        if (non_empty[b])
+          {
+          buckets[b].m_bounds.Unite(io_lights[i].m_bounds);
+          buckets[b].m_power += io_lights[i].m_power;
+          _UniteCones(buckets[b].m_axis, buckets[b].m_theta_o, io_lights[i].m_axis, io_lights[i].m_theta_o, buckets[b].m_axis, buckets[b].m_theta_o);
+          }
+        else
+          {
+          buckets[b] = io_lights[i];
+          non_empty[b] = true;
+          }
+        }
+
+      // Penalizes thin slices along the axes where the node is much smaller than its largest extent.
+      double k_r = extent[axis] > 0.0 ? max_extent/extent[axis] : 1.0;
+
+      for(size_t split=1;split<BUCKETS_NUM;++split)
+        {
+        double cost = 0.0;
+        bool empty_side = false;
+        for(unsigned char side=0;side<2;++side)
+          {
+          Node united;
+          bool empty = true;
+          for(size_t b = side ? split : 0; b < (side ? (size_t)BUCKETS_NUM : split); ++b)
+            if (non_empty[b])
+              {
+              if (empty)
+                united = buckets[b];
+              else
+                {
+                united.m_bounds.Unite(buckets[b].m_bounds);
+                united.m_power += buckets[b].m_power;
+                _UniteCones(united.m_axis, united.m_theta_o, buckets[b].m_axis, buckets[b].m_theta_o, united.m_axis, united.m_theta_o);
+                }
+              empty = false;
+              }
+
+          if (empty)
+            empty_side = true;
+          else
+            cost += united.m_power * _OrientationMeasure(united.m_theta_o) * united.m_bounds.Area();
+          }
+
+        cost *= k_r;
+        if (empty_side==false && cost < best_cost)
+          {
+          best_cost = cost;
+          best_axis = axis;
+          best_bucket = split;
+          }
+        }
+      }
+
+  size_t middle;
+  if (best_cost < DBL_INF)
+    {
+    double min = centroid_bounds.m_min[best_axis], max = centroid_bounds.m_max[best_axis];
+    middle = std::partition(io_lights.begin()+i_begin, io_lights.begin()+i_end, [&](const Node &i_light)
+      {
+      size_t b = std::min((size_t)(BUCKETS_NUM*(_Center(i_light.m_bounds)[best_axis]-min)/(max-min)), (size_t)BUCKETS_NUM-1);
+      return b < best_bucket;
+      }) - io_lights.begin();
+    }
+  else
+    {
+    // Fall back to the median split along the largest extent of the centroids.
+    Vector3D_d centroid_extent = Vector3D_d(centroid_bounds.m_max-centroid_bounds.m_min);
+    size_t axis = centroid_extent[0] > centroid_extent[1] ? (centroid_extent[0] > centroid_extent[2] ? 0 : 2) : (centroid_extent[1] > centroid_extent[2] ? 1 : 2);
+
+    middle = (i_begin+i_end)/2;
+    std::nth_element(io_lights.begin()+i_begin, io_lights.begin()+middle, io_lights.begin()+i_end, [axis](const Node &i_light1, const Node &i_light2)
+      {
+      return _Center(i_light1.m_bounds)[axis] < _Center(i_light2.m_bounds)[axis];
+      });
+    }
+  ASSERT(middle > i_begin && middle < i_end);
+
+  m_nodes.push_back(node);
+  _Build(io_lights, i_begin, middle, i_depth+1);
+  size_t second_child = _Build(io_lights, middle, i_end, i_depth+1);
+  m_nodes[node_index].m_second_child = second_child;
+  return node_index;
+  }
+
+double LightTreeLightsSamplingStrategy::_Importance(const Node &i_node, const Point3D_d &i_point, const Vector3D_d *ip_normal) const
+  {
+  if (i_node.m_power <= 0.0)
+    return 0.0;
+
+  Point3D_d center = _Center(i_node.m_bounds);
+  double radius_sqr = 0.25*Vector3D_d(i_node.m_bounds.m_max-i_node.m_bounds.m_min).LengthSqr();
+  Vector3D_d direction = Vector3D_d(center-i_point);
+  double distance_sqr = direction.LengthSqr();
+
+  // Half-angle of the cone of directions from the point to the bounding sphere of the node.
+  double theta_u = M_PI;
+  if (distance_sqr > radius_sqr)
+    {
+    theta_u = asin(sqrt(radius_sqr/distance_sqr));
+    direction /= sqrt(distance_sqr);
+    }
+  else if (direction.Normalize()==false)
+    direction = Vector3D_d(0.0,0.0,1.0);
+
+  // Minimal angle between the emission directions and the direction from the node to the point.
+  double theta_e = std::max(0.0, _SafeAcos(i_node.m_axis*direction*(-1.0)) - i_node.m_theta_o - theta_u);
+  if (theta_e >= THETA_E)
+    return 0.0;
+
+  double cos_i = 1.0;
+  if (ip_normal)
+    {
+    // Minimal angle between the surface normal and the directions to the node.
+    double theta_i = std::max(0.0, _SafeAcos((*ip_normal)*direction) - theta_u);
+    if (theta_i >= 0.5*M_PI)
+      return 0.0;
+    cos_i = cos(theta_i);
+    }
+
+  return i_node.m_power * cos(theta_e) * cos_i / (M_PI*std::max(std::max(distance_sqr, radius_sqr), DBL_EPS));
+  }
+
+double LightTreeLightsSamplingStrategy::_InfinityLightWeight(size_t i_light_index, const Vector3D_d *ip_normal) const
+  {
+  ASSERT(i_light_index < m_infinity_lights_num);
+  const InfiniteLightSource *p_light = m_light_sources.m_infinite_light_sources[i_light_index].get();
+  return SpectrumRoutines::Luminance(ip_normal ? p_light->Irradiance(*ip_normal) : p_light->Fluence());
+  }
+
+size_t LightTreeLightsSamplingStrategy::_SampleLight(const Point3D_d &i_point, const Vector3D_d *ip_normal, double i_sample, double &o_pdf, double &o_remapped_sample) const
+  {
+  ASSERT(i_sample>=0.0 && i_sample<1.0);
+  size_t lights_num = m_infinity_lights_num+m_area_lights_num;
+  if (lights_num==0)
+    {
+    ASSERT(0 && "No lights to sample.");
+    o_pdf = o_remapped_sample = 0.0;
+    return 0;
+    }
+
+  double tree_weight = m_area_lights_num>0 ? _Importance(m_nodes[0], i_point, ip_normal) : 0.0;
+  double total = tree_weight;
+  for(size_t i=0;i<m_infinity_lights_num;++i)
+    total += _InfinityLightWeight(i, ip_normal);
+
+  if (total <= 0.0)
+    {
+    // If all lights have zero contribution we sample them with equal probabilities.
+    size_t index = std::min((size_t)(i_sample*lights_num), lights_num-1);
+    o_pdf = 1.0/lights_num;
+    o_remapped_sample = std::min(i_sample*lights_num-index, 1.0-DBL_EPS);
+    return index;
+    }
+
+  double scaled_sample = i_sample*total, cumulative = 0.0;
+  size_t last_positive = lights_num;
+  for(size_t i=0;i<m_infinity_lights_num;++i)
+    {
+    double weight = _InfinityLightWeight(i, ip_normal);
+    if (weight <= 0.0)
+      continue;
+
+    last_positive = i;
+    if (scaled_sample < cumulative+weight)
+      {
+      o_pdf = weight/total;
+      o_remapped_sample = std::min((scaled_sample-cumulative)/weight, 1.0-DBL_EPS);
+      return i;
+      }
+    cumulative += weight;
+    }
+
+  if (tree_weight <= 0.0)
+    {
+    // Can only get here due to the rounding errors.
+    ASSERT(last_positive < m_infinity_lights_num);
+    double weight = _InfinityLightWeight(last_positive, ip_normal);
+    o_pdf = weight/total;
+    o_remapped_sample = 1.0-DBL_EPS;
+    return last_positive;
+    }
+
+  double pdf = tree_weight/total;
+  double sample = MathRoutines::Clamp((scaled_sample-cumulative)/tree_weight, 0.0, 1.0-DBL_EPS);
+
+  size_t node_index = 0;
+  while (m_nodes[node_index].m_second_child)
+    {
+    size_t second_child = m_nodes[node_index].m_second_child;
+    double importance1 = _Importance(m_nodes[node_index+1], i_point, ip_normal);
+    double importance2 = _Importance(m_nodes[second_child], i_point, ip_normal);
+    double p1 = importance1+importance2 > 0.0 ? importance1/(importance1+importance2) : 0.5;
+
+    if (sample < p1)
+      {
+      node_index = node_index+1;
+      pdf *= p1;
+      sample = sample/p1;
+      }
+    else
+      {
+      node_index = second_child;
+      pdf *= 1.0-p1;
+      sample = (sample-p1)/(1.0-p1);
+      }
+    sample = std::min(sample, 1.0-DBL_EPS);
+    }
+
+  o_pdf = pdf;
+  o_remapped_sample = sample;
+  return m_infinity_lights_num+m_nodes[node_index].m_light_index;
+  }
+
+double LightTreeLightsSamplingStrategy::_LightPDF(const Point3D_d &i_point, const Vector3D_d *ip_normal, size_t i_light_index) const
+  {
+  size_t lights_num = m_infinity_lights_num+m_area_lights_num;
+  ASSERT(i_light_index < lights_num);
+
+  double tree_weight = m_area_lights_num>0 ? _Importance(m_nodes[0], i_point, ip_normal) : 0.0;
+  double total = tree_weight;
+  for(size_t i=0;i<m_infinity_lights_num;++i)
+    total += _InfinityLightWeight(i, ip_normal);
+
+  if (total <= 0.0)
+    return 1.0/lights_num;
+
+  if (i_light_index < m_infinity_lights_num)
+    return _InfinityLightWeight(i_light_index, ip_normal)/total;
+
+  if (tree_weight <= 0.0)
+    return 0.0;
+
+  double pdf = tree_weight/total;
+  size_t node_index = m_light_leaves[i_light_index-m_infinity_lights_num];
+  while (node_index != 0)
+    {
+    size_t parent = m_parents[node_index];
+    size_t sibling = node_index==parent+1 ? m_nodes[parent].m_second_child : parent+1;
+
+    double importance = _Importance(m_nodes[node_index], i_point, ip_normal);
+    double sibling_importance = _Importance(m_nodes[sibling], i_point, ip_normal);
+    pdf *= importance+sibling_importance > 0.0 ? importance/(importance+sibling_importance) : 0.5;
+
+    node_index = parent;
+    }
+
+  return pdf;
+  }
+
+void LightTreeLightsSamplingStrategy::_GetLightsCDF(const Point3D_d &i_point, const Vector3D_d *ip_normal, double *o_lights_CDF) const
+  {
+  ASSERT(o_lights_CDF);
+
+  size_t lights_num = m_infinity_lights_num+m_area_lights_num;
+  if (lights_num==0)
+    return;
+
+  for(size_t i=0;i<lights_num;++i)
+    o_lights_CDF[i] = (i>0 ? o_lights_CDF[i-1] : 0.0) + _LightPDF(i_point, ip_normal, i);
+
+  // Make sure the CDF ends exactly at one despite the rounding errors.
+  double inv = 1.0/o_lights_CDF[lights_num-1];
+  for(size_t i=0;i<lights_num;++i)
+    o_lights_CDF[i] *= inv;
+  }
+
+void LightTreeLightsSamplingStrategy::GetLightsCDF(const Point3D_d &i_point, double *o_lights_CDF) const
+  {
+  _GetLightsCDF(i_point, NULL, o_lights_CDF);
+  }
+
+void LightTreeLightsSamplingStrategy::GetLightsCDF(const Point3D_d &i_point, const Vector3D_d &i_normal, double *o_lights_CDF) const
+  {
+  ASSERT(i_normal.IsNormalized());
+  _GetLightsCDF(i_point, &i_normal, o_lights_CDF);
+  }
+
+bool LightTreeLightsSamplingStrategy::SamplesLightsDirectly() const
+  {
+  return true;
+  }
+
+size_t LightTreeLightsSamplingStrategy::SampleLight(const Point3D_d &i_point, double i_sample, double &o_pdf, double &o_remapped_sample) const
+  {
+  return _SampleLight(i_point, NULL, i_sample, o_pdf, o_remapped_sample);
+  }
+
+size_t LightTreeLightsSamplingStrategy::SampleLight(const Point3D_d &i_point, const Vector3D_d &i_normal, double i_sample, double &o_pdf, double &o_remapped_sample) const
+  {
+  ASSERT(i_normal.IsNormalized());
+  return _SampleLight(i_point, &i_normal, i_sample, o_pdf, o_remapped_sample);
+  }
+
+double LightTreeLightsSamplingStrategy::LightPDF(const Point3D_d &i_point, size_t i_light_index) const
+  {
+  return _LightPDF(i_point, NULL, i_light_index);
+  }
+
+double LightTreeLightsSamplingStrategy::LightPDF(const Point3D_d &i_point, const Vector3D_d &i_normal, size_t i_light_index) const
+  {
+  ASSERT(i_normal.IsNormalized());
+  return _LightPDF(i_point, &i_normal, i_light_index);
+  }
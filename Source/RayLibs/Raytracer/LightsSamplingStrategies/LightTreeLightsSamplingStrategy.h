@@ -0,0 +1,151 @@
+/*
+* Copyright (C) 2014 by Volodymyr Kachurovskyi <Volodymyr.Kachurovskyi@gmail.com>
+*
+* This file is part of Skwarka.
+*
+* Skwarka is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+*
+* Skwarka is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License along with Skwarka.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef LIGHT_TREE_LIGHTS_SAMPLING_H
+#define LIGHT_TREE_LIGHTS_SAMPLING_H
+
+#include <Common/Common.h>
+#include <Math/Geometry.h>
+#include <Raytracer/Core/LightsSamplingStrategy.h>
+#include <Raytracer/Core/LightSources.h>
+#include <vector>
+
+/**
+* LightsSamplingStrategy implementation that samples the lights by traversing a binary tree built over the area lights.
+* Each node of the tree bounds its lights by a bounding box, the total power and a cone of the emission directions.
+* At each shading point the tree is traversed from the root and at each internal node one of the children is selected with the probability proportional
+* to its estimated irradiance at the point. The estimate is conservative, i.e. it is zero only if none of the node's lights can illuminate the point.
+* Thus a light is sampled and its probability is computed in time logarithmic in the number of area lights rather than linear.
+* The tree is built with the surface area orientation heuristic (see "Importance Sampling of Many Lights with Adaptive Tree Splitting" by Conty Estevez and Kulla).
+*
+* Infinity lights are not put in the tree. The tree as a whole and each of the infinity lights are selected with the probability proportional to their irradiance (or fluence).
+* The area lights are assumed to emit light from the front side of the triangles only, as DiffuseAreaLightSource does.
+*/
+class LightTreeLightsSamplingStrategy: public LightsSamplingStrategy
+  {
+  public:
+    /**
+    * Creates LightTreeLightsSamplingStrategy instance for the specified light sources and builds the tree over the area lights.
+    */
+    LightTreeLightsSamplingStrategy(const LightSources &i_light_sources);
+
+    /**
+    * Returns CDF for the infinity and area lights at the specified 3D point being shaded.
+    * The CDF is computed by querying probability of each light so the method takes time proportional to N*log(N). Use SampleLight() method instead when possible.
+    * @param i_point 3D point being shaded.
+    * @param[out] o_lights_CDF Output array where the CDF values will be written to. Should have enough space to fit as many values as there are infinity and area lights in the scene.
+    * The CDF values will be in non-descending order and will all be in [0;1] range.
+    */
+    virtual void GetLightsCDF(const Point3D_d &i_point, double *o_lights_CDF) const;
+
+    /**
+    * Returns CDF for the infinity and area lights at the specified 3D point being shaded and for the specified surface normal.
+    * The CDF is computed by querying probability of each light so the method takes time proportional to N*log(N). Use SampleLight() method instead when possible.
+    * @param i_point 3D point being shaded.
+    * @param i_normal Surface normal at the specified point. Should be normalized.
+    * @param[out] o_lights_CDF Output array where the CDF values will be written to. Should have enough space to fit as many values as there are infinity and area lights in the scene.
+    * The CDF values will be in non-descending order and will all be in [0;1] range.
+    */
+    virtual void GetLightsCDF(const Point3D_d &i_point, const Vector3D_d &i_normal, double *o_lights_CDF) const;
+
+    /**
+    * Returns true.
+    */
+    virtual bool SamplesLightsDirectly() const;
+
+    /**
+    * Samples one of the infinity and area lights at the specified 3D point being shaded.
+    * @param i_point 3D point being shaded.
+    * @param i_sample 1D sample. Should be in [0;1) range.
+    * @param[out] o_pdf Probability of the sampled light to be selected.
+    * @param[out] o_remapped_sample The sample remapped to [0;1) range after the light has been selected.
+    * @return Index of the sampled light.
+    */
+    virtual size_t SampleLight(const Point3D_d &i_point, double i_sample, double &o_pdf, double &o_remapped_sample) const;
+
+    /**
+    * Samples one of the infinity and area lights at the specified 3D point being shaded and for the specified surface normal.
+    * @param i_point 3D point being shaded.
+    * @param i_normal Surface normal at the specified point. Should be normalized.
+    * @param i_sample 1D sample. Should be in [0;1) range.
+    * @param[out] o_pdf Probability of the sampled light to be selected.
+    * @param[out] o_remapped_sample The sample remapped to [0;1) range after the light has been selected.
+    * @return Index of the sampled light.
+    */
+    virtual size_t SampleLight(const Point3D_d &i_point, const Vector3D_d &i_normal, double i_sample, double &o_pdf, double &o_remapped_sample) const;
+
+    /**
+    * Returns probability of the specified light to be selected by SampleLight() method at the specified 3D point being shaded.
+    */
+    virtual double LightPDF(const Point3D_d &i_point, size_t i_light_index) const;
+
+    /**
+    * Returns probability of the specified light to be selected by SampleLight() method at the specified 3D point being shaded and for the specified surface normal.
+    */
+    virtual double LightPDF(const Point3D_d &i_point, const Vector3D_d &i_normal, size_t i_light_index) const;
+
+  private:
+    // Node of the tree. The nodes are stored in the depth-first order so that the first child of an internal node immediately follows the node.
+    struct Node
+      {
+      BBox3D_d m_bounds;
+
+      // Axis and half-angle of the cone bounding the normals of the emitting triangles.
+      Vector3D_d m_axis;
+      double m_theta_o;
+
+      // Total luminance of the lights' power.
+      double m_power;
+
+      // Index of the second child for internal nodes, zero for leaves.
+      size_t m_second_child;
+
+      // Index of the area light in LightSources::m_area_light_sources (only for leaves).
+      size_t m_light_index;
+      };
+
+    // Maximum depth of the tree. If it is reached, the lights are split in two halves of equal size instead of using the heuristic.
+    static const size_t MAX_TREE_DEPTH = 64;
+
+    // Number of buckets the lights are put into when evaluating the split heuristic.
+    static const size_t BUCKETS_NUM = 12;
+
+  private:
+    size_t _Build(std::vector<Node> &io_lights, size_t i_begin, size_t i_end, size_t i_depth);
+
+    double _Importance(const Node &i_node, const Point3D_d &i_point, const Vector3D_d *ip_normal) const;
+
+    double _InfinityLightWeight(size_t i_light_index, const Vector3D_d *ip_normal) const;
+
+    size_t _SampleLight(const Point3D_d &i_point, const Vector3D_d *ip_normal, double i_sample, double &o_pdf, double &o_remapped_sample) const;
+
+    double _LightPDF(const Point3D_d &i_point, const Vector3D_d *ip_normal, size_t i_light_index) const;
+
+    void _GetLightsCDF(const Point3D_d &i_point, const Vector3D_d *ip_normal, double *o_lights_CDF) const;
+
+  private:
+    const LightSources &m_light_sources;
+    size_t m_infinity_lights_num, m_area_lights_num;
+
+    std::vector<Node> m_nodes;
+
+    // Index of the parent node for each node. The root node is its own parent.
+    std::vector<size_t> m_parents;
+
+    // Index of the leaf node for each area light.
+    std::vector<size_t> m_light_leaves;
+  };
+
+#endif // LIGHT_TREE_LIGHTS_SAMPLING_H
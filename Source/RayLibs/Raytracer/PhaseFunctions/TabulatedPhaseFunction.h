@@ -0,0 +1,146 @@
+/*
+* Copyright (C) 2014 by Volodymyr Kachurovskyi <Volodymyr.Kachurovskyi@gmail.com>
+*
+* This file is part of Skwarka.
+*
+* Skwarka is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+*
+* Skwarka is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License along with Skwarka.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef TABULATED_PHASE_FUNCTION_H
+#define TABULATED_PHASE_FUNCTION_H
+
+#include <Common/Common.h>
+#include <Math/Geometry.h>
+#include <Math/MathRoutines.h>
+#include <Raytracer/Core/PhaseFunction.h>
+#include <vector>
+
+/**
+* Phase function adapter that adds importance sampling to another phase function.
+* The adapted phase function must only depend on the angle between the incoming and outgoing directions (which is true for all phase functions of isotropic media).
+* The constructor tabulates the adapted phase function over cos(theta) and builds CDF for it. The directions are sampled by inverting the CDF.
+* The values of the phase function are computed by the adapted phase function, only the sampling is based on the table.
+* This is useful for the phase functions with sharp lobes (like MieHazyPhaseFunction and MieMurkyPhaseFunction) which are poorly sampled by the uniform sphere sampling.
+*/
+class TabulatedPhaseFunction: public PhaseFunction
+  {
+  public:
+    /**
+    * Creates TabulatedPhaseFunction instance for the specified phase function.
+    * @param ip_phase_function Adapted phase function.
+    * @param i_bins_num Number of bins over cos(theta) range. Should be greater than 0.
+    */
+    TabulatedPhaseFunction(intrusive_ptr<const PhaseFunction> ip_phase_function, size_t i_bins_num = 1024);
+
+    /**
+    * Returns probability density for the light to be scattered in the specified outgoing direction given the specified incoming direction.
+    * The value is computed by the adapted phase function.
+    */
+    double ScatteringPDF(const Vector3D_d &i_incoming, const Vector3D_d &i_outgoing) const;
+
+    /**
+    * Samples outgoing direction for the specified incoming direction proportionally to the tabulated phase function.
+    * @param i_incoming Incoming direction, i.e. the direction of the light ray before the scattering. Should be normalized.
+    * @param i_sample 2D sample. Should be in [0;1)^2 range.
+    * @param[out] o_outgoing Sampled outgoing direction. Normalized.
+    * @return PDF of the sampled direction.
+    */
+    double Sample(const Vector3D_d &i_incoming, const Point2D_d &i_sample, Vector3D_d &o_outgoing) const;
+
+    /**
+    * Returns PDF of sampling the specified outgoing direction by the Sample() method.
+    */
+    double PDF(const Vector3D_d &i_incoming, const Vector3D_d &i_outgoing) const;
+
+  private:
+    // Number of samples used to average the phase function in each bin.
+    static const size_t SAMPLES_PER_BIN = 8;
+
+    intrusive_ptr<const PhaseFunction> mp_phase_function;
+
+    double m_bin_size;
+
+    /**
+    * CDF of the bins and the PDF (with respect to the solid angle) of the directions within each bin.
+    */
+    std::vector<double> m_CDF, m_PDFs;
+  };
+
+/////////////////////////////////////////// IMPLEMENTATION ////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+inline TabulatedPhaseFunction::TabulatedPhaseFunction(intrusive_ptr<const PhaseFunction> ip_phase_function, size_t i_bins_num):
+mp_phase_function(ip_phase_function), m_bin_size(2.0/i_bins_num), m_CDF(i_bins_num), m_PDFs(i_bins_num)
+  {
+  ASSERT(ip_phase_function);
+  ASSERT(i_bins_num > 0);
+
+  // Average the phase function over each bin. The incoming direction is fixed since the phase function only depends on the angle.
+  Vector3D_d incoming(0.0, 0.0, 1.0);
+  double sum = 0.0;
+  for(size_t i=0;i<i_bins_num;++i)
+    {
+    double value = 0.0;
+    for(size_t j=0;j<SAMPLES_PER_BIN;++j)
+      {
+      double cos_theta = MathRoutines::Clamp(-1.0 + (i + (j+0.5)/SAMPLES_PER_BIN)*m_bin_size, -1.0, 1.0);
+      double sin_theta = sqrt(std::max(0.0, 1.0-cos_theta*cos_theta));
+      value += mp_phase_function->ScatteringPDF(incoming, Vector3D_d(sin_theta, 0.0, cos_theta));
+      }
+
+    m_PDFs[i] = value / SAMPLES_PER_BIN;
+    sum += m_PDFs[i];
+    m_CDF[i] = sum;
+    }
+
+  ASSERT(sum > 0.0);
+  for(size_t i=0;i<i_bins_num;++i)
+    {
+    m_CDF[i] /= sum;
+
+    // The solid angle of each bin is 2*pi*m_bin_size.
+    m_PDFs[i] /= sum * 2.0*M_PI*m_bin_size;
+    }
+  m_CDF.back() = 1.0;
+  }
+
+inline double TabulatedPhaseFunction::ScatteringPDF(const Vector3D_d &i_incoming, const Vector3D_d &i_outgoing) const
+  {
+  return mp_phase_function->ScatteringPDF(i_incoming, i_outgoing);
+  }
+
+inline double TabulatedPhaseFunction::Sample(const Vector3D_d &i_incoming, const Point2D_d &i_sample, Vector3D_d &o_outgoing) const
+  {
+  ASSERT(i_incoming.IsNormalized());
+
+  double bin_probability;
+  size_t bin = MathRoutines::BinarySearchCDF(m_CDF.begin(), m_CDF.end(), i_sample[0], &bin_probability) - m_CDF.begin();
+  ASSERT(bin_probability > 0.0);
+
+  // Position of the sample within the bin.
+  double offset = (i_sample[0] - (bin > 0 ? m_CDF[bin-1] : 0.0)) / bin_probability;
+  double cos_theta = MathRoutines::Clamp(-1.0 + (bin + offset)*m_bin_size, -1.0, 1.0);
+  double sin_theta = sqrt(std::max(0.0, 1.0-cos_theta*cos_theta));
+  double phi = 2.0*M_PI*i_sample[1];
+
+  Vector3D_d e2, e3;
+  MathRoutines::CoordinateSystem(i_incoming, e2, e3);
+  o_outgoing = (e2*(sin_theta*cos(phi)) + e3*(sin_theta*sin(phi)) + i_incoming*cos_theta).Normalized();
+
+  return m_PDFs[bin];
+  }
+
+inline double TabulatedPhaseFunction::PDF(const Vector3D_d &i_incoming, const Vector3D_d &i_outgoing) const
+  {
+  double cos_theta = i_incoming*i_outgoing;
+  size_t bin = std::min((size_t)std::max(0.0, (cos_theta+1.0)/m_bin_size), m_PDFs.size()-1);
+  return m_PDFs[bin];
+  }
+
+#endif // TABULATED_PHASE_FUNCTION_H
@@ -150,7 +150,7 @@ class SamplerBasedRenderer::IntegratorFilter: public tbb::filter
   {
   public:
     IntegratorFilter(intrusive_ptr<const LTEIntegrator> ip_lte_integrator, intrusive_ptr<const Camera> ip_camera, const SamplerBasedRenderer *ip_renderer,
-      intrusive_ptr<Log> ip_log, bool i_low_thread_priority);
+      intrusive_ptr<Log> ip_log, RenderThreadPool &io_thread_pool);
 
     void* operator()(void* ip_chunk);
 
@@ -162,7 +162,7 @@ class SamplerBasedRenderer::IntegratorFilter: public tbb::filter
     const SamplerBasedRenderer *mp_renderer;
 
     intrusive_ptr<Log> mp_log;
-    bool m_low_thread_priority;
+    RenderThreadPool &m_thread_pool;
   };
 
 /**
@@ -198,6 +198,12 @@ void SamplerBasedRenderer::SetLog(intrusive_ptr<Log> ip_log)
   }
 
 bool SamplerBasedRenderer::Render(intrusive_ptr<const Camera> ip_camera, bool i_low_thread_priority)
+  {
+  RenderThreadPool thread_pool(i_low_thread_priority ? RenderThreadPoolParams::LowPriority() : RenderThreadPoolParams());
+  return Render(ip_camera, thread_pool);
+  }
+
+bool SamplerBasedRenderer::Render(intrusive_ptr<const Camera> ip_camera, RenderThreadPool &io_thread_pool)
   {
   ASSERT(ip_camera);
   auto start_time = std::chrono::system_clock::now();
@@ -213,7 +219,7 @@ bool SamplerBasedRenderer::Render(intrusive_ptr<const Camera> ip_camera, bool i_
   mp_lte_integrator->RequestSamples(mp_sampler);
 
   SamplesGeneratorFilter samples_generator(mp_sampler, MAX_PIPELINE_TOKENS_NUM, PIXELS_PER_CHUNK, this);
-  IntegratorFilter integrator(mp_lte_integrator, ip_camera, this, mp_log, i_low_thread_priority);
+  IntegratorFilter integrator(mp_lte_integrator, ip_camera, this, mp_log, io_thread_pool);
   FilmWriterFilter film_writer(ip_camera->GetFilm(), this);
 
   tbb::pipeline pipeline;
@@ -221,10 +227,15 @@ bool SamplerBasedRenderer::Render(intrusive_ptr<const Camera> ip_camera, bool i_
   pipeline.add_filter(integrator);
   pipeline.add_filter(film_writer);
 
-  pipeline.run(MAX_PIPELINE_TOKENS_NUM);
+  pipeline.run(io_thread_pool.GetMaxConcurrency(MAX_PIPELINE_TOKENS_NUM));
   pipeline.clear();
+  size_t unlowered_threads_num = io_thread_pool.GetUnloweredThreadsNumber();
+  io_thread_pool.RestoreThreads();
   m_rendering_in_progress = false;
 
+  if (mp_log && unlowered_threads_num > 0)
+    mp_log->LogMessage(Log::WARNING_LEVEL, "Could not lower the scheduling priority of " + std::to_string((unsigned long long)unlowered_threads_num) + " rendering thread(s).");
+
   // Force display update (even if the time period has not passed yet).
   _UpdateDisplay(ip_camera->GetFilm(), true);
 
@@ -313,7 +324,7 @@ const Sample *SamplerBasedRenderer::PixelsChunk::GetNextSample()
   ASSERT(mp_sample);
   ASSERT(mp_sub_sampler);
 
-  if (mp_sub_sampler->GetNextSample(mp_sample))
+  if (mp_sub_sampler->GetNextSample(mp_sample.get()))
     return mp_sample.get();
   else
     return NULL;
@@ -409,8 +420,8 @@ void* SamplerBasedRenderer::SamplesGeneratorFilter::operator()(void*)
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////
 
 SamplerBasedRenderer::IntegratorFilter::IntegratorFilter(intrusive_ptr<const LTEIntegrator> ip_lte_integrator, intrusive_ptr<const Camera> ip_camera, const SamplerBasedRenderer *ip_renderer,
-                                                         intrusive_ptr<Log> ip_log, bool i_low_thread_priority)
-: tbb::filter(parallel), mp_lte_integrator(ip_lte_integrator), mp_camera(ip_camera), mp_renderer(ip_renderer), mp_log(ip_log), m_low_thread_priority(i_low_thread_priority)
+                                                         intrusive_ptr<Log> ip_log, RenderThreadPool &io_thread_pool)
+: tbb::filter(parallel), mp_lte_integrator(ip_lte_integrator), mp_camera(ip_camera), mp_renderer(ip_renderer), mp_log(ip_log), m_thread_pool(io_thread_pool)
   {
   ASSERT(ip_lte_integrator);
   ASSERT(ip_camera);
@@ -418,16 +429,18 @@ SamplerBasedRenderer::IntegratorFilter::IntegratorFilter(intrusive_ptr<const LTE
 
 void* SamplerBasedRenderer::IntegratorFilter::operator()(void* ip_chunk)
   {
-  int prev_thread_priority = 0;
-  if (m_low_thread_priority)
-    prev_thread_priority = CoreUtils::SetCurrentThreadPriority(THREAD_PRIORITY_LOWEST);
+  m_thread_pool.PrepareCurrentThread();
 
   PixelsChunk *p_chunk = static_cast<PixelsChunk*>(ip_chunk);
   MemoryPool *p_pool = p_chunk->GetMemoryPool();
 
+  // The shadow rays of the neighbouring pixels are coherent, so the last occluder is shared by all samples of the chunk.
+  OccluderHint occluder_hint;
+
   ThreadSpecifics ts;
   ts.mp_pool = p_pool;
   ts.mp_random_generator = p_chunk->GetRandomGenerator();
+  ts.mp_occluder_hint = &occluder_hint;
 
   const Sample *p_sample = NULL;
   while((p_sample = p_chunk->GetNextSample()) && mp_renderer->m_rendering_stopped==false)
@@ -438,20 +451,9 @@ void* SamplerBasedRenderer::IntegratorFilter::operator()(void* ip_chunk)
     double x_filter_width, y_filter_width;
     p_sample->GetImageFilterWidth(x_filter_width, y_filter_width);
 
-    // Compute ray differentials by computing camera rays for adjacent image pixels.
+    // Compute ray differentials for the adjacent image points.
     RayDifferential ray;
-    Ray r_dx, r_dy;
-    double weight = mp_camera->GenerateRay(image_point, lens_uv, ray.m_base_ray);
-    double weight_dx = mp_camera->GenerateRay(image_point+Point2D_d(x_filter_width, 0.0), lens_uv, r_dx);
-    double weight_dy = mp_camera->GenerateRay(image_point+Point2D_d(0.0, y_filter_width), lens_uv, r_dy);
-
-    if (weight_dx > DBL_EPS && weight_dy > DBL_EPS)
-      ray.m_has_differentials = true;
-
-    ray.m_origin_dx=r_dx.m_origin;
-    ray.m_origin_dy=r_dy.m_origin;
-    ray.m_direction_dx=r_dx.m_direction;
-    ray.m_direction_dy=r_dy.m_direction;
+    double weight = mp_camera->GenerateRayDifferential(image_point, lens_uv, x_filter_width, y_filter_width, ray);
 
     Spectrum_d radiance = weight > DBL_EPS ? mp_lte_integrator->Radiance(ray, p_sample, ts) : Spectrum_d(0.0);
 
@@ -483,10 +485,6 @@ void* SamplerBasedRenderer::IntegratorFilter::operator()(void* ip_chunk)
     p_pool->FreeAll();
     }
 
-  // Set the thread priority back to its original value.
-  if (m_low_thread_priority)
-    CoreUtils::SetCurrentThreadPriority(prev_thread_priority);
-
   return p_chunk;
   }
 
@@ -24,6 +24,7 @@
 #include <Raytracer/Core/Sampler.h>
 #include <Raytracer/Core/Camera.h>
 #include <Raytracer/Core/LTEIntegrator.h>
+#include <Raytracer/Core/RenderThreadPool.h>
 
 /**
 * Renders image by shooting camera rays for each camera sample generated by Sampler.
@@ -52,6 +53,16 @@ class SamplerBasedRenderer: public Renderer
     */
     virtual bool Render(intrusive_ptr<const Camera> ip_camera, bool i_low_thread_priority = false);
 
+    /**
+    * Renders the scene for the specified camera using the specified thread pool settings.
+    * The thread pool defines the OS scheduling settings of the threads performing the rendering and limits the number of threads.
+    * The original settings of the threads are restored by the time the method returns.
+    * @param ip_camera Camera in the scene for which the image is to be rendered.
+    * @param io_thread_pool Thread pool the rendering threads are prepared with.
+    * @return True if the image was rendered successfully and false if the rendering was stopped (see StopRendering() method).
+    */
+    bool Render(intrusive_ptr<const Camera> ip_camera, RenderThreadPool &io_thread_pool);
+
     /**
     * Stops rendering of the image.
     * This method can be called concurrently with the Render() method to stop rendering the image.
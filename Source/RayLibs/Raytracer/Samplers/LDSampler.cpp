@@ -58,7 +58,7 @@ m_image_points(i_samples_per_pixel), m_lens_UVs(i_samples_per_pixel)
   m_buffer_2D.assign(count_2D*i_samples_per_pixel, Point2D_d());
   }
 
-void LDSubSampler::_GetSample(const Point2D_i &i_current_pixel, size_t i_pixel_sample_index, intrusive_ptr<Sample> op_sample)
+void LDSubSampler::_GetSample(const Point2D_i &i_current_pixel, size_t i_pixel_sample_index, Sample *op_sample)
   {
   ASSERT(i_pixel_sample_index<m_samples_per_pixel);
 
@@ -44,7 +44,7 @@ RandomSubSampler::RandomSubSampler(const std::vector<Point2D_i> &i_pixels, size_
   m_inv_samples_per_pixel_sqrt = 1.0 / sqrt((double)i_samples_per_pixel);
   }
 
-void RandomSubSampler::_GetSample(const Point2D_i &i_current_pixel, size_t i_pixel_sample_index, intrusive_ptr<Sample> op_sample)
+void RandomSubSampler::_GetSample(const Point2D_i &i_current_pixel, size_t i_pixel_sample_index, Sample *op_sample)
   {
   RandomGenerator<double> *p_rng = _GetRandomGenerator();
   ASSERT(p_rng);
@@ -75,7 +75,7 @@ class RandomSubSampler: public SubSampler
     /**
     * Populates the Sample with the samples data for the specified image pixel and specified sample's index inside that pixel.
     */
-    virtual void _GetSample(const Point2D_i &i_current_pixel, size_t i_pixel_sample_index, intrusive_ptr<Sample> op_sample);
+    virtual void _GetSample(const Point2D_i &i_current_pixel, size_t i_pixel_sample_index, Sample *op_sample);
 
   private:
     /**
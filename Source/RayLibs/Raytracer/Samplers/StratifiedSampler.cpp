@@ -54,7 +54,7 @@ m_image_points(i_x_samples_per_pixel*i_y_samples_per_pixel), m_lens_UVs(i_x_samp
   m_inv_y_samples_per_pixel = 1.0/i_y_samples_per_pixel;
   }
 
-void StratifiedSubSampler::_GetSample(const Point2D_i &i_current_pixel, size_t i_pixel_sample_index, intrusive_ptr<Sample> op_sample)
+void StratifiedSubSampler::_GetSample(const Point2D_i &i_current_pixel, size_t i_pixel_sample_index, Sample *op_sample)
   {
   RandomGenerator<double> *p_rng = _GetRandomGenerator();
   ASSERT(p_rng);
@@ -43,7 +43,7 @@ class ConstantTexture: public Texture<T>
 
 template<typename T>
 ConstantTexture<T>::ConstantTexture(const T &i_value):
-Texture(), m_value(i_value)
+Texture<T>(), m_value(i_value)
   {
   }
 
@@ -47,7 +47,7 @@ class MixTexture : public Texture<T1>
 
 template<typename T1, typename T2>
 MixTexture<T1, T2>::MixTexture(intrusive_ptr<const Texture<T1>> ip_texture1, intrusive_ptr<const Texture<T1>> ip_texture2, intrusive_ptr<const Texture<T2>> ip_weight) :
-Texture(), mp_texture1(ip_texture1), mp_texture2(ip_texture2), mp_weight(ip_weight)
+Texture<T1>(), mp_texture1(ip_texture1), mp_texture2(ip_texture2), mp_weight(ip_weight)
   {
   ASSERT(ip_texture1);
   ASSERT(ip_texture2);
@@ -47,7 +47,7 @@ class ScaleTexture: public Texture<T2>
 
 template<typename T1, typename T2>
 ScaleTexture<T1,T2>::ScaleTexture(intrusive_ptr<const Texture<T1>> ip_texture1, intrusive_ptr<const Texture<T2>> ip_texture2):
-Texture(), mp_texture1(ip_texture1), mp_texture2(ip_texture2)
+Texture<T2>(), mp_texture1(ip_texture1), mp_texture2(ip_texture2)
   {
   ASSERT(ip_texture1);
   ASSERT(ip_texture2);
@@ -59,7 +59,7 @@ class WindyTexture : public Texture<T>
 
 template<typename T>
 WindyTexture<T>::WindyTexture(intrusive_ptr<const Mapping3D> ip_mapping) :
-Texture(), mp_mapping(ip_mapping)
+Texture<T>(), mp_mapping(ip_mapping)
   {
   }
 
@@ -62,7 +62,7 @@ class WrinkledTexture : public Texture<T>
 
 template<typename T>
 WrinkledTexture<T>::WrinkledTexture(size_t i_max_octaves, double i_roughness, intrusive_ptr<const Mapping3D> ip_mapping) :
-Texture(), m_max_octaves(i_max_octaves), m_roughness(i_roughness), mp_mapping(ip_mapping)
+Texture<T>(), m_max_octaves(i_max_octaves), m_roughness(i_roughness), mp_mapping(ip_mapping)
   {
   }
 
@@ -11,16 +11,149 @@
 *
 * You should have received a copy of the GNU General Public License along with Skwarka.  If not, see <http://www.gnu.org/licenses/>.
 */
-
 #include "AggregateVolumeRegion.h"
 #include <Raytracer/Core/SpectrumRoutines.h>
+#include <algorithm>
 
-AggregateVolumeRegion::AggregateVolumeRegion(const std::vector<intrusive_ptr<const VolumeRegion>> &i_volume_regions): m_volume_regions(i_volume_regions)
+AggregateVolumeRegion::AggregateVolumeRegion(const std::vector<intrusive_ptr<const VolumeRegion>> &i_volume_regions)
   {
   // Precompute aggregated bounding box.
   m_bounds = BBox3D_d();
+  std::vector<BBox3D_d> region_bounds(i_volume_regions.size());
   for(size_t i=0;i<i_volume_regions.size();++i)
+    {
+    // The bounding box is united with its corners to handle the boxes with swapped min and max coordinates.
+    BBox3D_d bounds = i_volume_regions[i]->GetBounds();
+    region_bounds[i].Unite(bounds.m_min);
+    region_bounds[i].Unite(bounds.m_max);
     m_bounds.Unite(i_volume_regions[i]->GetBounds());
+    }
+
+  if (i_volume_regions.empty())
+    return;
+
+  m_volume_regions = i_volume_regions;
+  m_region_bounds = region_bounds;
+
+  std::vector<size_t> indices(i_volume_regions.size());
+  for(size_t i=0;i<indices.size();++i)
+    indices[i] = i;
+
+  m_nodes.reserve(2*i_volume_regions.size());
+  _Build(indices, 0, indices.size());
+
+  // Reorder the volume regions so that the leaf nodes reference contiguous ranges.
+  for(size_t i=0;i<indices.size();++i)
+    {
+    m_volume_regions[i] = i_volume_regions[indices[i]];
+    m_region_bounds[i] = region_bounds[indices[i]];
+    }
+  }
+
+size_t AggregateVolumeRegion::_Build(std::vector<size_t> &io_indices, size_t i_begin, size_t i_end)
+  {
+  ASSERT(i_begin < i_end);
+
+  size_t node_index = m_nodes.size();
+  m_nodes.push_back(Node());
+
+  BBox3D_d bounds, centers_bounds;
+  for(size_t i=i_begin;i<i_end;++i)
+    {
+    const BBox3D_d &region_bounds = m_region_bounds[io_indices[i]];
+    bounds.Unite(region_bounds);
+    centers_bounds.Unite(Point3D_d(region_bounds.m_min+region_bounds.m_max)/2.0);
+    }
+  m_nodes[node_index].m_bounds = bounds;
+
+  if (i_end-i_begin <= MAX_LEAF_REGIONS)
+    {
+    m_nodes[node_index].m_second_child = 0;
+    m_nodes[node_index].m_regions_begin = i_begin;
+    m_nodes[node_index].m_regions_end = i_end;
+    return node_index;
+    }
+
+  Point3D_d extent = centers_bounds.m_max-centers_bounds.m_min;
+  unsigned char axis = extent[0]>extent[1] ? (extent[0]>extent[2] ? 0 : 2) : (extent[1]>extent[2] ? 1 : 2);
+
+  size_t middle = (i_begin+i_end)/2;
+  const std::vector<BBox3D_d> &all_bounds = m_region_bounds;
+  std::nth_element(io_indices.begin()+i_begin, io_indices.begin()+middle, io_indices.begin()+i_end, [&all_bounds, axis](size_t i_index1, size_t i_index2)
+    {
+    return all_bounds[i_index1].m_min[axis]+all_bounds[i_index1].m_max[axis] < all_bounds[i_index2].m_min[axis]+all_bounds[i_index2].m_max[axis];
+    });
+
+  _Build(io_indices, i_begin, middle);
+  size_t second_child = _Build(io_indices, middle, i_end);
+
+  m_nodes[node_index].m_second_child = second_child;
+  m_nodes[node_index].m_regions_begin = m_nodes[node_index].m_regions_end = 0;
+  return node_index;
+  }
+
+template<typename Function>
+void AggregateVolumeRegion::_ForEachRegion(const Point3D_d &i_point, Function i_function) const
+  {
+  if (m_nodes.empty())
+    return;
+
+  size_t stack[MAX_TREE_DEPTH];
+  size_t stack_size = 0, node_index = 0;
+  while (true)
+    {
+    const Node &node = m_nodes[node_index];
+    if (node.m_bounds.Inside(i_point))
+      {
+      if (node.m_regions_begin == node.m_regions_end)
+        {
+        ASSERT(stack_size < MAX_TREE_DEPTH);
+        stack[stack_size++] = node.m_second_child;
+        ++node_index;
+        continue;
+        }
+
+      for(size_t i=node.m_regions_begin;i<node.m_regions_end;++i)
+        if (m_region_bounds[i].Inside(i_point))
+          i_function(*m_volume_regions[i]);
+      }
+
+    if (stack_size == 0)
+      return;
+    node_index = stack[--stack_size];
+    }
+  }
+
+template<typename Function>
+void AggregateVolumeRegion::_ForEachRegion(const Ray &i_ray, Function i_function) const
+  {
+  if (m_nodes.empty())
+    return;
+
+  size_t stack[MAX_TREE_DEPTH];
+  size_t stack_size = 0, node_index = 0;
+  while (true)
+    {
+    const Node &node = m_nodes[node_index];
+    if (node.m_bounds.Intersect(i_ray))
+      {
+      if (node.m_regions_begin == node.m_regions_end)
+        {
+        ASSERT(stack_size < MAX_TREE_DEPTH);
+        stack[stack_size++] = node.m_second_child;
+        ++node_index;
+        continue;
+        }
+
+      for(size_t i=node.m_regions_begin;i<node.m_regions_end;++i)
+        if (i_function(*m_volume_regions[i]) == false)
+          return;
+      }
+
+    if (stack_size == 0)
+      return;
+    node_index = stack[--stack_size];
+    }
   }
 
 BBox3D_d AggregateVolumeRegion::GetBounds() const
@@ -33,15 +166,16 @@ bool AggregateVolumeRegion::Intersect(const Ray &i_ray, double *op_t_begin, doub
   double t_begin = DBL_INF;
   double t_end = -DBL_INF;
 
-  for (size_t i=0;i<m_volume_regions.size();++i)
+  _ForEachRegion(i_ray, [&](const VolumeRegion &i_region) -> bool
     {
     double tmp_begin, tmp_end;
-    if (m_volume_regions[i]->Intersect(i_ray, &tmp_begin, &tmp_end))
+    if (i_region.Intersect(i_ray, &tmp_begin, &tmp_end))
       {
       t_begin = std::min(t_begin, tmp_begin);
       t_end = std::max(t_end, tmp_end);
       }
-    }
+    return true;
+    });
 
   if (op_t_begin) *op_t_begin = t_begin;
   if (op_t_end) *op_t_end = t_end;
@@ -49,12 +183,41 @@ bool AggregateVolumeRegion::Intersect(const Ray &i_ray, double *op_t_begin, doub
   return t_begin < t_end;
   }
 
+void AggregateVolumeRegion::GetIntervals(const Ray &i_ray, std::vector<std::pair<double,double>> &o_intervals) const
+  {
+  o_intervals.clear();
+
+  _ForEachRegion(i_ray, [&](const VolumeRegion &i_region) -> bool
+    {
+    double t_begin, t_end;
+    if (i_region.Intersect(i_ray, &t_begin, &t_end) && t_begin < t_end)
+      o_intervals.push_back(std::make_pair(t_begin, t_end));
+    return true;
+    });
+
+  if (o_intervals.empty())
+    return;
+
+  // Merge the overlapping intervals.
+  std::sort(o_intervals.begin(), o_intervals.end());
+  size_t merged = 0;
+  for(size_t i=1;i<o_intervals.size();++i)
+    if (o_intervals[i].first <= o_intervals[merged].second)
+      o_intervals[merged].second = std::max(o_intervals[merged].second, o_intervals[i].second);
+    else
+      o_intervals[++merged] = o_intervals[i];
+
+  o_intervals.resize(merged+1);
+  }
+
 Spectrum_d AggregateVolumeRegion::Emission(const Point3D_d &i_point) const
   {
   Spectrum_d ret;
 
-  for (size_t i=0;i<m_volume_regions.size();++i)
-    ret += m_volume_regions[i]->Emission(i_point);
+  _ForEachRegion(i_point, [&](const VolumeRegion &i_region)
+    {
+    ret += i_region.Emission(i_point);
+    });
 
   return ret;
   }
@@ -63,8 +226,10 @@ SpectrumCoef_d AggregateVolumeRegion::Absorption(const Point3D_d &i_point) const
   {
   SpectrumCoef_d ret;
 
-  for (size_t i=0;i<m_volume_regions.size();++i)
-    ret += m_volume_regions[i]->Absorption(i_point);
+  _ForEachRegion(i_point, [&](const VolumeRegion &i_region)
+    {
+    ret += i_region.Absorption(i_point);
+    });
 
   return ret;
   }
@@ -73,8 +238,10 @@ SpectrumCoef_d AggregateVolumeRegion::Scattering(const Point3D_d &i_point) const
   {
   SpectrumCoef_d ret;
 
-  for (size_t i=0;i<m_volume_regions.size();++i)
-    ret += m_volume_regions[i]->Scattering(i_point);
+  _ForEachRegion(i_point, [&](const VolumeRegion &i_region)
+    {
+    ret += i_region.Scattering(i_point);
+    });
 
   return ret;
   }
@@ -83,8 +250,10 @@ SpectrumCoef_d AggregateVolumeRegion::Attenuation(const Point3D_d &i_point) cons
   {
   SpectrumCoef_d ret;
 
-  for (size_t i=0;i<m_volume_regions.size();++i)
-    ret += m_volume_regions[i]->Attenuation(i_point);
+  _ForEachRegion(i_point, [&](const VolumeRegion &i_region)
+    {
+    ret += i_region.Attenuation(i_point);
+    });
 
   return ret;
   }
@@ -93,12 +262,12 @@ double AggregateVolumeRegion::Phase(const Point3D_d &i_point, const Vector3D_d &
   {
   double ret = 0.0, sum_weights = 0.0;
 
-  for (size_t i=0;i<m_volume_regions.size();++i)
+  _ForEachRegion(i_point, [&](const VolumeRegion &i_region)
     {
-    double scattering = SpectrumRoutines::Luminance(m_volume_regions[i]->Scattering(i_point));
+    double scattering = SpectrumRoutines::Luminance(i_region.Scattering(i_point));
     sum_weights += scattering;
-    ret += scattering * m_volume_regions[i]->Phase(i_point, i_incoming, i_outgoing);
-    }
+    ret += scattering * i_region.Phase(i_point, i_incoming, i_outgoing);
+    });
 
   if (sum_weights > 0.0)
     return ret / sum_weights;
@@ -106,12 +275,100 @@ double AggregateVolumeRegion::Phase(const Point3D_d &i_point, const Vector3D_d &
     return 0.0;
   }
 
+double AggregateVolumeRegion::SamplePhase(const Point3D_d &i_point, const Vector3D_d &i_incoming, const Point2D_d &i_sample, Vector3D_d &o_outgoing) const
+  {
+  double sum_weights = 0.0;
+  _ForEachRegion(i_point, [&](const VolumeRegion &i_region)
+    {
+    sum_weights += SpectrumRoutines::Luminance(i_region.Scattering(i_point));
+    });
+
+  if (sum_weights <= 0.0)
+    return VolumeRegion::SamplePhase(i_point, i_incoming, i_sample, o_outgoing);
+
+  // Choose the volume region and remap the sample to [0;1) range so that it can be reused for sampling the region's phase function.
+  const VolumeRegion *p_sampled_region = NULL;
+  double sample = i_sample[0]*sum_weights, cumulative_weight = 0.0, sampled_weight = 0.0;
+  _ForEachRegion(i_point, [&](const VolumeRegion &i_region)
+    {
+    double weight = SpectrumRoutines::Luminance(i_region.Scattering(i_point));
+    if (p_sampled_region == NULL && weight > 0.0 && (sample < cumulative_weight+weight || cumulative_weight+weight >= sum_weights))
+      {
+      p_sampled_region = &i_region;
+      sampled_weight = weight;
+      }
+    else if (p_sampled_region == NULL)
+      cumulative_weight += weight;
+    });
+  ASSERT(p_sampled_region);
+
+  double remapped_sample = std::min((sample-cumulative_weight)/sampled_weight, 1.0-DBL_EPS);
+  p_sampled_region->SamplePhase(i_point, i_incoming, Point2D_d(std::max(0.0, remapped_sample), i_sample[1]), o_outgoing);
+
+  return PhasePDF(i_point, i_incoming, o_outgoing);
+  }
+
+double AggregateVolumeRegion::PhasePDF(const Point3D_d &i_point, const Vector3D_d &i_incoming, const Vector3D_d &i_outgoing) const
+  {
+  double ret = 0.0, sum_weights = 0.0;
+
+  _ForEachRegion(i_point, [&](const VolumeRegion &i_region)
+    {
+    double scattering = SpectrumRoutines::Luminance(i_region.Scattering(i_point));
+    sum_weights += scattering;
+    ret += scattering * i_region.PhasePDF(i_point, i_incoming, i_outgoing);
+    });
+
+  if (sum_weights > 0.0)
+    return ret / sum_weights;
+  else
+    return VolumeRegion::PhasePDF(i_point, i_incoming, i_outgoing);
+  }
+
 SpectrumCoef_d AggregateVolumeRegion::OpticalThickness(const Ray &i_ray, double i_step, double i_offset_sample) const
   {
   SpectrumCoef_d ret;
 
-  for (size_t i=0;i<m_volume_regions.size();++i)
-    ret += m_volume_regions[i]->OpticalThickness(i_ray, i_step, i_offset_sample);
+  _ForEachRegion(i_ray, [&](const VolumeRegion &i_region) -> bool
+    {
+    ret += i_region.OpticalThickness(i_ray, i_step, i_offset_sample);
+    return true;
+    });
+
+  return ret;
+  }
+
+SpectrumCoef_d AggregateVolumeRegion::Transmittance(const Ray &i_ray, double i_step, RandomGenerator<double> &io_random_generator) const
+  {
+  SpectrumCoef_d ret(1.0);
+
+  _ForEachRegion(i_ray, [&](const VolumeRegion &i_region) -> bool
+    {
+    ret *= i_region.Transmittance(i_ray, i_step, io_random_generator);
+    return ret.IsBlack() == false;
+    });
 
   return ret;
   }
+
+double AggregateVolumeRegion::SkipEmptySpace(const Ray &i_ray, double i_t_begin, double i_t_end) const
+  {
+  double t_non_empty = i_t_end;
+
+  _ForEachRegion(i_ray, [&](const VolumeRegion &i_region) -> bool
+    {
+    double t_begin, t_end;
+    if (i_region.Intersect(i_ray, &t_begin, &t_end))
+      {
+      t_begin = std::max(t_begin, i_t_begin);
+      t_end = std::min(t_end, t_non_empty);
+      if (t_begin < t_end)
+        t_non_empty = std::min(t_non_empty, i_region.SkipEmptySpace(i_ray, t_begin, t_end));
+      }
+
+    // Nothing can be skipped if the segment begins in a non-empty region.
+    return t_non_empty > i_t_begin;
+    });
+
+  return t_non_empty;
+  }
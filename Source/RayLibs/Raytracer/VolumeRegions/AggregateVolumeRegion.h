@@ -24,7 +24,8 @@
 /**
 * Implementation of the VolumeRegion that acts as a container for other volume regions.
 * The class is used by Scene to represent all volume regions as a single object to make calls to.
-* Current implementation stores all underlying volume regions in a vector and has linear complexity (with respect to the number of regions) for most of the methods.
+* The class builds a bounding volume hierarchy over the bounding boxes of the underlying volume regions so that the point queries only visit the regions
+* containing the point and the ray queries only visit the regions whose bounding boxes are intersected by the ray.
 */
 class AggregateVolumeRegion: public VolumeRegion
   {
@@ -48,6 +49,14 @@ class AggregateVolumeRegion: public VolumeRegion
     */
     bool Intersect(const Ray &i_ray, double *op_t_begin, double *op_t_end) const;
 
+    /**
+    * Computes the intervals of the ray that overlap the underlying volume regions.
+    * The intervals of different volume regions that overlap each other are merged, so the resulting intervals are disjoint.
+    * @param i_ray Input ray. Direction component should be normalized.
+    * @param[out] o_intervals Begin and end parametric coordinates of the intervals sorted by the parametric coordinate. The vector is cleared first.
+    */
+    void GetIntervals(const Ray &i_ray, std::vector<std::pair<double,double>> &o_intervals) const;
+
     /**
     * Returns aggregated emission density of the volume region at the specified point.
     * The aggregated value is a sum of corresponding values of the underlying volume regions.
@@ -84,6 +93,19 @@ class AggregateVolumeRegion: public VolumeRegion
     */
     double Phase(const Point3D_d &i_point, const Vector3D_d &i_incoming, const Vector3D_d &i_outgoing) const;
 
+    /**
+    * Samples outgoing direction for the specified incoming direction.
+    * One of the underlying volume regions is chosen with the probability proportional to its scattering luminance and its phase function is sampled.
+    * The returned PDF is the PDF of the whole mixture, i.e. the weighted sum of the PDFs of the underlying volume regions.
+    * If the scattering is zero at the point the sphere is sampled uniformly.
+    */
+    double SamplePhase(const Point3D_d &i_point, const Vector3D_d &i_incoming, const Point2D_d &i_sample, Vector3D_d &o_outgoing) const;
+
+    /**
+    * Returns PDF of sampling the specified outgoing direction by the SamplePhase() method.
+    */
+    double PhasePDF(const Point3D_d &i_point, const Vector3D_d &i_incoming, const Vector3D_d &i_outgoing) const;
+
     /**
     * Returns aggregated optical thickness of the volume region for the specified ray.
     * The method also takes two additional parameters for MonteCarlo integration.
@@ -95,8 +117,76 @@ class AggregateVolumeRegion: public VolumeRegion
     */
     SpectrumCoef_d OpticalThickness(const Ray &i_ray, double i_step, double i_offset_sample) const;
 
+    /**
+    * Returns aggregated transmittance of the volume region for the specified ray.
+    * The aggregated value is a product of the transmittances of the underlying volume regions.
+    * @param i_ray Ray for which the transmittance is to be computed. Ray direction should be normalized.
+    * @param i_step Step size for the MonteCarlo integration. Should be greater than 0.0
+    * @param io_random_generator Random generator used for MonteCarlo integration.
+    * @return Transmittance. Each component is in [0;1] range.
+    */
+    SpectrumCoef_d Transmittance(const Ray &i_ray, double i_step, RandomGenerator<double> &io_random_generator) const;
+
+    /**
+    * Returns the parametric coordinate of the first point of the ray segment where the media can be non-empty.
+    * The value is the minimum of the values returned by the underlying volume regions for the parts of the segment inside their bounding boxes.
+    * @param i_ray Input ray. Direction component should be normalized.
+    * @param i_t_begin Parametric coordinate of the begin of the segment.
+    * @param i_t_end Parametric coordinate of the end of the segment.
+    * @return Parametric coordinate in [i_t_begin;i_t_end] range. Equals i_t_end if the whole segment is empty.
+    */
+    double SkipEmptySpace(const Ray &i_ray, double i_t_begin, double i_t_end) const;
+
+  private:
+    /**
+    * Node of the bounding volume hierarchy.
+    * The nodes are stored in the depth-first order, so the first child of an internal node immediately follows the node.
+    */
+    struct Node
+      {
+      BBox3D_d m_bounds;
+
+      // Index of the second child. Only used for the internal nodes.
+      size_t m_second_child;
+
+      // Range of the volume regions of the leaf node. Empty for the internal nodes.
+      size_t m_regions_begin, m_regions_end;
+      };
+
   private:
+    /**
+    * Private method that recursively builds the hierarchy for the specified range of the volume regions and returns index of the created node.
+    * The volume regions are split by the median of their bounding box centers along the axis with the largest extent.
+    */
+    size_t _Build(std::vector<size_t> &io_indices, size_t i_begin, size_t i_end);
+
+    /**
+    * Private method that calls the specified function for each volume region whose bounding box contains the point.
+    */
+    template<typename Function>
+    void _ForEachRegion(const Point3D_d &i_point, Function i_function) const;
+
+    /**
+    * Private method that calls the specified function for each volume region whose bounding box may be intersected by the ray.
+    * The traversal stops if the function returns false.
+    */
+    template<typename Function>
+    void _ForEachRegion(const Ray &i_ray, Function i_function) const;
+
+  private:
+    // Maximum number of volume regions in a leaf node.
+    static const size_t MAX_LEAF_REGIONS = 2;
+
+    // Maximum depth of the hierarchy. Since the volume regions are split by the median the depth can not exceed the number of bits in size_t.
+    static const size_t MAX_TREE_DEPTH = 64;
+
+    /**
+    * Volume regions and their bounding boxes ordered so that each leaf node references a contiguous range.
+    */
     std::vector<intrusive_ptr<const VolumeRegion>> m_volume_regions;
+    std::vector<BBox3D_d> m_region_bounds;
+
+    std::vector<Node> m_nodes;
 
     BBox3D_d m_bounds;
   };
@@ -0,0 +1,211 @@
+/*
+* Copyright (C) 2014 by Volodymyr Kachurovskyi <Volodymyr.Kachurovskyi@gmail.com>
+*
+* This file is part of Skwarka.
+*
+* Skwarka is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+*
+* Skwarka is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License along with Skwarka.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "DensityGrid.h"
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <stdexcept>
+
+namespace
+  {
+  const char DENSITY_GRID_FILE_MAGIC[8] = {'S','K','W','V','O','L','U','M'};
+  const unsigned int DENSITY_GRID_FILE_VERSION = 1;
+
+  template<typename T>
+  T _Read(std::istream &io_stream)
+    {
+    T value = T();
+    io_stream.read(reinterpret_cast<char *>(&value), sizeof(T));
+    return value;
+    }
+
+  /**
+  * Returns number of bytes from the current position to the end of the stream.
+  */
+  unsigned long long _GetRemainingSize(std::istream &io_stream)
+    {
+    std::streampos position = io_stream.tellg();
+    io_stream.seekg(0, std::ios::end);
+    std::streampos end = io_stream.tellg();
+    io_stream.seekg(position);
+
+    if (position == std::streampos(-1) || end == std::streampos(-1) || end < position)
+      return 0;
+    return (unsigned long long)(end-position);
+    }
+
+  template<typename T>
+  void _Write(std::ostream &io_stream, T i_value)
+    {
+    io_stream.write(reinterpret_cast<const char *>(&i_value), sizeof(T));
+    }
+  }
+
+DensityGrid::DensityGrid(const std::vector<std::vector<std::vector<float>>> &i_densities)
+  {
+  ASSERT(i_densities.empty()==false && i_densities[0].empty()==false && i_densities[0][0].empty() == false);
+  _Initialize(i_densities.size(), i_densities[0].size(), i_densities[0][0].size());
+
+  // Check that all internal vectors have the same size.
+  for(size_t i=0;i<i_densities.size();++i)
+    {
+    ASSERT(i_densities[i].size() == i_densities[0].size());
+    for(size_t j=0;j<i_densities[i].size();++j)
+      {
+      ASSERT(i_densities[i][j].size() == i_densities[0][0].size());
+      for(size_t k=0;k<i_densities[i][j].size();++k)
+        ASSERT(i_densities[i][j][k]>=0.0);
+      }
+    }
+
+  std::vector<float> slab;
+  for(size_t bz=0;bz<m_bricks_z;++bz)
+    {
+    size_t z_begin = bz*BRICK_SIZE, z_end = std::min(z_begin+BRICK_SIZE, m_size_z);
+
+    slab.resize(m_size_x*m_size_y*(z_end-z_begin));
+    size_t index = 0;
+    for(size_t z=z_begin;z<z_end;++z)
+      for(size_t y=0;y<m_size_y;++y)
+        for(size_t x=0;x<m_size_x;++x)
+          slab[index++] = i_densities[x][y][z];
+
+    _AddSlab(bz, slab);
+    }
+  }
+
+DensityGrid::DensityGrid(const std::string &i_filename)
+  {
+  std::ifstream stream(i_filename.c_str(), std::ios::binary);
+  if (stream.good() == false)
+    throw std::runtime_error("Could not open volume file: " + i_filename);
+
+  char magic[sizeof(DENSITY_GRID_FILE_MAGIC)];
+  stream.read(magic, sizeof(magic));
+  if (stream.good() == false || memcmp(magic, DENSITY_GRID_FILE_MAGIC, sizeof(magic)) != 0)
+    throw std::runtime_error("Not a volume file: " + i_filename);
+
+  if (_Read<unsigned int>(stream) != DENSITY_GRID_FILE_VERSION)
+    throw std::runtime_error("Unsupported volume file version: " + i_filename);
+  _Read<unsigned int>(stream);
+
+  unsigned long long size_x = _Read<unsigned long long>(stream);
+  unsigned long long size_y = _Read<unsigned long long>(stream);
+  unsigned long long size_z = _Read<unsigned long long>(stream);
+  if (stream.good() == false || size_x == 0 || size_y == 0 || size_z == 0)
+    throw std::runtime_error("Invalid volume file header: " + i_filename);
+
+  // The sizes come from the file so they are checked against the amount of the data actually present in the file before anything is allocated.
+  // The number of cells should also fit into size_t, this guarantees that the sizes of the bricks table and slabs computed by _Initialize() do not overflow.
+  const unsigned long long max_cells_num = (unsigned long long)std::numeric_limits<size_t>::max() / sizeof(float);
+  if (size_x > max_cells_num/size_y || size_x*size_y > max_cells_num/size_z)
+    throw std::runtime_error("Invalid volume file header: " + i_filename);
+
+  if (size_x*size_y*size_z*sizeof(float) > _GetRemainingSize(stream))
+    throw std::runtime_error("Unexpected end of volume file: " + i_filename);
+
+  _Initialize((size_t)size_x, (size_t)size_y, (size_t)size_z);
+
+  std::vector<float> slab;
+  for(size_t bz=0;bz<m_bricks_z;++bz)
+    {
+    size_t z_begin = bz*BRICK_SIZE, z_end = std::min(z_begin+BRICK_SIZE, m_size_z);
+
+    slab.resize(m_size_x*m_size_y*(z_end-z_begin));
+    stream.read(reinterpret_cast<char *>(&slab[0]), slab.size()*sizeof(float));
+    if (stream.good() == false)
+      throw std::runtime_error("Unexpected end of volume file: " + i_filename);
+
+    for(size_t i=0;i<slab.size();++i)
+      if ((slab[i] >= 0.f) == false)
+        throw std::runtime_error("Negative or invalid density value in volume file: " + i_filename);
+
+    _AddSlab(bz, slab);
+    }
+  }
+
+void DensityGrid::_Initialize(size_t i_size_x, size_t i_size_y, size_t i_size_z)
+  {
+  m_size_x = i_size_x;
+  m_size_y = i_size_y;
+  m_size_z = i_size_z;
+
+  m_bricks_x = (m_size_x+BRICK_SIZE-1)/BRICK_SIZE;
+  m_bricks_y = (m_size_y+BRICK_SIZE-1)/BRICK_SIZE;
+  m_bricks_z = (m_size_z+BRICK_SIZE-1)/BRICK_SIZE;
+
+  m_brick_offsets.assign(m_bricks_x*m_bricks_y*m_bricks_z, (size_t)CONSTANT_BRICK);
+  m_brick_values.assign(m_bricks_x*m_bricks_y*m_bricks_z, 0.f);
+  }
+
+void DensityGrid::_AddSlab(size_t i_brick_z, const std::vector<float> &i_slab)
+  {
+  size_t z_begin = i_brick_z*BRICK_SIZE, slab_size_z = std::min(m_size_z-z_begin, (size_t)BRICK_SIZE);
+  ASSERT(i_slab.size() == m_size_x*m_size_y*slab_size_z);
+
+  float brick[BRICK_CELLS_NUM];
+  for(size_t bx=0;bx<m_bricks_x;++bx)
+    for(size_t by=0;by<m_bricks_y;++by)
+      {
+      // The cells of the border bricks that are outside of the grid are filled with the values of the nearest cells inside the grid.
+      // They are never accessed but this way they do not prevent the brick from being detected as a constant one.
+      size_t index = 0;
+      for(size_t x=0;x<BRICK_SIZE;++x)
+        for(size_t y=0;y<BRICK_SIZE;++y)
+          for(size_t z=0;z<BRICK_SIZE;++z)
+            {
+            size_t slab_x = std::min(bx*BRICK_SIZE+x, m_size_x-1);
+            size_t slab_y = std::min(by*BRICK_SIZE+y, m_size_y-1);
+            size_t slab_z = std::min(z, slab_size_z-1);
+            brick[index++] = i_slab[(slab_z*m_size_y + slab_y)*m_size_x + slab_x];
+            }
+
+      size_t brick_index = (bx*m_bricks_y + by)*m_bricks_z + i_brick_z;
+      if (std::count(brick, brick+BRICK_CELLS_NUM, brick[0]) == BRICK_CELLS_NUM)
+        m_brick_values[brick_index] = brick[0];
+      else
+        {
+        m_brick_offsets[brick_index] = m_values.size();
+        m_values.insert(m_values.end(), brick, brick+BRICK_CELLS_NUM);
+        }
+      }
+  }
+
+void DensityGrid::Save(const std::string &i_filename) const
+  {
+  std::ofstream stream(i_filename.c_str(), std::ios::binary);
+  if (stream.good() == false)
+    throw std::runtime_error("Could not create volume file: " + i_filename);
+
+  stream.write(DENSITY_GRID_FILE_MAGIC, sizeof(DENSITY_GRID_FILE_MAGIC));
+  _Write<unsigned int>(stream, DENSITY_GRID_FILE_VERSION);
+  _Write<unsigned int>(stream, 0);
+  _Write<unsigned long long>(stream, m_size_x);
+  _Write<unsigned long long>(stream, m_size_y);
+  _Write<unsigned long long>(stream, m_size_z);
+
+  std::vector<float> row(m_size_x);
+  for(size_t z=0;z<m_size_z;++z)
+    for(size_t y=0;y<m_size_y;++y)
+      {
+      for(size_t x=0;x<m_size_x;++x)
+        row[x] = Get(x,y,z);
+      stream.write(reinterpret_cast<const char *>(&row[0]), row.size()*sizeof(float));
+      }
+
+  if (stream.good() == false)
+    throw std::runtime_error("Could not write volume file: " + i_filename);
+  }
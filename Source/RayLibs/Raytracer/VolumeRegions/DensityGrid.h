@@ -0,0 +1,170 @@
+/*
+* Copyright (C) 2014 by Volodymyr Kachurovskyi <Volodymyr.Kachurovskyi@gmail.com>
+*
+* This file is part of Skwarka.
+*
+* Skwarka is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+*
+* Skwarka is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License along with Skwarka.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef DENSITY_GRID_H
+#define DENSITY_GRID_H
+
+#include <Common/Common.h>
+#include <string>
+#include <vector>
+
+/**
+* Sparse regular 3D grid of density values.
+* The grid is split into cubic bricks of BRICK_SIZE^3 cells. The bricks with the same value in all cells (e.g. empty space) are stored as a single value,
+* the values of the other bricks are stored in a single contiguous array brick by brick so that the neighboring cells are close in memory.
+* The grid can be created from the 3D array of values or loaded from a binary volume file. The file can be written by the Save() method.
+* The binary volume file starts with a header (magic, version, sizes of the grid) followed by the raw float values with x index changing fastest.
+* The values are stored in the native format of the platform so the files are not portable between platforms with different endianness.
+* @sa GridDensityVolumeRegion
+*/
+class DensityGrid: public ReferenceCounted
+  {
+  public:
+    /**
+    * Creates DensityGrid instance from the 3D array of values.
+    * @param i_densities 3D array of values indexed by x, y and z coordinates. All internal vectors should have the same size. The values should be non-negative.
+    */
+    DensityGrid(const std::vector<std::vector<std::vector<float>>> &i_densities);
+
+    /**
+    * Loads DensityGrid instance from the binary volume file.
+    * The file is read slab by slab so the dense grid is never stored in memory at once.
+    * Throws std::runtime_error if the file can not be read or is not a valid volume file, e.g. if the file is shorter than the grid sizes in its header imply.
+    */
+    DensityGrid(const std::string &i_filename);
+
+    size_t GetSizeX() const;
+    size_t GetSizeY() const;
+    size_t GetSizeZ() const;
+
+    /**
+    * Returns value of the specified cell.
+    */
+    float Get(size_t i_x, size_t i_y, size_t i_z) const;
+
+    /**
+    * Returns true if all cells of the specified brick have the same value and returns the value.
+    * @param i_brick_x X index of the brick. Should be less than (GetSizeX()+BRICK_SIZE-1)/BRICK_SIZE.
+    * @param i_brick_y Y index of the brick. Should be less than (GetSizeY()+BRICK_SIZE-1)/BRICK_SIZE.
+    * @param i_brick_z Z index of the brick. Should be less than (GetSizeZ()+BRICK_SIZE-1)/BRICK_SIZE.
+    * @param[out] o_value Value of the brick's cells. Only set if the method returns true.
+    */
+    bool IsConstantBrick(size_t i_brick_x, size_t i_brick_y, size_t i_brick_z, float &o_value) const;
+
+    /**
+    * Returns number of the bricks with varying values, i.e. the bricks that are stored cell by cell.
+    */
+    size_t GetStoredBricksNumber() const;
+
+    /**
+    * Writes the grid to the binary volume file.
+    * Throws std::runtime_error if the file can not be written.
+    */
+    void Save(const std::string &i_filename) const;
+
+  public:
+    // Size of the bricks in cells along each axis.
+    static const size_t BRICK_SIZE = 8;
+
+  private:
+    // Not implemented, not a value type.
+    DensityGrid(const DensityGrid&);
+    DensityGrid &operator=(const DensityGrid&);
+
+  private:
+    /**
+    * Private method that sets the sizes of the grid and allocates the bricks table.
+    */
+    void _Initialize(size_t i_size_x, size_t i_size_y, size_t i_size_z);
+
+    /**
+    * Private method that creates the bricks for the specified slab of the grid.
+    * @param i_brick_z Z index of the bricks.
+    * @param i_slab Values of the cells with z coordinate in [i_brick_z*BRICK_SIZE; (i_brick_z+1)*BRICK_SIZE) range (clamped to the grid size), x index changing fastest.
+    */
+    void _AddSlab(size_t i_brick_z, const std::vector<float> &i_slab);
+
+  private:
+    static const size_t BRICK_CELLS_NUM = BRICK_SIZE*BRICK_SIZE*BRICK_SIZE;
+
+    // Value of m_brick_offsets entry for the bricks with constant value.
+    static const size_t CONSTANT_BRICK = (size_t)-1;
+
+    size_t m_size_x, m_size_y, m_size_z;
+    size_t m_bricks_x, m_bricks_y, m_bricks_z;
+
+    /**
+    * Offsets of the bricks' values in m_values array or CONSTANT_BRICK for the bricks with constant value. Stored with z index changing fastest.
+    */
+    std::vector<size_t> m_brick_offsets;
+
+    /**
+    * Values of the constant bricks. Stored with z index changing fastest.
+    */
+    std::vector<float> m_brick_values;
+
+    /**
+    * Values of the bricks with varying values. The values of each brick are stored with z index changing fastest.
+    */
+    std::vector<float> m_values;
+  };
+
+/////////////////////////////////////////// IMPLEMENTATION ////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+inline size_t DensityGrid::GetSizeX() const
+  {
+  return m_size_x;
+  }
+
+inline size_t DensityGrid::GetSizeY() const
+  {
+  return m_size_y;
+  }
+
+inline size_t DensityGrid::GetSizeZ() const
+  {
+  return m_size_z;
+  }
+
+inline float DensityGrid::Get(size_t i_x, size_t i_y, size_t i_z) const
+  {
+  ASSERT(i_x<m_size_x && i_y<m_size_y && i_z<m_size_z);
+
+  size_t brick_index = ((i_x/BRICK_SIZE)*m_bricks_y + i_y/BRICK_SIZE)*m_bricks_z + i_z/BRICK_SIZE;
+  size_t offset = m_brick_offsets[brick_index];
+  if (offset == CONSTANT_BRICK)
+    return m_brick_values[brick_index];
+
+  return m_values[offset + ((i_x%BRICK_SIZE)*BRICK_SIZE + i_y%BRICK_SIZE)*BRICK_SIZE + i_z%BRICK_SIZE];
+  }
+
+inline bool DensityGrid::IsConstantBrick(size_t i_brick_x, size_t i_brick_y, size_t i_brick_z, float &o_value) const
+  {
+  ASSERT(i_brick_x<m_bricks_x && i_brick_y<m_bricks_y && i_brick_z<m_bricks_z);
+
+  size_t brick_index = (i_brick_x*m_bricks_y + i_brick_y)*m_bricks_z + i_brick_z;
+  if (m_brick_offsets[brick_index] != CONSTANT_BRICK)
+    return false;
+
+  o_value = m_brick_values[brick_index];
+  return true;
+  }
+
+inline size_t DensityGrid::GetStoredBricksNumber() const
+  {
+  return m_values.size() / BRICK_CELLS_NUM;
+  }
+
+#endif // DENSITY_GRID_H
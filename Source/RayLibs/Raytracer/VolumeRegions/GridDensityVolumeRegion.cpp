@@ -17,25 +17,26 @@
 
 GridDensityVolumeRegion::GridDensityVolumeRegion(const BBox3D_d &i_bounds, Spectrum_d &i_base_emission, SpectrumCoef_d &i_base_absorption, SpectrumCoef_d &i_base_scattering,
                                                  intrusive_ptr<const PhaseFunction> ip_phase_function, const std::vector<std::vector<std::vector<float>>> &i_densities):
-DensityVolumeRegion(i_bounds, i_base_emission, i_base_absorption, i_base_scattering, ip_phase_function), m_bounds(i_bounds), m_densities(i_densities)
+DensityVolumeRegion(i_bounds, i_base_emission, i_base_absorption, i_base_scattering, ip_phase_function), m_bounds(i_bounds), mp_densities(new DensityGrid(i_densities)),
+m_base_attenuation(i_base_absorption+i_base_scattering)
   {
-  ASSERT(i_densities.empty()==false && i_densities[0].empty()==false && i_densities[0][0].empty() == false);
+  _Initialize();
+  }
 
-  m_size_x=i_densities.size();
-  m_size_y=i_densities[0].size();
-  m_size_z=i_densities[0][0].size();
+GridDensityVolumeRegion::GridDensityVolumeRegion(const BBox3D_d &i_bounds, Spectrum_d &i_base_emission, SpectrumCoef_d &i_base_absorption, SpectrumCoef_d &i_base_scattering,
+                                                 intrusive_ptr<const PhaseFunction> ip_phase_function, intrusive_ptr<const DensityGrid> ip_densities):
+DensityVolumeRegion(i_bounds, i_base_emission, i_base_absorption, i_base_scattering, ip_phase_function), m_bounds(i_bounds), mp_densities(ip_densities),
+m_base_attenuation(i_base_absorption+i_base_scattering)
+  {
+  ASSERT(ip_densities);
+  _Initialize();
+  }
 
-  // Check that all internal vectors have the same size.
-  for(size_t i=0;i<i_densities.size();++i)
-    {
-    ASSERT(i_densities[i].size() == i_densities[0].size());
-    for(size_t j=0;j<i_densities[i].size();++j)
-      {
-      ASSERT(i_densities[i][j].size() == i_densities[0][0].size());
-      for(size_t k=0;k<i_densities[i][j].size();++k)
-        ASSERT(i_densities[i][j][k]>=0.0);
-      }
-    }
+void GridDensityVolumeRegion::_Initialize()
+  {
+  m_size_x=mp_densities->GetSizeX();
+  m_size_y=mp_densities->GetSizeY();
+  m_size_z=mp_densities->GetSizeZ();
 
   ASSERT(m_bounds.Volume() > 0.0);
   if (m_bounds.m_min[0] > m_bounds.m_max[0]) std::swap(m_bounds.m_min[0], m_bounds.m_max[0]);
@@ -45,6 +46,275 @@ DensityVolumeRegion(i_bounds, i_base_emission, i_base_absorption, i_base_scatter
   m_inv_extent_x = 1.0/fabs(m_bounds.m_max[0]-m_bounds.m_min[0]);
   m_inv_extent_y = 1.0/fabs(m_bounds.m_max[1]-m_bounds.m_min[1]);
   m_inv_extent_z = 1.0/fabs(m_bounds.m_max[2]-m_bounds.m_min[2]);
+
+  m_max_base_attenuation = std::max(std::max(m_base_attenuation[0], m_base_attenuation[1]), m_base_attenuation[2]);
+  _InitializeMajorants();
+  }
+
+void GridDensityVolumeRegion::_InitializeMajorants()
+  {
+  m_majorants_size_x = (m_size_x+MAJORANT_BLOCK_SIZE-1)/MAJORANT_BLOCK_SIZE;
+  m_majorants_size_y = (m_size_y+MAJORANT_BLOCK_SIZE-1)/MAJORANT_BLOCK_SIZE;
+  m_majorants_size_z = (m_size_z+MAJORANT_BLOCK_SIZE-1)/MAJORANT_BLOCK_SIZE;
+
+  m_min_densities.resize(m_majorants_size_x*m_majorants_size_y*m_majorants_size_z);
+  m_max_densities.resize(m_majorants_size_x*m_majorants_size_y*m_majorants_size_z);
+
+  for(size_t bx=0;bx<m_majorants_size_x;++bx)
+    for(size_t by=0;by<m_majorants_size_y;++by)
+      for(size_t bz=0;bz<m_majorants_size_z;++bz)
+        {
+        // The density inside the block is interpolated from the values of the block's cells and their immediate neighbors.
+        // The blocks coincide with the bricks of the density grid so if the block's brick and all the neighboring bricks are constant the range is known right away.
+        float min_density = FLT_INF, max_density = 0.f;
+        bool constant_bricks = true;
+        for(size_t x=(bx>0 ? bx-1 : 0);x<=std::min(bx+1, m_majorants_size_x-1) && constant_bricks;++x)
+          for(size_t y=(by>0 ? by-1 : 0);y<=std::min(by+1, m_majorants_size_y-1) && constant_bricks;++y)
+            for(size_t z=(bz>0 ? bz-1 : 0);z<=std::min(bz+1, m_majorants_size_z-1) && constant_bricks;++z)
+              {
+              float value = 0.f;
+              if (mp_densities->IsConstantBrick(x, y, z, value) == false)
+                {
+                constant_bricks = false;
+                break;
+                }
+
+              min_density = std::min(min_density, value);
+              max_density = std::max(max_density, value);
+              }
+
+        size_t index = (bx*m_majorants_size_y + by)*m_majorants_size_z + bz;
+        if (constant_bricks)
+          {
+          m_min_densities[index] = min_density;
+          m_max_densities[index] = max_density;
+          continue;
+          }
+
+        size_t x_begin = bx*MAJORANT_BLOCK_SIZE>0 ? bx*MAJORANT_BLOCK_SIZE-1 : 0, x_end = std::min((bx+1)*MAJORANT_BLOCK_SIZE, m_size_x-1);
+        size_t y_begin = by*MAJORANT_BLOCK_SIZE>0 ? by*MAJORANT_BLOCK_SIZE-1 : 0, y_end = std::min((by+1)*MAJORANT_BLOCK_SIZE, m_size_y-1);
+        size_t z_begin = bz*MAJORANT_BLOCK_SIZE>0 ? bz*MAJORANT_BLOCK_SIZE-1 : 0, z_end = std::min((bz+1)*MAJORANT_BLOCK_SIZE, m_size_z-1);
+
+        min_density = FLT_INF;
+        max_density = 0.f;
+        for(size_t x=x_begin;x<=x_end;++x)
+          for(size_t y=y_begin;y<=y_end;++y)
+            for(size_t z=z_begin;z<=z_end;++z)
+              {
+              float density = mp_densities->Get(x,y,z);
+              min_density = std::min(min_density, density);
+              max_density = std::max(max_density, density);
+              }
+
+        m_min_densities[index] = min_density;
+        m_max_densities[index] = max_density;
+        }
+  }
+
+template<typename Callback>
+void GridDensityVolumeRegion::_TraverseMajorants(const Ray &i_ray, double i_t_begin, double i_t_end, Callback &io_callback) const
+  {
+  const size_t sizes[3] = {m_size_x, m_size_y, m_size_z};
+  const size_t majorants_sizes[3] = {m_majorants_size_x, m_majorants_size_y, m_majorants_size_z};
+  const double inv_extents[3] = {m_inv_extent_x, m_inv_extent_y, m_inv_extent_z};
+
+  // Set up the 3D DDA traversal in the coarse grid space where each block has unit size.
+  int block[3], step[3];
+  double next_t[3], delta_t[3];
+  Point3D_d begin = i_ray(i_t_begin);
+  for(unsigned char i=0;i<3;++i)
+    {
+    double scale = sizes[i]*inv_extents[i]/MAJORANT_BLOCK_SIZE;
+    double origin = (begin[i]-m_bounds.m_min[i])*scale, direction = i_ray.m_direction[i]*scale;
+
+    block[i] = MathRoutines::Clamp((int)floor(origin), 0, (int)majorants_sizes[i]-1);
+    if (direction > 0.0)
+      {
+      step[i] = 1;
+      next_t[i] = i_t_begin + (block[i]+1-origin)/direction;
+      delta_t[i] = 1.0/direction;
+      }
+    else if (direction < 0.0)
+      {
+      step[i] = -1;
+      next_t[i] = i_t_begin + (block[i]-origin)/direction;
+      delta_t[i] = -1.0/direction;
+      }
+    else
+      {
+      step[i] = 0;
+      next_t[i] = DBL_INF;
+      delta_t[i] = DBL_INF;
+      }
+    }
+
+  double t = i_t_begin;
+  while (t < i_t_end)
+    {
+    unsigned char axis = next_t[0]<next_t[1] ? (next_t[0]<next_t[2] ? 0 : 2) : (next_t[1]<next_t[2] ? 1 : 2);
+    double t_next = std::max(t, std::min(next_t[axis], i_t_end));
+
+    size_t index = (block[0]*m_majorants_size_y + block[1])*m_majorants_size_z + block[2];
+    if (t_next > t && io_callback(t, t_next, m_min_densities[index], m_max_densities[index]) == false)
+      return;
+
+    t = t_next;
+    block[axis] += step[axis];
+    if (block[axis] < 0 || block[axis] >= (int)majorants_sizes[axis])
+      return;
+    next_t[axis] += delta_t[axis];
+    }
+  }
+
+SpectrumCoef_d GridDensityVolumeRegion::OpticalThickness(const Ray &i_ray, double i_step, double i_offset_sample) const
+  {
+  ASSERT(i_ray.m_direction.IsNormalized());
+  ASSERT(i_step > 0.0 && i_offset_sample >= 0.0 && i_offset_sample < 1.0);
+
+  double t_begin, t_end;
+  if (Intersect(i_ray, &t_begin, &t_end)==false)
+    return SpectrumCoef_d(0.0);
+
+  double optical_thickness = 0.0;
+  auto integrate = [&](double i_t_begin, double i_t_end, float i_min_density, float i_max_density) -> bool
+    {
+    // Empty blocks are skipped and the blocks with constant density are integrated analytically.
+    if (i_max_density == 0.f)
+      return true;
+
+    if (i_min_density == i_max_density)
+      {
+      optical_thickness += i_max_density * (i_t_end-i_t_begin);
+      return true;
+      }
+
+    double t = i_t_begin, step = i_step;
+    while (t<i_t_end-DBL_EPS)
+      {
+      step = std::min(step, i_t_end-t);
+      optical_thickness += _Density( i_ray(t+i_offset_sample * step) ) * step;
+      t += step;
+      }
+
+    return true;
+    };
+
+  _TraverseMajorants(i_ray, t_begin, t_end, integrate);
+  return optical_thickness * m_base_attenuation;
+  }
+
+SpectrumCoef_d GridDensityVolumeRegion::Transmittance(const Ray &i_ray, double i_step, RandomGenerator<double> &io_random_generator) const
+  {
+  ASSERT(i_ray.m_direction.IsNormalized());
+
+  double t_begin, t_end;
+  if (m_max_base_attenuation <= 0.0 || Intersect(i_ray, &t_begin, &t_end)==false)
+    return SpectrumCoef_d(1.0);
+
+  SpectrumCoef_d transmittance(1.0);
+  auto track = [&](double i_t_begin, double i_t_end, float i_min_density, float i_max_density) -> bool
+    {
+    if (i_max_density == 0.f)
+      return true;
+
+    if (i_min_density == i_max_density)
+      {
+      transmittance *= Exp((-i_max_density * (i_t_end-i_t_begin)) * m_base_attenuation);
+      return true;
+      }
+
+    // Sample the tentative collisions with the block's majorant and weight the transmittance by the probability of the null collision at each of them.
+    double majorant = i_max_density * m_max_base_attenuation;
+    double t = i_t_begin;
+    while (true)
+      {
+      t -= log(1.0-io_random_generator(1.0)) / majorant;
+      if (t >= i_t_end)
+        return true;
+
+      double density = _Density(i_ray(t));
+      for(unsigned char i=0;i<3;++i)
+        transmittance[i] *= std::max(0.0, 1.0 - density*m_base_attenuation[i]/majorant);
+
+      // Russian roulette keeps the estimate unbiased while terminating the paths with low transmittance.
+      double max_transmittance = std::max(std::max(transmittance[0], transmittance[1]), transmittance[2]);
+      if (max_transmittance < 0.1)
+        {
+        if (io_random_generator(1.0) >= max_transmittance*10.0)
+          {
+          transmittance = SpectrumCoef_d(0.0);
+          return false;
+          }
+        transmittance /= max_transmittance*10.0;
+        }
+      }
+    };
+
+  _TraverseMajorants(i_ray, t_begin, t_end, track);
+  return transmittance;
+  }
+
+bool GridDensityVolumeRegion::SampleFreeFlight(const Ray &i_ray, RandomGenerator<double> &io_random_generator, double &o_t) const
+  {
+  ASSERT(i_ray.m_direction.IsNormalized());
+
+  double t_begin, t_end;
+  if (m_max_base_attenuation <= 0.0 || Intersect(i_ray, &t_begin, &t_end)==false)
+    return false;
+
+  bool collided = false;
+  auto track = [&](double i_t_begin, double i_t_end, float i_min_density, float i_max_density) -> bool
+    {
+    if (i_max_density == 0.f)
+      return true;
+
+    double majorant = i_max_density * m_max_base_attenuation;
+    double t = i_t_begin;
+    while (true)
+      {
+      t -= log(1.0-io_random_generator(1.0)) / majorant;
+      if (t >= i_t_end)
+        return true;
+
+      // The tentative collision is a real one with the probability equal to the ratio of the density to the block's maximum density.
+      if (i_min_density == i_max_density || io_random_generator(i_max_density) < _Density(i_ray(t)))
+        {
+        o_t = t;
+        collided = true;
+        return false;
+        }
+      }
+    };
+
+  _TraverseMajorants(i_ray, t_begin, t_end, track);
+  return collided;
+  }
+
+double GridDensityVolumeRegion::SkipEmptySpace(const Ray &i_ray, double i_t_begin, double i_t_end) const
+  {
+  ASSERT(i_ray.m_direction.IsNormalized());
+
+  double t_begin, t_end;
+  if (Intersect(i_ray, &t_begin, &t_end)==false)
+    return i_t_end;
+
+  t_begin = std::max(t_begin, i_t_begin);
+  t_end = std::min(t_end, i_t_end);
+  if (t_begin >= t_end)
+    return i_t_end;
+
+  double t_non_empty = i_t_end;
+  auto skip = [&](double i_block_begin, double i_block_end, float i_min_density, float i_max_density) -> bool
+    {
+    if (i_max_density == 0.f)
+      return true;
+
+    t_non_empty = i_block_begin;
+    return false;
+    };
+
+  _TraverseMajorants(i_ray, t_begin, t_end, skip);
+  return t_non_empty;
   }
 
 bool GridDensityVolumeRegion::Intersect(const Ray &i_ray, double *op_t_begin, double *op_t_end) const
@@ -71,10 +341,10 @@ double GridDensityVolumeRegion::_Density(const Point3D_d &i_point) const
   double dx = x - int_x, dy = y - int_y, dz = z - int_z;
 
   // Trilinearly interpolate density values to compute local density.
-  double d00 = MathRoutines::LinearInterpolate(dx, (double)m_densities[int_x][int_y][int_z], (double)m_densities[int_x1][int_y][int_z]);
-  double d10 = MathRoutines::LinearInterpolate(dx, (double)m_densities[int_x][int_y1][int_z], (double)m_densities[int_x1][int_y1][int_z]);
-  double d01 = MathRoutines::LinearInterpolate(dx, (double)m_densities[int_x][int_y][int_z1], (double)m_densities[int_x1][int_y][int_z1]);
-  double d11 = MathRoutines::LinearInterpolate(dx, (double)m_densities[int_x][int_y1][int_z1], (double)m_densities[int_x1][int_y1][int_z1]);
+  double d00 = MathRoutines::LinearInterpolate(dx, (double)mp_densities->Get(int_x,int_y,int_z), (double)mp_densities->Get(int_x1,int_y,int_z));
+  double d10 = MathRoutines::LinearInterpolate(dx, (double)mp_densities->Get(int_x,int_y1,int_z), (double)mp_densities->Get(int_x1,int_y1,int_z));
+  double d01 = MathRoutines::LinearInterpolate(dx, (double)mp_densities->Get(int_x,int_y,int_z1), (double)mp_densities->Get(int_x1,int_y,int_z1));
+  double d11 = MathRoutines::LinearInterpolate(dx, (double)mp_densities->Get(int_x,int_y1,int_z1), (double)mp_densities->Get(int_x1,int_y1,int_z1));
 
   double d0 = MathRoutines::LinearInterpolate(dy, d00, d10);
   double d1 = MathRoutines::LinearInterpolate(dy, d01, d11);
@@ -21,12 +21,16 @@
 #include <Raytracer/Core/Spectrum.h>
 #include <Raytracer/Core/VolumeRegion.h>
 #include <Raytracer/Core/PhaseFunction.h>
+#include "DensityGrid.h"
 #include <vector>
 
 /**
 * Implementation of the VolumeRegion with emission, absorption and scattering being proportional to the density of the media particles.
-* The density of the media particles is defined by a regular 3D grid.
+* The density of the media particles is defined by a regular 3D grid (see DensityGrid).
 * The phase function does not depend on the point coordinates and is defined by the PhaseFunction implementation.
+* The class also keeps a coarse grid with the minimum and maximum densities of the blocks of the density grid (majorants).
+* The rays are traversed through the coarse grid so that the empty blocks are skipped, the blocks with constant density are integrated analytically
+* and the transmittance and the free-flight distances are sampled with the tight local majorants.
 */
 class GridDensityVolumeRegion: public DensityVolumeRegion
   {
@@ -37,6 +41,13 @@ class GridDensityVolumeRegion: public DensityVolumeRegion
     GridDensityVolumeRegion(const BBox3D_d &i_bounds, Spectrum_d &i_base_emission, SpectrumCoef_d &i_base_absorption, SpectrumCoef_d &i_base_scattering,
       intrusive_ptr<const PhaseFunction> ip_phase_function, const std::vector<std::vector<std::vector<float>>> &i_densities);
 
+    /**
+    * Creates GridDensityVolumeRegion instance with specified base emission, absorption, scattering, bounding box and the grid defining the density values.
+    * The grid can be shared between several volume regions.
+    */
+    GridDensityVolumeRegion(const BBox3D_d &i_bounds, Spectrum_d &i_base_emission, SpectrumCoef_d &i_base_absorption, SpectrumCoef_d &i_base_scattering,
+      intrusive_ptr<const PhaseFunction> ip_phase_function, intrusive_ptr<const DensityGrid> ip_densities);
+
     /**
     * Returns true if the ray intersects volume region and computes ray parametric coordinates of the intersection region.
     * @param i_ray Input ray. Direction component should be normalized.
@@ -46,7 +57,65 @@ class GridDensityVolumeRegion: public DensityVolumeRegion
     */
     bool Intersect(const Ray &i_ray, double *op_t_begin, double *op_t_end) const;
 
+    /**
+    * Returns optical thickness of the volume region for the specified ray.
+    * The density is integrated with the fixed step only in the non-empty blocks with varying density.
+    * @param i_ray Ray for which the optical thickness is to be computed. Ray direction should be normalized.
+    * @param i_step Step size for the MonteCarlo integration. Should be greater than 0.0
+    * @param i_offset_sample The sample value used for MonteCarlo integration to choose position in the segments for evaluating attenuation value. Should be in [0;1) range.
+    * @return Optical thickness.
+    */
+    SpectrumCoef_d OpticalThickness(const Ray &i_ray, double i_step, double i_offset_sample) const;
+
+    /**
+    * Returns unbiased estimate of the transmittance of the volume region for the specified ray.
+    * The transmittance is estimated with the ratio tracking using the local majorants of the blocks.
+    * @param i_ray Ray for which the transmittance is to be computed. Ray direction should be normalized.
+    * @param i_step Step size for the MonteCarlo integration. Not used by this implementation.
+    * @param io_random_generator Random generator used for MonteCarlo integration.
+    * @return Transmittance. Each component is in [0;1] range.
+    */
+    SpectrumCoef_d Transmittance(const Ray &i_ray, double i_step, RandomGenerator<double> &io_random_generator) const;
+
+    /**
+    * Samples distance to the next collision along the ray with the delta tracking.
+    * The collisions are distributed according to the attenuation of the spectrum component with the largest base attenuation value.
+    * @param i_ray Ray along which the collision is to be sampled. Ray direction should be normalized.
+    * @param io_random_generator Random generator used for sampling.
+    * @param[out] o_t Parametric coordinate of the collision point.
+    * @return true if the collision is sampled and false if the ray leaves the volume region (or reaches its end) without a collision.
+    */
+    bool SampleFreeFlight(const Ray &i_ray, RandomGenerator<double> &io_random_generator, double &o_t) const;
+
+    /**
+    * Returns the parametric coordinate of the first point of the ray segment where the media can be non-empty.
+    * The blocks of the coarse grid with zero maximum density are skipped. The parts of the segment outside of the bounding box are skipped too.
+    * @param i_ray Input ray. Direction component should be normalized.
+    * @param i_t_begin Parametric coordinate of the begin of the segment.
+    * @param i_t_end Parametric coordinate of the end of the segment.
+    * @return Parametric coordinate in [i_t_begin;i_t_end] range. Equals i_t_end if the whole segment is empty.
+    */
+    double SkipEmptySpace(const Ray &i_ray, double i_t_begin, double i_t_end) const;
+
   private:
+    /**
+    * Private method that initializes the bounds and the coarse grid. Called from the constructors.
+    */
+    void _Initialize();
+
+    /**
+    * Private method that computes the minimum and maximum densities for the blocks of the coarse grid.
+    */
+    void _InitializeMajorants();
+
+    /**
+    * Private method that traverses the blocks of the coarse grid along the ray segment and calls the callback for each of them.
+    * The callback is called with the begin and end parametric coordinates of the block's segment and the minimum and maximum densities of the block.
+    * The traversal stops if the callback returns false.
+    */
+    template<typename Callback>
+    void _TraverseMajorants(const Ray &i_ray, double i_t_begin, double i_t_end, Callback &io_callback) const;
+
     /**
     * Private virtual function for that returns density of the media particles at the specified point.
     * The density value is computed by interpolating the values of the densities 3D grid.
@@ -59,7 +128,22 @@ class GridDensityVolumeRegion: public DensityVolumeRegion
 
     size_t m_size_x, m_size_y, m_size_z;
 
-    std::vector<std::vector<std::vector<float>>> m_densities;
+    intrusive_ptr<const DensityGrid> mp_densities;
+
+    // Size of the blocks of the coarse grid in the density grid cells. The blocks coincide with the bricks of the density grid.
+    static const size_t MAJORANT_BLOCK_SIZE = DensityGrid::BRICK_SIZE;
+
+    size_t m_majorants_size_x, m_majorants_size_y, m_majorants_size_z;
+
+    /**
+    * Minimum and maximum densities of the coarse grid blocks stored as a flat array with z index changing fastest.
+    */
+    std::vector<float> m_min_densities, m_max_densities;
+
+    SpectrumCoef_d m_base_attenuation;
+
+    // Largest component of the base attenuation.
+    double m_max_base_attenuation;
   };
 
 #endif // GRID_DENSITY_VOLUME_REGION_H
\ No newline at end of file
@@ -60,6 +60,16 @@ double HomogeneousVolumeRegion::Phase(const Point3D_d &i_point, const Vector3D_d
   return m_bounds.Inside(i_point) ? mp_phase_function->ScatteringPDF(i_incoming, i_outgoing) : 0.0;
   }
 
+double HomogeneousVolumeRegion::SamplePhase(const Point3D_d &i_point, const Vector3D_d &i_incoming, const Point2D_d &i_sample, Vector3D_d &o_outgoing) const
+  {
+  return mp_phase_function->Sample(i_incoming, i_sample, o_outgoing);
+  }
+
+double HomogeneousVolumeRegion::PhasePDF(const Point3D_d &i_point, const Vector3D_d &i_incoming, const Vector3D_d &i_outgoing) const
+  {
+  return mp_phase_function->PDF(i_incoming, i_outgoing);
+  }
+
 SpectrumCoef_d HomogeneousVolumeRegion::OpticalThickness(const Ray &i_ray, double i_step, double i_offset_sample) const
   {
   ASSERT(i_ray.m_direction.IsNormalized());
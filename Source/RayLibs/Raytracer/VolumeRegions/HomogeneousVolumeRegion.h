@@ -79,6 +79,16 @@ class HomogeneousVolumeRegion: public VolumeRegion
     */
     double Phase(const Point3D_d &i_point, const Vector3D_d &i_incoming, const Vector3D_d &i_outgoing) const;
 
+    /**
+    * Samples outgoing direction for the specified incoming direction with the phase function's sampling method.
+    */
+    double SamplePhase(const Point3D_d &i_point, const Vector3D_d &i_incoming, const Point2D_d &i_sample, Vector3D_d &o_outgoing) const;
+
+    /**
+    * Returns PDF of sampling the specified outgoing direction by the SamplePhase() method.
+    */
+    double PhasePDF(const Point3D_d &i_point, const Vector3D_d &i_incoming, const Vector3D_d &i_outgoing) const;
+
     /**
     * Returns optical thickness of the volume region for the specified ray.
     * The method also takes two additional parameters for MonteCarlo integration that are not used by this implementation though.
@@ -25,6 +25,8 @@
 #include <Math/SamplingRoutines.h>
 #include <sstream>
 #include <fstream>
+#include <cstdio>
+#include <stdexcept>
 
 class MERLMeasuredTestSuite : public CxxTest::TestSuite
   {
@@ -156,6 +158,62 @@ class MERLMeasuredTestSuite : public CxxTest::TestSuite
       CustomAssertDelta(total, SpectrumCoef_d(0.0721, 0.0627, 0.0732), 0.001); // This is an empirical value.
       }
 
+    void test_MERLMeasuredData_SaveAndLoadCache()
+      {
+      mp_lambertian_data->SaveCache("MERLMeasuredTest.cache");
+
+        {
+        MERLMeasuredData cached_data("MERLMeasuredTest.cache");
+
+        bool equal=true;
+        for(size_t i=0;i<1000;++i)
+          {
+          Vector3D_d incident = SamplingRoutines::UniformHemisphereSampling(Point2D_d(RandomDouble(1.0),RandomDouble(1.0)));
+          Point2D_d sample(RandomDouble(1.0),RandomDouble(1.0));
+
+          double pdf1, pdf2;
+          Vector3D_d exitant1, exitant2;
+          SpectrumCoef_d sp1 = mp_lambertian_data->Sample(incident, exitant1, sample, pdf1);
+          SpectrumCoef_d sp2 = cached_data.Sample(incident, exitant2, sample, pdf2);
+
+          if (sp1!=sp2 || exitant1!=exitant2 || pdf1!=pdf2)
+            equal=false;
+          if (mp_lambertian_data->GetBRDF(incident, exitant1) != cached_data.GetBRDF(incident, exitant1))
+            equal=false;
+          if (mp_lambertian_data->PDF(incident, exitant1) != cached_data.PDF(incident, exitant1))
+            equal=false;
+          }
+
+        TS_ASSERT(equal);
+        }
+
+      std::remove("MERLMeasuredTest.cache");
+      }
+
+    void test_MERLMeasuredData_CacheSourceStamp()
+      {
+      TS_ASSERT_EQUALS(mp_lambertian_data->GetSourceSize(), 0);
+      TS_ASSERT_EQUALS(mp_lambertian_data->GetSourceModificationTime(), 0);
+
+      mp_lambertian_data->SaveCache("MERLMeasuredTest.cache", 12345678901ULL, 1400000000ULL);
+        {
+        MERLMeasuredData cached_data("MERLMeasuredTest.cache");
+        TS_ASSERT_EQUALS(cached_data.GetSourceSize(), 12345678901ULL);
+        TS_ASSERT_EQUALS(cached_data.GetSourceModificationTime(), 1400000000ULL);
+        }
+
+      std::remove("MERLMeasuredTest.cache");
+      }
+
+    void test_MERLMeasuredData_LoadInvalidCache()
+      {
+      std::ofstream("MERLMeasuredTest.cache", std::ios::out | std::ios::binary) << "Not a cache file";
+      TS_ASSERT_THROWS(MERLMeasuredData("MERLMeasuredTest.cache"), std::runtime_error);
+      std::remove("MERLMeasuredTest.cache");
+
+      TS_ASSERT_THROWS(MERLMeasuredData("MERLMeasuredTestMissing.cache"), std::runtime_error);
+      }
+
   private:
     intrusive_ptr<MERLMeasuredData> _CreateLambertianMERLData() const
       {
@@ -140,6 +140,20 @@ class PerspectiveCameraTestSuite : public CxxTest::TestSuite
       CustomAssertDelta(direction, ray.m_direction, (1e-10));
       }
 
+    // Tests that the analytically computed differentials match the rays generated for the adjacent image points.
+    void test_PerspectiveCamera_GenerateRayDifferential_PinHole()
+      {
+      PerspectiveCamera cam(m_transformation, mp_film, 0.0, 0.0, m_x_view_angle);
+      _TestRayDifferential(cam);
+      }
+
+    // Tests that the analytically computed differentials match the rays generated for the adjacent image points.
+    void test_PerspectiveCamera_GenerateRayDifferential_DepthOfField()
+      {
+      PerspectiveCamera cam(m_transformation, mp_film, 1.0, 10.0, m_x_view_angle);
+      _TestRayDifferential(cam);
+      }
+
   private:
     Point3D_d m_origin;
     Vector3D_d m_direction;
@@ -147,6 +161,35 @@ class PerspectiveCameraTestSuite : public CxxTest::TestSuite
     intrusive_ptr<Film> mp_film;
 
     double m_x_view_angle;
+
+    void _TestRayDifferential(const PerspectiveCamera &i_camera)
+      {
+      double x_res = (double)i_camera.GetFilm()->GetXResolution();
+      double y_res = (double)i_camera.GetFilm()->GetYResolution();
+
+      for(size_t i=0;i<100;++i)
+        {
+        Point2D_d image_point(RandomDouble(x_res), RandomDouble(y_res)), lens_uv(RandomDouble(1.0), RandomDouble(1.0));
+        double dx = RandomDouble(2.0), dy = RandomDouble(2.0);
+
+        RayDifferential ray;
+        double weight = i_camera.GenerateRayDifferential(image_point, lens_uv, dx, dy, ray);
+
+        Ray base, r_dx, r_dy;
+        double base_weight = i_camera.GenerateRay(image_point, lens_uv, base);
+        i_camera.GenerateRay(image_point+Point2D_d(dx, 0.0), lens_uv, r_dx);
+        i_camera.GenerateRay(image_point+Point2D_d(0.0, dy), lens_uv, r_dy);
+
+        TS_ASSERT_EQUALS(weight, base_weight);
+        TS_ASSERT(ray.m_has_differentials);
+        CustomAssertDelta(ray.m_base_ray.m_origin, base.m_origin, (1e-10));
+        CustomAssertDelta(ray.m_base_ray.m_direction, base.m_direction, (1e-10));
+        CustomAssertDelta(ray.m_origin_dx, r_dx.m_origin, (1e-10));
+        CustomAssertDelta(ray.m_origin_dy, r_dy.m_origin, (1e-10));
+        CustomAssertDelta(ray.m_direction_dx, r_dx.m_direction, (1e-10));
+        CustomAssertDelta(ray.m_direction_dy, r_dy.m_direction, (1e-10));
+        }
+      }
   };
 
 #endif // PERSPECTIVE_CAMERA_TEST_H
\ No newline at end of file
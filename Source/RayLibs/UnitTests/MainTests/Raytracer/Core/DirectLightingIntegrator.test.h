@@ -22,6 +22,7 @@
 #include <Raytracer/LightSources/DiffuseAreaLightSource.h>
 #include <Raytracer/LightSources/PointLight.h>
 #include <Raytracer/Samplers/StratifiedSampler.h>
+#include <Raytracer/LightsSamplingStrategies/LightTreeLightsSamplingStrategy.h>
 #include "Mocks/MaterialMock.h"
 #include "Mocks/InfiniteLightSourceMock.h"
 #include <Math/SamplingRoutines.h>
@@ -41,6 +42,7 @@ class DirectLightingIntegratorTestSuite : public CxxTest::TestSuite
 
       m_ts.mp_pool = &m_pool;
       m_ts.mp_random_generator = &m_rng;
+      m_ts.mp_occluder_hint = &m_occluder_hint;
       }
 
     void test_DirectLightingIntegrator_PointLight()
@@ -63,13 +65,49 @@ class DirectLightingIntegratorTestSuite : public CxxTest::TestSuite
       intrusive_ptr<DirectLightingIntegrator> p_integrator( new DirectLightingIntegrator(p_scene, 1, 1, 0.1) );
       p_integrator->RequestSamples(p_sampler);
       intrusive_ptr<Sample> p_sample = p_sampler->CreateSample();
-      p_sampler->GetNextSubSampler(1, &m_rng)->GetNextSample(p_sample);
+      p_sampler->GetNextSubSampler(1, &m_rng)->GetNextSample(p_sample.get());
       Spectrum_d radiance = p_integrator->ComputeDirectLighting(isect, ray.m_direction*(-1.0), p_bsdf, p_sample.get(), m_ts);
 
       // We use mock BxDF which is a Lambertian one so the reflectance is SpectrumCoef_d(1.0)/M_PI.
       CustomAssertDelta(radiance, Spectrum_d(100)/(9*9) * SpectrumCoef_d(1.0)/M_PI, 1e-4);
       }
 
+    // There are many point lights in the scene and only a few of them are sampled at a time.
+    void test_DirectLightingIntegrator_SampledDeltaLights()
+      {
+      intrusive_ptr<TriangleMesh> p_mesh = m_spheres[0];
+      intrusive_ptr<Primitive> p_primitive = _CreatePrimitive(p_mesh);
+      std::vector<intrusive_ptr<const Primitive>> primitives(1,p_primitive);
+
+      // Some of the lights are on the other side of the sphere and do not contribute.
+      LightSources lights;
+      for(size_t i=0;i<30;++i)
+        {
+        Point3D_d position(10.0*cos(0.2*i), 10.0*sin(0.2*i), 2.0-0.1*i);
+        lights.m_delta_light_sources.push_back( intrusive_ptr<DeltaLightSource>(new PointLight(position,Spectrum_d(10.0+i))) );
+        }
+
+      intrusive_ptr<Scene> p_scene( new Scene(primitives, NULL, lights) );
+      intrusive_ptr<Sampler> p_sampler = _CreaterSampler();
+
+      Ray ray(Point3D_d(5,5,0), Vector3D_d(1-5,1-5,0-0).Normalized());
+      Intersection isect;
+      p_scene->Intersect(RayDifferential(ray), isect);
+      const BSDF *p_bsdf = isect.mp_primitive->GetBSDF(isect.m_dg, isect.m_triangle_index, *m_ts.mp_pool);
+
+      intrusive_ptr<DirectLightingIntegrator> p_integrator( new DirectLightingIntegrator(p_scene, 1, 1, 0.1) );
+      Spectrum_d expected = p_integrator->ComputeDirectLighting(isect, ray.m_direction*(-1.0), p_bsdf, NULL, m_ts);
+
+      intrusive_ptr<DirectLightingIntegrator> p_sampling_integrator( new DirectLightingIntegrator(p_scene, 1, 1, 0.1, NULL, 2000) );
+      p_sampling_integrator->RequestSamples(p_sampler);
+      intrusive_ptr<Sample> p_sample = p_sampler->CreateSample();
+      p_sampler->GetNextSubSampler(1, &m_rng)->GetNextSample(p_sample.get());
+      Spectrum_d radiance = p_sampling_integrator->ComputeDirectLighting(isect, ray.m_direction*(-1.0), p_bsdf, p_sample.get(), m_ts);
+
+      TS_ASSERT(expected[0] > 0.0);
+      CustomAssertDelta(radiance, expected, 1e-2*expected[0]);
+      }
+
     // There are infinity lights in the scene.
     void test_DirectLightingIntegrator_InfinityLights()
       {
@@ -92,7 +130,7 @@ class DirectLightingIntegratorTestSuite : public CxxTest::TestSuite
       intrusive_ptr<DirectLightingIntegrator> p_integrator( new DirectLightingIntegrator(p_scene, 5000, 5100, 0.1) );
       p_integrator->RequestSamples(p_sampler);
       intrusive_ptr<Sample> p_sample = p_sampler->CreateSample();
-      p_sampler->GetNextSubSampler(1, &m_rng)->GetNextSample(p_sample);     
+      p_sampler->GetNextSubSampler(1, &m_rng)->GetNextSample(p_sample.get());     
       Spectrum_d radiance = p_integrator->ComputeDirectLighting(isect, ray.m_direction*(-1.0), p_bsdf, p_sample.get(), m_ts);
 
       // We use mock BxDF which is a Lambertian one so the reflectance is Spectrum_d(1.0)/M_PI.
@@ -123,7 +161,7 @@ class DirectLightingIntegratorTestSuite : public CxxTest::TestSuite
       intrusive_ptr<DirectLightingIntegrator> p_integrator( new DirectLightingIntegrator(p_scene, 5000, 5100, 0.1) );
       p_integrator->RequestSamples(p_sampler);
       intrusive_ptr<Sample> p_sample = p_sampler->CreateSample();
-      p_sampler->GetNextSubSampler(1, &m_rng)->GetNextSample(p_sample);     
+      p_sampler->GetNextSubSampler(1, &m_rng)->GetNextSample(p_sample.get());     
       Spectrum_d radiance = p_integrator->ComputeDirectLighting(isect, ray.m_direction*(-1.0), p_bsdf, p_sample.get(), m_ts);
 
       // Compute the estimate numerically.
@@ -169,6 +207,39 @@ class DirectLightingIntegratorTestSuite : public CxxTest::TestSuite
       CustomAssertDelta(radiance, area_light_estimate_1+area_light_estimate_2 + infinity_light_estimate_1+infinity_light_estimate_2, 1e-1);
       }
 
+    // Same as above but the lights are sampled directly by the LightsSamplingStrategy rather than with the CDF.
+    void test_DirectLightingIntegrator_LightTreeSampling()
+      {
+      std::vector<intrusive_ptr<const Primitive>> primitives;
+      primitives.push_back(_CreatePrimitive(m_spheres[0]));
+      primitives.push_back( _CreatePrimitive(m_spheres[1], _CreateAreaLight(m_spheres[1], Spectrum_d(10))) );
+      primitives.push_back( _CreatePrimitive(m_spheres[2], _CreateAreaLight(m_spheres[2], Spectrum_d(20))) );
+
+      LightSources lights;
+      lights.m_infinite_light_sources.push_back(intrusive_ptr<InfiniteLightSource>(new InfiniteLightSourceMock(Spectrum_d(5), m_world_bbox)) );
+      lights.m_infinite_light_sources.push_back(intrusive_ptr<InfiniteLightSource>(new InfiniteLightSourceMock(Spectrum_d(15), m_world_bbox)) );
+      lights.m_area_light_sources.push_back(primitives[1]->GetAreaLightSource());
+      lights.m_area_light_sources.push_back(primitives[2]->GetAreaLightSource());
+
+      intrusive_ptr<Scene> p_scene( new Scene(primitives, NULL, lights) );
+
+      Ray ray(Point3D_d(5,5,0), Vector3D_d(1-5,1-5,0-0).Normalized());
+      Intersection isect;
+      p_scene->Intersect(RayDifferential(ray), isect);
+      const BSDF *p_bsdf = isect.mp_primitive->GetBSDF(isect.m_dg, isect.m_triangle_index, *m_ts.mp_pool);
+
+      intrusive_ptr<LightsSamplingStrategy> p_strategy( new LightTreeLightsSamplingStrategy(p_scene->GetLightSources()) );
+      intrusive_ptr<DirectLightingIntegrator> p_integrator( new DirectLightingIntegrator(p_scene, 10000, 11000, 0.1, p_strategy) );
+      Spectrum_d radiance = p_integrator->ComputeDirectLighting(isect, ray.m_direction*(-1.0), p_bsdf, NULL, m_ts);
+
+      double cos_integrated = _ComputeCosineIntegral(isect.m_dg, Point3D_d(0,10,0), 1);
+      Spectrum_d area_light_estimate_1 = Spectrum_d(10) * cos_integrated * INV_PI;
+      Spectrum_d area_light_estimate_2 = Spectrum_d(20) * cos_integrated * INV_PI;
+      Spectrum_d infinity_light_estimate_1 = Spectrum_d(5)/M_PI * (M_PI - 2.0*cos_integrated);
+      Spectrum_d infinity_light_estimate_2 = Spectrum_d(15)/M_PI * (M_PI - 2.0*cos_integrated);
+      CustomAssertDelta(radiance, area_light_estimate_1+area_light_estimate_2 + infinity_light_estimate_1+infinity_light_estimate_2, 1e-1);
+      }
+
     // There are two area lights and two infinity lights in the scene but the intersection is inside the sphere so there's no lighting.
     void test_DirectLightingIntegrator_NoLighting()
       {
@@ -194,7 +265,7 @@ class DirectLightingIntegratorTestSuite : public CxxTest::TestSuite
       intrusive_ptr<DirectLightingIntegrator> p_integrator( new DirectLightingIntegrator(p_scene, 5000, 5100, 0.1) );
       p_integrator->RequestSamples(p_sampler);
       intrusive_ptr<Sample> p_sample = p_sampler->CreateSample();
-      p_sampler->GetNextSubSampler(1, &m_rng)->GetNextSample(p_sample);     
+      p_sampler->GetNextSubSampler(1, &m_rng)->GetNextSample(p_sample.get());     
       Spectrum_d radiance = p_integrator->ComputeDirectLighting(isect, ray.m_direction*(-1.0), p_bsdf, p_sample.get(), m_ts);
 
       TS_ASSERT_EQUALS(radiance, Spectrum_d(0));
@@ -249,6 +320,7 @@ class DirectLightingIntegratorTestSuite : public CxxTest::TestSuite
 
     MemoryPool m_pool;
     RandomGenerator<double> m_rng;
+    OccluderHint m_occluder_hint;
     ThreadSpecifics m_ts;
   };
 
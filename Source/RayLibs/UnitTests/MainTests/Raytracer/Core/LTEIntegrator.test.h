@@ -41,6 +41,7 @@ class LTEIntegratorTestSuite : public CxxTest::TestSuite
 
       m_ts.mp_pool = &m_pool;
       m_ts.mp_random_generator = &m_rng;
+      m_ts.mp_occluder_hint = NULL;
       }
 
     void setUp()
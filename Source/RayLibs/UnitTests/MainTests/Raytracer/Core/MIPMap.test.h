@@ -19,6 +19,11 @@
 #include <UnitTests/TestHelpers/CustomValueTraits.h>
 #include <Raytracer/Core/MIPMap.h>
 #include <Raytracer/Core/Spectrum.h>
+#include <Raytracer/Core/TextureCache.h>
+#include <UnitTests/Mocks/ImageSourceMock.h>
+#include <Math/ThreadSafeRandom.h>
+#include <tbb/tbb.h>
+#include <cstdio>
 #include <vector>
 
 class MIPMapTestSuite : public CxxTest::TestSuite
@@ -88,8 +93,360 @@ class MIPMapTestSuite : public CxxTest::TestSuite
       TS_ASSERT_EQUALS(t, Spectrum_d(0.0,0.0,1.0));
       }
 
+    // Tests that the EWA filter matches the reference filter testing every texel of the ellipse's bounding box.
+    // The ellipses are small enough for the finest level to be used, they have anisotropy up to 16 and cross the image borders.
+    void test_MIPMap_EWAReference()
+      {
+      size_t width = 45, height = 29;
+      double max_anisotropy = 16.0;
+      std::vector<std::vector<double>> image(height, std::vector<double>(width));
+      for(size_t y=0;y<height;++y)
+        for(size_t x=0;x<width;++x)
+          image[y][x] = RandomDouble(1.0);
+
+      for(int repeat=0;repeat<2;++repeat)
+        {
+        MIPMap<double> map(image, repeat==1, max_anisotropy);
+        map.Save("MIPMapTest.mip");
+
+        intrusive_ptr<const MIPMapFile> p_file(new MIPMapFile("MIPMapTest.mip", sizeof(double)));
+        intrusive_ptr<const ImageSource<double>> p_source(new ImageSourceMock<double>(image));
+        MIPMap<double> mapped_map(p_file, repeat==1, max_anisotropy);
+        MIPMap<double> cached_map(p_source, repeat==1, max_anisotropy, new TextureCache(1<<20, 16));
+
+        double max_difference = 0.0;
+        for(size_t i=0;i<2000;++i)
+          {
+          // Half of the points are near the top or the bottom border so that the ellipses cross the border rows.
+          Point2D_d point(RandomDouble(1.2)-0.1, RandomDouble(1.2)-0.1);
+          if (i%2)
+            point[1] = (i%4==1) ? RandomDouble(0.1) : 1.0-RandomDouble(0.1);
+
+          // The major axis is at most 0.2 so the minor axis is below 1/64 after it is clamped, this makes the finest level to be used.
+          double angle = RandomDouble(2.0*M_PI), major_length = 0.02+RandomDouble(0.18), minor_length = 1e-4+RandomDouble(0.0124);
+          Vector2D_d dxy_1(major_length*cos(angle), major_length*sin(angle)), dxy_2(-minor_length*sin(angle), minor_length*cos(angle));
+
+          double reference = _ReferenceEWA(image, repeat==1, max_anisotropy, point, dxy_1, dxy_2);
+          max_difference = std::max(max_difference, fabs(map.Evaluate(point, dxy_1, dxy_2) - reference));
+          max_difference = std::max(max_difference, fabs(mapped_map.Evaluate(point, dxy_1, dxy_2) - reference));
+          max_difference = std::max(max_difference, fabs(cached_map.Evaluate(point, dxy_1, dxy_2) - reference));
+          }
+
+        TS_ASSERT(max_difference < 1e-10);
+        p_file.reset();
+        std::remove("MIPMapTest.mip");
+        }
+      }
+
+    // Tests that MIPMap with the levels loaded on demand returns exactly the same values as the one with the levels built in memory.
+    void test_MIPMap_TextureCache()
+      {
+      std::vector<std::vector<Spectrum_d>> image = _CreateRandomImage(67, 45);
+      intrusive_ptr<const ImageSource<Spectrum_d>> p_source(new ImageSourceMock<Spectrum_d>(image));
+      intrusive_ptr<TextureCache> p_cache(new TextureCache(1<<20, 8));
+
+      for(int repeat=0;repeat<2;++repeat)
+        {
+        MIPMap<Spectrum_d> map(image, repeat!=0, 8.0), cached_map(p_source, repeat!=0, 8.0, p_cache);
+
+        bool equal=true;
+        for(size_t i=0;i<1000;++i)
+          {
+          Point2D_d point(RandomDouble(1.4)-0.2, RandomDouble(1.4)-0.2);
+          double width = 0.05+RandomDouble(0.05);
+          Vector2D_d dxy_1(RandomDouble(0.1), RandomDouble(0.1)), dxy_2(RandomDouble(0.02), RandomDouble(0.02));
+
+          if (map.Evaluate(point, width) != cached_map.Evaluate(point, width))
+            equal=false;
+          if (map.Evaluate(point, dxy_1, dxy_2) != cached_map.Evaluate(point, dxy_1, dxy_2))
+            equal=false;
+          }
+
+        TS_ASSERT(equal);
+        }
+      }
+
+    // Tests that only the accessed tiles are loaded and that the memory budget is respected.
+    void test_MIPMap_TextureCacheMemoryBudget()
+      {
+      std::vector<std::vector<Spectrum_d>> image = _CreateRandomImage(256, 256);
+      intrusive_ptr<ImageSourceMock<Spectrum_d>> p_source(new ImageSourceMock<Spectrum_d>(image));
+      size_t budget = 4*16*16*sizeof(Spectrum_d);
+      intrusive_ptr<TextureCache> p_cache(new TextureCache(budget, 16, 1));
+      MIPMap<Spectrum_d> map(image, true, 8.0), cached_map(p_source, true, 8.0, p_cache);
+
+      // A single lookup in the finest level reads only the tiles around the point.
+      cached_map.Evaluate(Point2D_d(0.5,0.5), 0.0);
+      TS_ASSERT(p_source->GetRegionValuesRead() <= 4*16*16);
+
+      bool equal=true;
+      for(size_t i=0;i<1000;++i)
+        {
+        Point2D_d point(RandomDouble(1.0), RandomDouble(1.0));
+        double width = 0.004+RandomDouble(0.01);
+        if (map.Evaluate(point, width) != cached_map.Evaluate(point, width))
+          equal=false;
+        }
+
+      TS_ASSERT(equal);
+
+      // The tiles kept in the cache fit in the budget, the evicted tiles still referenced by the thread's table can only exceed it by the table size.
+      size_t tile_memory_size = 16*16*sizeof(Spectrum_d);
+      TS_ASSERT(p_cache->GetTilesNumber()*tile_memory_size <= budget);
+      TS_ASSERT(p_cache->GetMemoryUsage() <= budget + TextureCache::ThreadTiles::SLOTS_NUM*tile_memory_size);
+      }
+
+    void test_MIPMap_TextureCacheConcurrentAccess()
+      {
+      std::vector<std::vector<Spectrum_d>> image = _CreateRandomImage(200, 100);
+      intrusive_ptr<const ImageSource<Spectrum_d>> p_source(new ImageSourceMock<Spectrum_d>(image));
+      intrusive_ptr<TextureCache> p_cache(new TextureCache(8*16*16*sizeof(Spectrum_d), 16));
+      MIPMap<Spectrum_d> map(image, true, 8.0), cached_map(p_source, true, 8.0, p_cache);
+
+      tbb::atomic<size_t> errors;
+      errors = 0;
+      tbb::parallel_for((size_t)0, (size_t)20000, [&](size_t i)
+        {
+        Point2D_d point((i%97)/97.0, (i%89)/89.0);
+        Vector2D_d dxy_1(0.01*(i%7), 0.002), dxy_2(-0.001, 0.001*(i%5));
+        if (map.Evaluate(point, dxy_1, dxy_2) != cached_map.Evaluate(point, dxy_1, dxy_2))
+          ++errors;
+        });
+
+      TS_ASSERT_EQUALS(errors, 0);
+      }
+
+    void test_MIPMap_SaveAndLoad()
+      {
+      std::vector<std::vector<Spectrum_d>> image = _CreateRandomImage(67, 45);
+      MIPMap<Spectrum_d> map(image, true, 8.0);
+      map.Save("MIPMapTest.mip");
+
+      intrusive_ptr<const MIPMapFile> p_file(new MIPMapFile("MIPMapTest.mip", sizeof(Spectrum_d)));
+      MIPMap<Spectrum_d> loaded_map(p_file, true, 8.0);
+
+      bool equal = true;
+      for(size_t i=0;i<1000;++i)
+        {
+        Point2D_d point(RandomDouble(1.0), RandomDouble(1.0));
+        double width = 0.02+RandomDouble(0.2);
+        if (map.Evaluate(point, width) != loaded_map.Evaluate(point, width))
+          equal=false;
+
+        Vector2D_d dxy_1(RandomDouble(0.02), RandomDouble(0.02)), dxy_2(RandomDouble(0.02), RandomDouble(0.02));
+        if (map.Evaluate(point, dxy_1, dxy_2) != loaded_map.Evaluate(point, dxy_1, dxy_2))
+          equal=false;
+        }
+
+      TS_ASSERT(equal);
+      p_file.reset();
+      std::remove("MIPMapTest.mip");
+      }
+
+    // Tests the MIP-map file life cycle: there is no file at first, then it is built from the image and then it is loaded until the image changes.
+    void test_MIPMap_BuildAndLoadFile()
+      {
+      std::remove("MIPMapTest.mip");
+      TS_ASSERT(MIPMap<Spectrum_d>::LoadFile("MIPMapTest.mip", true, 8.0, 1000, 2000) == NULL);
+
+      std::vector<std::vector<Spectrum_d>> image = _CreateRandomImage(67, 45);
+      intrusive_ptr<const ImageSource<Spectrum_d>> p_source(new ImageSourceMock<Spectrum_d>(image));
+      MIPMap<Spectrum_d> map(image, true, 8.0);
+
+      intrusive_ptr<const MIPMap<Spectrum_d>> p_built_map = MIPMap<Spectrum_d>::BuildFile(p_source, "MIPMapTest.mip", true, 8.0, 1000, 2000);
+      TS_ASSERT(p_built_map);
+      TS_ASSERT_EQUALS(_MaxDifference(map, *p_built_map), 0.0);
+      p_built_map.reset();
+
+      intrusive_ptr<const MIPMap<Spectrum_d>> p_loaded_map = MIPMap<Spectrum_d>::LoadFile("MIPMapTest.mip", true, 8.0, 1000, 2000);
+      TS_ASSERT(p_loaded_map);
+      if (p_loaded_map)
+        TS_ASSERT_EQUALS(_MaxDifference(map, *p_loaded_map), 0.0);
+      p_loaded_map.reset();
+
+      // The file is outdated if the image stamp changes, and it is not checked if the stamp is unknown.
+      TS_ASSERT(MIPMap<Spectrum_d>::LoadFile("MIPMapTest.mip", true, 8.0, 1001, 2000) == NULL);
+      TS_ASSERT(MIPMap<Spectrum_d>::LoadFile("MIPMapTest.mip", true, 8.0, 1000, 2001) == NULL);
+      TS_ASSERT(MIPMap<Spectrum_d>::LoadFile("MIPMapTest.mip", true, 8.0) != NULL);
+
+      std::remove("MIPMapTest.mip");
+      }
+
+    // The file is valid by itself but its levels do not form the MIP-map pyramid of the first level.
+    void test_MIPMap_InvalidPyramidFile()
+      {
+      std::vector<size_t> widths, heights;
+      widths.push_back(4); heights.push_back(4);
+      widths.push_back(1); heights.push_back(1);
+      std::vector<double> values(16, 1.0);
+      std::vector<const void *> level_pointers(2, &values[0]);
+
+      MIPMapFile::Write("MIPMapTest.mip", sizeof(double), widths, heights, level_pointers);
+      intrusive_ptr<const MIPMapFile> p_file(new MIPMapFile("MIPMapTest.mip", sizeof(double)));
+      TS_ASSERT_THROWS(MIPMap<double>(p_file, true, 8.0), std::runtime_error);
+
+      widths.insert(widths.begin()+1, 3); heights.insert(heights.begin()+1, 2);
+      level_pointers.push_back(&values[0]);
+      p_file.reset();
+      MIPMapFile::Write("MIPMapTest.mip", sizeof(double), widths, heights, level_pointers);
+      p_file.reset(new MIPMapFile("MIPMapTest.mip", sizeof(double)));
+      TS_ASSERT_THROWS(MIPMap<double>(p_file, true, 8.0), std::runtime_error);
+
+      p_file.reset();
+      std::remove("MIPMapTest.mip");
+      }
+
+    // Tests that the MIPMap with the texture cache saves the same levels as the MIPMap built in memory.
+    void test_MIPMap_SaveWithTextureCache()
+      {
+      std::vector<std::vector<Spectrum_d>> image = _CreateRandomImage(50, 70);
+      intrusive_ptr<const ImageSource<Spectrum_d>> p_source(new ImageSourceMock<Spectrum_d>(image));
+      intrusive_ptr<TextureCache> p_cache(new TextureCache(4*16*16*sizeof(Spectrum_d), 16));
+      MIPMap<Spectrum_d> map(image, false, 4.0), cached_map(p_source, false, 4.0, p_cache);
+      cached_map.Save("MIPMapTest.mip");
+
+      intrusive_ptr<const MIPMapFile> p_file(new MIPMapFile("MIPMapTest.mip", sizeof(Spectrum_d)));
+      MIPMap<Spectrum_d> loaded_map(p_file, false, 4.0);
+
+      bool equal = true;
+      for(size_t i=0;i<1000;++i)
+        {
+        Point2D_d point(RandomDouble(1.0), RandomDouble(1.0));
+        double width = 0.02+RandomDouble(0.2);
+        if (map.Evaluate(point, width) != loaded_map.Evaluate(point, width))
+          equal=false;
+        }
+
+      TS_ASSERT(equal);
+      p_file.reset();
+      std::remove("MIPMapTest.mip");
+      }
+
+    void test_MIPMap_HalfStorage()
+      {
+      std::vector<std::vector<Spectrum_d>> image = _CreateRandomImage(67, 45);
+      MIPMap<Spectrum_d> map(image, true, 8.0), half_map(image, true, 8.0, MIP_MAP_STORAGE_HALF);
+      TS_ASSERT_EQUALS(half_map.GetStorageFormat(), MIP_MAP_STORAGE_HALF);
+
+      // Half floats have 11 bits of mantissa so the relative error is below 1e-3.
+      TS_ASSERT(_MaxDifference(map, half_map) < 1e-3);
+      }
+
+    void test_MIPMap_SRGB8Storage()
+      {
+      std::vector<std::vector<Spectrum_d>> image = _CreateRandomImage(67, 45);
+      MIPMap<Spectrum_d> map(image, true, 8.0), srgb8_map(image, true, 8.0, MIP_MAP_STORAGE_SRGB8);
+      TS_ASSERT_EQUALS(srgb8_map.GetStorageFormat(), MIP_MAP_STORAGE_SRGB8);
+
+      // The largest quantization step of the sRGB encoding is about 0.01 of the channel range.
+      TS_ASSERT(_MaxDifference(map, srgb8_map) < 0.01);
+      }
+
+    // Tests that the 8-bit storage format handles the values beyond the [0;1] range.
+    void test_MIPMap_SRGB8StorageRange()
+      {
+      std::vector<std::vector<float>> image(32, std::vector<float>(40));
+      for(size_t j=0;j<image.size();++j)
+        for(size_t i=0;i<image[j].size();++i)
+          image[j][i] = (float)(-2.0+RandomDouble(10.0));
+
+      MIPMap<float> map(image, false, 8.0), srgb8_map(image, false, 8.0, MIP_MAP_STORAGE_SRGB8);
+
+      double max_difference = 0.0;
+      for(size_t i=0;i<1000;++i)
+        {
+        Point2D_d point(RandomDouble(1.0), RandomDouble(1.0));
+        max_difference = std::max(max_difference, (double)fabs(map.Evaluate(point, 0.0)-srgb8_map.Evaluate(point, 0.0)));
+        }
+
+      TS_ASSERT(max_difference < 0.01*10.0);
+      }
 
   private:
+    double _MaxDifference(const MIPMap<Spectrum_d> &i_map1, const MIPMap<Spectrum_d> &i_map2)
+      {
+      double max_difference = 0.0;
+      for(size_t i=0;i<1000;++i)
+        {
+        Point2D_d point(RandomDouble(1.0), RandomDouble(1.0));
+        double width = 0.02+RandomDouble(0.2);
+        Spectrum_d value1 = i_map1.Evaluate(point, width), value2 = i_map2.Evaluate(point, width);
+
+        Vector2D_d dxy_1(RandomDouble(0.02), RandomDouble(0.02)), dxy_2(RandomDouble(0.02), RandomDouble(0.02));
+        Spectrum_d value3 = i_map1.Evaluate(point, dxy_1, dxy_2), value4 = i_map2.Evaluate(point, dxy_1, dxy_2);
+
+        for(size_t j=0;j<3;++j)
+          max_difference = std::max(max_difference, std::max(fabs(value1[j]-value2[j]), fabs(value3[j]-value4[j])));
+        }
+
+      return max_difference;
+      }
+
+    // Reference EWA lookup in the finest level that tests every texel of the ellipse's bounding box.
+    double _ReferenceEWA(const std::vector<std::vector<double>> &i_image, bool i_repeat, double i_max_anisotropy, Point2D_d i_point, Vector2D_d i_dxy_1, Vector2D_d i_dxy_2)
+      {
+      if (i_dxy_1.LengthSqr() < i_dxy_2.LengthSqr())
+        std::swap(i_dxy_1, i_dxy_2);
+
+      double major_length = sqrt(i_dxy_1.LengthSqr()), minor_length = sqrt(i_dxy_2.LengthSqr());
+      if (minor_length * i_max_anisotropy < major_length)
+        i_dxy_2 *= major_length / (minor_length * i_max_anisotropy);
+
+      int width = (int)i_image[0].size(), height = (int)i_image.size();
+      i_point[0] = i_point[0] * width - 0.5;
+      i_point[1] = i_point[1] * height - 0.5;
+      i_dxy_1[0] *= width;
+      i_dxy_1[1] *= height;
+      i_dxy_2[0] *= width;
+      i_dxy_2[1] *= height;
+
+      double A = i_dxy_1[1]*i_dxy_1[1] + i_dxy_2[1]*i_dxy_2[1] + 1.0;
+      double B = -2.0 * (i_dxy_1[0]*i_dxy_1[1] + i_dxy_2[0]*i_dxy_2[1]);
+      double C = i_dxy_1[0]*i_dxy_1[0] + i_dxy_2[0]*i_dxy_2[0] + 1.0;
+      double inv_F = 1.0 / (A*C - B*B*0.25);
+      A *= inv_F;
+      B *= inv_F;
+      C *= inv_F;
+
+      double det = 4.0*A*C - B*B, inv_det = 1.0 / det;
+      int x1 = (int) ceil(i_point[0] - 2.0 * inv_det * sqrt(det * C)), x2 = (int)floor(i_point[0] + 2.0 * inv_det * sqrt(det * C));
+      int y1 = (int) ceil(i_point[1] - 2.0 * inv_det * sqrt(A * det)), y2 = (int)floor(i_point[1] + 2.0 * inv_det * sqrt(A * det));
+
+      double num = 0.0, den = 0.0;
+      for (int y=y1;y<=y2;++y)
+        for (int x=x1;x<=x2;++x)
+          {
+          double xx = x - i_point[0], yy = y - i_point[1];
+          double r_sqr = A*xx*xx + B*xx*yy + C*yy*yy;
+          if (r_sqr < 1.0)
+            {
+            double r2 = std::min(floor(r_sqr * 128.0), 127.0) / 127.0;
+            double weight = exp(-2.0 * r2) - exp(-2.0);
+
+            double value = 0.0;
+            if (i_repeat)
+              value = i_image[MathRoutines::Mod(y, height)][MathRoutines::Mod(x, width)];
+            else if (x>=0 && x<width && y>=0 && y<height)
+              value = i_image[y][x];
+
+            num += value * weight;
+            den += weight;
+            }
+          }
+
+      return num / den;
+      }
+
+    std::vector<std::vector<Spectrum_d>> _CreateRandomImage(size_t i_width, size_t i_height)
+      {
+      std::vector<std::vector<Spectrum_d>> image(i_height,std::vector<Spectrum_d>(i_width));
+      for(size_t j=0;j<i_height;++j)
+        for(size_t i=0;i<i_width;++i)
+          image[j][i]=Spectrum_d(RandomDouble(1.0),RandomDouble(1.0),RandomDouble(1.0));
+
+      return image;
+      }
+
     intrusive_ptr<MIPMap<double>> _CreateWhiteMIPMap(size_t i_width, size_t i_height, double i_value, bool i_repeat, double i_max_anisotropy)
       {
       std::vector<std::vector<double>> image(i_height,std::vector<double>(i_width,i_value));
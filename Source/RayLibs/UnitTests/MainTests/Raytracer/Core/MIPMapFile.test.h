@@ -0,0 +1,142 @@
+/*
+* Copyright (C) 2014 by Volodymyr Kachurovskyi <Volodymyr.Kachurovskyi@gmail.com>
+*
+* This file is part of Skwarka.
+*
+* Skwarka is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+*
+* Skwarka is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License along with Skwarka.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef MIP_MAP_FILE_TEST_H
+#define MIP_MAP_FILE_TEST_H
+
+#include <cxxtest/TestSuite.h>
+#include <UnitTests/TestHelpers/CustomValueTraits.h>
+#include <Raytracer/Core/MIPMapFile.h>
+#include <cstdio>
+#include <fstream>
+#include <limits>
+#include <stdexcept>
+#include <vector>
+
+class MIPMapFileTestSuite : public CxxTest::TestSuite
+  {
+  public:
+    void test_MIPMapFile_WriteAndRead()
+      {
+      std::vector<size_t> widths, heights;
+      widths.push_back(5); heights.push_back(3);
+      widths.push_back(3); heights.push_back(2);
+      widths.push_back(1); heights.push_back(1);
+
+      std::vector<std::vector<float>> levels(widths.size());
+      std::vector<const void *> level_pointers;
+      for(size_t i=0;i<levels.size();++i)
+        {
+        for(size_t j=0;j<widths[i]*heights[i];++j)
+          levels[i].push_back(float(i*100+j));
+        level_pointers.push_back(&levels[i][0]);
+        }
+
+      MIPMapFile::Write("MIPMapFileTest.mip", sizeof(float), widths, heights, level_pointers);
+
+      intrusive_ptr<const MIPMapFile> p_file(new MIPMapFile("MIPMapFileTest.mip", sizeof(float)));
+      TS_ASSERT_EQUALS(p_file->GetValueSize(), sizeof(float));
+      TS_ASSERT_EQUALS(p_file->GetLevelsNumber(), levels.size());
+
+      bool equal = true;
+      for(size_t i=0;i<levels.size();++i)
+        {
+        TS_ASSERT_EQUALS(p_file->GetLevelWidth(i), widths[i]);
+        TS_ASSERT_EQUALS(p_file->GetLevelHeight(i), heights[i]);
+
+        const float *p_values = static_cast<const float *>(p_file->GetLevelData(i));
+        for(size_t j=0;j<levels[i].size();++j)
+          if (p_values[j] != levels[i][j])
+            equal = false;
+        }
+
+      TS_ASSERT(equal);
+      p_file.reset();
+      std::remove("MIPMapFileTest.mip");
+      }
+
+    void test_MIPMapFile_ValueSizeMismatch()
+      {
+      std::vector<size_t> widths(1, 2), heights(1, 2);
+      std::vector<float> values(4, 1.f);
+      MIPMapFile::Write("MIPMapFileTest.mip", sizeof(float), widths, heights, std::vector<const void *>(1, &values[0]));
+
+      TS_ASSERT_THROWS(MIPMapFile("MIPMapFileTest.mip", sizeof(double)), std::runtime_error);
+      std::remove("MIPMapFileTest.mip");
+      }
+
+    void test_MIPMapFile_InvalidFile()
+      {
+      std::ofstream("MIPMapFileTest.mip", std::ios::out | std::ios::binary) << "Not a MIP-map file";
+
+      TS_ASSERT_THROWS(MIPMapFile("MIPMapFileTest.mip", sizeof(float)), std::runtime_error);
+      std::remove("MIPMapFileTest.mip");
+      }
+
+    void test_MIPMapFile_MissingFile()
+      {
+      TS_ASSERT_THROWS(MIPMapFile("MIPMapFileTestMissing.mip", sizeof(float)), std::runtime_error);
+      }
+
+    void test_MIPMapFile_SourceStamp()
+      {
+      std::vector<size_t> widths(1, 2), heights(1, 2);
+      std::vector<float> values(4, 1.f);
+      MIPMapFile::Write("MIPMapFileTest.mip", sizeof(float), widths, heights, std::vector<const void *>(1, &values[0]), 12345, 1400000000);
+
+      intrusive_ptr<const MIPMapFile> p_file(new MIPMapFile("MIPMapFileTest.mip", sizeof(float)));
+      TS_ASSERT_EQUALS(p_file->GetSourceSize(), 12345);
+      TS_ASSERT_EQUALS(p_file->GetSourceModificationTime(), 1400000000);
+      p_file.reset();
+      std::remove("MIPMapFileTest.mip");
+      }
+
+    // The level sizes in the header are patched so that the size of the level wraps around in size_t arithmetic.
+    void test_MIPMapFile_OverflowingLevelSize()
+      {
+      _WriteFileWithLevelSize(((unsigned long long)std::numeric_limits<size_t>::max())/4+1, 4);
+      TS_ASSERT_THROWS(MIPMapFile("MIPMapFileTest.mip", sizeof(float)), std::runtime_error);
+
+      _WriteFileWithLevelSize(std::numeric_limits<unsigned long long>::max(), 1);
+      TS_ASSERT_THROWS(MIPMapFile("MIPMapFileTest.mip", sizeof(float)), std::runtime_error);
+      std::remove("MIPMapFileTest.mip");
+      }
+
+    void test_MIPMapFile_EmptyLevel()
+      {
+      _WriteFileWithLevelSize(0, 2);
+      TS_ASSERT_THROWS(MIPMapFile("MIPMapFileTest.mip", sizeof(float)), std::runtime_error);
+      std::remove("MIPMapFileTest.mip");
+      }
+
+  private:
+    /**
+    * Writes valid 2x2 file and then patches the size of its only level in the header.
+    */
+    void _WriteFileWithLevelSize(unsigned long long i_width, unsigned long long i_height) const
+      {
+      std::vector<size_t> widths(1, 2), heights(1, 2);
+      std::vector<float> values(4, 1.f);
+      MIPMapFile::Write("MIPMapFileTest.mip", sizeof(float), widths, heights, std::vector<const void *>(1, &values[0]));
+
+      // The level sizes follow the magic, version, value size, source stamp and number of levels.
+      std::fstream file("MIPMapFileTest.mip", std::ios::in | std::ios::out | std::ios::binary);
+      file.seekp(8 + 2*sizeof(unsigned int) + 3*sizeof(unsigned long long));
+      file.write(reinterpret_cast<const char *>(&i_width), sizeof(i_width));
+      file.write(reinterpret_cast<const char *>(&i_height), sizeof(i_height));
+      }
+  };
+
+#endif // MIP_MAP_FILE_TEST_H
@@ -52,6 +52,16 @@ class PrimitiveTestSuite : public CxxTest::TestSuite
             TS_FAIL("Transform is incorrect.");
             return;
             }
+
+      Matrix4x4_d m3 = transform.Inverted().GetMatrix();
+      Matrix4x4_d m4 = p_primitive->GetWorldToMeshTransform().GetMatrix();
+      for(unsigned char i=0;i<4;++i)
+        for(unsigned char j=0;j<4;++j)
+          if (m3.m_values[i][j]!=m4.m_values[i][j])
+            {
+            TS_FAIL("Inverted transform is incorrect.");
+            return;
+            }
       }
 
     // Tests BSDF with a constant bump map.
@@ -0,0 +1,191 @@
+/*
+* Copyright (C) 2014 by Volodymyr Kachurovskyi <Volodymyr.Kachurovskyi@gmail.com>
+*
+* This file is part of Skwarka.
+*
+* Skwarka is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+*
+* Skwarka is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License along with Skwarka.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef RENDER_THREAD_POOL_TEST_H
+#define RENDER_THREAD_POOL_TEST_H
+
+#include <cxxtest/TestSuite.h>
+#include <UnitTests/TestHelpers/CustomValueTraits.h>
+#include <Raytracer/Core/RenderThreadPool.h>
+#include <tbb/tbb.h>
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+#if defined(_WIN32)
+  #ifndef NOMINMAX
+    #define NOMINMAX
+  #endif
+  #include <windows.h>
+#elif defined(__linux__)
+  #include <sched.h>
+  #include <unistd.h>
+  #include <sys/resource.h>
+  #include <sys/syscall.h>
+#endif
+
+class RenderThreadPoolTestSuite : public CxxTest::TestSuite
+  {
+  public:
+    void test_RenderThreadPool_DefaultParams()
+      {
+      RenderThreadPoolParams params;
+      TS_ASSERT(params.m_low_priority == false);
+      TS_ASSERT_EQUALS(params.m_max_concurrency, 0);
+      TS_ASSERT(params.m_processors.empty());
+      TS_ASSERT(params.m_numa_node < 0);
+      }
+
+    void test_RenderThreadPool_LowPriority()
+      {
+      RenderThreadPoolParams params = RenderThreadPoolParams::LowPriority();
+      TS_ASSERT(params.m_low_priority);
+      TS_ASSERT_EQUALS(params.m_max_concurrency, 0);
+      TS_ASSERT(params.m_processors.empty());
+      }
+
+    void test_RenderThreadPool_GetMaxConcurrency()
+      {
+      RenderThreadPool unlimited_pool;
+      TS_ASSERT_EQUALS(unlimited_pool.GetMaxConcurrency(64), 64);
+
+      RenderThreadPoolParams params;
+      params.m_max_concurrency = 4;
+      RenderThreadPool limited_pool(params);
+      TS_ASSERT_EQUALS(limited_pool.GetMaxConcurrency(64), 4);
+      TS_ASSERT_EQUALS(limited_pool.GetMaxConcurrency(2), 2);
+      }
+
+    void test_RenderThreadPool_GetProcessors()
+      {
+      RenderThreadPoolParams params;
+      params.m_processors.push_back(2);
+      params.m_processors.push_back(0);
+      params.m_processors.push_back(2);
+      RenderThreadPool pool(params);
+
+      TS_ASSERT_EQUALS(pool.GetProcessors().size(), 2);
+      TS_ASSERT_EQUALS(pool.GetProcessors()[0], 0);
+      TS_ASSERT_EQUALS(pool.GetProcessors()[1], 2);
+      }
+
+    // Tests that the threads can be prepared concurrently and that their original settings are restored afterwards multiple times.
+    // The threads whose priority is not lowered (e.g. if the process is not allowed to restore the nice value on Linux) must be reported by the pool.
+    void test_RenderThreadPool_PrepareAndRestore()
+      {
+      RenderThreadPoolParams params = RenderThreadPoolParams::LowPriority();
+      params.m_processors.push_back(0);
+      params.m_pin_threads = true;
+
+      // The settings of each thread before it is prepared for the first time.
+      tbb::enumerable_thread_specific<std::pair<bool, ThreadSettings>> original_settings(std::make_pair(false, ThreadSettings()));
+      tbb::atomic<size_t> not_prepared, not_restored;
+      not_prepared = not_restored = 0;
+
+        {
+        // The pool restores the threads when destroyed even if the test fails in the middle.
+        RenderThreadPool pool(params);
+
+        for(size_t i=0;i<3;++i)
+          {
+          tbb::enumerable_thread_specific<bool> unlowered(false);
+          tbb::parallel_for((size_t)0, (size_t)1000, [&](size_t)
+            {
+            std::pair<bool, ThreadSettings> &original = original_settings.local();
+            if (original.first == false)
+              original = std::make_pair(true, _GetCurrentThreadSettings());
+
+            pool.PrepareCurrentThread();
+            ThreadSettings settings = _GetCurrentThreadSettings();
+            if (_IsAffinitySet(settings, params) == false)
+              ++not_prepared;
+            if (_IsPriorityLowered(settings, params) == false)
+              unlowered.local() = true;
+            });
+
+          TS_ASSERT_EQUALS(pool.GetUnloweredThreadsNumber(), (size_t)std::count(unlowered.begin(), unlowered.end(), true));
+          pool.RestoreThreads();
+          TS_ASSERT_EQUALS(pool.GetUnloweredThreadsNumber(), 0);
+
+          tbb::parallel_for((size_t)0, (size_t)1000, [&](size_t)
+            {
+            const std::pair<bool, ThreadSettings> &original = original_settings.local();
+            if (original.first && (_GetCurrentThreadSettings() == original.second) == false)
+              ++not_restored;
+            });
+          }
+        }
+
+      TS_ASSERT_EQUALS(not_prepared, 0);
+      TS_ASSERT_EQUALS(not_restored, 0);
+      }
+
+  private:
+    // Scheduling settings of a thread changed by RenderThreadPool.
+    struct ThreadSettings
+      {
+      ThreadSettings(): m_priority(0) {}
+
+      bool operator==(const ThreadSettings &i_settings) const
+        {
+        return m_priority == i_settings.m_priority && m_processors == i_settings.m_processors;
+        }
+
+      // Thread priority on Windows or the nice value on Linux.
+      int m_priority;
+
+      // Processors the thread is allowed to run on. Empty if the affinity can not be queried.
+      std::vector<size_t> m_processors;
+      };
+
+    static ThreadSettings _GetCurrentThreadSettings()
+      {
+      ThreadSettings settings;
+#if defined(_WIN32)
+      settings.m_priority = ::GetThreadPriority(::GetCurrentThread());
+#elif defined(__linux__)
+      pid_t thread_id = (pid_t)::syscall(SYS_gettid);
+      settings.m_priority = ::getpriority(PRIO_PROCESS, thread_id);
+
+      cpu_set_t affinity;
+      if (::sched_getaffinity(0, sizeof(cpu_set_t), &affinity) == 0)
+        for(size_t i=0;i<CPU_SETSIZE;++i)
+          if (CPU_ISSET(i, &affinity))
+            settings.m_processors.push_back(i);
+#endif
+      return settings;
+      }
+
+    static bool _IsPriorityLowered(const ThreadSettings &i_settings, const RenderThreadPoolParams &i_params)
+      {
+#if defined(_WIN32)
+      return i_settings.m_priority == THREAD_PRIORITY_LOWEST;
+#elif defined(__linux__)
+      return i_settings.m_priority >= i_params.m_niceness;
+#else
+      return false;
+#endif
+      }
+
+    static bool _IsAffinitySet(const ThreadSettings &i_settings, const RenderThreadPoolParams &i_params)
+      {
+#if defined(__linux__)
+      return i_settings.m_processors == i_params.m_processors;
+#else
+      return true;
+#endif
+      }
+  };
+
+#endif // RENDER_THREAD_POOL_TEST_H
@@ -96,7 +96,7 @@ class SamplerTestSuite : public CxxTest::TestSuite
 
       size_t count=0;
       intrusive_ptr<SubSampler> p_sub_sampler = p_sampler->GetNextSubSampler(16, &m_rng);
-      while(p_sub_sampler->GetNextSample(sample))
+      while(p_sub_sampler->GetNextSample(sample.get()))
         ++count;
 
       TS_ASSERT_EQUALS(count, p_sub_sampler->GetTotalSamplesNum());
@@ -110,7 +110,7 @@ class SamplerTestSuite : public CxxTest::TestSuite
 
       size_t count=0;
       intrusive_ptr<SubSampler> p_sub_sampler = p_sampler->GetNextSubSampler(1000000, &m_rng);
-      while(p_sub_sampler->GetNextSample(sample))
+      while(p_sub_sampler->GetNextSample(sample.get()))
         ++count;
 
       TS_ASSERT_EQUALS(count, p_sub_sampler->GetTotalSamplesNum());
@@ -123,7 +123,7 @@ class SamplerTestSuite : public CxxTest::TestSuite
 
       size_t count=0;
       while(intrusive_ptr<SubSampler> p_sub_sampler = p_sampler->GetNextSubSampler(16, &m_rng))
-        while(p_sub_sampler->GetNextSample(p_sample))
+        while(p_sub_sampler->GetNextSample(p_sample.get()))
           ++count;
 
       TS_ASSERT_EQUALS(count, p_sampler->GetTotalSamplesNum());
@@ -135,13 +135,13 @@ class SamplerTestSuite : public CxxTest::TestSuite
       intrusive_ptr<Sample> p_sample = p_sampler->CreateSample();
 
       intrusive_ptr<SubSampler> p_sub_sampler = p_sampler->GetNextSubSampler(16, &m_rng);
-      for(size_t i=0;i<1003;++i) p_sub_sampler->GetNextSample(p_sample);
+      for(size_t i=0;i<1003;++i) p_sub_sampler->GetNextSample(p_sample.get());
 
       //Reset the sub sampler.
       p_sub_sampler->Reset();
 
       size_t count=0;
-      while(p_sub_sampler->GetNextSample(p_sample))
+      while(p_sub_sampler->GetNextSample(p_sample.get()))
         ++count;
 
       TS_ASSERT_EQUALS(count, p_sub_sampler->GetTotalSamplesNum());
@@ -153,14 +153,14 @@ class SamplerTestSuite : public CxxTest::TestSuite
       intrusive_ptr<Sample> p_sample = p_sampler->CreateSample();
 
       intrusive_ptr<SubSampler> p_sub_sampler = p_sampler->GetNextSubSampler(16, &m_rng);
-      for(size_t i=0;i<1003;++i) p_sub_sampler->GetNextSample(p_sample);
+      for(size_t i=0;i<1003;++i) p_sub_sampler->GetNextSample(p_sample.get());
       
       //Reset the sampler.
       p_sampler->Reset();
 
       size_t count=0;
       while(intrusive_ptr<SubSampler> p_sub_sampler = p_sampler->GetNextSubSampler(16, &m_rng))
-        while(p_sub_sampler->GetNextSample(p_sample))
+        while(p_sub_sampler->GetNextSample(p_sample.get()))
           ++count;
 
       TS_ASSERT_EQUALS(count, p_sampler->GetTotalSamplesNum());
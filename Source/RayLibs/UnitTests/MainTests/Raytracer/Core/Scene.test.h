@@ -24,9 +24,12 @@
 #include <Raytracer/Core/Intersection.h>
 #include <Raytracer/LightSources/PointLight.h>
 #include <Raytracer/LightSources/DiffuseAreaLightSource.h>
+#include <Common/MemoryPool.h>
+#include <Math/RandomGenerator.h>
 #include "Mocks/MaterialMock.h"
 #include <UnitTests/TestHelpers/TriangleMeshTestHelper.h>
 #include <vector>
+#include <algorithm>
 
 class SceneTestSuite : public CxxTest::TestSuite
   {
@@ -102,7 +105,149 @@ class SceneTestSuite : public CxxTest::TestSuite
       TS_ASSERT(intersected == false);
       }
 
+    void test_Scene_SetPrimitive()
+      {
+      // Replace the material only.
+      const Primitive *p_primitive = m_primitives[3].get();
+      intrusive_ptr<const Primitive> p_new_primitive( new Primitive(p_primitive->GetTriangleMesh(), p_primitive->GetMeshToWorldTransform(),
+        new MaterialMock(), p_primitive->GetAreaLightSource()) );
+      mp_scene->SetPrimitive(3, p_new_primitive);
+      mp_scene->CommitChanges();
+
+      TS_ASSERT(mp_scene->GetPrimitives()[3] == p_new_primitive);
+      TS_ASSERT_EQUALS(mp_scene->GetLightSources().m_area_light_sources.size(), m_primitives.size());
+
+      // Move the primitive and replace its area light source.
+      intrusive_ptr<AreaLightSource> p_area_light( new DiffuseAreaLightSource(Spectrum_d(2.0), p_new_primitive->GetTriangleMesh()) );
+      p_new_primitive.reset( new Primitive(p_primitive->GetTriangleMesh(), MakeTranslation(Vector3D_d(5.0,0.0,0.0)), new MaterialMock(), p_area_light) );
+      mp_scene->SetPrimitive(3, p_new_primitive);
+      mp_scene->CommitChanges();
+      m_primitives[3] = p_new_primitive;
+
+      const std::vector<intrusive_ptr<const AreaLightSource>> &area_lights = mp_scene->GetLightSources().m_area_light_sources;
+      TS_ASSERT_EQUALS(area_lights.size(), m_primitives.size());
+      TS_ASSERT(std::find(area_lights.begin(), area_lights.end(), p_area_light) != area_lights.end());
+      TS_ASSERT(std::find(area_lights.begin(), area_lights.end(), p_primitive->GetAreaLightSource()) == area_lights.end());
+
+      _CompareWithNewScene();
+      }
+
+    void test_Scene_AddRemovePrimitive()
+      {
+      intrusive_ptr<const Primitive> p_primitive = _CreateDummyPrimitive(Point3D_f(3.f,0.f,0.f));
+      mp_scene->AddPrimitive(p_primitive);
+      m_primitives.push_back(p_primitive);
+
+      intrusive_ptr<const AreaLightSource> p_removed_area_light = m_primitives[5]->GetAreaLightSource();
+      mp_scene->RemovePrimitive(5);
+      m_primitives.erase(m_primitives.begin()+5);
+      mp_scene->CommitChanges();
+
+      TS_ASSERT_EQUALS(mp_scene->GetPrimitives().size(), m_primitives.size());
+      for(size_t i=0;i<m_primitives.size();++i)
+        TS_ASSERT(mp_scene->GetPrimitives()[i] == m_primitives[i]);
+
+      const std::vector<intrusive_ptr<const AreaLightSource>> &area_lights = mp_scene->GetLightSources().m_area_light_sources;
+      TS_ASSERT_EQUALS(area_lights.size(), m_primitives.size());
+      TS_ASSERT(std::find(area_lights.begin(), area_lights.end(), p_primitive->GetAreaLightSource()) != area_lights.end());
+      TS_ASSERT(std::find(area_lights.begin(), area_lights.end(), p_removed_area_light) == area_lights.end());
+
+      _CompareWithNewScene();
+      }
+
+    // Tests that an area light source shared by two primitives stays in the scene until the last of the primitives stops using it.
+    void test_Scene_SharedAreaLightSource()
+      {
+      intrusive_ptr<const Primitive> p_primitive1 = _CreateDummyPrimitive(Point3D_f(3.f,0.f,0.f));
+      intrusive_ptr<const AreaLightSource> p_area_light = p_primitive1->GetAreaLightSource();
+      intrusive_ptr<const Primitive> p_primitive2( new Primitive(p_primitive1->GetTriangleMesh(), MakeTranslation(Vector3D_d(0.0,3.0,0.0)),
+        new MaterialMock(), p_area_light) );
+
+      size_t lights_num = mp_scene->GetLightSources().m_area_light_sources.size();
+      mp_scene->AddPrimitive(p_primitive1);
+      mp_scene->AddPrimitive(p_primitive2);
+      mp_scene->CommitChanges();
+
+      const std::vector<intrusive_ptr<const AreaLightSource>> &area_lights = mp_scene->GetLightSources().m_area_light_sources;
+      TS_ASSERT_EQUALS(area_lights.size(), lights_num+1);
+      TS_ASSERT_EQUALS(std::count(area_lights.begin(), area_lights.end(), p_area_light), 1);
+
+      // Replace the first primitive with a non-emissive one, the light source is still used by the second primitive.
+      size_t index1 = mp_scene->GetPrimitives().size()-2;
+      mp_scene->SetPrimitive(index1, new Primitive(p_primitive1->GetTriangleMesh(), p_primitive1->GetMeshToWorldTransform(), new MaterialMock(), NULL));
+      mp_scene->CommitChanges();
+      TS_ASSERT_EQUALS(area_lights.size(), lights_num+1);
+      TS_ASSERT_EQUALS(std::count(area_lights.begin(), area_lights.end(), p_area_light), 1);
+
+      // Remove the second primitive, the light source is not used anymore.
+      mp_scene->RemovePrimitive(index1+1);
+      mp_scene->CommitChanges();
+      TS_ASSERT_EQUALS(area_lights.size(), lights_num);
+      TS_ASSERT_EQUALS(std::count(area_lights.begin(), area_lights.end(), p_area_light), 0);
+      }
+
+    // Tests that intersecting the scene, evaluating BSDF and sampling lights does not copy any intrusive pointers.
+    // The reference operations counter is only available in debug builds.
+    void test_Scene_Intersect_NoReferenceOperations()
+      {
+#ifndef NDEBUG
+      RayDifferential rd( Ray(Point3D_d(0.0,0.0,-1.0), Vector3D_d(0.1,0.1,1.0).Normalized()) );
+      MemoryPool pool;
+
+      size_t operations_before = ReferenceCounted::GetReferenceOperationsCount();
+
+      Intersection isect;
+      bool intersected = mp_scene->Intersect(rd, isect);
+      TS_ASSERT(intersected && isect.mp_primitive);
+      const BSDF *p_bsdf = isect.mp_primitive->GetBSDF(isect.m_dg, isect.m_triangle_index, pool);
+      TS_ASSERT(p_bsdf);
+
+      const AreaLightSource *p_light = isect.mp_primitive->GetAreaLightSource_RawPtr();
+      TS_ASSERT(p_light);
+      Ray lighting_ray;
+      double pdf;
+      p_light->Radiance(isect.m_dg, isect.m_triangle_index, rd.m_base_ray.m_direction*(-1.0));
+      p_light->SampleLighting(Point3D_d(0.0,0.0,-1.0), 0.5, Point2D_d(0.5,0.5), lighting_ray, pdf);
+      mp_scene->IntersectTest(lighting_ray);
+
+      TS_ASSERT_EQUALS(ReferenceCounted::GetReferenceOperationsCount(), operations_before);
+
+      // Sanity check that the counter does track copies.
+      intrusive_ptr<const Primitive> p_primitive_copy = m_primitives[0];
+      TS_ASSERT(ReferenceCounted::GetReferenceOperationsCount() > operations_before);
+#endif
+      }
+
   private:
+    // Compares the intersections of the edited scene with the scene constructed from scratch for the same primitives.
+    void _CompareWithNewScene()
+      {
+      intrusive_ptr<Scene> p_scene(new Scene(m_primitives, NULL, mp_scene->GetLightSources()));
+      BBox3D_d bounds = p_scene->GetWorldBounds();
+      TS_ASSERT_EQUALS(mp_scene->GetWorldBounds().m_min, bounds.m_min);
+      TS_ASSERT_EQUALS(mp_scene->GetWorldBounds().m_max, bounds.m_max);
+
+      RandomGenerator<double> rng;
+      for(size_t i=0;i<1000;++i)
+        {
+        Point3D_d origin(rng(-2.0,7.0), rng(-2.0,2.0), rng(-2.0,12.0));
+        Ray ray(origin, Vector3D_d(rng(-1.0,1.0), rng(-1.0,1.0), rng(-1.0,1.0)).Normalized());
+
+        Intersection isect1, isect2;
+        double t1, t2;
+        bool hit1 = mp_scene->Intersect(RayDifferential(ray), isect1, &t1);
+        bool hit2 = p_scene->Intersect(RayDifferential(ray), isect2, &t2);
+        TS_ASSERT_EQUALS(hit1, hit2);
+        TS_ASSERT_EQUALS(mp_scene->IntersectTest(ray), hit2);
+        if (hit1 && hit2)
+          {
+          TS_ASSERT_EQUALS(t1, t2);
+          TS_ASSERT(isect1.mp_primitive == isect2.mp_primitive);
+          TS_ASSERT_EQUALS(isect1.m_triangle_index, isect2.m_triangle_index);
+          }
+        }
+      }
+
     intrusive_ptr<Primitive> _CreateDummyPrimitive(const Point3D_f &i_origin)
       {
       intrusive_ptr<TriangleMesh> p_mesh( TriangleMeshHelper::ConstructTetrahedron(i_origin) );
@@ -0,0 +1,147 @@
+/*
+* Copyright (C) 2014 by Volodymyr Kachurovskyi <Volodymyr.Kachurovskyi@gmail.com>
+*
+* This file is part of Skwarka.
+*
+* Skwarka is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+*
+* Skwarka is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License along with Skwarka.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef TEXTURE_CACHE_TEST_H
+#define TEXTURE_CACHE_TEST_H
+
+#include <cxxtest/TestSuite.h>
+#include <UnitTests/TestHelpers/CustomValueTraits.h>
+#include <Raytracer/Core/TextureCache.h>
+#include <vector>
+
+class TextureCacheTestSuite : public CxxTest::TestSuite
+  {
+  public:
+    void test_TextureCache_RegisterTexture()
+      {
+      TextureCache cache(1000);
+      size_t id1 = cache.RegisterTexture(), id2 = cache.RegisterTexture();
+      TS_ASSERT_DIFFERS(id1, id2);
+      }
+
+    void test_TextureCache_TileKey()
+      {
+      TS_ASSERT_DIFFERS(TextureCache::GetTileKey(0,1,0), TextureCache::GetTileKey(0,0,1));
+      TS_ASSERT_DIFFERS(TextureCache::GetTileKey(1,0,0), TextureCache::GetTileKey(0,0,1));
+      TS_ASSERT_DIFFERS(TextureCache::GetTileKey(1,0,0), TextureCache::GetTileKey(0,1,0));
+      }
+
+    void test_TextureCache_AddAndGetTile()
+      {
+      TextureCache cache(1000);
+      unsigned long long key = TextureCache::GetTileKey(0,0,0);
+      TS_ASSERT(cache.GetTile(key) == NULL);
+
+      intrusive_ptr<const TextureCache::Tile> p_tile(new TestTile(10));
+      TS_ASSERT(cache.AddTile(key, p_tile) == p_tile);
+      TS_ASSERT(cache.GetTile(key) == p_tile);
+      TS_ASSERT_EQUALS(cache.GetMemoryUsage(), 10*sizeof(float));
+
+      // The tile added for the same key later should be ignored.
+      intrusive_ptr<const TextureCache::Tile> p_tile2(new TestTile(10));
+      TS_ASSERT(cache.AddTile(key, p_tile2) == p_tile);
+      TS_ASSERT_EQUALS(cache.GetTilesNumber(), 1);
+      }
+
+    // Tests that the least recently used tiles are evicted when the memory budget is exceeded.
+    void test_TextureCache_Eviction()
+      {
+      TextureCache cache(3*10*sizeof(float), 64, 1);
+      for(size_t i=0;i<3;++i)
+        cache.AddTile(TextureCache::GetTileKey(0,0,i), new TestTile(10));
+
+      // Access the first tile so that the second one becomes the least recently used.
+      cache.GetTile(TextureCache::GetTileKey(0,0,0));
+      cache.AddTile(TextureCache::GetTileKey(0,0,3), new TestTile(10));
+
+      TS_ASSERT_EQUALS(cache.GetTilesNumber(), 3);
+      TS_ASSERT_EQUALS(cache.GetMemoryUsage(), 3*10*sizeof(float));
+      TS_ASSERT(cache.GetTile(TextureCache::GetTileKey(0,0,0)) != NULL);
+      TS_ASSERT(cache.GetTile(TextureCache::GetTileKey(0,0,1)) == NULL);
+      TS_ASSERT(cache.GetTile(TextureCache::GetTileKey(0,0,2)) != NULL);
+      TS_ASSERT(cache.GetTile(TextureCache::GetTileKey(0,0,3)) != NULL);
+      }
+
+    // Tests that each shard keeps its part of the budget.
+    void test_TextureCache_Shards()
+      {
+      size_t shards_num = 4, tiles_per_shard = 8;
+      TextureCache cache(shards_num*tiles_per_shard*10*sizeof(float), 64, shards_num);
+      TS_ASSERT_EQUALS(cache.GetShardsNumber(), shards_num);
+
+      for(size_t i=0;i<1000;++i)
+        cache.AddTile(TextureCache::GetTileKey(i%3,0,i), new TestTile(10));
+
+      TS_ASSERT(cache.GetMemoryUsage() <= cache.GetMemoryBudget());
+      TS_ASSERT_EQUALS(cache.GetMemoryUsage(), cache.GetTilesNumber()*10*sizeof(float));
+      TS_ASSERT_EQUALS(cache.GetTilesNumber(), shards_num*tiles_per_shard);
+
+      // The most recently added tile is always kept.
+      TS_ASSERT(cache.GetTile(TextureCache::GetTileKey(999%3,0,999)) != NULL);
+      }
+
+    void test_TextureCache_ThreadTiles()
+      {
+      TextureCache cache(1000);
+      TextureCache::ThreadTiles &tiles = cache.GetThreadTiles();
+      TS_ASSERT_EQUALS(&tiles, &cache.GetThreadTiles());
+
+      unsigned long long key = TextureCache::GetTileKey(0,0,5);
+      TS_ASSERT(tiles.Find(key) == NULL);
+
+      intrusive_ptr<const TextureCache::Tile> p_tile(new TestTile(10));
+      tiles.Put(key, p_tile);
+      TS_ASSERT_EQUALS(tiles.Find(key), p_tile->GetData());
+      TS_ASSERT(tiles.Find(TextureCache::GetTileKey(1,0,5)) == NULL);
+      }
+
+    // Tests that the eviction does not invalidate the thread's table and that the evicted tiles are counted in the memory usage until their slots are reused.
+    void test_TextureCache_ThreadTilesEviction()
+      {
+      TextureCache cache(2*10*sizeof(float), 64, 1);
+      unsigned long long key1 = TextureCache::GetTileKey(0,0,0), key2 = TextureCache::GetTileKey(0,0,1);
+
+      TextureCache::ThreadTiles &tiles = cache.GetThreadTiles();
+      tiles.Put(key1, cache.AddTile(key1, new TestTile(10)));
+      tiles.Put(key2, cache.AddTile(key2, new TestTile(10)));
+      cache.AddTile(TextureCache::GetTileKey(0,0,2), new TestTile(10));
+
+      TS_ASSERT(cache.GetTile(key1) == NULL);
+      TS_ASSERT(tiles.Find(key1) != NULL);
+      TS_ASSERT(tiles.Find(key2) != NULL);
+      TS_ASSERT_EQUALS(&tiles, &cache.GetThreadTiles());
+      TS_ASSERT(tiles.Find(key1) != NULL);
+      TS_ASSERT_EQUALS(cache.GetMemoryUsage(), 3*10*sizeof(float));
+
+      intrusive_ptr<const TextureCache::Tile> p_tile(new TestTile(10));
+      tiles.Put(key1, p_tile);
+      TS_ASSERT_EQUALS(tiles.Find(key1), p_tile->GetData());
+      TS_ASSERT_EQUALS(cache.GetMemoryUsage(), 2*10*sizeof(float));
+      }
+
+  private:
+    class TestTile: public TextureCache::Tile
+      {
+      public:
+        TestTile(size_t i_size): m_values(i_size)
+          {
+          _SetData(&m_values[0], m_values.size()*sizeof(float));
+          }
+
+      private:
+        std::vector<float> m_values;
+      };
+  };
+
+#endif // TEXTURE_CACHE_TEST_H
@@ -0,0 +1,128 @@
+/*
+* Copyright (C) 2014 by Volodymyr Kachurovskyi <Volodymyr.Kachurovskyi@gmail.com>
+*
+* This file is part of Skwarka.
+*
+* Skwarka is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+*
+* Skwarka is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License along with Skwarka.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef TONE_MAPPER_TEST_H
+#define TONE_MAPPER_TEST_H
+
+#include <cxxtest/TestSuite.h>
+#include <UnitTests/TestHelpers/CustomValueTraits.h>
+#include <Raytracer/Core/ToneMapper.h>
+#include <Raytracer/Core/Spectrum.h>
+#include <Raytracer/Core/SpectrumRoutines.h>
+#include <Raytracer/Core/Color.h>
+#include <Math/ThreadSafeRandom.h>
+#include <vector>
+
+class ToneMapperTestSuite : public CxxTest::TestSuite
+  {
+  public:
+    // Tests that the result matches the per-pixel conversion via XYZ space. The difference of one quantization level is allowed due to the rounding errors.
+    void test_ToneMapper_ReferenceConversion()
+      {
+      ToneMapper tone_mapper(500.0, 256.0);
+
+      bool correct=true;
+      for(size_t i=0;i<10000;++i)
+        {
+        // Some of the values are out of gamut and some are larger than the white value.
+        float value[3] = {(float)RandomDouble(1.0)-0.1f, (float)RandomDouble(1.0), (float)RandomDouble(0.5)};
+        if (i%2)
+          for(size_t j=0;j<3;++j)
+            value[j] *= 0.01f;
+
+        unsigned char expected[3], rgb[3];
+        _ReferenceToneMap(value, 500.0, 256.0, expected);
+        tone_mapper.ToneMap(value, rgb);
+
+        for(size_t j=0;j<3;++j)
+          if (abs((int)rgb[j]-(int)expected[j]) > 1)
+            correct=false;
+        }
+
+      TS_ASSERT(correct);
+      }
+
+    void test_ToneMapper_Range()
+      {
+      ToneMapper tone_mapper(1.0, 1.0);
+      unsigned char rgb[3];
+
+      float black[3] = {0.f, 0.f, 0.f};
+      tone_mapper.ToneMap(black, rgb);
+      TS_ASSERT(rgb[0]==0 && rgb[1]==0 && rgb[2]==0);
+
+      float negative[3] = {-1.f, -1.f, -1.f};
+      tone_mapper.ToneMap(negative, rgb);
+      TS_ASSERT(rgb[0]==0 && rgb[1]==0 && rgb[2]==0);
+
+      float white[3] = {100.f, 100.f, 100.f};
+      tone_mapper.ToneMap(white, rgb);
+      TS_ASSERT(rgb[0]==255 && rgb[1]==255 && rgb[2]==255);
+      }
+
+    // Tests the pixel format, the row pitch and the rows flipping.
+    void test_ToneMapper_Image()
+      {
+      ToneMapper tone_mapper(500.0, 256.0);
+
+      size_t width=7, height=5, pitch=32;
+      std::vector<float> values(width*height*3);
+      for(size_t i=0;i<values.size();++i)
+        values[i] = (float)RandomDouble(1.0);
+
+      std::vector<unsigned char> rgba(height*pitch, 0), bgra(height*pitch, 0);
+      tone_mapper.ToneMap(values, width, height, ToneMapper::PIXEL_FORMAT_RGBA, false, &rgba[0], pitch);
+      tone_mapper.ToneMap(values, width, height, ToneMapper::PIXEL_FORMAT_BGRA, true, &bgra[0], pitch);
+
+      bool correct=true;
+      for(size_t y=0;y<height;++y)
+        {
+        for(size_t x=0;x<width;++x)
+          {
+          unsigned char expected[3];
+          tone_mapper.ToneMap(&values[(y*width+x)*3], expected);
+
+          const unsigned char *p_rgba = &rgba[y*pitch+x*4], *p_bgra = &bgra[(height-y-1)*pitch+x*4];
+          if (p_rgba[0]!=expected[0] || p_rgba[1]!=expected[1] || p_rgba[2]!=expected[2] || p_rgba[3]!=255)
+            correct=false;
+          if (p_bgra[2]!=expected[0] || p_bgra[1]!=expected[1] || p_bgra[0]!=expected[2] || p_bgra[3]!=255)
+            correct=false;
+          }
+
+        // The padding bytes should not be touched.
+        for(size_t i=width*4;i<pitch;++i)
+          if (rgba[y*pitch+i]!=0 || bgra[y*pitch+i]!=0)
+            correct=false;
+        }
+
+      TS_ASSERT(correct);
+      }
+
+  private:
+    void _ReferenceToneMap(const float i_value[3], double i_scale, double i_white_value, unsigned char o_rgb[3])
+      {
+      Spectrum_d sp(i_value[0], i_value[1], i_value[2]);
+      sp *= i_scale;
+
+      RGBColor_d color = global_sRGB_D65_ColorSystem.XYZ_To_RGB(SpectrumRoutines::SpectrumToXYZ(sp), true);
+      color.Clamp(0.0, i_white_value);
+      color[0]/=i_white_value; color[1]/=i_white_value; color[2]/=i_white_value;
+      color = global_sRGB_D65_ColorSystem.GammaEncode(color);
+
+      for(unsigned char i=0;i<3;++i)
+        o_rgb[i] = (unsigned char) std::min(255, (int)(color[i]*256.0));
+      }
+  };
+
+#endif // TONE_MAPPER_TEST_H
@@ -161,6 +161,85 @@ class TriangleAcceleratorTestSuite : public CxxTest::TestSuite
         }
       }
 
+    // Shoots coherent shadow-like rays and compares the results of the occlusion query with and without the occluder hint.
+    void test_TriangleAccelerator_IntersectTestWithHint()
+      {
+      RandomGenerator<double> rg;
+      BBox3D_d bbox = mp_triangle_accelerator->GetWorldBounds();
+
+      OccluderHint hint;
+      TS_ASSERT_EQUALS(hint.m_instance_index, std::numeric_limits<size_t>::max());
+
+      bool hint_set = false;
+      for(size_t i=0;i<100;++i)
+        {
+        Point3D_d point(rg(bbox.m_min[0], bbox.m_max[0]), rg(bbox.m_min[1], bbox.m_max[1]), rg(bbox.m_min[2], bbox.m_max[2]));
+        Point3D_d light(rg(bbox.m_min[0], bbox.m_max[0]), rg(bbox.m_min[1], bbox.m_max[1]), rg(bbox.m_min[2], bbox.m_max[2]));
+
+        for(size_t j=0;j<100;++j)
+          {
+          Point3D_d target = light + Point3D_d(rg(-1.0,1.0), rg(-1.0,1.0), rg(-1.0,1.0));
+          Vector3D_d direction = Vector3D_d(target-point);
+          double distance = direction.Length();
+          Ray ray(point, direction/distance, 0.0, distance);
+
+          bool hit = mp_triangle_accelerator->IntersectTest(ray, &hint);
+          if (hit != mp_triangle_accelerator->IntersectTest(ray))
+            {
+            TS_FAIL("TriangleAccelerator::IntersectTest() with hint test failed.");
+            return;
+            }
+
+          hint_set |= hit;
+          }
+        }
+
+      TS_ASSERT(hint_set && hint.m_instance_index < m_primitives.size());
+
+      // The hint filled by the other accelerator should not affect the results.
+      std::vector<intrusive_ptr<const Primitive>> primitives(1, _CreatePrimitive(TriangleMeshHelper::ConstructSphere(Point3D_d(0,0,0), 1.0, 2)));
+      TriangleAccelerator accelerator(primitives);
+      for(size_t i=0;i<1000;++i)
+        {
+        Ray ray(Point3D_d(rg(-2.0,2.0), rg(-2.0,2.0), rg(-2.0,2.0)), Vector3D_d(rg(1.0), rg(1.0), rg(1.0)).Normalized(), 0.0, rg(0.1, 2.0));
+        OccluderHint stale_hint(hint);
+        if (accelerator.IntersectTest(ray, &stale_hint) != accelerator.IntersectTest(ray))
+          {
+          TS_FAIL("TriangleAccelerator::IntersectTest() with stale hint test failed.");
+          return;
+          }
+        }
+      }
+
+    // Shoots rays from inside a closed mesh exactly through its vertices and edges, none of the rays should leak through.
+    void test_TriangleAccelerator_Watertight()
+      {
+      intrusive_ptr<TriangleMesh> p_mesh( TriangleMeshHelper::ConstructSphere(Point3D_d(100.3,50.2,-30.1), 1.0, 4) );
+      std::vector<intrusive_ptr<const Primitive>> primitives(1, _CreatePrimitive(p_mesh));
+      TriangleAccelerator accelerator(primitives);
+
+      RandomGenerator<double> rg;
+      for(size_t i=0;i<p_mesh->GetNumberOfTriangles();++i)
+        {
+        MeshTriangle triangle = p_mesh->GetTriangle(i);
+        Point3D_d v0 = Convert<double>(p_mesh->GetVertex(triangle.m_vertices[0]));
+        Point3D_d v1 = Convert<double>(p_mesh->GetVertex(triangle.m_vertices[1]));
+        Point3D_d v2 = Convert<double>(p_mesh->GetVertex(triangle.m_vertices[2]));
+
+        Point3D_d origin(100.3+rg(-0.5,0.5), 50.2+rg(-0.5,0.5), -30.1+rg(-0.5,0.5));
+        Point3D_d targets[2] = {v0, (v1+v2)*0.5};
+        for(size_t j=0;j<2;++j)
+          {
+          Ray ray(origin, Vector3D_d(targets[j]-origin).Normalized());
+          if (accelerator.IntersectTest(ray) == false)
+            {
+            TS_FAIL("Ray leaked through the mesh.");
+            return;
+            }
+          }
+        }
+      }
+
     void test_TriangleAccelerator_ObjectInstancing()
       {
       std::vector<intrusive_ptr<const Primitive>> primitives1, primitives2;
@@ -202,7 +281,177 @@ class TriangleAcceleratorTestSuite : public CxxTest::TestSuite
         }
       }
 
+    void test_TriangleAccelerator_SetPrimitive()
+      {
+      std::vector<intrusive_ptr<const Primitive>> primitives;
+      RandomGenerator<double> rg;
+
+      intrusive_ptr<TriangleMesh> p_shared_mesh( TriangleMeshHelper::ConstructTetrahedron(Point3D_f(0,0,0)) );
+      for(size_t i=0;i<1000;++i)
+        {
+        Transform transform = MakeTranslation(Vector3D_d(rg(100), rg(100), rg(100)))*MakeRotationY(rg(6.0));
+        if (i%10 == 0)
+          primitives.push_back( _CreatePrimitive(TriangleMeshHelper::ConstructSphere(Point3D_d(0,0,0), 1.0, 2), transform) );
+        else
+          primitives.push_back( _CreatePrimitive(p_shared_mesh, transform) );
+        }
+
+      TriangleAccelerator accelerator(primitives);
+
+      // Move a small subset of the primitives slightly, this should only refit the top-level tree.
+      for(size_t i=0;i<primitives.size();i+=50)
+        {
+        const Primitive *p_primitive = primitives[i].get();
+        Transform transform = MakeTranslation(Vector3D_d(rg(1.0), rg(1.0), rg(1.0)))*p_primitive->GetMeshToWorldTransform();
+        primitives[i] = new Primitive(p_primitive->GetTriangleMesh(), transform, p_primitive->GetMaterial());
+        accelerator.SetPrimitive(i, primitives[i]);
+        }
+      TS_ASSERT(accelerator.UpdateTopLevelTree() == false);
+      TriangleAccelerator reference_accelerator1(primitives);
+      _CompareAccelerators(accelerator, reference_accelerator1, rg);
+
+      // Now scatter all the primitives, this should trigger the rebuild of the top-level tree.
+      for(size_t i=0;i<primitives.size();++i)
+        {
+        const Primitive *p_primitive = primitives[i].get();
+        Transform transform = MakeTranslation(Vector3D_d(rg(1000), rg(1000), rg(1000)))*p_primitive->GetMeshToWorldTransform();
+        primitives[i] = new Primitive(p_primitive->GetTriangleMesh(), transform, p_primitive->GetMaterial());
+        accelerator.SetPrimitive(i, primitives[i]);
+        }
+      TS_ASSERT(accelerator.UpdateTopLevelTree() == true);
+      TriangleAccelerator reference_accelerator2(primitives);
+      _CompareAccelerators(accelerator, reference_accelerator2, rg);
+      }
+
+    void test_TriangleAccelerator_AddRemovePrimitive()
+      {
+      std::vector<intrusive_ptr<const Primitive>> primitives;
+      RandomGenerator<double> rg;
+
+      intrusive_ptr<TriangleMesh> p_shared_mesh( TriangleMeshHelper::ConstructTetrahedron(Point3D_f(0,0,0)) );
+      for(size_t i=0;i<100;++i)
+        primitives.push_back( _CreatePrimitive(p_shared_mesh, MakeTranslation(Vector3D_d(rg(100), rg(100), rg(100)))) );
+
+      TriangleAccelerator accelerator(primitives);
+
+      // Replace the mesh of one of the primitives, add new primitives and remove some of the existing ones.
+      primitives[10] = _CreatePrimitive(TriangleMeshHelper::ConstructSphere(Point3D_d(0,0,0), 3.0, 3), primitives[10]->GetMeshToWorldTransform());
+      accelerator.SetPrimitive(10, primitives[10]);
+      for(size_t i=0;i<20;++i)
+        {
+        if (i%2)
+          primitives.push_back( _CreatePrimitive(p_shared_mesh, MakeTranslation(Vector3D_d(rg(100), rg(100), rg(100)))) );
+        else
+          primitives.push_back( _CreatePrimitive(TriangleMeshHelper::ConstructSphere(Point3D_d(rg(100), rg(100), rg(100)), 1.0, 2)) );
+        accelerator.AddPrimitive(primitives.back());
+        }
+      for(size_t i=0;i<10;++i)
+        {
+        size_t index = (size_t)rg(primitives.size());
+        primitives.erase(primitives.begin()+index);
+        accelerator.RemovePrimitive(index);
+        }
+
+      TS_ASSERT(accelerator.UpdateTopLevelTree() == true);
+      TriangleAccelerator reference_accelerator(primitives);
+      _CompareAccelerators(accelerator, reference_accelerator, rg);
+      }
+
+    void test_TriangleAccelerator_UpdateMesh()
+      {
+      std::vector<intrusive_ptr<const Primitive>> primitives;
+      RandomGenerator<double> rg;
+
+      intrusive_ptr<TriangleMesh> p_deforming_mesh( TriangleMeshHelper::ConstructSphere(Point3D_d(0,0,0), 1.0, 4) );
+      for(size_t i=0;i<100;++i)
+        {
+        Transform transform = MakeTranslation(Vector3D_d(rg(100), rg(100), rg(100)));
+        if (i%10 == 0)
+          primitives.push_back( _CreatePrimitive(TriangleMeshHelper::ConstructTetrahedron(Point3D_f(0,0,0)), transform) );
+        else
+          primitives.push_back( _CreatePrimitive(p_deforming_mesh, transform) );
+        }
+
+      TriangleAccelerator accelerator(primitives);
+
+      // Deform the mesh slightly, this should only refit the bottom-level tree.
+      std::vector<Point3D_f> vertices(p_deforming_mesh->GetNumberOfVertices());
+      for(size_t i=0;i<vertices.size();++i)
+        vertices[i] = p_deforming_mesh->GetVertex(i) + Point3D_f((float)rg(0.01), (float)rg(0.01), (float)rg(0.01));
+      p_deforming_mesh->SetVertices(vertices);
+
+      TS_ASSERT(accelerator.UpdateMesh(p_deforming_mesh.get()) == false);
+      accelerator.UpdateTopLevelTree();
+      TriangleAccelerator reference_accelerator1(primitives);
+      _CompareAccelerators(accelerator, reference_accelerator1, rg);
+
+      // Now scramble the vertices, this should trigger the rebuild of the bottom-level tree.
+      for(size_t i=0;i<vertices.size();++i)
+        vertices[i] = Point3D_f((float)rg(-5.0, 5.0), (float)rg(-5.0, 5.0), (float)rg(-5.0, 5.0));
+      p_deforming_mesh->SetVertices(vertices);
+
+      TS_ASSERT(accelerator.UpdateMesh(p_deforming_mesh.get()) == true);
+      accelerator.UpdateTopLevelTree();
+      TriangleAccelerator reference_accelerator2(primitives);
+      _CompareAccelerators(accelerator, reference_accelerator2, rg);
+      }
+
+    void test_TriangleAccelerator_MortonBuildModes()
+      {
+      RandomGenerator<double> rg;
+
+      TriangleAccelerator accelerator1(m_primitives, TriangleAccelerator::BUILD_MODE_MORTON);
+      _CompareAccelerators(accelerator1, *mp_triangle_accelerator, rg);
+
+      TriangleAccelerator accelerator2(m_primitives, TriangleAccelerator::BUILD_MODE_MORTON_OPTIMIZED);
+      _CompareAccelerators(accelerator2, *mp_triangle_accelerator, rg);
+
+      // The rebuilt bottom-level trees should use the same build mode.
+      std::vector<intrusive_ptr<const Primitive>> primitives;
+      intrusive_ptr<TriangleMesh> p_deforming_mesh( TriangleMeshHelper::ConstructSphere(Point3D_d(0,0,0), 10.0, 4) );
+      primitives.push_back( _CreatePrimitive(p_deforming_mesh) );
+      TriangleAccelerator accelerator3(primitives, TriangleAccelerator::BUILD_MODE_MORTON_OPTIMIZED);
+
+      std::vector<Point3D_f> vertices(p_deforming_mesh->GetNumberOfVertices());
+      for(size_t i=0;i<vertices.size();++i)
+        vertices[i] = Point3D_f((float)rg(-5.0, 5.0), (float)rg(-5.0, 5.0), (float)rg(-5.0, 5.0));
+      p_deforming_mesh->SetVertices(vertices);
+
+      TS_ASSERT(accelerator3.UpdateMesh(p_deforming_mesh.get()) == true);
+      accelerator3.UpdateTopLevelTree();
+      TriangleAccelerator reference_accelerator(primitives);
+      _CompareAccelerators(accelerator3, reference_accelerator, rg);
+      }
+
   private:
+    void _CompareAccelerators(const TriangleAccelerator &i_accelerator1, const TriangleAccelerator &i_accelerator2, RandomGenerator<double> &i_rg) const
+      {
+      BBox3D_d bounds = i_accelerator2.GetWorldBounds();
+      CustomAssertDelta(i_accelerator1.GetWorldBounds().m_min, bounds.m_min, (1e-3));
+      CustomAssertDelta(i_accelerator1.GetWorldBounds().m_max, bounds.m_max, (1e-3));
+
+      for(size_t i=0;i<10000;++i)
+        {
+        Point3D_d point(i_rg(bounds.m_min[0], bounds.m_max[0]), i_rg(bounds.m_min[1], bounds.m_max[1]), i_rg(bounds.m_min[2], bounds.m_max[2]));
+        Vector3D_d dir(i_rg(1.0), i_rg(1.0), i_rg(1.0));
+        Ray ray(point, dir.Normalized());
+
+        Intersection isect1, isect2;
+        double t1,t2;
+        bool hit1 = i_accelerator1.Intersect(RayDifferential(ray), isect1, &t1);
+        bool hit2 = i_accelerator2.Intersect(RayDifferential(ray), isect2, &t2);
+
+        TS_ASSERT_EQUALS(hit1, hit2);
+        TS_ASSERT_EQUALS(i_accelerator1.IntersectTest(ray), hit2);
+        if (hit1 && hit2)
+          {
+          TS_ASSERT_DELTA(t1,t2,(1e-6));
+          TS_ASSERT_EQUALS(isect1.mp_primitive, isect2.mp_primitive);
+          TS_ASSERT_EQUALS(isect1.m_triangle_index, isect2.m_triangle_index);
+          }
+        }
+      }
+
     intrusive_ptr<Primitive> _CreatePrimitive(intrusive_ptr<TriangleMesh> ip_mesh, const Transform &i_transform = Transform()) const
       {
       intrusive_ptr<Material> p_material(new MaterialMock());
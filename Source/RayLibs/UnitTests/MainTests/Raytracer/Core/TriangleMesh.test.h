@@ -80,6 +80,27 @@ class TriangleMeshTestSuite : public CxxTest::TestSuite
       TS_ASSERT_DELTA(area, p_mesh->GetArea(), FLT_EPS);
       }
 
+    void test_TriangleMesh_SetVertices()
+      {
+      intrusive_ptr<TriangleMesh> p_mesh=TriangleMeshHelper::ConstructTetrahedron();
+      BBox3D_f bbox = p_mesh->GetBounds();
+      float area = p_mesh->GetArea();
+      Vector3D_f normal = p_mesh->GetTriangleNormal(0);
+
+      // Scale the mesh twice, the bounds and the area should be updated while the triangle normals should remain the same.
+      std::vector<Point3D_f> vertices(p_mesh->GetNumberOfVertices());
+      for(size_t i=0;i<vertices.size();++i)
+        vertices[i] = p_mesh->GetVertex(i)*2.f;
+      p_mesh->SetVertices(vertices);
+
+      TS_ASSERT_EQUALS(p_mesh->GetNumberOfVertices(), vertices.size());
+      TS_ASSERT_EQUALS(p_mesh->GetVertex(1), vertices[1]);
+      CustomAssertDelta(p_mesh->GetBounds().m_min, bbox.m_min*2.f, (1e-6f));
+      CustomAssertDelta(p_mesh->GetBounds().m_max, bbox.m_max*2.f, (1e-6f));
+      TS_ASSERT_DELTA(p_mesh->GetArea(), 4.f*area, (1e-5f));
+      CustomAssertDelta(p_mesh->GetTriangleNormal(0), normal, (1e-6f));
+      }
+
     // Tests a case when the mesh is solid.
     void test_TriangleMesh_SolidTopologyInfo()
       {
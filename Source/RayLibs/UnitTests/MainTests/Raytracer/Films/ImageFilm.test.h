@@ -138,6 +138,40 @@ class ImageFilmTestSuite : public CxxTest::TestSuite
       TS_ASSERT(correct);
       }
 
+    // Tests that GetPixels() method returns the same values as GetPixel() method does for each pixel of the region.
+    void test_ImageFilm_GetPixels()
+      {
+      mp_film->SetCropWindow(Point2D_i(20,10),Point2D_i(80,40));
+      for(size_t i=0;i<300;++i)
+        {
+        Point2D_d image_point(RandomDouble(100.0), RandomDouble(50.0));
+        Spectrum_d sp(RandomDouble(1.0)-0.1,RandomDouble(1.0),RandomDouble(1.0));
+        mp_film->AddSample(image_point,sp);
+        }
+
+      Point2D_i begin(10,5), end(90,45);
+      std::vector<float> values;
+      size_t pixels_read = mp_film->GetPixels(begin, end, values);
+      TS_ASSERT_EQUALS(values.size(), 80*40*3);
+
+      bool correct=true;
+      size_t expected_pixels_read=0;
+      for(int y=begin[1];y<end[1];++y)
+        for(int x=begin[0];x<end[0];++x)
+          {
+          Spectrum_d expected;
+          if (mp_film->GetPixel(Point2D_i(x,y), expected))
+            ++expected_pixels_read;
+
+          const float *p_value = &values[((y-begin[1])*80+(x-begin[0]))*3];
+          if (p_value[0]!=(float)expected[0] || p_value[1]!=(float)expected[1] || p_value[2]!=(float)expected[2])
+            correct=false;
+          }
+
+      TS_ASSERT(correct);
+      TS_ASSERT_EQUALS(pixels_read, expected_pixels_read);
+      }
+
     void test_ImageFilm_GetCropWindow()
       {
       mp_film->SetCropWindow(Point2D_i(20,10),Point2D_i(80,40));
@@ -0,0 +1,243 @@
+/*
+* Copyright (C) 2014 by Volodymyr Kachurovskyi <Volodymyr.Kachurovskyi@gmail.com>
+*
+* This file is part of Skwarka.
+*
+* Skwarka is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+*
+* Skwarka is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License along with Skwarka.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef TILED_INTERACTIVE_FILM_TEST_H
+#define TILED_INTERACTIVE_FILM_TEST_H
+
+#include <cxxtest/TestSuite.h>
+#include <UnitTests/TestHelpers/CustomValueTraits.h>
+#include <Raytracer/Core/Film.h>
+#include <Raytracer/Core/Spectrum.h>
+#include <UnitTests/Mocks/FilmFilterMock.h>
+#include <Math/ThreadSafeRandom.h>
+#include <Raytracer/Films/ImageFilm.h>
+#include <Raytracer/Films/TiledInteractiveFilm.h>
+#include <Math/Point2D.h>
+#include <tbb/tbb.h>
+
+class TiledInteractiveFilmTestSuite : public CxxTest::TestSuite
+  {
+  public:
+    void setUp()
+      {
+      mp_filter = intrusive_ptr<FilmFilter>(new FilmFilterMock(4.0,2.0));
+      mp_film = intrusive_ptr<TiledInteractiveFilm>(new TiledInteractiveFilm(100,50,mp_filter));
+      }
+
+    void tearDown()
+      {
+      // Nothing to clear.
+      }
+
+    void test_TiledInteractiveFilm_Extent()
+      {
+      Point2D_i begin, end;
+      mp_film->GetSamplingExtent(begin, end);
+
+      TS_ASSERT_EQUALS(begin, Convert<int>( Point2D_d(-mp_filter->GetXWidth(),-mp_filter->GetYWidth()) ) );
+      TS_ASSERT_EQUALS(end, Convert<int>( Point2D_d(100+mp_filter->GetXWidth(),50+mp_filter->GetYWidth()) ) );
+      }
+
+    void test_TiledInteractiveFilm_CropWindowExtent()
+      {
+      Point2D_i begin, end;
+      mp_film->SetCropWindow(Point2D_i(20,10),Point2D_i(80,40));
+      mp_film->GetSamplingExtent(begin, end);
+
+      TS_ASSERT_EQUALS(begin, Convert<int>( Point2D_d(20-mp_filter->GetXWidth(),10-mp_filter->GetYWidth()) ) );
+      TS_ASSERT_EQUALS(end, Convert<int>( Point2D_d(80+mp_filter->GetXWidth(),40+mp_filter->GetYWidth()) ) );
+      }
+
+    // Tests that the pixels with samples have exactly the same values as the ones of ImageFilm.
+    void test_TiledInteractiveFilm_Pixel()
+      {
+      ImageFilm image_film(100, 50, mp_filter);
+      for(size_t i=0;i<1000;++i)
+        {
+        Point2D_d image_point(RandomDouble(100.0), RandomDouble(50.0));
+        Spectrum_d sp(RandomDouble(1.0),RandomDouble(1.0),RandomDouble(1.0));
+        mp_film->AddSample(image_point,sp);
+        image_film.AddSample(image_point,sp);
+        }
+
+      bool correct=true;
+      for(int x=0;x<100;++x)
+        for(int y=0;y<50;++y)
+          {
+          Spectrum_d expected, spectrum_res;
+          if (image_film.GetPixel(Point2D_i(x,y), expected, false))
+            if (mp_film->GetPixel(Point2D_i(x,y), spectrum_res, false)==false || spectrum_res!=expected)
+              correct=false;
+          }
+
+      TS_ASSERT(correct);
+      }
+
+    void test_TiledInteractiveFilm_Clear()
+      {
+      for(size_t x=0;x<100;++x)
+        for(size_t y=0;y<50;++y)
+          {
+          Point2D_d image_point=Point2D_d(x+RandomDouble(1.0),y+RandomDouble(1.0));
+          Spectrum_d sp(RandomDouble(1.0),RandomDouble(1.0),RandomDouble(1.0));
+          mp_film->AddSample(image_point,sp);
+          }
+
+      // Read a pixel to make the film update its coarser layers too.
+      Spectrum_d spectrum_res;
+      TS_ASSERT(mp_film->GetPixel(Point2D_i(0,0), spectrum_res, false));
+
+      mp_film->ClearFilm();
+
+      bool cleared=true;
+      for(size_t x=0;x<100;++x)
+        for(size_t y=0;y<50;++y)
+          if (mp_film->GetPixel(Point2D_i((int)x, (int)y), spectrum_res, false))
+            cleared=false;
+
+      TS_ASSERT(cleared);
+      }
+
+    // Test that GetPixel() method returns false outside of the cropping window.
+    void test_TiledInteractiveFilm_CropWindowPixels()
+      {
+      mp_film->SetCropWindow(Point2D_i(20,10),Point2D_i(80,40));
+
+      for(size_t x=0;x<100;++x)
+        for(size_t y=0;y<50;++y)
+          {
+          Point2D_d image_point=Point2D_d(x+RandomDouble(1.0),y+RandomDouble(1.0));
+          Spectrum_d sp(RandomDouble(1.0),RandomDouble(1.0),RandomDouble(1.0));
+          mp_film->AddSample(image_point,sp);
+          }
+
+      bool correct=true;
+      for(size_t x=0;x<100;++x)
+        for(size_t y=0;y<50;++y)
+          {
+          Spectrum_d spectrum_res;
+          bool pixel_read = mp_film->GetPixel(Point2D_i((int)x, (int)y), spectrum_res, false);
+
+          bool inside_crop_window = (x>=20 && x<80 && y>=10 && y<40);
+          if (inside_crop_window != pixel_read)
+            correct=false;
+          }
+
+      TS_ASSERT(correct);
+      }
+
+    // Test that after adding one sample other unfilled pixels have its spectrum value.
+    void test_TiledInteractiveFilm_Approximation()
+      {
+      Spectrum_d sp(1.0, 0.5, 0.2);
+      mp_film->AddSample(Point2D_d(10.0,20.0),sp);
+
+      Spectrum_d spectrum_res;
+      bool pixel_read = mp_film->GetPixel(Point2D_i(90,45), spectrum_res, false);
+
+      TS_ASSERT(pixel_read);
+      CustomAssertDelta(sp, spectrum_res, (1e-10));
+      }
+
+    // Test that the coarser layers are updated with the samples added after they were read.
+    void test_TiledInteractiveFilm_ApproximationUpdate()
+      {
+      Spectrum_d sp1(1.0, 0.5, 0.2), sp2(0.2, 0.4, 0.6);
+      mp_film->AddSample(Point2D_d(10.0,20.0),sp1);
+
+      Spectrum_d spectrum_res;
+      TS_ASSERT(mp_film->GetPixel(Point2D_i(90,45), spectrum_res, false));
+      CustomAssertDelta(sp1, spectrum_res, (1e-10));
+
+      // The sample has the same number of contributing pixels as the first one.
+      mp_film->AddSample(Point2D_d(30.0,20.0),sp2);
+      TS_ASSERT(mp_film->GetPixel(Point2D_i(90,45), spectrum_res, false));
+      CustomAssertDelta((sp1+sp2)/2.0, spectrum_res, (1e-10));
+      }
+
+    // Test that the samples added concurrently with reading the pixels are all accounted for.
+    void test_TiledInteractiveFilm_ConcurrentAccess()
+      {
+      Spectrum_d sp(1.0, 0.5, 0.2);
+
+      tbb::parallel_for((size_t)0, (size_t)20000, [&](size_t i)
+        {
+        if (i%4 == 0)
+          {
+          Spectrum_d spectrum_res;
+          mp_film->GetPixel(Point2D_i((int)(i%100), (int)(i%50)), spectrum_res, false);
+          }
+        else
+          mp_film->AddSample(Point2D_d(50.0, 25.0), sp);
+        });
+
+      // All samples are added to the same point and thus each pixel within the filter's support has the same weight sum.
+      Spectrum_d spectrum_res;
+      TS_ASSERT(mp_film->GetPixel(Point2D_i(50,25), spectrum_res, false));
+      CustomAssertDelta(sp, spectrum_res, (1e-10));
+      TS_ASSERT(mp_film->GetPixel(Point2D_i(0,0), spectrum_res, false));
+      CustomAssertDelta(sp, spectrum_res, (1e-10));
+      }
+
+    // Tests that GetPixels() method returns the same values as GetPixel() method does for each pixel of the region.
+    void test_TiledInteractiveFilm_GetPixels()
+      {
+      mp_film->SetCropWindow(Point2D_i(20,10),Point2D_i(80,40));
+      for(size_t i=0;i<300;++i)
+        {
+        Point2D_d image_point(RandomDouble(100.0), RandomDouble(50.0));
+        Spectrum_d sp(RandomDouble(1.0)-0.1,RandomDouble(1.0),RandomDouble(1.0));
+        mp_film->AddSample(image_point,sp);
+        }
+
+      Point2D_i begin(10,5), end(90,45);
+      std::vector<float> values;
+      size_t pixels_read = mp_film->GetPixels(begin, end, values);
+      TS_ASSERT_EQUALS(values.size(), 80*40*3);
+
+      bool correct=true;
+      size_t expected_pixels_read=0;
+      for(int y=begin[1];y<end[1];++y)
+        for(int x=begin[0];x<end[0];++x)
+          {
+          Spectrum_d expected;
+          if (mp_film->GetPixel(Point2D_i(x,y), expected))
+            ++expected_pixels_read;
+
+          const float *p_value = &values[((y-begin[1])*80+(x-begin[0]))*3];
+          if (p_value[0]!=(float)expected[0] || p_value[1]!=(float)expected[1] || p_value[2]!=(float)expected[2])
+            correct=false;
+          }
+
+      TS_ASSERT(correct);
+      TS_ASSERT_EQUALS(pixels_read, expected_pixels_read);
+      }
+
+    void test_TiledInteractiveFilm_GetCropWindow()
+      {
+      mp_film->SetCropWindow(Point2D_i(20,10),Point2D_i(80,40));
+
+      Point2D_i begin, end;
+      mp_film->GetCropWindow(begin, end);
+
+      TS_ASSERT_EQUALS(begin, Point2D_i(20,10));
+      TS_ASSERT_EQUALS(end, Point2D_i(80,40));
+      }
+
+  private:
+    intrusive_ptr<FilmFilter> mp_filter;
+    intrusive_ptr<TiledInteractiveFilm> mp_film;
+  };
+
+#endif // TILED_INTERACTIVE_FILM_TEST_H
@@ -0,0 +1,242 @@
+/*
+* Copyright (C) 2014 by Volodymyr Kachurovskyi <Volodymyr.Kachurovskyi@gmail.com>
+*
+* This file is part of Skwarka.
+*
+* Skwarka is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+*
+* Skwarka is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License along with Skwarka.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef DIRECT_LIGHTING_LTE_INTEGRATOR_TEST_H
+#define DIRECT_LIGHTING_LTE_INTEGRATOR_TEST_H
+
+#include <cxxtest/TestSuite.h>
+#include <UnitTests/TestHelpers/CustomValueTraits.h>
+#include <Raytracer/LTEIntegrators/DirectLightingLTEIntegrator.h>
+#include <Raytracer/Core/Primitive.h>
+#include <Raytracer/VolumeRegions/HomogeneousVolumeRegion.h>
+#include <Raytracer/VolumeRegions/GridDensityVolumeRegion.h>
+#include <Raytracer/PhaseFunctions/HGPhaseFunction.h>
+#include <Raytracer/PhaseFunctions/TabulatedPhaseFunction.h>
+#include <Raytracer/Samplers/StratifiedSampler.h>
+#include <Raytracer/Materials/MatteMaterial.h>
+#include <Raytracer/Textures/ConstantTexture.h>
+#include "Mocks/InfiniteLightSourceMock.h"
+#include <UnitTests/TestHelpers/TriangleMeshTestHelper.h>
+
+/**
+* Phase function that forwards all calls to the wrapped phase function and counts the sampled directions.
+*/
+class CountingPhaseFunction: public PhaseFunction
+  {
+  public:
+    CountingPhaseFunction(intrusive_ptr<const PhaseFunction> ip_phase_function): mp_phase_function(ip_phase_function), m_samples_num(0)
+      {
+      }
+
+    double ScatteringPDF(const Vector3D_d &i_incoming, const Vector3D_d &i_outgoing) const
+      {
+      return mp_phase_function->ScatteringPDF(i_incoming, i_outgoing);
+      }
+
+    double Sample(const Vector3D_d &i_incoming, const Point2D_d &i_sample, Vector3D_d &o_outgoing) const
+      {
+      ++m_samples_num;
+      return mp_phase_function->Sample(i_incoming, i_sample, o_outgoing);
+      }
+
+    double PDF(const Vector3D_d &i_incoming, const Vector3D_d &i_outgoing) const
+      {
+      return mp_phase_function->PDF(i_incoming, i_outgoing);
+      }
+
+    size_t GetSamplesNumber() const
+      {
+      return m_samples_num;
+      }
+
+  private:
+    intrusive_ptr<const PhaseFunction> mp_phase_function;
+    mutable size_t m_samples_num;
+  };
+
+/**
+* Volume region that forwards all calls to the wrapped volume region and counts the emission evaluations at the points with no media.
+*/
+class CountingVolumeRegion: public VolumeRegion
+  {
+  public:
+    CountingVolumeRegion(intrusive_ptr<const VolumeRegion> ip_volume): mp_volume(ip_volume), m_empty_evaluations_num(0)
+      {
+      }
+
+    BBox3D_d GetBounds() const { return mp_volume->GetBounds(); }
+    bool Intersect(const Ray &i_ray, double *op_t_begin, double *op_t_end) const { return mp_volume->Intersect(i_ray, op_t_begin, op_t_end); }
+    SpectrumCoef_d Absorption(const Point3D_d &i_point) const { return mp_volume->Absorption(i_point); }
+    SpectrumCoef_d Scattering(const Point3D_d &i_point) const { return mp_volume->Scattering(i_point); }
+    SpectrumCoef_d Attenuation(const Point3D_d &i_point) const { return mp_volume->Attenuation(i_point); }
+
+    Spectrum_d Emission(const Point3D_d &i_point) const
+      {
+      if (mp_volume->Attenuation(i_point).IsBlack())
+        ++m_empty_evaluations_num;
+      return mp_volume->Emission(i_point);
+      }
+
+    double Phase(const Point3D_d &i_point, const Vector3D_d &i_incoming, const Vector3D_d &i_outgoing) const
+      {
+      return mp_volume->Phase(i_point, i_incoming, i_outgoing);
+      }
+
+    double SamplePhase(const Point3D_d &i_point, const Vector3D_d &i_incoming, const Point2D_d &i_sample, Vector3D_d &o_outgoing) const
+      {
+      return mp_volume->SamplePhase(i_point, i_incoming, i_sample, o_outgoing);
+      }
+
+    double PhasePDF(const Point3D_d &i_point, const Vector3D_d &i_incoming, const Vector3D_d &i_outgoing) const
+      {
+      return mp_volume->PhasePDF(i_point, i_incoming, i_outgoing);
+      }
+
+    SpectrumCoef_d OpticalThickness(const Ray &i_ray, double i_step, double i_offset_sample) const
+      {
+      return mp_volume->OpticalThickness(i_ray, i_step, i_offset_sample);
+      }
+
+    SpectrumCoef_d Transmittance(const Ray &i_ray, double i_step, RandomGenerator<double> &io_random_generator) const
+      {
+      return mp_volume->Transmittance(i_ray, i_step, io_random_generator);
+      }
+
+    double SkipEmptySpace(const Ray &i_ray, double i_t_begin, double i_t_end) const
+      {
+      return mp_volume->SkipEmptySpace(i_ray, i_t_begin, i_t_end);
+      }
+
+    size_t GetEmptyEvaluationsNumber() const
+      {
+      return m_empty_evaluations_num;
+      }
+
+  private:
+    intrusive_ptr<const VolumeRegion> mp_volume;
+    mutable size_t m_empty_evaluations_num;
+  };
+
+class DirectLightingLTEIntegratorTestSuite : public CxxTest::TestSuite
+  {
+  public:
+    DirectLightingLTEIntegratorTestSuite()
+      {
+      m_ts.mp_pool = &m_pool;
+      m_ts.mp_random_generator = &m_rng;
+      m_ts.mp_occluder_hint = NULL;
+      }
+
+    // The single-scattering integration in a homogeneous medium lit by an infinite light should sample the scattering directions with the phase function of the medium.
+    // The result should match the one computed with the uniform sampling of the scattering directions since both estimators are unbiased.
+    void test_DirectLightingLTEIntegrator_MediaPhaseSampling()
+      {
+      intrusive_ptr<const PhaseFunction> p_hg_phase_function(new HGPhaseFunction(0.7));
+      intrusive_ptr<const PhaseFunction> p_tabulated_phase_function(new TabulatedPhaseFunction(p_hg_phase_function));
+      intrusive_ptr<CountingPhaseFunction> p_counting_phase_function(new CountingPhaseFunction(p_tabulated_phase_function));
+
+      Spectrum_d radiance1 = _ComputeMediaRadiance(p_counting_phase_function);
+      Spectrum_d radiance2 = _ComputeMediaRadiance(p_hg_phase_function);
+
+      TS_ASSERT(p_counting_phase_function->GetSamplesNumber() > 0);
+      TS_ASSERT(radiance1[0] > 0.0);
+      TS_ASSERT_DELTA(radiance1[0], radiance2[0], 0.05*radiance2[0]);
+      TS_ASSERT_DELTA(radiance1[1], radiance2[1], 0.05*radiance2[1]);
+      TS_ASSERT_DELTA(radiance1[2], radiance2[2], 0.05*radiance2[2]);
+      }
+
+    // The ray marching should skip the empty part of the grid volume region without evaluating the media there.
+    // The empty space is skipped with the majorant block granularity, so only the last empty block before the media can be marched through.
+    // The result should match the one computed for the homogeneous region covering the non-empty part of the grid.
+    void test_DirectLightingLTEIntegrator_MediaSkipEmptySpace()
+      {
+      intrusive_ptr<const PhaseFunction> p_phase_function(new HGPhaseFunction(0.7));
+
+      // The grid spans [-3;1] range along the X axis, the first half of it is empty and the second half has unit density.
+      std::vector<std::vector<std::vector<float>>> densities(64, std::vector<std::vector<float>>(16, std::vector<float>(16, 0.f)));
+      for(size_t i=32;i<64;++i)
+        for(size_t j=0;j<16;++j)
+          std::fill(densities[i][j].begin(), densities[i][j].end(), 1.f);
+
+      Spectrum_d emission(0.0);
+      SpectrumCoef_d absorption(0.1, 0.2, 0.3), scattering(0.5, 0.4, 0.3);
+      intrusive_ptr<const VolumeRegion> p_grid_volume(new GridDensityVolumeRegion(BBox3D_d(Point3D_d(-3,-1,-1), Point3D_d(1,1,1)), emission, absorption, scattering,
+        p_phase_function, densities));
+      intrusive_ptr<CountingVolumeRegion> p_counting_volume(new CountingVolumeRegion(p_grid_volume));
+
+      Spectrum_d radiance1 = _ComputeMediaRadiance(p_counting_volume);
+      Spectrum_d radiance2 = _ComputeMediaRadiance(intrusive_ptr<const VolumeRegion>(
+        new HomogeneousVolumeRegion(BBox3D_d(Point3D_d(-1,-1,-1), Point3D_d(1,1,1)), emission, absorption, scattering, p_phase_function)));
+
+      // The empty half is 2 units long (4000 steps), a single majorant block spans 8 cells which is 0.5 units (1000 steps).
+      TS_ASSERT(p_counting_volume->GetEmptyEvaluationsNumber() < 1000);
+      TS_ASSERT(radiance1[0] > 0.0);
+      TS_ASSERT_DELTA(radiance1[0], radiance2[0], 0.05*radiance2[0]);
+      TS_ASSERT_DELTA(radiance1[1], radiance2[1], 0.05*radiance2[1]);
+      TS_ASSERT_DELTA(radiance1[2], radiance2[2], 0.05*radiance2[2]);
+      }
+
+  private:
+    /**
+    * Computes radiance along the ray crossing the unit homogeneous medium box with the specified phase function.
+    * The box is lit by the uniform infinite light, the only primitive of the scene is placed far away from the ray.
+    */
+    Spectrum_d _ComputeMediaRadiance(intrusive_ptr<const PhaseFunction> ip_phase_function)
+      {
+      Spectrum_d emission(0.0);
+      SpectrumCoef_d absorption(0.1, 0.2, 0.3), scattering(0.5, 0.4, 0.3);
+      return _ComputeMediaRadiance(intrusive_ptr<const VolumeRegion>(
+        new HomogeneousVolumeRegion(BBox3D_d(Point3D_d(-1,-1,-1), Point3D_d(1,1,1)), emission, absorption, scattering, ip_phase_function)));
+      }
+
+    /**
+    * Computes radiance along the ray crossing the specified volume region along the X axis.
+    * The region is lit by the uniform infinite light, the only primitive of the scene is placed far away from the ray.
+    */
+    Spectrum_d _ComputeMediaRadiance(intrusive_ptr<const VolumeRegion> ip_volume)
+      {
+      intrusive_ptr<TriangleMesh> p_mesh = TriangleMeshHelper::ConstructSphere(Point3D_d(0,0,-100), 0.1, 2);
+      intrusive_ptr<Texture<SpectrumCoef_d>> p_reflectance( new ConstantTexture<SpectrumCoef_d>(SpectrumCoef_d(0.5)) );
+      intrusive_ptr<Texture<double>> p_sigma( new ConstantTexture<double>(0.0) );
+      intrusive_ptr<Material> p_material(new MatteMaterial(p_reflectance, p_sigma));
+      std::vector<intrusive_ptr<const Primitive>> primitives(1, intrusive_ptr<const Primitive>(new Primitive(p_mesh, Transform(), p_material, NULL)));
+
+      LightSources lights;
+      lights.m_infinite_light_sources.push_back(intrusive_ptr<InfiniteLightSource>(new InfiniteLightSourceMock(Spectrum_d(100,90,80), BBox3D_d(Point3D_d(-1,-1,-100), Point3D_d(1,1,1)))));
+
+      intrusive_ptr<Scene> p_scene( new Scene(primitives, ip_volume, lights) );
+      intrusive_ptr<Sampler> p_sampler( new StratifiedSampler(Point2D_i(0,0), Point2D_i(1,1), 1, 1) );
+
+      DirectLightingLTEIntegratorParams params;
+      params.m_direct_light_samples_num=16;
+      params.m_max_specular_depth=6;
+      params.m_media_step_size=0.0005;
+      intrusive_ptr<DirectLightingLTEIntegrator> p_integrator( new DirectLightingLTEIntegrator(p_scene, params) );
+      p_integrator->RequestSamples(p_sampler);
+
+      intrusive_ptr<Sample> p_sample = p_sampler->CreateSample();
+      p_sampler->GetNextSubSampler(1, &m_rng)->GetNextSample(p_sample.get());
+
+      Ray ray(Point3D_d(-5,0,0), Vector3D_d(1,0,0));
+      return p_integrator->Radiance(RayDifferential(ray), p_sample.get(), m_ts);
+      }
+
+  private:
+    RandomGenerator<double> m_rng;
+    MemoryPool m_pool;
+
+    ThreadSpecifics m_ts;
+  };
+
+#endif // DIRECT_LIGHTING_LTE_INTEGRATOR_TEST_H
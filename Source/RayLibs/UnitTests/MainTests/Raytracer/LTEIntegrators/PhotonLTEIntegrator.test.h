@@ -37,6 +37,7 @@ class PhotonLTEIntegratorTestSuite : public CxxTest::TestSuite
       mp_sphere = TriangleMeshHelper::ConstructSphere(Point3D_d(0,0,0), 1.0, 7);
       m_ts.mp_pool = &m_pool;
       m_ts.mp_random_generator = &m_rng;
+      m_ts.mp_occluder_hint = NULL;
       }
 
     // The case with a camera placed inside of a self-illuminated sphere with lambertian BSDF.
@@ -70,7 +71,7 @@ class PhotonLTEIntegratorTestSuite : public CxxTest::TestSuite
       p_photon_lte_integrator->RequestSamples(p_sampler);
 
       intrusive_ptr<Sample> p_sample = p_sampler->CreateSample();
-      p_sampler->GetNextSubSampler(1, &m_rng)->GetNextSample(p_sample);
+      p_sampler->GetNextSubSampler(1, &m_rng)->GetNextSample(p_sample.get());
 
       Ray ray(Point3D_d(0,0,0), Vector3D_d(1,0,0).Normalized());
 
@@ -110,7 +111,7 @@ class PhotonLTEIntegratorTestSuite : public CxxTest::TestSuite
       p_photon_lte_integrator->RequestSamples(p_sampler);
 
       intrusive_ptr<Sample> p_sample = p_sampler->CreateSample();
-      p_sampler->GetNextSubSampler(1, &m_rng)->GetNextSample(p_sample);
+      p_sampler->GetNextSubSampler(1, &m_rng)->GetNextSample(p_sample.get());
 
       Ray ray(Point3D_d(0,0,0), Vector3D_d(1,0,0).Normalized());
 
@@ -153,7 +154,7 @@ class PhotonLTEIntegratorTestSuite : public CxxTest::TestSuite
       p_photon_lte_integrator->RequestSamples(p_sampler);
 
       intrusive_ptr<Sample> p_sample = p_sampler->CreateSample();
-      p_sampler->GetNextSubSampler(1, &m_rng)->GetNextSample(p_sample);
+      p_sampler->GetNextSubSampler(1, &m_rng)->GetNextSample(p_sample.get());
 
       Ray ray(Point3D_d(2,0,0), Vector3D_d(-1,0,0).Normalized());
 
@@ -22,6 +22,8 @@
 #include <Math/ThreadSafeRandom.h>
 #include <Math/SamplingRoutines.h>
 #include <Math/MathRoutines.h>
+#include <cstdio>
+#include <fstream>
 #include <vector>
 
 class ImageEnvironmentalLightTestSuite : public CxxTest::TestSuite
@@ -353,8 +355,66 @@ class ImageEnvironmentalLightTestSuite : public CxxTest::TestSuite
         }
       }
 
+    void test_ImageEnvironmentalLight_LazyPrecomputation()
+      {
+      intrusive_ptr<InfiniteLightSource> p_lazy_light(new ImageEnvironmentalLight(m_bbox, m_light_to_world, m_image, m_scale, "", true));
+      TS_ASSERT(_SameSampling(*mp_light, *p_lazy_light));
+      TS_ASSERT_EQUALS(mp_light->Power(), p_lazy_light->Power());
+      }
+
+    void test_ImageEnvironmentalLight_Cache()
+      {
+      std::string cache_filename;
+        {
+        intrusive_ptr<ImageEnvironmentalLight> p_light(new ImageEnvironmentalLight(m_bbox, m_light_to_world, m_image, m_scale, "."));
+        cache_filename = p_light->GetCacheFilename();
+        TS_ASSERT(std::ifstream(cache_filename.c_str(), std::ios::binary).good());
+        TS_ASSERT(_SameSampling(*mp_light, *p_light));
+        }
+
+      // Another transformation should not affect the cache file name since the cached data is defined in the light space.
+      Transform light_to_world = MakeRotation(0.3, Vector3D_d(1,0,0));
+      intrusive_ptr<ImageEnvironmentalLight> p_cached_light(new ImageEnvironmentalLight(m_bbox, light_to_world, m_image, m_scale, "."));
+      TS_ASSERT_EQUALS(p_cached_light->GetCacheFilename(), cache_filename);
+
+      intrusive_ptr<InfiniteLightSource> p_light(new ImageEnvironmentalLight(m_bbox, light_to_world, m_image, m_scale));
+      TS_ASSERT(_SameSampling(*p_light, *p_cached_light));
+
+      std::vector<std::vector<Spectrum_f>> image(m_image);
+      image[10][10] = Spectrum_f(1000.f);
+      intrusive_ptr<ImageEnvironmentalLight> p_other_light(new ImageEnvironmentalLight(m_bbox, m_light_to_world, image, m_scale, "."));
+      TS_ASSERT_DIFFERS(p_other_light->GetCacheFilename(), cache_filename);
+
+      std::remove(cache_filename.c_str());
+      std::remove(p_other_light->GetCacheFilename().c_str());
+      }
+
   private:
 
+    // Returns true if both lights produce exactly the same results for the sampling with a normal provided.
+    bool _SameSampling(const InfiniteLightSource &i_light1, const InfiniteLightSource &i_light2) const
+      {
+      for(size_t i=0;i<1000;++i)
+        {
+        Vector3D_d normal = Vector3D_d(RandomDouble(2.0)-1.0,RandomDouble(2.0)-1.0,RandomDouble(2.0)-1.0).Normalized();
+        Point2D_d sample(RandomDouble(1.0),RandomDouble(1.0));
+
+        double pdf1, pdf2;
+        Vector3D_d direction1, direction2;
+        Spectrum_d radiance1 = i_light1.SampleLighting(normal, sample, direction1, pdf1);
+        Spectrum_d radiance2 = i_light2.SampleLighting(normal, sample, direction2, pdf2);
+
+        if (radiance1 != radiance2 || direction1 != direction2 || pdf1 != pdf2)
+          return false;
+        if (i_light1.LightingPDF(normal, direction1) != i_light2.LightingPDF(normal, direction1))
+          return false;
+        if (i_light1.Irradiance(normal) != i_light2.Irradiance(normal))
+          return false;
+        }
+
+      return true;
+      }
+
     Spectrum_d _GetAverage(double i_x, double i_y) const
       {
       double w = 0.0;
@@ -0,0 +1,213 @@
+/*
+* Copyright (C) 2014 by Volodymyr Kachurovskyi <Volodymyr.Kachurovskyi@gmail.com>
+*
+* This file is part of Skwarka.
+*
+* Skwarka is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+*
+* Skwarka is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License along with Skwarka.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef LIGHT_TREE_LIGHTS_SAMPLING_TEST_H
+#define LIGHT_TREE_LIGHTS_SAMPLING_TEST_H
+
+#include <cxxtest/TestSuite.h>
+#include <UnitTests/TestHelpers/CustomValueTraits.h>
+#include <Common/Common.h>
+#include <Raytracer/LightsSamplingStrategies/LightTreeLightsSamplingStrategy.h>
+#include <UnitTests/TestHelpers/TriangleMeshTestHelper.h>
+#include <Raytracer/Core/TriangleMesh.h>
+#include <Raytracer/LightSources/DiffuseAreaLightSource.h>
+#include <Raytracer/LightSources/PointLight.h>
+#include <Math/ThreadSafeRandom.h>
+#include "Mocks/InfiniteLightSourceMock.h"
+#include <vector>
+
+class LightTreeLightsSamplingStrategyTestSuite : public CxxTest::TestSuite
+  {
+  public:
+    void setUp()
+      {
+      m_light_sources.m_delta_light_sources.clear();
+      m_light_sources.m_infinite_light_sources.clear();
+      m_light_sources.m_area_light_sources.clear();
+
+      intrusive_ptr<DeltaLightSource> p_delta_light( new PointLight(Point3D_d(1.0,2.0,3.0), Spectrum_d(10.5,20.5,30.5)) );
+      m_light_sources.m_delta_light_sources.push_back(p_delta_light);
+
+      intrusive_ptr<InfiniteLightSource> p_infinity_light( new InfiniteLightSourceMock(Spectrum_d(0.001,0.005,0.002), BBox3D_d(Point3D_d(-1,-1,-1),Point3D_d(50,50,50))));
+      m_light_sources.m_infinite_light_sources.push_back(p_infinity_light);
+
+      for(size_t i=0;i<5;++i)
+        {
+        intrusive_ptr<TriangleMesh> p_mesh( TriangleMeshHelper::ConstructTetrahedron(Point3D_f(10.f*(i+1),0.f,0.f)) );
+        intrusive_ptr<AreaLightSource> p_area_light( new DiffuseAreaLightSource(Spectrum_d(1.0), p_mesh) );
+        m_light_sources.m_area_light_sources.push_back(p_area_light);
+        }
+
+      mp_light_sampling.reset( new LightTreeLightsSamplingStrategy(m_light_sources) );
+      }
+
+    void tearDown()
+      {
+      // Nothing to clear.
+      }
+
+    void test_LightTreeLightsSamplingStrategy_SamplesLightsDirectly()
+      {
+      TS_ASSERT(mp_light_sampling->SamplesLightsDirectly());
+      }
+
+    void test_LightTreeLightsSamplingStrategy_GetLightsCDF()
+      {
+      double cdf[100]; // 100 should be enough.
+
+      size_t infinity_lights_num = m_light_sources.m_infinite_light_sources.size();
+      size_t area_lights_num = m_light_sources.m_area_light_sources.size();
+      size_t lights_num = infinity_lights_num+area_lights_num;
+
+      mp_light_sampling->GetLightsCDF(Point3D_d(0,0,0), cdf);
+
+      for(size_t i=0;i<lights_num;++i)
+        {
+        if (cdf[i]<0.0) {TS_FAIL("CDF value is less than 0."); break;}
+        if (cdf[i]>1.0) {TS_FAIL("CDF value is greater than 1."); break;}
+        if (i>0 && cdf[i]<cdf[i-1]) {TS_FAIL("CDF values aren't ordered non-descendingly."); break;}
+        }
+
+      // Check that the nearest area light is the most probable one and the farthest area light is the least probable one (look at setUp() method).
+      // The PDFs of the lights in between are not necessarily ordered since they depend on how the lights are grouped in the tree.
+      double pdf_nearest = cdf[infinity_lights_num]-cdf[infinity_lights_num-1];
+      double pdf_farthest = cdf[lights_num-1]-cdf[lights_num-2];
+      for(size_t i=1;i<area_lights_num-1;++i)
+        {
+        size_t j=i+infinity_lights_num;
+        double pdf = cdf[j]-cdf[j-1];
+        if (pdf >= pdf_nearest || pdf <= pdf_farthest) {TS_FAIL("CDF values for area lights are incorrect."); break;}
+        }
+
+      TS_ASSERT_DELTA(cdf[lights_num-1], 1.0, (1e-10));
+      }
+
+    void test_LightTreeLightsSamplingStrategy_SampleLightWithoutNormal()
+      {
+      _TestSampleLight(Point3D_d(15,3,-2), NULL);
+      }
+
+    void test_LightTreeLightsSamplingStrategy_SampleLightWithNormal()
+      {
+      Vector3D_d normal = Vector3D_d(1,1,0).Normalized();
+      _TestSampleLight(Point3D_d(15,3,-2), &normal);
+      }
+
+    // Tests that the sampled lights are distributed according to the PDF.
+    void test_LightTreeLightsSamplingStrategy_SampledDistribution()
+      {
+      size_t lights_num = m_light_sources.m_infinite_light_sources.size()+m_light_sources.m_area_light_sources.size();
+      Point3D_d point(15,3,-2);
+
+      size_t num_samples = 10000;
+      std::vector<size_t> counts(lights_num, 0);
+      for(size_t i=0;i<num_samples;++i)
+        {
+        double pdf, remapped_sample;
+        ++counts[mp_light_sampling->SampleLight(point, (i+0.5)/num_samples, pdf, remapped_sample)];
+        }
+
+      for(size_t i=0;i<lights_num;++i)
+        {
+        double expected = mp_light_sampling->LightPDF(point, i);
+        if (fabs(counts[i]/(double)num_samples - expected) > 1e-3) {TS_FAIL("Sampled distribution does not match the PDF."); break;}
+        }
+      }
+
+    // Tests a case when the area lights face away from the point, they should have zero PDF in this case.
+    void test_LightTreeLightsSamplingStrategy_FacingAway()
+      {
+      m_light_sources.m_area_light_sources.clear();
+      for(size_t i=0;i<5;++i)
+        {
+        std::vector<Point3D_f> vertices;
+        vertices.push_back(Point3D_f(2.f*i,0.f,0.f));
+        vertices.push_back(Point3D_f(2.f*i+1.f,0.f,0.f));
+        vertices.push_back(Point3D_f(2.f*i+1.f,1.f,0.f));
+        vertices.push_back(Point3D_f(2.f*i,1.f,0.f));
+
+        std::vector<MeshTriangle> triangles;
+        triangles.push_back(MeshTriangle(0,1,2));
+        triangles.push_back(MeshTriangle(0,2,3));
+
+        intrusive_ptr<TriangleMesh> p_mesh( new TriangleMesh(vertices, triangles) );
+        intrusive_ptr<AreaLightSource> p_area_light( new DiffuseAreaLightSource(Spectrum_d(1.0), p_mesh) );
+        m_light_sources.m_area_light_sources.push_back(p_area_light);
+        }
+      mp_light_sampling.reset( new LightTreeLightsSamplingStrategy(m_light_sources) );
+
+      // The quads emit light in the positive Z direction only.
+      // Note that the point should be far enough so that it is not inside the bounding sphere of any tree node, otherwise the estimate is too conservative.
+      Point3D_d point(5,0.5,-10);
+      for(size_t i=0;i<5;++i)
+        {
+        TS_ASSERT_EQUALS(mp_light_sampling->LightPDF(point, i+1), 0.0);
+        TS_ASSERT_EQUALS(mp_light_sampling->LightPDF(point, Vector3D_d(0,0,1), i+1), 0.0);
+        }
+
+      for(size_t i=0;i<100;++i)
+        {
+        double pdf, remapped_sample;
+        if (mp_light_sampling->SampleLight(point, (i+0.5)/100, pdf, remapped_sample) != 0) {TS_FAIL("Area light facing away is sampled."); break;}
+        }
+
+      // The point above the quads should be lit by them.
+      TS_ASSERT(mp_light_sampling->LightPDF(Point3D_d(5,0.5,10), 3) > 0.0);
+      }
+
+    void test_LightTreeLightsSamplingStrategy_NoLights()
+      {
+      m_light_sources.m_delta_light_sources.clear();
+      m_light_sources.m_infinite_light_sources.clear();
+      m_light_sources.m_area_light_sources.clear();
+      mp_light_sampling.reset( new LightTreeLightsSamplingStrategy(m_light_sources) );
+
+      double cdf[100]; // 100 should be enough.
+      cdf[0]=-1.0;
+      mp_light_sampling->GetLightsCDF(Point3D_d(0,0,0), cdf);
+
+      // If there are no lights in the scene the cdf array should not be changed.
+      TS_ASSERT_EQUALS(cdf[0], -1.0);
+      }
+
+  private:
+    void _TestSampleLight(const Point3D_d &i_point, const Vector3D_d *ip_normal)
+      {
+      size_t lights_num = m_light_sources.m_infinite_light_sources.size()+m_light_sources.m_area_light_sources.size();
+
+      double sum = 0.0;
+      for(size_t i=0;i<lights_num;++i)
+        sum += ip_normal ? mp_light_sampling->LightPDF(i_point, *ip_normal, i) : mp_light_sampling->LightPDF(i_point, i);
+      TS_ASSERT_DELTA(sum, 1.0, (1e-10));
+
+      for(size_t i=0;i<1000;++i)
+        {
+        double pdf, remapped_sample, sample = RandomDouble(1.0);
+        size_t index = ip_normal ? mp_light_sampling->SampleLight(i_point, *ip_normal, sample, pdf, remapped_sample) :
+          mp_light_sampling->SampleLight(i_point, sample, pdf, remapped_sample);
+
+        double expected_pdf = ip_normal ? mp_light_sampling->LightPDF(i_point, *ip_normal, index) : mp_light_sampling->LightPDF(i_point, index);
+        if (index >= lights_num) {TS_FAIL("Sampled index is out of range."); break;}
+        if (fabs(pdf-expected_pdf) > 1e-10) {TS_FAIL("Sampled PDF does not match LightPDF()."); break;}
+        if (remapped_sample < 0.0 || remapped_sample >= 1.0) {TS_FAIL("Remapped sample is out of range."); break;}
+        }
+      }
+
+  private:
+    LightSources m_light_sources;
+    intrusive_ptr<LightsSamplingStrategy> mp_light_sampling;
+  };
+
+#endif // LIGHT_TREE_LIGHTS_SAMPLING_TEST_H
@@ -0,0 +1,105 @@
+/*
+* Copyright (C) 2014 by Volodymyr Kachurovskyi <Volodymyr.Kachurovskyi@gmail.com>
+*
+* This file is part of Skwarka.
+*
+* Skwarka is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+*
+* Skwarka is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License along with Skwarka.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef TABULATED_PHASE_FUNCTION_TEST_H
+#define TABULATED_PHASE_FUNCTION_TEST_H
+
+#include <cxxtest/TestSuite.h>
+#include <UnitTests/TestHelpers/CustomValueTraits.h>
+#include <Math/Vector3D.h>
+#include <Math/SamplingRoutines.h>
+#include <Math/ThreadSafeRandom.h>
+#include <Raytracer/PhaseFunctions/TabulatedPhaseFunction.h>
+#include <Raytracer/PhaseFunctions/MieMurkyPhaseFunction.h>
+#include <Raytracer/PhaseFunctions/HGPhaseFunction.h>
+
+class TabulatedPhaseFunctionTestSuite : public CxxTest::TestSuite
+  {
+  public:
+    void test_TabulatedPhaseFunction_ScatteringPDF()
+      {
+      intrusive_ptr<const PhaseFunction> p_murky(new MieMurkyPhaseFunction);
+      TabulatedPhaseFunction pf(p_murky);
+
+      Vector3D_d incoming=Vector3D_d(1,2,3).Normalized();
+      Vector3D_d outgoing=Vector3D_d(-1,2,3).Normalized();
+      TS_ASSERT_EQUALS(pf.ScatteringPDF(incoming, outgoing), p_murky->ScatteringPDF(incoming, outgoing));
+      }
+
+    // Tests that the tabulated PDF integrates to one and approximates the adapted phase function.
+    void test_TabulatedPhaseFunction_PDF()
+      {
+      intrusive_ptr<const PhaseFunction> p_hg(new HGPhaseFunction(0.7));
+      TabulatedPhaseFunction pf(p_hg);
+
+      Vector3D_d incoming=Vector3D_d(1,-2,3).Normalized();
+      size_t N=100000;
+      double sum = 0.0;
+      bool close = true;
+      for(size_t i=0;i<N;++i)
+        {
+        Vector3D_d outgoing = SamplingRoutines::UniformSphereSampling(Point2D_d(RandomDouble(1.0), RandomDouble(1.0)));
+        double pdf = pf.PDF(incoming, outgoing);
+        sum += pdf / SamplingRoutines::UniformSpherePDF();
+
+        double value = p_hg->ScatteringPDF(incoming, outgoing);
+        if (fabs(pdf-value) > 0.05*value)
+          close = false;
+        }
+
+      TS_ASSERT_DELTA(sum/N, 1.0, 0.01);
+      TS_ASSERT(close);
+      }
+
+    void test_TabulatedPhaseFunction_Sample()
+      {
+      intrusive_ptr<const PhaseFunction> p_murky(new MieMurkyPhaseFunction);
+      TabulatedPhaseFunction pf(p_murky);
+
+      Vector3D_d incoming=Vector3D_d(1,2,-3).Normalized();
+      size_t N=100000;
+      double sum_cos = 0.0, sum_weights = 0.0;
+      bool pdf_consistent = true, normalized = true;
+      for(size_t i=0;i<N;++i)
+        {
+        Vector3D_d outgoing;
+        double pdf = pf.Sample(incoming, Point2D_d(RandomDouble(1.0), RandomDouble(1.0)), outgoing);
+        if (outgoing.IsNormalized() == false)
+          normalized = false;
+        if (fabs(pdf - pf.PDF(incoming, outgoing)) > 1e-10*pdf)
+          pdf_consistent = false;
+
+        sum_cos += incoming*outgoing;
+        sum_weights += pf.ScatteringPDF(incoming, outgoing) / pdf;
+        }
+
+      TS_ASSERT(normalized);
+      TS_ASSERT(pdf_consistent);
+
+      // The ratio of the phase function value to the PDF should be close to one for all samples.
+      TS_ASSERT_DELTA(sum_weights/N, 1.0, 0.01);
+
+      // Expected value of cos(theta) for the MieMurky phase function computed numerically.
+      double correct_cos = 0.0;
+      size_t M=100000;
+      for(size_t i=0;i<M;++i)
+        {
+        double cos_theta = -1.0 + (i+0.5)*2.0/M;
+        correct_cos += cos_theta * p_murky->ScatteringPDF(Vector3D_d(0,0,1), Vector3D_d(sqrt(1.0-cos_theta*cos_theta),0,cos_theta)) * 2.0*M_PI*2.0/M;
+        }
+      TS_ASSERT_DELTA(sum_cos/N, correct_cos, 0.01);
+      }
+  };
+
+#endif // TABULATED_PHASE_FUNCTION_TEST_H
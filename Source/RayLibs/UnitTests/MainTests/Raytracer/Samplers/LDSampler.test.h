@@ -44,7 +44,7 @@ class LDSamplerTestSuite : public CxxTest::TestSuite
 
       intrusive_ptr<Sample> p_sample = p_sampler->CreateSample();
       while(intrusive_ptr<SubSampler> p_sub_sampler = p_sampler->GetNextSubSampler(16, &m_rng))
-        while(p_sub_sampler->GetNextSample(p_sample))
+        while(p_sub_sampler->GetNextSample(p_sample.get()))
           {
           Point2D_d point = p_sample->GetImagePoint();
           points.push_back(point);
@@ -74,7 +74,7 @@ class LDSamplerTestSuite : public CxxTest::TestSuite
       intrusive_ptr<Sample> p_sample = p_sampler->CreateSample();
       std::vector<Point2D_d> UVs;
       while(intrusive_ptr<SubSampler> p_sub_sampler = p_sampler->GetNextSubSampler(16, &m_rng))
-        while(p_sub_sampler->GetNextSample(p_sample))
+        while(p_sub_sampler->GetNextSample(p_sample.get()))
           {
           Point2D_d point = p_sample->GetLensUV();
           UVs.push_back(point);
@@ -108,7 +108,7 @@ class LDSamplerTestSuite : public CxxTest::TestSuite
 
       intrusive_ptr<Sample> p_sample = p_sampler->CreateSample();
       while(intrusive_ptr<SubSampler> p_sub_sampler = p_sampler->GetNextSubSampler(16, &m_rng))
-        while(p_sub_sampler->GetNextSample(p_sample))
+        while(p_sub_sampler->GetNextSample(p_sample.get()))
           {
           std::vector<double> values;
 
@@ -144,7 +144,7 @@ class LDSamplerTestSuite : public CxxTest::TestSuite
 
       intrusive_ptr<Sample> p_sample = p_sampler->CreateSample();
       while(intrusive_ptr<SubSampler> p_sub_sampler = p_sampler->GetNextSubSampler(16, &m_rng))
-        while(p_sub_sampler->GetNextSample(p_sample))
+        while(p_sub_sampler->GetNextSample(p_sample.get()))
           {
           std::vector<Point2D_d> values;
 
@@ -42,7 +42,7 @@ class StratifiedSamplerTestSuite : public CxxTest::TestSuite
 
       intrusive_ptr<Sample> p_sample = p_sampler->CreateSample();
       while(intrusive_ptr<SubSampler> p_sub_sampler = p_sampler->GetNextSubSampler(16, &m_rng))
-        while(p_sub_sampler->GetNextSample(p_sample))
+        while(p_sub_sampler->GetNextSample(p_sample.get()))
           {
           Point2D_d point = p_sample->GetImagePoint();
           points.push_back(point);
@@ -69,7 +69,7 @@ class StratifiedSamplerTestSuite : public CxxTest::TestSuite
 
       std::vector<Point2D_d> UVs;
       while(intrusive_ptr<SubSampler> p_sub_sampler = p_sampler->GetNextSubSampler(16, &m_rng))
-        while(p_sub_sampler->GetNextSample(p_sample))
+        while(p_sub_sampler->GetNextSample(p_sample.get()))
           {
           Point2D_d point = p_sample->GetLensUV();
           UVs.push_back(point);
@@ -105,7 +105,7 @@ class StratifiedSamplerTestSuite : public CxxTest::TestSuite
 
       intrusive_ptr<Sample> p_sample = p_sampler->CreateSample();
       while(intrusive_ptr<SubSampler> p_sub_sampler = p_sampler->GetNextSubSampler(16, &m_rng))
-        while(p_sub_sampler->GetNextSample(p_sample))
+        while(p_sub_sampler->GetNextSample(p_sample.get()))
           {
           std::vector<double> values;
 
@@ -141,7 +141,7 @@ class StratifiedSamplerTestSuite : public CxxTest::TestSuite
 
       intrusive_ptr<Sample> p_sample = p_sampler->CreateSample();
       while(intrusive_ptr<SubSampler> p_sub_sampler = p_sampler->GetNextSubSampler(16, &m_rng))
-        while(p_sub_sampler->GetNextSample(p_sample))
+        while(p_sub_sampler->GetNextSample(p_sample.get()))
           {
           std::vector<Point2D_d> values;
 
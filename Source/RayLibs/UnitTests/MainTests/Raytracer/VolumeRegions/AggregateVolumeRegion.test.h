@@ -167,6 +167,87 @@ class AggregateVolumeRegionTestSuite : public CxxTest::TestSuite
         }
       }
 
+    // Tests the aggregate with many small volume regions against the brute-force sum over the regions.
+    void test_AggregateVolumeRegion_ManyRegions()
+      {
+      std::vector<intrusive_ptr<const VolumeRegion>> regions;
+      for(size_t i=0;i<200;++i)
+        {
+        Point3D_d corner(RandomDouble(20.0), RandomDouble(20.0), RandomDouble(20.0));
+        BBox3D_d bounds(corner, corner+Point3D_d(RandomDouble(2.0), RandomDouble(2.0), RandomDouble(2.0)));
+        Spectrum_d emission(RandomDouble(1.0), RandomDouble(1.0), RandomDouble(1.0));
+        SpectrumCoef_d absorption(RandomDouble(1.0), RandomDouble(1.0), RandomDouble(1.0)), scattering(RandomDouble(1.0), RandomDouble(1.0), RandomDouble(1.0));
+        regions.push_back(intrusive_ptr<const VolumeRegion>(new VolumeRegionMock(bounds, emission, absorption, scattering)));
+        }
+      AggregateVolumeRegion aggregate(regions);
+
+      size_t N=1000;
+      for (size_t t=0;t<N;++t)
+        {
+        Point3D_d point(RandomDouble(22.0), RandomDouble(22.0), RandomDouble(22.0));
+        SpectrumCoef_d correct;
+        for(size_t i=0;i<regions.size();++i)
+          correct += regions[i]->Attenuation(point);
+        SpectrumCoef_d tmp = aggregate.Attenuation(point);
+        TS_ASSERT_DELTA(tmp[0], correct[0], 1e-10);
+        TS_ASSERT_DELTA(tmp[1], correct[1], 1e-10);
+        TS_ASSERT_DELTA(tmp[2], correct[2], 1e-10);
+
+        Vector3D_d direction = Vector3D_d(RandomDouble(2.0)-1.0, RandomDouble(2.0)-1.0, RandomDouble(2.0)-1.0).Normalized();
+        Ray ray(point, direction, RandomDouble(20.0));
+        correct = SpectrumCoef_d();
+        for(size_t i=0;i<regions.size();++i)
+          correct += regions[i]->OpticalThickness(ray, 1.0, 0.0);
+        tmp = aggregate.OpticalThickness(ray, 1.0, 0.0);
+        TS_ASSERT_DELTA(tmp[0], correct[0], 1e-10);
+        TS_ASSERT_DELTA(tmp[1], correct[1], 1e-10);
+        TS_ASSERT_DELTA(tmp[2], correct[2], 1e-10);
+        }
+      }
+
+    void test_AggregateVolumeRegion_GetIntervals()
+      {
+      std::vector<intrusive_ptr<const VolumeRegion>> regions;
+      Spectrum_d emission(1.0);
+      SpectrumCoef_d absorption(1.0), scattering(1.0);
+      regions.push_back(intrusive_ptr<const VolumeRegion>(new VolumeRegionMock(BBox3D_d(Point3D_d(1,-1,-1), Point3D_d(2,1,1)), emission, absorption, scattering)));
+      regions.push_back(intrusive_ptr<const VolumeRegion>(new VolumeRegionMock(BBox3D_d(Point3D_d(6,-1,-1), Point3D_d(8,1,1)), emission, absorption, scattering)));
+      regions.push_back(intrusive_ptr<const VolumeRegion>(new VolumeRegionMock(BBox3D_d(Point3D_d(5,-1,-1), Point3D_d(7,1,1)), emission, absorption, scattering)));
+      regions.push_back(intrusive_ptr<const VolumeRegion>(new VolumeRegionMock(BBox3D_d(Point3D_d(3,2,-1), Point3D_d(4,3,1)), emission, absorption, scattering)));
+      AggregateVolumeRegion aggregate(regions);
+
+      std::vector<std::pair<double,double>> intervals;
+      aggregate.GetIntervals(Ray(Point3D_d(0,0,0), Vector3D_d(1,0,0)), intervals);
+
+      TS_ASSERT_EQUALS(intervals.size(), 2);
+      if (intervals.size() == 2)
+        {
+        TS_ASSERT_DELTA(intervals[0].first, 1.0, 1e-10);
+        TS_ASSERT_DELTA(intervals[0].second, 2.0, 1e-10);
+        TS_ASSERT_DELTA(intervals[1].first, 5.0, 1e-10);
+        TS_ASSERT_DELTA(intervals[1].second, 8.0, 1e-10);
+        }
+      }
+
+    void test_AggregateVolumeRegion_SkipEmptySpace()
+      {
+      std::vector<intrusive_ptr<const VolumeRegion>> regions;
+      Spectrum_d emission(1.0);
+      SpectrumCoef_d absorption(1.0), scattering(1.0);
+      regions.push_back(intrusive_ptr<const VolumeRegion>(new VolumeRegionMock(BBox3D_d(Point3D_d(1,-1,-1), Point3D_d(2,1,1)), emission, absorption, scattering)));
+      regions.push_back(intrusive_ptr<const VolumeRegion>(new VolumeRegionMock(BBox3D_d(Point3D_d(6,-1,-1), Point3D_d(8,1,1)), emission, absorption, scattering)));
+      regions.push_back(intrusive_ptr<const VolumeRegion>(new VolumeRegionMock(BBox3D_d(Point3D_d(5,-1,-1), Point3D_d(7,1,1)), emission, absorption, scattering)));
+      regions.push_back(intrusive_ptr<const VolumeRegion>(new VolumeRegionMock(BBox3D_d(Point3D_d(3,2,-1), Point3D_d(4,3,1)), emission, absorption, scattering)));
+      AggregateVolumeRegion aggregate(regions);
+
+      // The gaps between the regions are skipped, the region missed by the ray does not stop the skipping.
+      Ray ray(Point3D_d(0,0,0), Vector3D_d(1,0,0));
+      TS_ASSERT_DELTA(aggregate.SkipEmptySpace(ray, 0.0, 10.0), 1.0, 1e-10);
+      TS_ASSERT_DELTA(aggregate.SkipEmptySpace(ray, 1.5, 10.0), 1.5, 1e-10);
+      TS_ASSERT_DELTA(aggregate.SkipEmptySpace(ray, 2.5, 10.0), 5.0, 1e-10);
+      TS_ASSERT_DELTA(aggregate.SkipEmptySpace(ray, 2.5, 4.0), 4.0, 1e-10);
+      TS_ASSERT_DELTA(aggregate.SkipEmptySpace(ray, 8.5, 10.0), 10.0, 1e-10);
+      }
 
   private:
     BBox3D_d m_bounds1;
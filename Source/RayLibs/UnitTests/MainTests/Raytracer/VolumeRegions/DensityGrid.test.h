@@ -0,0 +1,152 @@
+/*
+* Copyright (C) 2014 by Volodymyr Kachurovskyi <Volodymyr.Kachurovskyi@gmail.com>
+*
+* This file is part of Skwarka.
+*
+* Skwarka is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+*
+* Skwarka is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License along with Skwarka.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef DENSITY_GRID_TEST_H
+#define DENSITY_GRID_TEST_H
+
+#include <cxxtest/TestSuite.h>
+#include <UnitTests/TestHelpers/CustomValueTraits.h>
+#include <Raytracer/VolumeRegions/DensityGrid.h>
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <limits>
+#include <stdexcept>
+#include <vector>
+
+class DensityGridTestSuite : public CxxTest::TestSuite
+  {
+  public:
+    void test_DensityGrid_Get()
+      {
+      std::vector<std::vector<std::vector<float>>> densities = _CreateDensities();
+      DensityGrid grid(densities);
+
+      TS_ASSERT_EQUALS(grid.GetSizeX(), densities.size());
+      TS_ASSERT_EQUALS(grid.GetSizeY(), densities[0].size());
+      TS_ASSERT_EQUALS(grid.GetSizeZ(), densities[0][0].size());
+      TS_ASSERT(_Equal(grid, densities));
+      }
+
+    // Tests that only the bricks with varying values are stored.
+    void test_DensityGrid_ConstantBricks()
+      {
+      std::vector<std::vector<std::vector<float>>> densities = _CreateDensities();
+      DensityGrid grid(densities);
+
+      // Bricks with z index 0 are empty, bricks with z index 1 are constant and bricks with z index 2 are varying.
+      TS_ASSERT_EQUALS(grid.GetStoredBricksNumber(), 2*2);
+
+      float value;
+      TS_ASSERT(grid.IsConstantBrick(1,1,0,value));
+      TS_ASSERT_EQUALS(value, 0.f);
+      TS_ASSERT(grid.IsConstantBrick(0,1,1,value));
+      TS_ASSERT_EQUALS(value, 2.5f);
+      TS_ASSERT(grid.IsConstantBrick(1,0,2,value) == false);
+      }
+
+    void test_DensityGrid_SaveAndLoad()
+      {
+      std::vector<std::vector<std::vector<float>>> densities = _CreateDensities();
+      DensityGrid(densities).Save("DensityGridTest.vol");
+
+      DensityGrid grid("DensityGridTest.vol");
+      TS_ASSERT_EQUALS(grid.GetSizeX(), densities.size());
+      TS_ASSERT_EQUALS(grid.GetSizeY(), densities[0].size());
+      TS_ASSERT_EQUALS(grid.GetSizeZ(), densities[0][0].size());
+      TS_ASSERT_EQUALS(grid.GetStoredBricksNumber(), 2*2);
+      TS_ASSERT(_Equal(grid, densities));
+      std::remove("DensityGridTest.vol");
+      }
+
+    void test_DensityGrid_TruncatedFile()
+      {
+      DensityGrid(_CreateDensities()).Save("DensityGridTest.vol");
+
+      std::ifstream input("DensityGridTest.vol", std::ios::in | std::ios::binary);
+      std::vector<char> data((std::istreambuf_iterator<char>(input)), std::istreambuf_iterator<char>());
+      input.close();
+      std::ofstream("DensityGridTest.vol", std::ios::out | std::ios::binary).write(&data[0], data.size()/2);
+
+      TS_ASSERT_THROWS(DensityGrid("DensityGridTest.vol"), std::runtime_error);
+      std::remove("DensityGridTest.vol");
+      }
+
+    void test_DensityGrid_InvalidFile()
+      {
+      std::ofstream("DensityGridTest.vol", std::ios::out | std::ios::binary) << "Not a volume file";
+
+      TS_ASSERT_THROWS(DensityGrid("DensityGridTest.vol"), std::runtime_error);
+      std::remove("DensityGridTest.vol");
+      }
+
+    void test_DensityGrid_MissingFile()
+      {
+      TS_ASSERT_THROWS(DensityGrid("DensityGridTestMissing.vol"), std::runtime_error);
+      }
+
+    // The sizes in the header imply much more data than there is in the file or do not fit into the memory at all.
+    void test_DensityGrid_HugeSizes()
+      {
+      _WriteHeader(100000, 100000, 100000);
+      TS_ASSERT_THROWS(DensityGrid("DensityGridTest.vol"), std::runtime_error);
+
+      _WriteHeader(1ull<<40, 1ull<<40, 1ull<<40);
+      TS_ASSERT_THROWS(DensityGrid("DensityGridTest.vol"), std::runtime_error);
+
+      _WriteHeader(std::numeric_limits<unsigned long long>::max(), 1, 1);
+      TS_ASSERT_THROWS(DensityGrid("DensityGridTest.vol"), std::runtime_error);
+      std::remove("DensityGridTest.vol");
+      }
+
+  private:
+    /**
+    * Writes the header of a valid 1x1x1 volume file with the sizes replaced by the specified ones, followed by a single value.
+    */
+    void _WriteHeader(unsigned long long i_size_x, unsigned long long i_size_y, unsigned long long i_size_z) const
+      {
+      std::vector<std::vector<std::vector<float>>> densities(1, std::vector<std::vector<float>>(1, std::vector<float>(1, 1.f)));
+      DensityGrid(densities).Save("DensityGridTest.vol");
+
+      // The sizes follow the magic, version and the reserved field.
+      std::fstream file("DensityGridTest.vol", std::ios::in | std::ios::out | std::ios::binary);
+      file.seekp(8 + 2*sizeof(unsigned int));
+      file.write(reinterpret_cast<const char *>(&i_size_x), sizeof(i_size_x));
+      file.write(reinterpret_cast<const char *>(&i_size_y), sizeof(i_size_y));
+      file.write(reinterpret_cast<const char *>(&i_size_z), sizeof(i_size_z));
+      }
+
+    // Creates 13x11x20 grid. The sizes are not multiples of the brick size to test the border bricks.
+    std::vector<std::vector<std::vector<float>>> _CreateDensities() const
+      {
+      std::vector<std::vector<std::vector<float>>> densities(13, std::vector<std::vector<float>>(11, std::vector<float>(20, 0.f)));
+      for(size_t x=0;x<13;++x)
+        for(size_t y=0;y<11;++y)
+          for(size_t z=8;z<20;++z)
+            densities[x][y][z] = z<16 ? 2.5f : (float)(x+y*13+z*143);
+      return densities;
+      }
+
+    bool _Equal(const DensityGrid &i_grid, const std::vector<std::vector<std::vector<float>>> &i_densities) const
+      {
+      for(size_t x=0;x<i_densities.size();++x)
+        for(size_t y=0;y<i_densities[x].size();++y)
+          for(size_t z=0;z<i_densities[x][y].size();++z)
+            if (i_grid.Get(x,y,z) != i_densities[x][y][z])
+              return false;
+      return true;
+      }
+  };
+
+#endif // DENSITY_GRID_TEST_H
@@ -178,7 +178,143 @@ class GridDensityVolumeRegionTestSuite : public CxxTest::TestSuite
         }
       }
 
+    // Tests the optical thickness for a mostly empty grid with the blocks of constant and varying density.
+    void test_GridDensityVolumeRegion_OpticalThicknessSparse()
+      {
+      intrusive_ptr<const GridDensityVolumeRegion> p_volume = _CreateSparseVolume();
+
+      size_t N=1000;
+      for (size_t t=0;t<N;++t)
+        {
+        Point3D_d point(RandomDouble(30)-10, RandomDouble(30)-10, RandomDouble(30)-10);
+        Vector3D_d direction = Vector3D_d(RandomDouble(2.0)-1.0, RandomDouble(2.0)-1.0, RandomDouble(2.0)-1.0).Normalized();
+        Ray ray(point, direction, RandomDouble(40.0));
+
+        SpectrumCoef_d tmp = p_volume->OpticalThickness(ray, 0.01, 0.5);
+
+        double t0, t1;
+        SpectrumCoef_d correct;
+        if (p_volume->Intersect(ray, &t0, &t1))
+          for(double t=t0;t<t1;t+=0.01)
+            {
+            double step = std::min(0.01,t1-t);
+            correct += step*p_volume->Attenuation(ray(t+0.5*step));
+            }
+        TS_ASSERT_DELTA(tmp[0], correct[0], correct[0]*0.01+1e-6);
+        TS_ASSERT_DELTA(tmp[1], correct[1], correct[1]*0.01+1e-6);
+        TS_ASSERT_DELTA(tmp[2], correct[2], correct[2]*0.01+1e-6);
+        }
+      }
+
+    void test_GridDensityVolumeRegion_Transmittance()
+      {
+      intrusive_ptr<const GridDensityVolumeRegion> p_volume = _CreateSparseVolume();
+      RandomGenerator<double> rng;
+
+      size_t N=100, M=2000;
+      for (size_t t=0;t<N;++t)
+        {
+        Point3D_d point(RandomDouble(30)-10, RandomDouble(30)-10, RandomDouble(30)-10);
+        Vector3D_d direction = Vector3D_d(RandomDouble(2.0)-1.0, RandomDouble(2.0)-1.0, RandomDouble(2.0)-1.0).Normalized();
+        Ray ray(point, direction, RandomDouble(40.0));
+
+        SpectrumCoef_d transmittance;
+        for(size_t i=0;i<M;++i)
+          {
+          SpectrumCoef_d tmp = p_volume->Transmittance(ray, 0.01, rng);
+          TS_ASSERT(InRange(tmp, 0.0, 1.0));
+          transmittance += tmp;
+          }
+        transmittance /= (double)M;
+
+        SpectrumCoef_d correct = Exp(-1.0*p_volume->OpticalThickness(ray, 0.01, 0.5));
+        TS_ASSERT_DELTA(transmittance[0], correct[0], 0.03);
+        TS_ASSERT_DELTA(transmittance[1], correct[1], 0.03);
+        TS_ASSERT_DELTA(transmittance[2], correct[2], 0.03);
+        }
+      }
+
+    void test_GridDensityVolumeRegion_SampleFreeFlight()
+      {
+      intrusive_ptr<const GridDensityVolumeRegion> p_volume = _CreateSparseVolume();
+      RandomGenerator<double> rng;
+
+      size_t N=100, M=2000;
+      for (size_t t=0;t<N;++t)
+        {
+        Point3D_d point(RandomDouble(30)-10, RandomDouble(30)-10, RandomDouble(30)-10);
+        Vector3D_d direction = Vector3D_d(RandomDouble(2.0)-1.0, RandomDouble(2.0)-1.0, RandomDouble(2.0)-1.0).Normalized();
+        Ray ray(point, direction, RandomDouble(40.0));
+
+        double t0, t1;
+        bool intersected = p_volume->Intersect(ray, &t0, &t1);
+
+        size_t escaped = 0;
+        for(size_t i=0;i<M;++i)
+          {
+          double collision_t;
+          if (p_volume->SampleFreeFlight(ray, rng, collision_t))
+            {
+            TS_ASSERT(intersected && collision_t >= t0 && collision_t <= t1);
+            TS_ASSERT(p_volume->Attenuation(ray(collision_t))[2] > 0.0);
+            }
+          else
+            ++escaped;
+          }
+
+        // The third spectrum component has the largest base attenuation.
+        double correct = exp(-p_volume->OpticalThickness(ray, 0.01, 0.5)[2]);
+        TS_ASSERT_DELTA(escaped/(double)M, correct, 0.03);
+        }
+      }
+
+    void test_GridDensityVolumeRegion_SkipEmptySpace()
+      {
+      intrusive_ptr<const GridDensityVolumeRegion> p_volume = _CreateSparseVolume();
+
+      // The ray enters the grid at t=5 and the first two blocks it crosses are empty, the third one overlaps with the linear density block.
+      Ray ray(Point3D_d(-5,9.5,9.5), Vector3D_d(1,0,0));
+      TS_ASSERT_DELTA(p_volume->SkipEmptySpace(ray, 0.0, 20.0), 9.0, 1e-10);
+      TS_ASSERT_DELTA(p_volume->SkipEmptySpace(ray, 10.0, 20.0), 10.0, 1e-10);
+      TS_ASSERT_DELTA(p_volume->SkipEmptySpace(ray, 0.0, 8.0), 8.0, 1e-10);
+
+      // The skipped part of the ray must be empty.
+      size_t N=1000;
+      for (size_t t=0;t<N;++t)
+        {
+        Point3D_d point(RandomDouble(30)-10, RandomDouble(30)-10, RandomDouble(30)-10);
+        Vector3D_d direction = Vector3D_d(RandomDouble(2.0)-1.0, RandomDouble(2.0)-1.0, RandomDouble(2.0)-1.0).Normalized();
+        Ray ray(point, direction);
+
+        double t_begin = RandomDouble(20.0), t_end = t_begin + RandomDouble(20.0);
+        double t_non_empty = p_volume->SkipEmptySpace(ray, t_begin, t_end);
+        TS_ASSERT(t_non_empty >= t_begin && t_non_empty <= t_end);
+        for(double t=t_begin;t<t_non_empty;t+=0.01)
+          TS_ASSERT(p_volume->Attenuation(ray(t)).IsBlack());
+        }
+      }
+
   private:
+    // Creates volume region with most of the blocks being empty, one block with constant density and one block with linear density.
+    intrusive_ptr<const GridDensityVolumeRegion> _CreateSparseVolume() const
+      {
+      size_t size = 40;
+      std::vector<std::vector<std::vector<float>>> densities(size, std::vector<std::vector<float>>(size, std::vector<float>(size, 0.0)));
+      for(size_t i=8;i<24;++i)
+        for(size_t j=8;j<24;++j)
+          for(size_t k=8;k<24;++k)
+            densities[i][j][k] = 1.5f;
+      for(size_t i=24;i<32;++i)
+        for(size_t j=16;j<40;++j)
+          for(size_t k=24;k<40;++k)
+            densities[i][j][k] = (float)(j-16)/24.f;
+
+      Spectrum_d emission(0.0);
+      SpectrumCoef_d absorption(0.05,0.1,0.15), scattering(0.05,0.0,0.1);
+      intrusive_ptr<PhaseFunction> p_phase_function( new PhaseFunctionMock );
+      return intrusive_ptr<const GridDensityVolumeRegion>( new GridDensityVolumeRegion(BBox3D_d(Point3D_d(0,0,0), Point3D_d(10,10,10)), emission, absorption, scattering, p_phase_function, densities) );
+      }
+
     double _GetDensity(const Point3D_d &i_point) const
       {
       if (m_bounds.Inside(i_point)==false)
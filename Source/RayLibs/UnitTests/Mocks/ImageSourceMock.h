@@ -0,0 +1,66 @@
+/*
+* Copyright (C) 2014 by Volodymyr Kachurovskyi <Volodymyr.Kachurovskyi@gmail.com>
+*
+* This file is part of Skwarka.
+*
+* Skwarka is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+*
+* Skwarka is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License along with Skwarka.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef IMAGE_SOURCE_MOCK_H
+#define IMAGE_SOURCE_MOCK_H
+
+#include <Raytracer/Core/ImageSource.h>
+#include <tbb/atomic.h>
+#include <vector>
+
+/*
+ImageSource mock implementation.
+Returns the image it has been created with and counts the values read by GetRegion() method.
+*/
+template <typename T>
+class ImageSourceMock: public ImageSource<T>
+  {
+  public:
+    ImageSourceMock(const std::vector<std::vector<T>> &i_image): m_image(i_image)
+      {
+      m_region_values_read = 0;
+      }
+
+    std::vector<std::vector<T>> GetImage() const
+      {
+      return m_image;
+      }
+
+    void GetRegion(size_t i_begin_x, size_t i_begin_y, size_t i_end_x, size_t i_end_y, std::vector<T> &o_values) const
+      {
+      ImageSource<T>::GetRegion(i_begin_x, i_begin_y, i_end_x, i_end_y, o_values);
+      m_region_values_read += o_values.size();
+      }
+
+    size_t GetHeight() const
+      {
+      return m_image.size();
+      }
+
+    size_t GetWidth() const
+      {
+      return m_image.empty() ? 0 : m_image[0].size();
+      }
+
+    size_t GetRegionValuesRead() const
+      {
+      return m_region_values_read;
+      }
+
+  private:
+    std::vector<std::vector<T>> m_image;
+    mutable tbb::atomic<size_t> m_region_values_read;
+  };
+
+#endif // IMAGE_SOURCE_MOCK_H
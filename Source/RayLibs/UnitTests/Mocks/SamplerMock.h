@@ -44,7 +44,7 @@ class SubSamplerMock: public SubSampler
     SubSamplerMock(const std::vector<Point2D_i> &i_pixels, size_t i_samples_per_pixel, RandomGenerator<double> *ip_rng);
 
   protected:
-    void _GetSample(const Point2D_i &i_current_pixel, size_t i_pixel_sample_index, intrusive_ptr<Sample> op_sample);
+    void _GetSample(const Point2D_i &i_current_pixel, size_t i_pixel_sample_index, Sample *op_sample);
 
   private:
     double m_inv_samples_per_pixel;
@@ -75,7 +75,7 @@ SubSampler(i_pixels, i_samples_per_pixel,ip_rng)
   m_inv_samples_per_pixel = 1.0 / i_samples_per_pixel;
   }
 
-void SubSamplerMock::_GetSample(const Point2D_i &i_current_pixel, size_t i_pixel_sample_index, intrusive_ptr<Sample> op_sample)
+void SubSamplerMock::_GetSample(const Point2D_i &i_current_pixel, size_t i_pixel_sample_index, Sample *op_sample)
   {
   op_sample->SetImagePoint( Convert<double>(i_current_pixel) + Point2D_d(RandomDouble(1.0), RandomDouble(1.0)) );
   op_sample->SetImageFilterWidth(m_inv_samples_per_pixel, m_inv_samples_per_pixel);